@@ -0,0 +1,499 @@
+//==============================================================================
+// CornerDetector.cpp - Shi-Tomasi corner detection with grid bucketing
+//==============================================================================
+
+#include "CornerDetector.hpp"
+#include "RTUtils/TaskPool.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//#define DEBUG
+
+typedef struct _detector_corner
+{
+ float response;  // smallest eigenvalue of the gradient matrix, per pixel
+ int x, y;
+}detector_corner_t;
+
+static void gradientProducts(const unsigned char *row, int stride, int x0, int x1,
+                             float *xx, float *xy, float *yy);
+static inline bool isFar(const feature_t &p, const detector_corner_t &c, float minDist2)
+ { float dx = p.x - c.x, dy = p.y - c.y; return (dx * dx + dy * dy >= minDist2); }
+
+
+//==============================================================================
+CornerDetector::CornerDetector()
+//==============================================================================
+{
+ d_width = d_height = 0;
+ d_cols = d_rows = 0;
+ d_scores = NULL;
+ d_scratch = NULL;
+ d_cellCorners = NULL;
+ d_cellCounts = NULL;
+ d_bandMax = NULL;
+ d_cellStart = NULL;
+ d_cellSlots = NULL;
+ d_numSlots = 0;
+ d_accepted = NULL;
+ d_maxResponse = 0;
+ d_startCell = 0;
+ d_image = NULL;
+ d_pool = NULL;
+}
+
+
+//==============================================================================
+CornerDetector::~CornerDetector()
+//==============================================================================
+{
+ if(d_scores) free(d_scores);
+ if(d_scratch) free(d_scratch);
+ if(d_cellCorners) free(d_cellCorners);
+ if(d_cellCounts) free(d_cellCounts);
+ if(d_bandMax) free(d_bandMax);
+ if(d_cellStart) free(d_cellStart);
+ if(d_cellSlots) free(d_cellSlots);
+ if(d_accepted) free(d_accepted);
+}
+
+
+//==============================================================================
+int CornerDetector::initialize(const CornerDetectorContext_t &dc, int w, int h)
+//==============================================================================
+{
+ if( (dc.cell_size < 3) || (dc.max_per_cell < 1) || (dc.min_dist < 0) || (dc.border < 2) ) {
+  fprintf(stderr, "[CornerDetector::initialize] ERROR. Invalid detector parameters.\n");
+  return -1;
+ }
+ if( (w < 2 * dc.border + 1) || (h < 2 * dc.border + 1) ) {
+  fprintf(stderr, "[CornerDetector::initialize] ERROR. Image smaller than its border.\n");
+  return -1;
+ }
+
+ if(d_scores) free(d_scores);
+ if(d_scratch) free(d_scratch);
+ if(d_cellCorners) free(d_cellCorners);
+ if(d_cellCounts) free(d_cellCounts);
+ if(d_bandMax) free(d_bandMax);
+ if(d_cellStart) free(d_cellStart);
+ if(d_accepted) free(d_accepted);
+ d_scratch = NULL;
+ d_cellCorners = NULL;
+ d_cellCounts = NULL;
+ d_bandMax = NULL;
+ d_cellStart = NULL;
+ d_accepted = NULL;
+
+ d_context = dc;
+ d_width = w;
+ d_height = h;
+ d_cols = (w + dc.cell_size - 1) / dc.cell_size;
+ d_rows = (h + dc.cell_size - 1) / dc.cell_size;
+ int numCells = d_cols * d_rows;
+
+ // per band: three rows of gradient products and their vertical sum
+ d_scores = (float *)malloc(w * h * sizeof(float));
+ d_scratch = (float *)malloc(d_rows * 12 * w * sizeof(float));
+ d_cellCorners = (detector_corner_t *)malloc(numCells * dc.max_per_cell * sizeof(detector_corner_t));
+ d_cellCounts = (int *)malloc(2 * numCells * sizeof(int));
+ d_bandMax = (float *)malloc(d_rows * sizeof(float));
+ d_cellStart = (int *)malloc((numCells + 1) * sizeof(int));
+ d_accepted = (int *)malloc(numCells * dc.max_per_cell * sizeof(int));
+ if( !d_scores || !d_scratch || !d_cellCorners || !d_cellCounts || !d_bandMax || !d_cellStart
+     || !d_accepted ) {
+  fprintf(stderr, "[CornerDetector::initialize] ERROR allocating memory.\n");
+  if(d_scores) free(d_scores);
+  d_scores = NULL;
+  return -1;
+ }
+ d_maxResponse = 0;
+ d_startCell = 0;
+ return 0;
+}
+
+
+//==============================================================================
+int CornerDetector::detect(const unsigned char *img, feature_list_t &list)
+//==============================================================================
+{
+ if(d_scores == NULL) {
+  fprintf(stderr, "[CornerDetector::detect] ERROR. Call initialize() first.\n");
+  return -1;
+ }
+ int n = list.num_features;
+ if(n > d_numSlots) {
+  int *slots = (int *)realloc(d_cellSlots, n * sizeof(int));
+  if(slots == NULL) {
+   fprintf(stderr, "[CornerDetector::detect] ERROR allocating memory.\n");
+   return -1;
+  }
+  d_cellSlots = slots;
+  d_numSlots = n;
+ }
+
+ // the response over the whole image, then the candidates of every cell,
+ // one band of cells per task. Local maxima are found across cell borders.
+ int b = d_context.border;
+ d_image = img;
+ d_scored[0] = b;
+ d_scored[1] = b;
+ d_scored[2] = d_width - b;
+ d_scored[3] = d_height - b;
+ if(d_pool) {
+  if( (d_pool->parallelFor(0, d_rows, 1, scoreBands, this) != 0)
+      || (d_pool->parallelFor(0, d_rows, 1, selectBands, this) != 0) ) return -1;
+ } else {
+  scoreBands(0, d_rows, this);
+  selectBands(0, d_rows, this);
+ }
+ d_maxResponse = 0;
+ for(int band = 0; band < d_rows; ++band)
+  if(d_bandMax[band] > d_maxResponse) d_maxResponse = d_bandMax[band];
+ float threshold = d_context.quality * d_maxResponse;
+ if(threshold < d_context.min_eigenvalue) threshold = d_context.min_eigenvalue;
+
+ // bucket the features already in the list by cell (counting sort)
+ int numCells = d_cols * d_rows;
+ int cs = d_context.cell_size;
+ memset(d_cellStart, 0, (numCells + 1) * sizeof(int));
+ for(int i = 0; i < n; ++i) {
+  const feature_t &p = list.features[i];
+  if(p.val < 0) continue;
+  int cx = (int)p.x / cs, cy = (int)p.y / cs;
+  if( (cx < 0) || (cy < 0) || (cx >= d_cols) || (cy >= d_rows) ) continue;
+  ++d_cellStart[cy * d_cols + cx + 1];
+ }
+ for(int c = 0; c < numCells; ++c)
+  d_cellStart[c + 1] += d_cellStart[c];
+ for(int i = 0; i < n; ++i) {
+  const feature_t &p = list.features[i];
+  if(p.val < 0) continue;
+  int cx = (int)p.x / cs, cy = (int)p.y / cs;
+  if( (cx < 0) || (cy < 0) || (cx >= d_cols) || (cy >= d_rows) ) continue;
+  d_cellSlots[d_cellStart[cy * d_cols + cx]++] = i;
+ }
+ for(int c = numCells; c > 0; --c)
+  d_cellStart[c] = d_cellStart[c - 1];
+ d_cellStart[0] = 0;
+
+ // best corner of every cell first, then the second best, and so on. A
+ // corner must be far from the features and the corners already taken in
+ // every cell within min_dist of its own.
+ int *taken = d_cellCounts + numCells;
+ memset(taken, 0, numCells * sizeof(int));
+ float minDist2 = (float)d_context.min_dist * d_context.min_dist;
+ int reach = (d_context.min_dist + cs - 1) / cs;
+ int mpc = d_context.max_per_cell;
+ int slot = 0, numAdded = 0;
+ for(int rank = 0; rank < mpc; ++rank) {
+  for(int k = 0; k < numCells; ++k) {
+   int c = (d_startCell + k) % numCells;
+   if(rank >= d_cellCounts[c]) continue;
+   const detector_corner_t &corner = d_cellCorners[c * mpc + rank];
+   if(corner.response < threshold) continue;
+   if(d_cellStart[c + 1] - d_cellStart[c] + taken[c] >= mpc) continue;
+   bool far = true;
+   int cx = c % d_cols, cy = c / d_cols;
+   for(int ny = cy - reach; far && (ny <= cy + reach); ++ny) {
+    if( (ny < 0) || (ny >= d_rows) ) continue;
+    for(int nx = cx - reach; far && (nx <= cx + reach); ++nx) {
+     if( (nx < 0) || (nx >= d_cols) ) continue;
+     int nc = ny * d_cols + nx;
+     for(int j = d_cellStart[nc]; far && (j < d_cellStart[nc + 1]); ++j)
+      far = isFar(list.features[d_cellSlots[j]], corner, minDist2);
+     for(int j = 0; far && (j < taken[nc]); ++j)
+      far = isFar(list.features[d_accepted[nc * mpc + j]], corner, minDist2);
+    }
+   }
+   if(!far) continue;
+
+   while( (slot < n) && (list.features[slot].val >= 0) ) ++slot;
+   if(slot == n) {
+    rank = mpc;
+    break;
+   }
+   list.features[slot].x = corner.x;
+   list.features[slot].y = corner.y;
+   list.features[slot].val = e_new;
+   d_accepted[c * mpc + taken[c]++] = slot;
+   ++numAdded;
+  }
+ }
+ d_startCell = (d_startCell + 1) % numCells;
+#ifdef DEBUG
+ fprintf(stderr, "[CornerDetector::detect] %d corners added, strongest response %f.\n",
+         numAdded, d_maxResponse);
+#endif
+ return numAdded;
+}
+
+
+//==============================================================================
+int CornerDetector::detectInRect(const unsigned char *img, int x, int y, int w, int h,
+                                 int maxCount, feature_t *corners)
+//==============================================================================
+{
+ if(d_scores == NULL) return 0;
+ int capacity = d_cols * d_rows * d_context.max_per_cell;
+ if(maxCount > capacity) maxCount = capacity;
+
+ int b = d_context.border;
+ int x0 = (x > b) ? x : b;
+ int y0 = (y > b) ? y : b;
+ int x1 = (x + w < d_width - b) ? x + w : d_width - b;
+ int y1 = (y + h < d_height - b) ? y + h : d_height - b;
+ if( (x1 <= x0) || (y1 <= y0) || (maxCount < 1) ) return 0;
+
+ float minResponse = d_context.quality * d_maxResponse;
+ if(minResponse < d_context.min_eigenvalue) minResponse = d_context.min_eigenvalue;
+
+ // the response one pixel around the rectangle too, so that a corner on
+ // its edge is a maximum of its whole 3x3 neighbourhood
+ d_scored[0] = (x0 - 1 > b) ? x0 - 1 : b;
+ d_scored[1] = (y0 - 1 > b) ? y0 - 1 : b;
+ d_scored[2] = (x1 + 1 < d_width - b) ? x1 + 1 : d_width - b;
+ d_scored[3] = (y1 + 1 < d_height - b) ? y1 + 1 : d_height - b;
+ float maxResponse;
+ d_image = img;
+ scoreRows(img, d_scored[0], d_scored[2], d_scored[1], d_scored[3], d_scratch, &maxResponse);
+ int n = selectInRect(x0, y0, x1, y1, maxCount, minResponse, d_cellCorners);
+ for(int i = 0; i < n; ++i) {
+  corners[i].x = d_cellCorners[i].x;
+  corners[i].y = d_cellCorners[i].y;
+  corners[i].val = e_new;
+ }
+ return n;
+}
+
+
+//==============================================================================
+void CornerDetector::scoreBands(int begin, int end, void *arg)
+//==============================================================================
+{
+ CornerDetector *d = (CornerDetector *)arg;
+ int cs = d->d_context.cell_size;
+ for(int band = begin; band < end; ++band) {
+  int y0 = band * cs;
+  int y1 = (y0 + cs < d->d_height) ? y0 + cs : d->d_height;
+  d->scoreRows(d->d_image, 0, d->d_width, y0, y1, d->d_scratch + band * 12 * d->d_width, d->d_bandMax + band);
+ }
+}
+
+
+//==============================================================================
+void CornerDetector::selectBands(int begin, int end, void *arg)
+//==============================================================================
+{
+ CornerDetector *d = (CornerDetector *)arg;
+ int cs = d->d_context.cell_size;
+ int k = d->d_context.max_per_cell;
+ for(int band = begin; band < end; ++band) {
+  int y0 = band * cs;
+  int y1 = (y0 + cs < d->d_height) ? y0 + cs : d->d_height;
+  for(int cx = 0; cx < d->d_cols; ++cx) {
+   int c = band * d->d_cols + cx;
+   int x0 = cx * cs;
+   int x1 = (x0 + cs < d->d_width) ? x0 + cs : d->d_width;
+   d->d_cellCounts[c] = d->selectInRect(x0, y0, x1, y1, k, d->d_context.min_eigenvalue,
+                                        d->d_cellCorners + c * k);
+  }
+ }
+}
+
+
+//==============================================================================
+void CornerDetector::scoreRows(const unsigned char *img, int x0, int x1, int y0, int y1,
+                               float *scratch, float *maxResponse)
+//==============================================================================
+{
+ int w = d_width;
+ int b = d_context.border;
+ if(x0 < b) x0 = b;
+ if(y0 < b) y0 = b;
+ if(x1 > w - b) x1 = w - b;
+ if(y1 > d_height - b) y1 = d_height - b;
+ *maxResponse = 0;
+ if( (x1 <= x0) || (y1 <= y0) ) return;
+
+ // gradient products are needed one pixel around the scored pixels
+ float *rows[3] = {scratch, scratch + 3 * w, scratch + 6 * w};
+ float *vxx = scratch + 9 * w, *vxy = vxx + w, *vyy = vxy + w;
+ for(int y = y0 - 1; y <= y0; ++y) {
+  float *p = rows[y % 3];
+  gradientProducts(img + y * w, w, x0 - 1, x1 + 1, p, p + w, p + 2 * w);
+ }
+
+ float m = 0;
+ for(int y = y0; y < y1; ++y) {
+  float *p = rows[(y + 1) % 3];
+  gradientProducts(img + (y + 1) * w, w, x0 - 1, x1 + 1, p, p + w, p + 2 * w);
+  const float *p0 = rows[(y + 2) % 3], *p1 = rows[y % 3], *p2 = p;
+
+  // vertical sums of the 3x3 blocks
+  int x = x0 - 1;
+#ifdef __SSE2__
+  for(; x + 4 <= x1 + 1; x += 4) {
+   _mm_storeu_ps(vxx + x, _mm_add_ps(_mm_add_ps(_mm_loadu_ps(p0 + x), _mm_loadu_ps(p1 + x)),
+                                     _mm_loadu_ps(p2 + x)));
+   _mm_storeu_ps(vxy + x, _mm_add_ps(_mm_add_ps(_mm_loadu_ps(p0 + w + x), _mm_loadu_ps(p1 + w + x)),
+                                     _mm_loadu_ps(p2 + w + x)));
+   _mm_storeu_ps(vyy + x, _mm_add_ps(_mm_add_ps(_mm_loadu_ps(p0 + 2 * w + x), _mm_loadu_ps(p1 + 2 * w + x)),
+                                     _mm_loadu_ps(p2 + 2 * w + x)));
+  }
+#endif
+  for(; x < x1 + 1; ++x) {
+   vxx[x] = p0[x] + p1[x] + p2[x];
+   vxy[x] = p0[w + x] + p1[w + x] + p2[w + x];
+   vyy[x] = p0[2 * w + x] + p1[2 * w + x] + p2[2 * w + x];
+  }
+
+  // horizontal sums and the smallest eigenvalue. Gradients are twice the
+  // per pixel difference, and summed over 9 pixels.
+  float *s = d_scores + y * w;
+  x = x0;
+#ifdef __SSE2__
+  __m128 half = _mm_set1_ps(0.5f), quarter = _mm_set1_ps(0.25f);
+  __m128 norm = _mm_set1_ps(1.0f / 36), qm = _mm_setzero_ps();
+  for(; x + 4 <= x1; x += 4) {
+   __m128 a = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(vxx + x - 1), _mm_loadu_ps(vxx + x)),
+                         _mm_loadu_ps(vxx + x + 1));
+   __m128 bb = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(vxy + x - 1), _mm_loadu_ps(vxy + x)),
+                          _mm_loadu_ps(vxy + x + 1));
+   __m128 c = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(vyy + x - 1), _mm_loadu_ps(vyy + x)),
+                         _mm_loadu_ps(vyy + x + 1));
+   __m128 t = _mm_mul_ps(_mm_add_ps(a, c), half);
+   __m128 d = _mm_sub_ps(a, c);
+   d = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(d, d), quarter), _mm_mul_ps(bb, bb)));
+   __m128 r = _mm_mul_ps(_mm_sub_ps(t, d), norm);
+   _mm_storeu_ps(s + x, r);
+   qm = _mm_max_ps(qm, r);
+  }
+  float q[4];
+  _mm_storeu_ps(q, qm);
+  for(int i = 0; i < 4; ++i)
+   if(q[i] > m) m = q[i];
+#endif
+  for(; x < x1; ++x) {
+   float a = vxx[x - 1] + vxx[x] + vxx[x + 1];
+   float bb = vxy[x - 1] + vxy[x] + vxy[x + 1];
+   float c = vyy[x - 1] + vyy[x] + vyy[x + 1];
+   float r = ((a + c) * 0.5f - sqrtf((a - c) * (a - c) * 0.25f + bb * bb)) * (1.0f / 36);
+   s[x] = r;
+   if(r > m) m = r;
+  }
+ }
+ *maxResponse = m;
+}
+
+
+//==============================================================================
+int CornerDetector::selectInRect(int x0, int y0, int x1, int y1, int maxCount,
+                                 float minResponse, detector_corner_t *corners)
+//==============================================================================
+{
+ int w = d_width;
+ int b = d_context.border;
+ if(x0 < b) x0 = b;
+ if(y0 < b) y0 = b;
+ if(x1 > w - b) x1 = w - b;
+ if(y1 > d_height - b) y1 = d_height - b;
+ float minDist2 = (float)d_context.min_dist * d_context.min_dist;
+
+ int n = 0;
+ for(int y = y0; y < y1; ++y) {
+  const float *s = d_scores + y * w;
+  for(int x = x0; x < x1; ++x) {
+   float r = s[x];
+   if( (r < minResponse) || (r <= 0) ) continue;
+   if( (n == maxCount) && (r <= corners[n - 1].response) ) continue;
+
+   // local maximum, also over pixels just outside the rectangle; ties go
+   // to the first pixel
+   bool isMax = true;
+   for(int v = -1; isMax && (v <= 1); ++v) {
+    if( (y + v < d_scored[1]) || (y + v >= d_scored[3]) ) continue;
+    for(int u = -1; u <= 1; ++u) {
+     if( (x + u < d_scored[0]) || (x + u >= d_scored[2]) || ((u == 0) && (v == 0)) ) continue;
+     float q = s[v * w + x + u];
+     if( (q > r) || ((q == r) && ((v < 0) || ((v == 0) && (u < 0)))) ) {
+      isMax = false;
+      break;
+     }
+    }
+   }
+   if(!isMax) continue;
+
+   // a stronger corner nearby rejects this one, weaker ones nearby go
+   bool isFar = true;
+   int k = 0;
+   for(int j = 0; j < n; ++j) {
+    float dx = (float)(corners[j].x - x), dy = (float)(corners[j].y - y);
+    if(dx * dx + dy * dy < minDist2) {
+     if(corners[j].response >= r) {
+      isFar = false;
+      break;
+     }
+     continue;
+    }
+    corners[k++] = corners[j];
+   }
+   if(!isFar) continue;
+   n = k;
+
+   // insert in order of strength
+   int j = (n < maxCount) ? n++ : n - 1;
+   for(; (j > 0) && (corners[j - 1].response < r); --j)
+    corners[j] = corners[j - 1];
+   corners[j].response = r;
+   corners[j].x = x;
+   corners[j].y = y;
+  }
+ }
+ return n;
+}
+
+
+//==============================================================================
+// gradientProducts - products of the central difference gradients of a row,
+// for pixels [x0, x1)
+//==============================================================================
+void gradientProducts(const unsigned char *row, int stride, int x0, int x1,
+                      float *xx, float *xy, float *yy)
+{
+ const unsigned char *above = row - stride, *below = row + stride;
+ int x = x0;
+#ifdef __SSE2__
+ __m128i z = _mm_setzero_si128();
+ for(; x + 9 <= x1 + 1; x += 8) {
+  __m128i l = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(row + x - 1)), z);
+  __m128i r = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(row + x + 1)), z);
+  __m128i u = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(above + x)), z);
+  __m128i d = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(below + x)), z);
+  __m128i gx = _mm_sub_epi16(r, l);
+  __m128i gy = _mm_sub_epi16(d, u);
+  __m128 gx0 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(gx, gx), 16));
+  __m128 gx1 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(gx, gx), 16));
+  __m128 gy0 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(gy, gy), 16));
+  __m128 gy1 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(gy, gy), 16));
+  _mm_storeu_ps(xx + x, _mm_mul_ps(gx0, gx0));
+  _mm_storeu_ps(xx + x + 4, _mm_mul_ps(gx1, gx1));
+  _mm_storeu_ps(xy + x, _mm_mul_ps(gx0, gy0));
+  _mm_storeu_ps(xy + x + 4, _mm_mul_ps(gx1, gy1));
+  _mm_storeu_ps(yy + x, _mm_mul_ps(gy0, gy0));
+  _mm_storeu_ps(yy + x + 4, _mm_mul_ps(gy1, gy1));
+ }
+#endif
+ for(; x < x1; ++x) {
+  float gx = (float)(row[x + 1] - row[x - 1]);
+  float gy = (float)(below[x] - above[x]);
+  xx[x] = gx * gx;
+  xy[x] = gx * gy;
+  yy[x] = gy * gy;
+ }
+}
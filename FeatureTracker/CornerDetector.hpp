@@ -0,0 +1,142 @@
+//==============================================================================
+// CornerDetector.hpp - Shi-Tomasi corner detection with grid bucketing
+//==============================================================================
+
+#ifndef INCLUDED_CORNERDETECTOR_HPP
+#define INCLUDED_CORNERDETECTOR_HPP
+
+#include "TrackerUtils.hpp"
+
+class TaskPool;
+
+
+//==============================================================================
+/*! \struct _CornerDetectorContext
+    \brief Parameters for corner detection (see CornerDetector)
+
+    Good default values for parameters are given in parenthesis. */
+//==============================================================================
+typedef struct _CornerDetectorContext
+{
+ _CornerDetectorContext() : cell_size(32), max_per_cell(2), quality(0.01),
+                            min_eigenvalue(4), min_dist(10), border(10) {};
+ int cell_size;         /*!< Width and height of a grid cell in pixels. Corners
+                             are selected in every cell independently (32). */
+ int max_per_cell;      /*!< Maximum number of corners in a cell, counting
+                             features already in the cell (2). */
+ double quality;        /*!< Corners are accepted where the smallest
+                             eigenvalue is at least this fraction of the
+                             strongest in the image (0.01). */
+ float min_eigenvalue;  /*!< Smallest accepted eigenvalue of the gradient
+                             matrix, per pixel, in (grey levels/pixel)^2 (4). */
+ int min_dist;          /*!< Minimum distance between detected corners, and
+                             between a corner and the features already in
+                             the list (10). */
+ int border;            /*!< No corners are detected closer than this to the
+                             image edge. At least 2 (10). */
+}CornerDetectorContext_t;
+
+
+//==============================================================================
+// class CornerDetector
+//------------------------------------------------------------------------------
+// \brief
+// Detects corners by the smallest eigenvalue of the gradient matrix over a
+// 3x3 block (Shi and Tomasi, "Good Features to Track", CVPR 1994), with
+// uniform coverage of the image.
+//
+// The image is divided into a grid of square cells. The response is
+// computed a band of cells at a time, with SSE2 where available. Each band
+// then selects the strongest local maxima of each of its cells: a corner
+// must be a maximum of its 3x3 neighbourhood, across cell borders, the
+// minimum distance is applied within the cell, and at most 'max_per_cell'
+// corners are kept. There is no sort over the whole image. Bands run in
+// parallel on a TaskPool if one is set. The corners are then written into
+// the free slots of a feature list best first in each cell, taking one
+// corner from every cell in turn, so that features spread over the image
+// even if there are fewer slots than corners. A corner is skipped if it is
+// closer than the minimum distance to a feature or a corner already taken
+// in any cell.
+//
+// All memory is allocated in initialize(), except an index of the feature
+// list, which is allocated by the first call to detect() and grows if a
+// longer list is passed.
+//==============================================================================
+class CornerDetector
+{
+ public:
+  CornerDetector();
+   // Default constructor.
+
+  ~CornerDetector();
+   // Destructor frees all memory.
+
+  int initialize(const CornerDetectorContext_t &dc, int w, int h);
+   // Set up the detector for images of one size.
+   //  dc      Detector parameters.
+   //  w,h     Image dimensions in pixels.
+   //  return  0 on success, -1 on error (error message redirected to stderr).
+
+  inline bool isInitialized() const {return d_scores != NULL;}
+   //  return  true if initialize() succeeded.
+
+  void setTaskPool(TaskPool *pool) {d_pool = pool;}
+   // Detect in parallel bands of cells using a pool of worker threads. The
+   // pool is shared, not owned.
+   //  pool    The task pool, or NULL to detect in the calling thread (default).
+
+  int detect(const unsigned char *img, feature_list_t &list);
+   // Detect corners over the whole image and store them in the slots of the
+   // list that hold no feature (val < 0), with val = e_new. Cells already
+   // holding features of the list take fewer corners.
+   //  img     Image buffer, 8 bit grayscale, of the size given to initialize().
+   //  list    The feature list.
+   //  return  Number of corners added, -1 on error (error message redirected
+   //          to stderr).
+
+  int detectInRect(const unsigned char *img, int x, int y, int w, int h,
+                   int maxCount, feature_t *corners);
+   // Detect corners in a rectangle of the image, for instance a cell chosen
+   // by a FeatureReplenisher. The quality threshold is relative to the
+   // strongest corner found by the last call to detect(). The minimum
+   // distance is applied between the corners returned only; distances to
+   // features outside the rectangle are left to the caller.
+   //  img       Image buffer, as for detect().
+   //  x,y,w,h   The rectangle in pixels.
+   //  maxCount  Maximum number of corners.
+   //  corners   Detected corners, strongest first, with val = e_new (output).
+   //  return    Number of corners.
+
+  inline float getMaxResponse() const {return d_maxResponse;}
+   //  return  Strongest response found by the last call to detect().
+
+ protected:
+ private:
+  CornerDetector(const CornerDetector &);
+  CornerDetector &operator=(const CornerDetector &);
+  static void scoreBands(int begin, int end, void *arg);
+  static void selectBands(int begin, int end, void *arg);
+  void scoreRows(const unsigned char *img, int x0, int x1, int y0, int y1,
+                 float *scratch, float *maxResponse);
+  int selectInRect(int x0, int y0, int x1, int y1, int maxCount, float minResponse,
+                   struct _detector_corner *corners);
+  CornerDetectorContext_t d_context;
+  int d_width, d_height;
+  int d_cols, d_rows;
+  float *d_scores;         // response at every pixel
+  float *d_scratch;        // gradient products, per band of cells
+  struct _detector_corner *d_cellCorners;  // best corners of each cell
+  int *d_cellCounts;
+  float *d_bandMax;        // strongest response in each band
+  int *d_cellStart;        // features of the list, grouped by cell
+  int *d_cellSlots;
+  int d_numSlots;
+  int *d_accepted;         // slots of the corners taken in each cell
+  int d_scored[4];         // region of d_scores for this image: x0, y0, x1, y1
+  float d_maxResponse;
+  int d_startCell;         // where the round-robin over cells starts
+  const unsigned char *d_image;
+  TaskPool *d_pool;
+};
+
+#endif // INCLUDED_CORNERDETECTOR_HPP
@@ -0,0 +1,151 @@
+//==============================================================================
+// FeatureBudgetController.cpp - Tracking effort adjusted to a frame time target
+//==============================================================================
+
+#include "FeatureBudgetController.hpp"
+#include <stdio.h>
+
+//#define DEBUG
+
+
+//==============================================================================
+FeatureBudgetController::FeatureBudgetController()
+//==============================================================================
+{
+ d_point.num_features = 0;
+ d_point.max_iter = 0;
+ d_point.num_levels = 0;
+ d_point.frame_ms = 0;
+ d_maxFeatures = d_maxIter = d_maxLevels = 0;
+ d_over = d_under = 0;
+ d_start.tv_sec = 0;
+ d_start.tv_nsec = 0;
+}
+
+
+//==============================================================================
+int FeatureBudgetController::initialize(const BudgetContext_t &bc, int maxFeatures,
+                                        int maxIter, int maxLevels)
+//==============================================================================
+{
+ if( (bc.target_ms <= 0) || (bc.low_fraction <= 0) || (bc.high_fraction <= bc.low_fraction)
+     || (bc.down_frames < 1) || (bc.up_frames < 1) || (bc.min_features < 1)
+     || (bc.min_iter < 1) || (bc.min_levels < 1) ) {
+  fprintf(stderr, "[FeatureBudgetController::initialize] ERROR. Invalid budget parameters.\n");
+  return -1;
+ }
+ if( (maxFeatures < 1) || (maxIter < 1) || (maxLevels < 1) ) {
+  fprintf(stderr, "[FeatureBudgetController::initialize] ERROR. Invalid tracker settings.\n");
+  return -1;
+ }
+
+ // the minimums cannot exceed the tracker settings
+ d_context = bc;
+ if(d_context.min_features > maxFeatures) d_context.min_features = maxFeatures;
+ if(d_context.min_iter > maxIter) d_context.min_iter = maxIter;
+ if(d_context.min_levels > maxLevels) d_context.min_levels = maxLevels;
+ d_maxFeatures = maxFeatures;
+ d_maxIter = maxIter;
+ d_maxLevels = maxLevels;
+ d_point.num_features = maxFeatures;
+ d_point.max_iter = maxIter;
+ d_point.num_levels = maxLevels;
+ d_point.frame_ms = 0;
+ d_over = d_under = 0;
+ return 0;
+}
+
+
+//==============================================================================
+void FeatureBudgetController::beginFrame()
+//==============================================================================
+{
+ clock_gettime(CLOCK_MONOTONIC, &d_start);
+}
+
+
+//==============================================================================
+bool FeatureBudgetController::endFrame()
+//==============================================================================
+{
+ struct timespec now;
+ clock_gettime(CLOCK_MONOTONIC, &now);
+ float ms = (now.tv_sec - d_start.tv_sec) * 1000.0f + (now.tv_nsec - d_start.tv_nsec) * 1e-6f;
+ return update(ms);
+}
+
+
+//==============================================================================
+bool FeatureBudgetController::update(float ms)
+//==============================================================================
+{
+ if(d_maxFeatures == 0) return false;
+ d_point.frame_ms = (d_point.frame_ms == 0) ? ms : 0.75f * d_point.frame_ms + 0.25f * ms;
+
+ // Count frames on each side of the marks. The raw time is used, since the
+ // smoothed one would keep reporting an overrun for frames after a step.
+ if(ms > d_context.high_fraction * d_context.target_ms) {
+  ++d_over;
+  d_under = 0;
+ } else if(ms < d_context.low_fraction * d_context.target_ms) {
+  ++d_under;
+  d_over = 0;
+ } else {
+  d_over = d_under = 0;
+ }
+
+ bool changed = false;
+ if(d_over >= d_context.down_frames) {
+  changed = stepDown();
+  d_over = 0;
+ } else if(d_under >= d_context.up_frames) {
+  changed = stepUp();
+  d_under = 0;
+ }
+#ifdef DEBUG
+ if(changed)
+  fprintf(stderr, "[FeatureBudgetController::update] %.1f ms: %d features, %d iterations, "
+          "%d levels.\n", ms, d_point.num_features, d_point.max_iter, d_point.num_levels);
+#endif
+ return changed;
+}
+
+
+//==============================================================================
+bool FeatureBudgetController::stepDown()
+//==============================================================================
+{
+ budget_point_t &p = d_point;
+ if(p.max_iter > d_context.min_iter) {
+  p.max_iter -= (p.max_iter + 3) / 4;
+  if(p.max_iter < d_context.min_iter) p.max_iter = d_context.min_iter;
+ } else if(p.num_levels > d_context.min_levels) {
+  --p.num_levels;
+ } else if(p.num_features > d_context.min_features) {
+  p.num_features -= (p.num_features + 3) / 4;
+  if(p.num_features < d_context.min_features) p.num_features = d_context.min_features;
+ } else {
+  return false;
+ }
+ return true;
+}
+
+
+//==============================================================================
+bool FeatureBudgetController::stepUp()
+//==============================================================================
+{
+ budget_point_t &p = d_point;
+ if(p.num_features < d_maxFeatures) {
+  p.num_features += (p.num_features + 2) / 3;
+  if(p.num_features > d_maxFeatures) p.num_features = d_maxFeatures;
+ } else if(p.num_levels < d_maxLevels) {
+  ++p.num_levels;
+ } else if(p.max_iter < d_maxIter) {
+  p.max_iter += (p.max_iter + 2) / 3;
+  if(p.max_iter > d_maxIter) p.max_iter = d_maxIter;
+ } else {
+  return false;
+ }
+ return true;
+}
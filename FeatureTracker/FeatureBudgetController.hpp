@@ -0,0 +1,121 @@
+//==============================================================================
+// FeatureBudgetController.hpp - Tracking effort adjusted to a frame time target
+//==============================================================================
+
+#ifndef INCLUDED_FEATUREBUDGETCONTROLLER_HPP
+#define INCLUDED_FEATUREBUDGETCONTROLLER_HPP
+
+#include <time.h>
+
+
+//==============================================================================
+/*! \struct _BudgetContext
+    \brief Parameters for holding the tracking time per frame to a target
+    (see FeatureBudgetController)
+
+    Good default values for parameters are given in parenthesis. */
+//==============================================================================
+typedef struct _BudgetContext
+{
+ _BudgetContext() : target_ms(33), high_fraction(0.9), low_fraction(0.6),
+                    down_frames(3), up_frames(30), min_features(20), min_iter(5),
+                    min_levels(1) {};
+ float target_ms;      /*!< Time per frame in milliseconds to stay within
+                            (33 for NTSC). */
+ float high_fraction;  /*!< Effort is reduced when frames take more than this
+                            fraction of the target (0.9). */
+ float low_fraction;   /*!< Effort is increased when frames take less than
+                            this fraction of the target. The gap to
+                            'high_fraction' keeps the controller from
+                            oscillating between two settings (0.6). */
+ int down_frames;      /*!< Number of consecutive frames over the high mark
+                            before each reduction (3). */
+ int up_frames;        /*!< Number of consecutive frames under the low mark
+                            before each increase (30). */
+ int min_features;     /*!< Fewest features to track (20). */
+ int min_iter;         /*!< Fewest iterations per pyramid level (5). */
+ int min_levels;       /*!< Fewest pyramid levels, including the full
+                            resolution image (1). */
+}BudgetContext_t;
+
+
+//==============================================================================
+/*! \struct _budget_point
+    \brief Tracking effort chosen by FeatureBudgetController */
+//==============================================================================
+typedef struct _budget_point
+{
+ int num_features;     /*!< Number of feature slots in use. */
+ int max_iter;         /*!< Maximum number of iterations per level. */
+ int num_levels;       /*!< Number of pyramid levels, including the full
+                            resolution image. */
+ float frame_ms;       /*!< Time of recent frames in milliseconds (smoothed). */
+}budget_point_t;
+
+
+//==============================================================================
+// class FeatureBudgetController
+//------------------------------------------------------------------------------
+// \brief
+// Chooses how many features to track, with how many iterations and pyramid
+// levels, so that frames are processed within a time target.
+//
+// The tracker calls beginFrame() and endFrame() around each frame, and
+// applies the operating point returned by getOperatingPoint() to the next
+// frame. When frames take more than a high mark, effort is reduced one step
+// at a time, cheapest loss first: iterations by a quarter down to the
+// minimum, then one pyramid level, then features by a quarter. When frames
+// take less than a low mark, effort is increased in reverse order. A step is
+// taken only after several consecutive frames on the same side of the marks,
+// counted anew after every step so that the effect of a step is measured
+// before the next. Increases wait longer than reductions, since an overrun
+// costs more than a frame tracked with less effort.
+//==============================================================================
+class FeatureBudgetController
+{
+ public:
+  FeatureBudgetController();
+   // Default constructor.
+
+  ~FeatureBudgetController() {};
+   // Destructor.
+
+  int initialize(const BudgetContext_t &bc, int maxFeatures, int maxIter, int maxLevels);
+   // Set the target and start from full effort.
+   //  bc           Control parameters.
+   //  maxFeatures  Number of slots in the feature lists.
+   //  maxIter      Iterations per level configured for the tracker.
+   //  maxLevels    Pyramid levels configured for the tracker, including the
+   //               full resolution image.
+   //  return       0 on success, -1 on error (error message redirected to stderr).
+
+  void beginFrame();
+   // Start timing a frame.
+
+  bool endFrame();
+   // Stop timing the frame and update the operating point.
+   //  return  true if the operating point changed.
+
+  bool update(float ms);
+   // Update the operating point with a frame time measured by the caller
+   // (instead of beginFrame() and endFrame()).
+   //  ms      Time taken by the frame in milliseconds.
+   //  return  true if the operating point changed.
+
+  inline const budget_point_t &getOperatingPoint() const {return d_point;}
+   //  return  The effort to apply to the next frame.
+
+ protected:
+ private:
+  FeatureBudgetController(const FeatureBudgetController &);
+  FeatureBudgetController &operator=(const FeatureBudgetController &);
+  bool stepDown();
+  bool stepUp();
+  BudgetContext_t d_context;
+  budget_point_t d_point;
+  int d_maxFeatures, d_maxIter, d_maxLevels;
+  int d_over, d_under;     // consecutive frames over the high and under the low mark
+  struct timespec d_start;
+};
+
+#endif // INCLUDED_FEATUREBUDGETCONTROLLER_HPP
@@ -20,6 +20,7 @@ FeatureServer::FeatureServer() : Thread(), UDPServer()
  d_srcFeatures = NULL;
  d_dstFeatures = NULL;
  d_numFeatures = 0;
+ d_numStreams = 0;
 }
 
 
@@ -44,26 +45,37 @@ int FeatureServer::initialize(FeatureServerContext_t &cxt)
  d_numFeatures = cxt.num_features;
  d_port = cxt.port;
  d_priority = cxt.thread_priority;
+ d_numStreams = cxt.num_streams;
  d_msgSize = d_numFeatures * sizeof(feature_t) + 2 * sizeof(int);
  
- if((d_srcFeatures = (char *)realloc(d_srcFeatures, d_msgSize)) == NULL) {
+ if(d_numStreams < 1) {
+  fprintf(stderr, "[FeatureServer::initialize] ERROR. Need at least one stream.\n");
+  return -1;
+ }
+ 
+ // one message buffer per stream, back to back
+ if((d_srcFeatures = (char *)realloc(d_srcFeatures, d_numStreams * d_msgSize)) == NULL) {
   fprintf(stderr, "[FeatureServer::initialize] ERROR allocating memory.\n");
   return -1;
  }
  
- if((d_dstFeatures = (char *)realloc(d_dstFeatures, d_msgSize)) == NULL) {
+ if((d_dstFeatures = (char *)realloc(d_dstFeatures, d_numStreams * d_msgSize)) == NULL) {
   fprintf(stderr, "[FeatureServer::initialize] ERROR allocating memory.\n");
   return -1;
  }
  
  // data in buffer follows the structure of features_list_t 
- * (int *)d_srcFeatures = -1; // frame_number
- * (int *)d_dstFeatures = -1;
- * (int *)(d_srcFeatures + sizeof(int)) = d_numFeatures; 
- * (int *)(d_dstFeatures + sizeof(int)) = d_numFeatures;
+ for(int i = 0; i < d_numStreams; ++i) {
+  char *src = d_srcFeatures + i * d_msgSize;
+  char *dst = d_dstFeatures + i * d_msgSize;
+  * (int *)src = -1; // frame_number
+  * (int *)dst = -1;
+  * (int *)(src + sizeof(int)) = d_numFeatures; 
+  * (int *)(dst + sizeof(int)) = d_numFeatures;
+ }
  
- // initialize server
- if( UDPServer::init(d_port, sizeof(char)) == -1) {
+ // initialize server. Requests hold the stream id.
+ if( UDPServer::init(d_port, sizeof(int)) == -1) {
   fprintf(stderr, "[FeatureServer::initialize] %s\n", UDPServer::getStatusMessage());
   return -1;
  }
@@ -81,7 +93,7 @@ int FeatureServer::initialize(FeatureServerContext_t &cxt)
 
 
 //==============================================================================
-int FeatureServer::updateFeatures(feature_list_t &features, int frame)
+int FeatureServer::updateFeatures(feature_list_t &features, int frame, int stream)
 //==============================================================================
 {
 #ifdef DEBUG
@@ -99,7 +111,12 @@ int FeatureServer::updateFeatures(feature_list_t &features, int frame)
   return(-1);
  }
  
- char *buf = d_srcFeatures;
+ if( (stream < 0) || (stream >= d_numStreams) ) {
+  fprintf(stderr, "[FeatureServer::updateFeatures] ERROR. No stream %d.\n", stream);
+  return(-1);
+ }
+ 
+ char *buf = d_srcFeatures + stream * d_msgSize;
  
  d_rwLock.writeLock();
  if( *(int *)buf != frame ) {
@@ -126,18 +143,27 @@ const char *FeatureServer::receiveAndReply(const char *inMsgBuf, int inMsgLen, i
 #ifdef DEBUG
  fprintf(stderr, "[FeatureServer::receiveAndReply]: Enter.\n");
 #endif
- inMsgBuf = inMsgBuf;
- inMsgLen = inMsgLen;
+ // old clients send a single byte and get stream 0
+ int stream = 0;
+ if(inMsgLen == (int)sizeof(int))
+  memcpy(&stream, inMsgBuf, sizeof(int));
+ if( (stream < 0) || (stream >= d_numStreams) ) { // empty reply
+  *outMsgLen = 0;
+  return (const char *)(d_dstFeatures);
+ }
+ 
+ char *src = d_srcFeatures + stream * d_msgSize;
+ char *dst = d_dstFeatures + stream * d_msgSize;
  d_rwLock.readLock();
- if( * (int *)d_srcFeatures != * (int *)d_dstFeatures) { // check for new frame
-  memcpy(d_dstFeatures, d_srcFeatures, d_msgSize);
+ if( * (int *)src != * (int *)dst) { // check for new frame
+  memcpy(dst, src, d_msgSize);
  }
  d_rwLock.unlock();
  *outMsgLen = d_msgSize;
 #ifdef DEBUG
  fprintf(stderr, "[FeatureServer::receiveAndReply]: exit.\n");
 #endif
- return (const char *)(d_dstFeatures);
+ return (const char *)(dst);
 }
 
 
@@ -145,16 +171,7 @@ const char *FeatureServer::receiveAndReply(const char *inMsgBuf, int inMsgLen, i
 void FeatureServer::enterThread(void *arg)
 //==============================================================================
 {
- struct sched_param param;
- int policy;
-
- pthread_getschedparam(pthread_self(), &policy, &param);
- policy = SCHED_FIFO;
- param.sched_priority = ((FeatureServer *)arg)->d_priority;
- pthread_setschedparam(pthread_self(), policy, &param);
- pthread_getschedparam(pthread_self(), &policy, &param);
- fprintf(stdout, "[FeatureServer::enterThread]: Thread priority set to %d\n", 
-         param.sched_priority);
+ applyThreadPlacement(e_serverThread, ((FeatureServer *)arg)->d_priority);
 }
 
 
@@ -180,6 +197,7 @@ FeatureClient::FeatureClient()
 //==============================================================================
 {
  d_inMsgLen = 0;
+ d_stream = 0;
  d_featureList = NULL;
 }
 
@@ -195,7 +213,8 @@ FeatureClient::~FeatureClient()
 
 
 //==============================================================================
-int FeatureClient::initialize(const char *serverIp, int port, int msTimeOut, int nFeatures)
+int FeatureClient::initialize(const char *serverIp, int port, int msTimeOut, int nFeatures,
+                              int stream)
 //==============================================================================
 {
  struct timeval timeout;
@@ -210,6 +229,7 @@ int FeatureClient::initialize(const char *serverIp, int port, int msTimeOut, int
  }
 
  // create receive buffer
+ d_stream = stream;
  d_inMsgLen = nFeatures * sizeof(feature_t) + 2 * sizeof(int);
  if( (d_featureList = (char *)malloc(d_inMsgLen)) == NULL) {
   fprintf(stderr, "[FeatureClient::initialize]: ERROR allocating receiver buffer.\n");
@@ -227,7 +247,8 @@ int FeatureClient::receiveFeatureList(feature_list_t &l)
  int inMsgLen;
  
  // receive features from server
- if( d_client.sendAndReceive(d_featureList, 1, d_featureList, d_inMsgLen, &inMsgLen) == -1) {
+ if( d_client.sendAndReceive((char *)&d_stream, sizeof(int), d_featureList, 
+                             d_inMsgLen, &inMsgLen) == -1) {
   fprintf(stderr, "[FeatureClient::receiveFeatureList]: %s\n", d_client.getStatusMessage());
   return -1;
  }
@@ -9,17 +9,26 @@
 #include "putils/UDPClientServer.hpp"
 #include "putils/RWLock.hpp"
 #include "putils/Thread.hpp"
+#include "RTUtils/ThreadPlacement.hpp"
 #include "TrackerUtils.hpp"
 
 //==============================================================================
 /*! \struct _FeatureServerContext
-    \brief Parameters for UDP feature server. Use with class FeatureServer. */
+    \brief Parameters for UDP feature server. Use with class FeatureServer. 
+
+    Good default values for parameters are given in parenthesis. */
 //==============================================================================
 typedef struct _FeatureServerContext
 {
- int port;             /*!< Server port number. */
- int thread_priority;  /*!< Priority of the server thread. */
- int num_features;     /*!< Max. number of features to serve. */
+ _FeatureServerContext() : port(8000), thread_priority(10), num_features(100), 
+                           num_streams(1) {};
+ int port;             /*!< Server port number (8000). */
+ int thread_priority;  /*!< Priority of the server thread (SCHED_FIFO). Used only
+                            if no placement was set for e_serverThread (see 
+                            ThreadPlacement.hpp in RTUtils) (10). */
+ int num_features;     /*!< Max. number of features to serve (100). */
+ int num_streams;      /*!< Number of feature lists served, one per camera 
+                            stream. Clients ask for a list by stream id (1). */
 }FeatureServerContext_t;
 
 
@@ -32,6 +41,11 @@ typedef struct _FeatureServerContext
 // An object of this class starts a separate thread and replies to clients 
 // (FeatureClient object) with the latest feature point list.
 //
+// One server can serve the features of several camera streams (see 
+// 'num_streams' and MultiStreamTracker). Each stream has its own buffer, and
+// a client names the stream it wants in its request. Clients that send no
+// stream id get stream 0.
+//
 // <b>Example Program:</b>
 // \include FeatureServer.t.cpp
 // \include FeatureClient.t.cpp
@@ -50,15 +64,20 @@ class FeatureServer: public Thread, public UDPServer
    // called before using any other method in this class.
    //  return  0 on success, -1 on error (error message redirected to stderr).
  
-  int updateFeatures(feature_list_t &features, int srcFrameNumber);
-   // Update the features buffer in the server.
+  int updateFeatures(feature_list_t &features, int srcFrameNumber, int stream = 0);
+   // Update the features buffer in the server. May be called from several
+   // threads at once, for different streams.
    //  features        The feature list.
    //  srcFrameNumber  the image/video frame number corresponding to this 
    //                  feature list. The internal buffer is not updated 
    //                  unless this number is different from an internally
    //                  maintained counter. This avoid unecessary copy operations.
+   //  stream          The stream id, 0 to 'num_streams' - 1.
    //  return          0 on success, -1 on error (error message redirected to stderr).
 
+  inline int getNumStreams() const {return d_numStreams;}
+   //  return  Number of streams served.
+
  protected:
   virtual const char *receiveAndReply(const char *inMsgBuf, int inMsgLen, int *outMsgLen); 
    // Reimplemented from UDPServer class.
@@ -80,6 +99,7 @@ class FeatureServer: public Thread, public UDPServer
   char *d_dstFeatures;
   int d_msgSize;
   int d_numFeatures;
+  int d_numStreams;
   RWLock d_rwLock;
 };
 
@@ -102,12 +122,14 @@ class FeatureClient
   ~FeatureClient();
    // Default destructor. Does nothing.
    
-  int initialize(const char *serverIp, int port, int msTimeOut, int nFeatures);
+  int initialize(const char *serverIp, int port, int msTimeOut, int nFeatures, 
+                 int stream = 0);
    // Connect to remote feature server.
    //  serverIp   The IP address of the remote server.
    //  port       The server port.
    //  msTimeOut  Connection timeout (in milliseconds).
    //  nFeatures  Number of feature points expected in the server message.
+   //  stream     Id of the stream whose features are requested.
    //  return     0 on success, -1 on error (error message redirected to stderr).
    
   int receiveFeatureList(feature_list_t &features);
@@ -118,6 +140,7 @@ class FeatureClient
  private:
   UDPClient d_client;
   int d_inMsgLen;
+  int d_stream;
   char *d_featureList;
 };
 
@@ -0,0 +1,370 @@
+//==============================================================================
+// FeatureReidentifier.cpp - Recovery of lost features by binary descriptor
+//==============================================================================
+
+#include "FeatureReidentifier.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//#define DEBUG
+
+#define REID_MARGIN (REID_PATCH_RADIUS + REID_BOX_RADIUS + 1)
+
+static int patternOffset(unsigned int &seed);
+static inline int popCount(unsigned int v);
+
+
+//==============================================================================
+FeatureReidentifier::FeatureReidentifier()
+//==============================================================================
+{
+ d_numFeatures = 0;
+ d_width = d_height = 0;
+ d_image = NULL;
+ d_integral = NULL;
+ d_integralReady = false;
+ d_descriptors = NULL;
+ d_described = NULL;
+ d_last = NULL;
+ d_velocity = NULL;
+ d_hasVelocity = NULL;
+ d_wasValid = NULL;
+ d_lostFrames = NULL;
+ d_pending = NULL;
+ d_restored = NULL;
+ d_numRestored = 0;
+}
+
+
+//==============================================================================
+FeatureReidentifier::~FeatureReidentifier()
+//==============================================================================
+{
+ if(d_integral) free(d_integral);
+ if(d_descriptors) free(d_descriptors);
+ if(d_described) free(d_described);
+ if(d_last) free(d_last);
+ if(d_velocity) free(d_velocity);
+ if(d_hasVelocity) free(d_hasVelocity);
+ if(d_wasValid) free(d_wasValid);
+ if(d_lostFrames) free(d_lostFrames);
+ if(d_pending) free(d_pending);
+ if(d_restored) free(d_restored);
+}
+
+
+//==============================================================================
+int FeatureReidentifier::initialize(const ReidContext_t &rc, int numFeatures, int w, int h)
+//==============================================================================
+{
+ if( (rc.search_radius < 0) || (rc.max_distance < 0) || (rc.max_lost_frames < 1)
+     || (rc.min_distance < 0) ) {
+  fprintf(stderr, "[FeatureReidentifier::initialize] ERROR. Invalid re-identification parameters.\n");
+  return -1;
+ }
+ // the integral image holds sums of up to w*h bytes in an int
+ if( (numFeatures < 1) || (w <= 2 * REID_MARGIN) || (h <= 2 * REID_MARGIN)
+     || ((double)w * h * 255 > 2147483647.0) ) {
+  fprintf(stderr, "[FeatureReidentifier::initialize] ERROR. Invalid list or image size.\n");
+  return -1;
+ }
+
+ if(d_integral) free(d_integral);
+ if(d_descriptors) free(d_descriptors);
+ if(d_described) free(d_described);
+ if(d_last) free(d_last);
+ if(d_velocity) free(d_velocity);
+ if(d_hasVelocity) free(d_hasVelocity);
+ if(d_wasValid) free(d_wasValid);
+ if(d_lostFrames) free(d_lostFrames);
+ if(d_pending) free(d_pending);
+ if(d_restored) free(d_restored);
+
+ d_context = rc;
+ d_numFeatures = numFeatures;
+ d_width = w;
+ d_height = h;
+ d_integral = (int *)malloc((w + 1) * (h + 1) * sizeof(int));
+ d_descriptors = (unsigned int *)malloc(numFeatures * REID_DESCRIPTOR_WORDS * sizeof(unsigned int));
+ d_described = (char *)calloc(numFeatures, 1);
+ d_last = (float *)calloc(2 * numFeatures, sizeof(float));
+ d_velocity = (float *)calloc(2 * numFeatures, sizeof(float));
+ d_hasVelocity = (char *)calloc(numFeatures, 1);
+ d_wasValid = (char *)calloc(numFeatures, 1);
+ d_lostFrames = (int *)malloc(numFeatures * sizeof(int));
+ d_pending = (char *)calloc(numFeatures, 1);
+ d_restored = (int *)malloc(numFeatures * sizeof(int));
+ if( !d_integral || !d_descriptors || !d_described || !d_last || !d_velocity || !d_hasVelocity
+     || !d_wasValid || !d_lostFrames || !d_pending || !d_restored ) {
+  fprintf(stderr, "[FeatureReidentifier::initialize] ERROR allocating memory.\n");
+  if(d_descriptors) free(d_descriptors);
+  d_descriptors = NULL;
+  return -1;
+ }
+ for(int i = 0; i < numFeatures; ++i)
+  d_lostFrames[i] = -1;
+ d_numRestored = 0;
+ d_image = NULL;
+ d_integralReady = false;
+
+ // The same pattern of test pairs for every run: points drawn from an
+ // isotropic Gaussian around the feature with a standard deviation of a
+ // fifth of the patch width, clipped to the patch (BRIEF's best pattern).
+ unsigned int seed = 0x5eed1e55;
+ int iw = w + 1;
+ for(int k = 0; k < REID_DESCRIPTOR_WORDS * 32; ++k) {
+  int x1, y1, x2, y2;
+  do {
+   x1 = patternOffset(seed);
+   y1 = patternOffset(seed);
+   x2 = patternOffset(seed);
+   y2 = patternOffset(seed);
+  } while( (x1 == x2) && (y1 == y2) );
+  d_pattern[2 * k] = y1 * iw + x1;
+  d_pattern[2 * k + 1] = y2 * iw + x2;
+ }
+ return 0;
+}
+
+
+//==============================================================================
+int FeatureReidentifier::reidentify(const unsigned char *img, feature_list_t &f, int numSlots)
+//==============================================================================
+{
+ if(d_descriptors == NULL) {
+  fprintf(stderr, "[FeatureReidentifier::reidentify] ERROR. Call initialize() first.\n");
+  return -1;
+ }
+ if(f.num_features != d_numFeatures) {
+  fprintf(stderr, "[FeatureReidentifier::reidentify] ERROR. List holds %d features, expected %d.\n",
+          f.num_features, d_numFeatures);
+  return -1;
+ }
+ d_image = img;
+ d_integralReady = false;
+ d_numRestored = 0;
+ if( (numSlots < 0) || (numSlots > d_numFeatures) ) numSlots = d_numFeatures;
+
+ for(int i = 0; i < d_numFeatures; ++i) {
+  if( !d_pending[i] ) continue;
+  feature_t &p = f.features[i];
+  if( (p.val >= 0) || (i >= numSlots) || (++d_lostFrames[i] > d_context.max_lost_frames) ) {
+   d_pending[i] = 0;
+   d_lostFrames[i] = -1;
+   continue;
+  }
+
+  // where the feature would be had it kept moving as it did: d_last is from
+  // the frame before the loss, and d_lostFrames[i] frames have passed since
+  float px = d_last[2 * i], py = d_last[2 * i + 1];
+  if(d_hasVelocity[i]) {
+   px += (d_lostFrames[i] + 1) * d_velocity[2 * i];
+   py += (d_lostFrames[i] + 1) * d_velocity[2 * i + 1];
+  }
+  int mx, my;
+  if( match(px, py, d_descriptors + i * REID_DESCRIPTOR_WORDS, mx, my) > d_context.max_distance )
+   continue;
+  if( !isFarFromOthers(f, mx, my) )
+   continue;
+
+  p.x = (float)mx;
+  p.y = (float)my;
+  p.val = e_tracked;
+  d_pending[i] = 0;
+  d_lostFrames[i] = -1;
+  d_restored[d_numRestored++] = i;
+ }
+#ifdef DEBUG
+ if(d_numRestored)
+  fprintf(stderr, "[FeatureReidentifier::reidentify] Restored %d features.\n", d_numRestored);
+#endif
+ return d_numRestored;
+}
+
+
+//==============================================================================
+int FeatureReidentifier::endFrame(const feature_list_t &f)
+//==============================================================================
+{
+ if(d_descriptors == NULL) {
+  fprintf(stderr, "[FeatureReidentifier::endFrame] ERROR. Call initialize() first.\n");
+  return -1;
+ }
+ if( (f.num_features != d_numFeatures) || (d_image == NULL) ) {
+  fprintf(stderr, "[FeatureReidentifier::endFrame] ERROR. Wrong list size, or no image.\n");
+  return -1;
+ }
+
+ for(int i = 0; i < d_numFeatures; ++i) {
+  const feature_t &p = f.features[i];
+  if(p.val < 0) {
+   // start looking for a described feature just lost
+   if( d_wasValid[i] && d_described[i] ) {
+    d_pending[i] = 1;
+    d_lostFrames[i] = 0;
+   }
+   d_wasValid[i] = 0;
+   continue;
+  }
+
+  if(p.val == e_new) {
+   // a new identity in this slot, whatever was lost from it is gone
+   d_described[i] = describe((int)(p.x + 0.5f), (int)(p.y + 0.5f),
+                             d_descriptors + i * REID_DESCRIPTOR_WORDS);
+   d_hasVelocity[i] = 0;
+  } else if(d_wasValid[i]) {
+   d_velocity[2 * i] = p.x - d_last[2 * i];
+   d_velocity[2 * i + 1] = p.y - d_last[2 * i + 1];
+   d_hasVelocity[i] = 1;
+  } else {
+   d_hasVelocity[i] = 0; // restored this frame
+  }
+  d_last[2 * i] = p.x;
+  d_last[2 * i + 1] = p.y;
+  d_wasValid[i] = 1;
+  d_pending[i] = 0;
+  d_lostFrames[i] = -1;
+ }
+ d_image = NULL;
+ return 0;
+}
+
+
+//==============================================================================
+void FeatureReidentifier::buildIntegral()
+//==============================================================================
+{
+ int iw = d_width + 1;
+ memset(d_integral, 0, iw * sizeof(int));
+ for(int y = 0; y < d_height; ++y) {
+  const unsigned char *row = d_image + y * d_width;
+  int *above = d_integral + y * iw;
+  int *out = above + iw;
+  int sum = 0;
+  out[0] = 0;
+  for(int x = 0; x < d_width; ++x) {
+   sum += row[x];
+   out[x + 1] = above[x + 1] + sum;
+  }
+ }
+ d_integralReady = true;
+}
+
+
+//==============================================================================
+bool FeatureReidentifier::describe(int x, int y, unsigned int *desc)
+//==============================================================================
+{
+ if( (x < REID_MARGIN) || (y < REID_MARGIN) || (x >= d_width - REID_MARGIN)
+     || (y >= d_height - REID_MARGIN) )
+  return false;
+ if( !d_integralReady ) buildIntegral();
+
+ // box sum around test point o: four corners of the integral image
+ int iw = d_width + 1, r = REID_BOX_RADIUS;
+ const int *s = d_integral + y * iw + x;
+ int a = (r + 1) * iw + r + 1, b = -r * iw + r + 1, c = (r + 1) * iw - r, d = -r * iw - r;
+ const int *t = d_pattern;
+ for(int w = 0; w < REID_DESCRIPTOR_WORDS; ++w) {
+  unsigned int bits = 0;
+  for(int k = 0; k < 32; ++k, t += 2) {
+   const int *p = s + t[0], *q = s + t[1];
+   int v1 = p[a] - p[b] - p[c] + p[d];
+   int v2 = q[a] - q[b] - q[c] + q[d];
+   bits |= (unsigned int)(v1 < v2) << k;
+  }
+  desc[w] = bits;
+ }
+ return true;
+}
+
+
+//==============================================================================
+int FeatureReidentifier::match(float px, float py, const unsigned int *desc, int &mx, int &my)
+//==============================================================================
+{
+ int cx = (int)(px + 0.5f), cy = (int)(py + 0.5f);
+ int rad = d_context.search_radius;
+ int x0 = (cx - rad < REID_MARGIN) ? REID_MARGIN : cx - rad;
+ int y0 = (cy - rad < REID_MARGIN) ? REID_MARGIN : cy - rad;
+ int x1 = (cx + rad >= d_width - REID_MARGIN) ? d_width - REID_MARGIN - 1 : cx + rad;
+ int y1 = (cy + rad >= d_height - REID_MARGIN) ? d_height - REID_MARGIN - 1 : cy + rad;
+ int best = REID_DESCRIPTOR_WORDS * 32 + 1;
+ if( (x0 > x1) || (y0 > y1) ) return best;
+ if( !d_integralReady ) buildIntegral();
+
+ // Every pixel of the window. A candidate is abandoned as soon as its
+ // distance reaches the best so far, which after a few candidates is
+ // usually within the first words.
+ int iw = d_width + 1, r = REID_BOX_RADIUS;
+ int a = (r + 1) * iw + r + 1, b = -r * iw + r + 1, c = (r + 1) * iw - r, d = -r * iw - r;
+ for(int y = y0; y <= y1; ++y) {
+  for(int x = x0; x <= x1; ++x) {
+   const int *s = d_integral + y * iw + x;
+   const int *t = d_pattern;
+   int dist = 0;
+   for(int w = 0; (w < REID_DESCRIPTOR_WORDS) && (dist < best); ++w) {
+    unsigned int bits = 0;
+    for(int k = 0; k < 32; ++k, t += 2) {
+     const int *p = s + t[0], *q = s + t[1];
+     int v1 = p[a] - p[b] - p[c] + p[d];
+     int v2 = q[a] - q[b] - q[c] + q[d];
+     bits |= (unsigned int)(v1 < v2) << k;
+    }
+    dist += popCount(bits ^ desc[w]);
+   }
+   if(dist < best) {
+    best = dist;
+    mx = x;
+    my = y;
+   }
+  }
+ }
+ return best;
+}
+
+
+//==============================================================================
+bool FeatureReidentifier::isFarFromOthers(const feature_list_t &f, int x, int y) const
+//==============================================================================
+{
+ float minDist2 = (float)d_context.min_distance * d_context.min_distance;
+ for(int i = 0; i < d_numFeatures; ++i) {
+  const feature_t &p = f.features[i];
+  if(p.val < 0) continue;
+  float dx = p.x - x, dy = p.y - y;
+  if(dx * dx + dy * dy < minDist2) return false;
+ }
+ return true;
+}
+
+
+//==============================================================================
+// patternOffset - one coordinate of a test point, roughly Gaussian (sum of
+//                 twelve uniform numbers), from a fixed generator
+//==============================================================================
+int patternOffset(unsigned int &seed)
+{
+ float sum = 0;
+ for(int i = 0; i < 12; ++i) {
+  seed = seed * 1664525u + 1013904223u;
+  sum += (seed >> 8) * (1.0f / 16777216.0f);
+ }
+ int v = (int)((sum - 6.0f) * (2 * REID_PATCH_RADIUS + 1) / 5.0f + ((sum < 6.0f) ? -0.5f : 0.5f));
+ if(v < -REID_PATCH_RADIUS) v = -REID_PATCH_RADIUS;
+ if(v > REID_PATCH_RADIUS) v = REID_PATCH_RADIUS;
+ return v;
+}
+
+
+//==============================================================================
+// popCount - number of set bits in a word
+//==============================================================================
+int popCount(unsigned int v)
+{
+ v = v - ((v >> 1) & 0x55555555u);
+ v = (v & 0x33333333u) + ((v >> 2) & 0x33333333u);
+ v = (v + (v >> 4)) & 0x0f0f0f0fu;
+ return (int)((v * 0x01010101u) >> 24);
+}
@@ -0,0 +1,142 @@
+//==============================================================================
+// FeatureReidentifier.hpp - Recovery of lost features by binary descriptor
+//==============================================================================
+
+#ifndef INCLUDED_FEATUREREIDENTIFIER_HPP
+#define INCLUDED_FEATUREREIDENTIFIER_HPP
+
+#include "TrackerUtils.hpp"
+
+#define REID_DESCRIPTOR_WORDS 8   // descriptor length in 32 bit words (256 tests)
+#define REID_PATCH_RADIUS 15      // tests lie in a 31x31 patch around the feature
+#define REID_BOX_RADIUS 2         // each test compares two 5x5 box sums
+
+
+//==============================================================================
+/*! \struct _ReidContext
+    \brief Parameters for re-identification of lost features (see
+    FeatureReidentifier)
+
+    Good default values for parameters are given in parenthesis. */
+//==============================================================================
+typedef struct _ReidContext
+{
+ _ReidContext() : search_radius(12), max_distance(48), max_lost_frames(30),
+                  min_distance(5) {};
+ int search_radius;    /*!< Half width in pixels of the window searched around
+                            the predicted position of a lost feature (12). */
+ int max_distance;     /*!< Largest Hamming distance, out of 256 bits, at which
+                            a patch is taken to be the lost feature (48). */
+ int max_lost_frames;  /*!< Number of frames a lost feature is searched for
+                            before it is given up (30). */
+ int min_distance;     /*!< A lost feature is not restored closer than this
+                            many pixels to a feature being tracked (5). */
+}ReidContext_t;
+
+
+//==============================================================================
+// class FeatureReidentifier
+//------------------------------------------------------------------------------
+// \brief
+// Finds features again after they were lost for a few frames, for instance
+// behind a passing occlusion, and restores them to their original slots so
+// that consumers see the same identity before and after.
+//
+// Each feature is described once, when it is new, by a 256 bit binary
+// descriptor in the manner of BRIEF: bit k tells whether the image, smoothed
+// with a 5x5 box, is brighter at the first or the second point of the kth
+// pair of a fixed random pattern of point pairs around the feature. Box sums
+// come from an integral image, built only in frames in which there is
+// something to describe or to search for. Descriptors are compared by
+// Hamming distance, with a population count over 32 bit words.
+//
+// The tracker calls reidentify() after tracking and before replenishment,
+// and endFrame() once the feature list of the frame is final. endFrame()
+// describes new features, keeps the velocity of tracked features, and starts
+// a search for every described feature that was lost. In each following
+// frame, reidentify() looks for the lost feature in a window around where
+// its last velocity would have taken it, at every pixel, and restores it as
+// e_tracked at the best match, if the match is close enough. Restored
+// positions are whole pixels; the tracker refines them in the next frame.
+//
+// Features within 18 pixels of an edge of the image are not described, and
+// are not re-identified. All memory is allocated in initialize().
+//==============================================================================
+class FeatureReidentifier
+{
+ public:
+  FeatureReidentifier();
+   // Default constructor.
+
+  ~FeatureReidentifier();
+   // Destructor frees all memory.
+
+  int initialize(const ReidContext_t &rc, int numFeatures, int w, int h);
+   // Set up descriptor storage and the test pattern, and forget all features.
+   //  rc           Re-identification parameters.
+   //  numFeatures  Number of slots in the feature lists.
+   //  w,h          Image dimensions in pixels.
+   //  return       0 on success, -1 on error (error message redirected to stderr).
+
+  inline bool isInitialized() const {return d_descriptors != NULL;}
+   //  return  true if initialize() succeeded.
+
+  int reidentify(const unsigned char *img, feature_list_t &f, int numSlots = -1);
+   // Search the image for features lost in earlier frames, and restore
+   // those found into their slots as e_tracked. Call in every frame,
+   // including the first.
+   //  img       The image of this frame, 8 bit grayscale. Must stay valid
+   //            until endFrame() returns.
+   //  f         Features of this frame (after tracking).
+   //  numSlots  Only slots below this are restored, -1 for all. Lost
+   //            features in other slots are given up.
+   //  return    Number of features restored, -1 on error (error message
+   //            redirected to stderr).
+
+  inline int getRestoredSlot(int i) const {return d_restored[i];}
+   //  return  Slot of the ith feature restored by the last call to
+   //          reidentify(). No bounds checking.
+
+  int endFrame(const feature_list_t &f);
+   // Record the final features of this frame, after replenishment. A lost
+   // feature whose slot has been given to a new feature is given up.
+   //  f       Features of this frame.
+   //  return  0 on success, -1 on error (error message redirected to stderr).
+
+  inline int getWidth() const {return d_width;}
+  inline int getHeight() const {return d_height;}
+   //  return  Image dimensions in pixels.
+
+  inline const char *getPending() const {return d_pending;}
+   //  return  Per slot: 1 if the slot holds a lost feature that is still
+   //          searched for, else 0. Pass to FeatureReplenisher::beginFrame()
+   //          so that these slots are filled last.
+
+ protected:
+ private:
+  FeatureReidentifier(const FeatureReidentifier &);
+  FeatureReidentifier &operator=(const FeatureReidentifier &);
+  void buildIntegral();
+  bool describe(int x, int y, unsigned int *desc);
+  int match(float px, float py, const unsigned int *desc, int &mx, int &my);
+  bool isFarFromOthers(const feature_list_t &f, int x, int y) const;
+  ReidContext_t d_context;
+  int d_numFeatures;
+  int d_width, d_height;
+  const unsigned char *d_image;
+  int *d_integral;              // (w+1)x(h+1) integral image of d_image
+  bool d_integralReady;
+  int d_pattern[REID_DESCRIPTOR_WORDS * 32 * 2];  // test points, as offsets into d_integral
+  unsigned int *d_descriptors;  // per slot
+  char *d_described;            // per slot: 1 if the descriptor is valid
+  float *d_last;                // per slot: last tracked position (x,y pairs)
+  float *d_velocity;            // per slot: step over the last frame (x,y pairs)
+  char *d_hasVelocity;
+  char *d_wasValid;             // per slot: valid in the last frame
+  int *d_lostFrames;            // per slot: frames since the feature was lost
+  char *d_pending;
+  int *d_restored;
+  int d_numRestored;
+};
+
+#endif // INCLUDED_FEATUREREIDENTIFIER_HPP
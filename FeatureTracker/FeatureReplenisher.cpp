@@ -0,0 +1,228 @@
+//==============================================================================
+// FeatureReplenisher.cpp - Grid-based incremental replacement of lost features
+//==============================================================================
+
+#include "FeatureReplenisher.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//#define DEBUG
+
+
+//==============================================================================
+FeatureReplenisher::FeatureReplenisher()
+//==============================================================================
+{
+ d_list = NULL;
+ d_numFeatures = 0;
+ d_width = d_height = 0;
+ d_cols = d_rows = 0;
+ d_cells = NULL;
+ d_cellSlots = NULL;
+ d_freeSlots = NULL;
+ d_numFree = 0;
+ d_emptyCells = NULL;
+ d_numEmpty = 0;
+ d_nextEmpty = 0;
+ d_startCell = 0;
+ d_added = NULL;
+ d_numAdded = 0;
+}
+
+
+//==============================================================================
+FeatureReplenisher::~FeatureReplenisher()
+//==============================================================================
+{
+ if(d_cells) free(d_cells);
+ if(d_cellSlots) free(d_cellSlots);
+ if(d_freeSlots) free(d_freeSlots);
+ if(d_emptyCells) free(d_emptyCells);
+ if(d_added) free(d_added);
+}
+
+
+//==============================================================================
+int FeatureReplenisher::initialize(const ReplenishContext_t &rc, int numFeatures, int w, int h)
+//==============================================================================
+{
+ if( (rc.cell_size < 1) || (rc.min_distance < 0) || (rc.min_distance > rc.cell_size)
+     || (rc.max_per_cell < 1) || (rc.time_budget_us < 0) ) {
+  fprintf(stderr, "[FeatureReplenisher::initialize] ERROR. Invalid replenishment parameters.\n");
+  return -1;
+ }
+ if( (numFeatures < 1) || (w < 1) || (h < 1) ) {
+  fprintf(stderr, "[FeatureReplenisher::initialize] ERROR. Invalid list or image size.\n");
+  return -1;
+ }
+
+ if(d_cells) free(d_cells);
+ if(d_cellSlots) free(d_cellSlots);
+ if(d_freeSlots) free(d_freeSlots);
+ if(d_emptyCells) free(d_emptyCells);
+ if(d_added) free(d_added);
+
+ d_context = rc;
+ d_numFeatures = numFeatures;
+ d_width = w;
+ d_height = h;
+ d_cols = (w + rc.cell_size - 1) / rc.cell_size;
+ d_rows = (h + rc.cell_size - 1) / rc.cell_size;
+ d_cells = (int *)malloc((d_cols * d_rows + 1) * sizeof(int));
+ d_cellSlots = (int *)malloc(numFeatures * sizeof(int));
+ d_freeSlots = (int *)malloc(numFeatures * sizeof(int));
+ d_emptyCells = (int *)malloc(d_cols * d_rows * sizeof(int));
+ d_added = (float *)malloc(2 * numFeatures * sizeof(float));
+ if( !d_cells || !d_cellSlots || !d_freeSlots || !d_emptyCells || !d_added ) {
+  fprintf(stderr, "[FeatureReplenisher::initialize] ERROR allocating memory.\n");
+  if(d_cells) free(d_cells);
+  d_cells = NULL;
+  return -1;
+ }
+ d_list = NULL;
+ d_numFree = 0;
+ d_numEmpty = 0;
+ d_nextEmpty = 0;
+ d_startCell = 0;
+ d_numAdded = 0;
+ return 0;
+}
+
+
+//==============================================================================
+int FeatureReplenisher::beginFrame(const feature_list_t &f, int numSlots, const char *held)
+//==============================================================================
+{
+ if(d_cells == NULL) {
+  fprintf(stderr, "[FeatureReplenisher::beginFrame] ERROR. Call initialize() first.\n");
+  return -1;
+ }
+ if(f.num_features != d_numFeatures) {
+  fprintf(stderr, "[FeatureReplenisher::beginFrame] ERROR. List holds %d features, expected %d.\n",
+          f.num_features, d_numFeatures);
+  return -1;
+ }
+ clock_gettime(CLOCK_MONOTONIC, &d_start);
+ d_list = &f;
+
+ // bucket valid features by cell (counting sort), collect free slots
+ int numCells = d_cols * d_rows;
+ int cs = d_context.cell_size;
+ memset(d_cells, 0, (numCells + 1) * sizeof(int));
+ d_numFree = 0;
+ if( (numSlots < 0) || (numSlots > d_numFeatures) ) numSlots = d_numFeatures;
+ for(int i = 0; i < d_numFeatures; ++i) {
+  const feature_t &p = f.features[i];
+  if(p.val < 0) {
+   if( (i < numSlots) && !(held && held[i]) ) d_freeSlots[d_numFree++] = i;
+   continue;
+  }
+  int cx = (int)p.x / cs, cy = (int)p.y / cs;
+  if(cx < 0) cx = 0; else if(cx >= d_cols) cx = d_cols - 1;
+  if(cy < 0) cy = 0; else if(cy >= d_rows) cy = d_rows - 1;
+  ++d_cells[cy * d_cols + cx + 1];
+ }
+ // held slots are given out last
+ for(int i = 0; held && (i < numSlots); ++i)
+  if( (f.features[i].val < 0) && held[i] ) d_freeSlots[d_numFree++] = i;
+ for(int c = 0; c < numCells; ++c)
+  d_cells[c + 1] += d_cells[c];
+ for(int i = 0; i < d_numFeatures; ++i) {
+  const feature_t &p = f.features[i];
+  if(p.val < 0) continue;
+  int cx = (int)p.x / cs, cy = (int)p.y / cs;
+  if(cx < 0) cx = 0; else if(cx >= d_cols) cx = d_cols - 1;
+  if(cy < 0) cy = 0; else if(cy >= d_rows) cy = d_rows - 1;
+  d_cellSlots[d_cells[cy * d_cols + cx]++] = i;
+ }
+ // d_cells[c] now holds the end of cell c, i.e. the start of cell c + 1
+ for(int c = numCells; c > 0; --c)
+  d_cells[c] = d_cells[c - 1];
+ d_cells[0] = 0;
+
+ // empty cells, starting where the last frame left off
+ d_numEmpty = 0;
+ d_nextEmpty = 0;
+ d_numAdded = 0;
+ if(d_numFree == 0) return 0;
+ for(int k = 0; k < numCells; ++k) {
+  int c = (d_startCell + k) % numCells;
+  if(d_cells[c + 1] == d_cells[c]) d_emptyCells[d_numEmpty++] = c;
+ }
+#ifdef DEBUG
+ fprintf(stderr, "[FeatureReplenisher::beginFrame] %d free slots, %d/%d empty cells.\n",
+         d_numFree, d_numEmpty, numCells);
+#endif
+ return d_numFree;
+}
+
+
+//==============================================================================
+bool FeatureReplenisher::nextCell(int &x, int &y, int &w, int &h)
+//==============================================================================
+{
+ if( (d_numAdded >= d_numFree) || (d_nextEmpty >= d_numEmpty) )
+  return false;
+
+ if(d_context.time_budget_us > 0) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  long us = (now.tv_sec - d_start.tv_sec) * 1000000L + (now.tv_nsec - d_start.tv_nsec) / 1000;
+  if(us >= d_context.time_budget_us) return false;
+ }
+
+ int c = d_emptyCells[d_nextEmpty++];
+ int cs = d_context.cell_size;
+ x = (c % d_cols) * cs;
+ y = (c / d_cols) * cs;
+ w = (x + cs <= d_width) ? cs : d_width - x;
+ h = (y + cs <= d_height) ? cs : d_height - y;
+ d_startCell = (c + 1) % (d_cols * d_rows);
+ return true;
+}
+
+
+//==============================================================================
+int FeatureReplenisher::addFeature(float x, float y)
+//==============================================================================
+{
+ if( (d_list == NULL) || (d_numAdded >= d_numFree) ) return -1;
+ if( (x < 0) || (y < 0) || (x >= d_width) || (y >= d_height) ) return -1;
+ if( !isFarFromOthers(x, y) ) return -1;
+
+ d_added[2 * d_numAdded] = x;
+ d_added[2 * d_numAdded + 1] = y;
+ return d_freeSlots[d_numAdded++];
+}
+
+
+//==============================================================================
+bool FeatureReplenisher::isFarFromOthers(float x, float y) const
+//==============================================================================
+{
+ float minDist2 = (float)d_context.min_distance * d_context.min_distance;
+ int cs = d_context.cell_size;
+ int cx = (int)x / cs, cy = (int)y / cs;
+
+ // features tracked into this frame, from the neighbouring cells
+ for(int j = cy - 1; j <= cy + 1; ++j) {
+  if( (j < 0) || (j >= d_rows) ) continue;
+  for(int i = cx - 1; i <= cx + 1; ++i) {
+   if( (i < 0) || (i >= d_cols) ) continue;
+   int c = j * d_cols + i;
+   for(int k = d_cells[c]; k < d_cells[c + 1]; ++k) {
+    const feature_t &p = d_list->features[d_cellSlots[k]];
+    float dx = p.x - x, dy = p.y - y;
+    if(dx * dx + dy * dy < minDist2) return false;
+   }
+  }
+ }
+
+ // features added in this frame
+ for(int k = 0; k < d_numAdded; ++k) {
+  float dx = d_added[2 * k] - x, dy = d_added[2 * k + 1] - y;
+  if(dx * dx + dy * dy < minDist2) return false;
+ }
+ return true;
+}
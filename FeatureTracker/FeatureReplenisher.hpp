@@ -0,0 +1,134 @@
+//==============================================================================
+// FeatureReplenisher.hpp - Grid-based incremental replacement of lost features
+//==============================================================================
+
+#ifndef INCLUDED_FEATUREREPLENISHER_HPP
+#define INCLUDED_FEATUREREPLENISHER_HPP
+
+#include "TrackerUtils.hpp"
+#include <time.h>
+
+
+//==============================================================================
+/*! \struct _ReplenishContext
+    \brief Parameters for incremental feature replenishment (see
+    FeatureReplenisher)
+
+    Good default values for parameters are given in parenthesis. */
+//==============================================================================
+typedef struct _ReplenishContext
+{
+ _ReplenishContext() : cell_size(64), min_distance(10), max_per_cell(2),
+                       time_budget_us(2000) {};
+ int cell_size;       /*!< Width and height of a grid cell in pixels. Cells
+                           without features are searched for new ones (64). */
+ int min_distance;    /*!< Minimum distance in pixels between a new feature and
+                           any other feature. Must not exceed 'cell_size' (10). */
+ int max_per_cell;    /*!< Maximum number of features detected in one cell
+                           per frame (2). */
+ int time_budget_us;  /*!< Time in microseconds that may be spent on detection
+                           per frame. Detection stops after the cell in which
+                           the budget runs out, and resumes from the next cell
+                           in the next frame. 0 for no limit (2000). */
+}ReplenishContext_t;
+
+
+//==============================================================================
+// class FeatureReplenisher
+//------------------------------------------------------------------------------
+// \brief
+// Finds the regions of an image that have lost their features, and assigns
+// newly detected features to free slots of a feature list.
+//
+// The image is divided into a grid of square cells. In each frame, the
+// tracker calls beginFrame() with its current features, and then detects
+// corners only in the empty cells returned by nextCell(), so that detection
+// cost is proportional to what was lost and not to the image size. Detected
+// corners are offered to addFeature(), which rejects those too close to
+// other features and otherwise returns the slot in which to store the new
+// feature. The tracker marks the slot e_new, which tells consumers that
+// the slot holds a new identity. Cells are visited in round-robin order
+// across frames, so a time budget that cuts detection short does not
+// starve any part of the image.
+//
+// All memory is allocated in initialize().
+//==============================================================================
+class FeatureReplenisher
+{
+ public:
+  FeatureReplenisher();
+   // Default constructor.
+
+  ~FeatureReplenisher();
+   // Destructor frees all memory.
+
+  int initialize(const ReplenishContext_t &rc, int numFeatures, int w, int h);
+   // Set up the grid.
+   //  rc           Replenishment parameters.
+   //  numFeatures  Number of slots in the feature lists.
+   //  w,h          Image dimensions in pixels.
+   //  return       0 on success, -1 on error (error message redirected to stderr).
+
+  inline bool isInitialized() const {return d_cells != NULL;}
+   //  return  true if initialize() succeeded.
+
+  int beginFrame(const feature_list_t &f, int numSlots = -1, const char *held = NULL);
+   // Find the empty cells and free slots for this frame and start the
+   // detection timer.
+   //  f         Features of the current frame (after tracking). The list
+   //            must not change until the end of the frame, other than
+   //            through slots returned by addFeature().
+   //  numSlots  Only slots below this are filled, -1 for all.
+   //  held      Optional, per slot: nonzero if the slot should be filled
+   //            only when no other slot is free, such as slots of lost
+   //            features that may yet be re-identified (see 
+   //            FeatureReidentifier).
+   //  return    Number of free slots, -1 on error (error message redirected
+   //            to stderr).
+
+  bool nextCell(int &x, int &y, int &w, int &h);
+   // Get the next empty cell to search for features.
+   //  x,y,w,h  The cell rectangle in pixels (output).
+   //  return   false if no empty cells or free slots are left, or the
+   //           time budget is used up.
+
+  int addFeature(float x, float y);
+   // Offer a newly detected feature.
+   //  x,y     Feature coordinates in pixels.
+   //  return  The slot in which to store the feature, or -1 if the
+   //          feature is too close to another feature or no slot is free.
+
+  inline int getMaxPerCell() const {return d_context.max_per_cell;}
+   //  return  Maximum number of features to detect in a cell.
+
+  inline int getCellSize() const {return d_context.cell_size;}
+   //  return  Width and height of a grid cell in pixels.
+
+  inline int getWidth() const {return d_width;}
+  inline int getHeight() const {return d_height;}
+   //  return  Image dimensions in pixels.
+
+ protected:
+ private:
+  FeatureReplenisher(const FeatureReplenisher &);
+  FeatureReplenisher &operator=(const FeatureReplenisher &);
+  bool isFarFromOthers(float x, float y) const;
+  ReplenishContext_t d_context;
+  const feature_list_t *d_list;
+  int d_numFeatures;
+  int d_width, d_height;
+  int d_cols, d_rows;
+  int *d_cells;         // first entry of each cell in d_cellSlots (counting sort)
+  int *d_cellSlots;     // slots of valid features, grouped by cell
+  int *d_freeSlots;
+  int d_numFree;
+  int *d_emptyCells;    // empty cells, in visiting order
+  int d_numEmpty;
+  int d_nextEmpty;
+  int d_startCell;      // where the round-robin search starts
+  float *d_added;       // features added this frame (x,y pairs)
+  int d_numAdded;
+  struct timespec d_start;
+};
+
+#endif // INCLUDED_FEATUREREPLENISHER_HPP
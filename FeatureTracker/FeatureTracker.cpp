@@ -0,0 +1,158 @@
+//==============================================================================
+// FeatureTracker.cpp - Common interface of the feature trackers, and
+//                      selection of a tracker at run time
+//==============================================================================
+
+#include "FeatureTracker.hpp"
+#include "FeatureTrackerOCV.hpp"
+#include "FeatureTrackerKLT.hpp"
+#include "FeatureTrackerLK.hpp"
+#include <string.h>
+
+//#define DEBUG
+
+static const char *s_backendNames[e_numTrackerBackends] = {"ocv", "klt", "lk"};
+
+
+//==============================================================================
+FeatureTracker *FeatureTracker::create(tracker_backend_t backend, FeatureTrackerContext_t &ftc,
+                                       const TrackerSettings_t &ts)
+//==============================================================================
+{
+ if( (ts.window_size < 3) || (ts.window_size % 2 != 1) || (ts.num_levels < 1)
+     || (ts.max_iter < 1) ) {
+  fprintf(stderr, "[FeatureTracker::create] ERROR. Invalid tracker settings.\n");
+  return NULL;
+ }
+
+ FeatureTracker *tracker = NULL;
+ int ret = -1;
+ switch(backend) {
+  case e_trackerOCV: {
+   // OpenCV windows are given by their half size
+   OCVTrackingContext_t ocvt;
+   ocvt.min_dist = ts.min_dist;
+   ocvt.quality = ts.quality;
+   ocvt.block_size = 3;
+   ocvt.max_iter = ts.max_iter;
+   ocvt.epsilon = ts.epsilon;
+   ocvt.window_size = ts.window_size / 2;
+   ocvt.max_error = 200;
+   FeatureTrackerOCV *ocv = new FeatureTrackerOCV;
+   tracker = ocv;
+   ret = ocv->initialize(ftc, ocvt);
+  }
+  break;
+  case e_trackerKLT: {
+   // levels of 2x subsampling, as in the other trackers; without the
+   // affine consistency check, so that features can be tracked in parallel
+   KLT_TrackingContext kltc = KLTCreateTrackingContext();
+   kltc->window_width = ts.window_size;
+   kltc->window_height = ts.window_size;
+   kltc->nPyramidLevels = ts.num_levels;
+   kltc->subsampling = 2;
+   kltc->max_iterations = ts.max_iter;
+   kltc->min_displacement = ts.epsilon;
+   kltc->mindist = ts.min_dist;
+   kltc->affineConsistencyCheck = -1;
+   kltc->writeInternalImages = false;
+   KLTUpdateTCBorder(kltc);
+   FeatureTrackerKLT *klt = new FeatureTrackerKLT;
+   klt->setContextOwnership(true);
+   tracker = klt;
+   ret = klt->initialize(ftc, kltc);
+  }
+  break;
+  case e_trackerLK: {
+   LKTrackingContext_t lkt;
+   lkt.window_size = ts.window_size;
+   lkt.num_levels = (ts.num_levels < LK_MAX_LEVELS) ? ts.num_levels : LK_MAX_LEVELS;
+   lkt.max_iter = ts.max_iter;
+   lkt.epsilon = ts.epsilon;
+   lkt.quality = ts.quality;
+   lkt.min_dist = ts.min_dist;
+   FeatureTrackerLK *lk = new FeatureTrackerLK;
+   tracker = lk;
+   ret = lk->initialize(ftc, lkt);
+  }
+  break;
+  default:
+   fprintf(stderr, "[FeatureTracker::create] ERROR. Unknown tracker %d.\n", (int)backend);
+   return NULL;
+ }
+
+ if(ret != 0) {
+  fprintf(stderr, "[FeatureTracker::create] ERROR initializing the %s tracker.\n",
+          s_backendNames[backend]);
+  delete tracker;
+  return NULL;
+ }
+#ifdef DEBUG
+ fprintf(stderr, "[FeatureTracker::create] Created the %s tracker.\n", s_backendNames[backend]);
+#endif
+ return tracker;
+}
+
+
+//==============================================================================
+FeatureTracker *FeatureTracker::create(const char *name, FeatureTrackerContext_t &ftc,
+                                       const TrackerSettings_t &ts)
+//==============================================================================
+{
+ for(int i = 0; i < e_numTrackerBackends; ++i)
+  if( name && !strcmp(name, s_backendNames[i]) )
+   return create((tracker_backend_t)i, ftc, ts);
+ fprintf(stderr, "[FeatureTracker::create] ERROR. Unknown tracker '%s'.\n", name ? name : "");
+ return NULL;
+}
+
+
+//==============================================================================
+const char *FeatureTracker::getBackendName(tracker_backend_t backend)
+//==============================================================================
+{
+ if( (backend < 0) || (backend >= e_numTrackerBackends) ) return NULL;
+ return s_backendNames[backend];
+}
+
+
+//==============================================================================
+int FeatureTracker::setTaskPool(TaskPool *pool)
+//==============================================================================
+{
+ return pool ? notSupported("parallel tracking") : 0;
+}
+
+
+//==============================================================================
+int FeatureTracker::setLatencyTarget(const BudgetContext_t *bc)
+//==============================================================================
+{
+ return bc ? notSupported("a latency target") : 0;
+}
+
+
+//==============================================================================
+int FeatureTracker::setReidentification(const ReidContext_t *rc)
+//==============================================================================
+{
+ return rc ? notSupported("re-identification") : 0;
+}
+
+
+//==============================================================================
+int FeatureTracker::setPipelining(bool on)
+//==============================================================================
+{
+ return on ? notSupported("pipelining") : 0;
+}
+
+
+//==============================================================================
+int FeatureTracker::notSupported(const char *option) const
+//==============================================================================
+{
+ fprintf(stderr, "[FeatureTracker] ERROR. The %s tracker does not support %s.\n",
+         s_backendNames[getBackend()], option);
+ return -1;
+}
@@ -0,0 +1,165 @@
+//==============================================================================
+// FeatureTracker.hpp - Common interface of the feature trackers, and
+//                      selection of a tracker at run time
+//==============================================================================
+
+#ifndef INCLUDED_FEATURETRACKER_HPP
+#define INCLUDED_FEATURETRACKER_HPP
+
+#include <stdio.h>
+#include "TrackerUtils.hpp"
+#include "TrackHistory.hpp"
+#include "FeatureReplenisher.hpp"
+#include "FeatureReidentifier.hpp"
+#include "FeatureBudgetController.hpp"
+
+class TaskPool;
+
+
+//==============================================================================
+/*! \enum _tracker_backend
+    \brief Implementations of FeatureTracker */
+//==============================================================================
+typedef enum _tracker_backend
+{
+ e_trackerOCV = 0,      //!< FeatureTrackerOCV (OpenCV).
+ e_trackerKLT,          //!< FeatureTrackerKLT (KLT library).
+ e_trackerLK,           //!< FeatureTrackerLK (native).
+ e_numTrackerBackends
+}tracker_backend_t;
+
+
+//==============================================================================
+/*! \struct _TrackerSettings
+    \brief Tracking parameters that all trackers share, for trackers created
+    with FeatureTracker::create(). Each is translated to the nearest setting
+    of the tracker created; parameters not listed here keep the defaults of
+    the tracker.
+
+    Good default values for parameters are given in parenthesis. */
+//==============================================================================
+typedef struct _TrackerSettings
+{
+ _TrackerSettings() : window_size(15), num_levels(3), max_iter(20), epsilon(0.03),
+                      quality(0.01), min_dist(10) {};
+ int window_size;       /*!< Width and height of the tracking window in pixels,
+                             odd (15). */
+ int num_levels;        /*!< Number of pyramid levels, including the full
+                             resolution image. The OpenCV tracker always uses
+                             OCV_PYR_LEVELS levels above the image (3). */
+ int max_iter;          /*!< Maximum number of iterations per level (20). */
+ double epsilon;        /*!< Iterations stop once the feature moves by less
+                             than this many pixels (0.03). */
+ double quality;        /*!< Features are detected where the smallest
+                             eigenvalue is at least this fraction of the
+                             strongest in the image. Not used by the KLT
+                             tracker, which has an absolute threshold (0.01). */
+ int min_dist;          /*!< Minimum distance between detected features (10). */
+}TrackerSettings_t;
+
+
+//==============================================================================
+// class FeatureTracker
+//------------------------------------------------------------------------------
+// \brief
+// The interface shared by FeatureTrackerOCV, FeatureTrackerKLT and
+// FeatureTrackerLK, so that the tracker can be chosen, or trackers
+// compared, at run time.
+//
+// A tracker is created with create(), from its backend or its name, and
+// from the settings common to all trackers; it is then initialized and can
+// be used through this interface alone. Trackers can also be created and
+// initialized directly, with the settings specific to each, and used
+// through this interface afterwards.
+//
+// Options that only some trackers have are part of the interface. Trackers
+// that do not have an option return an error when it is turned on, and
+// succeed when it is turned off.
+//==============================================================================
+class FeatureTracker
+{
+ public:
+  virtual ~FeatureTracker() {}
+   // Destructor frees any allocated resources.
+
+  static FeatureTracker *create(tracker_backend_t backend, FeatureTrackerContext_t &ftc,
+                                const TrackerSettings_t &ts = TrackerSettings_t());
+   // Create and initialize a tracker.
+   //  backend The tracker to create.
+   //  ftc     settings specific to this class (see the initialize() method
+   //          of each tracker).
+   //  ts      tracking parameters.
+   //  return  The tracker, to be deleted by the caller, or NULL on error
+   //          (error message redirected to stderr).
+
+  static FeatureTracker *create(const char *name, FeatureTrackerContext_t &ftc,
+                                const TrackerSettings_t &ts = TrackerSettings_t());
+   // Create and initialize a tracker by name, e.g. from the command line.
+   //  name    "ocv", "klt" or "lk" (see getBackendName()).
+   //  ftc,ts  As above.
+   //  return  As above.
+
+  static const char *getBackendName(tracker_backend_t backend);
+   //  return  The name of a tracker, as accepted by create(), or NULL.
+
+  virtual tracker_backend_t getBackend() const = 0;
+   //  return  The implementation of this tracker.
+
+  virtual int processImage(unsigned char *img, int w, int h, feature_list_t &list) = 0;
+   // Track features in the image buffer (see the processImage() method of
+   // each tracker).
+   //  img     Image buffer, 8 bit grayscale.
+   //  w,h     Image dimensions in pixels.
+   //  list    List of tracked features.
+   //  return  current frame number on success (first frame = 1), -1 on
+   //          error (error message redirected to stderr), -2 on user
+   //          initiated quit. 0 if a pipelined tracker has no features yet.
+
+  virtual const TrackHistory &getTrackHistory() const = 0;
+   //  return  The history of tracked features over recent frames.
+
+  virtual int openTrackLog(const char *fileName, int indexInterval = 30) = 0;
+   // Start logging tracked features into a binary track log.
+   //  fileName       Name of the log file.
+   //  indexInterval  Number of frames between commits of the log header.
+   //  return    0 on success, -1 on error (error message redirected to stderr).
+
+  virtual int closeTrackLog() = 0;
+   // Stop logging and close the track log.
+   //  return    0 on success, -1 on error (error message redirected to stderr).
+
+  virtual int setReplenishment(const ReplenishContext_t *rc) = 0;
+   // Replace lost features in the grid cells that have none left.
+   //  rc      Replenishment parameters, or NULL to turn replenishment off.
+   //  return  0 on success, -1 on error (error message redirected to stderr).
+
+  virtual int setTaskPool(TaskPool *pool);
+   // Track features in parallel using a pool of worker threads (KLT, LK).
+   //  pool    The task pool, or NULL to track in the calling thread.
+   //  return  0 on success, -1 on error (error message redirected to stderr).
+
+  virtual int setLatencyTarget(const BudgetContext_t *bc);
+   // Adjust the effort per frame to stay within a target time (OCV, LK).
+   //  bc      Control parameters, or NULL to turn the control off.
+   //  return  0 on success, -1 on error (error message redirected to stderr).
+
+  virtual int setReidentification(const ReidContext_t *rc);
+   // Restore lost features found again to their slots (OCV, KLT).
+   //  rc      Re-identification parameters, or NULL to turn it off.
+   //  return  0 on success, -1 on error (error message redirected to stderr).
+
+  virtual int setPipelining(bool on);
+   // Build the pyramid of the next image while the features of the last
+   // image are tracked, one frame late (KLT, LK).
+   //  on      true to pipeline, false to process each image within its call.
+   //  return  0 on success, -1 on error (error message redirected to stderr).
+
+  virtual bool isPipelined() const {return false;}
+   //  return  true if processImage() returns the features of each image one
+   //          call late.
+
+ protected:
+  int notSupported(const char *option) const;
+};
+
+#endif // INCLUDED_FEATURETRACKER_HPP
@@ -4,22 +4,84 @@
 //==============================================================================
 
 #include "FeatureTrackerKLT.hpp"
+#include "RTUtils/TaskPool.hpp"
+#include "RTUtils/FrameArena.hpp"
+#include "klt/convolve.h"
+#include <pthread.h>
+#include <math.h>
+#include <string.h>
 
 //#define DEBUG
 
+// The KLT convolution routines cache kernels in globals. Every call into
+// them, from any KLT tracker in the process, is made with this lock held.
+static pthread_mutex_t s_kltLock = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct _klt_partitions
+{
+ KLT_TrackingContext tc;
+ KLT_Feature *features;       // features to track
+ int grain;                   // features per partition
+ float *windows;              // three tracking windows per partition
+ _KLT_Pyramid pyramid1, gradx1, grady1;
+ _KLT_Pyramid pyramid2, gradx2, grady2;
+}klt_partitions_t;
+
+static void trackPartition(int begin, int end, void *arg);
+static int trackFeature(float x1, float y1, float *x2, float *y2,
+                        _KLT_FloatImage img1, _KLT_FloatImage gradx1, _KLT_FloatImage grady1,
+                        _KLT_FloatImage img2, _KLT_FloatImage gradx2, _KLT_FloatImage grady2,
+                        KLT_TrackingContext tc, float *imgdiff, float *gradx, float *grady);
+static float interpolate(float x, float y, _KLT_FloatImage img);
+static void intensityDifference(_KLT_FloatImage img1, _KLT_FloatImage img2,
+                                float x1, float y1, float x2, float y2,
+                                int width, int height, bool lightingInsensitive,
+                                float *imgdiff);
+static void gradientSum(_KLT_FloatImage gradx1, _KLT_FloatImage grady1,
+                        _KLT_FloatImage gradx2, _KLT_FloatImage grady2,
+                        _KLT_FloatImage img1, _KLT_FloatImage img2,
+                        float x1, float y1, float x2, float y2,
+                        int width, int height, bool lightingInsensitive,
+                        float *gradx, float *grady);
+
 //==============================================================================
 FeatureTrackerKLT::FeatureTrackerKLT()
 //==============================================================================
 {
  d_kltc = NULL;
+ d_ownsContext = false;
  d_numFeatures = 0;
  d_numFrames = 0;
  d_frameNumber = 0;
  d_autoSelect = true;
  d_displayOn = true;
+ d_displayDecimation = 1;
  d_featureList = NULL;
- d_featureTable = NULL;
  d_screen = NULL;
+ d_pool = NULL;
+ d_arena = NULL;
+ d_tmpImage = NULL;
+ d_floatImage = NULL;
+ for(int i = 0; i < 3; ++i) {
+  d_pyramid[i] = NULL;
+  d_gradx[i] = NULL;
+  d_grady[i] = NULL;
+ }
+ d_current = 0;
+ d_previous = 1;
+ d_active = NULL;
+ d_windows = NULL;
+ d_replenishOn = false;
+ d_cellFeatures = NULL;
+ d_cellImage = NULL;
+ d_cellImageSize = 0;
+ d_reidOn = false;
+ d_pipelineOn = false;
+ d_pipeImage[0] = d_pipeImage[1] = NULL;
+ d_pipeSlot = -1;
+ d_buildImage = NULL;
+ d_buildSlot = 0;
+ d_buildPyramid = 2;
 }
 
 
@@ -27,8 +89,14 @@ FeatureTrackerKLT::FeatureTrackerKLT()
 FeatureTrackerKLT::~FeatureTrackerKLT()
 //==============================================================================
 {
+ d_stage.shutdown();
  if(d_featureList) KLTFreeFeatureList(d_featureList);
- if(d_featureTable) KLTFreeFeatureTable(d_featureTable);
+ freePyramids();
+ if(d_active) free(d_active);
+ if(d_windows) free(d_windows);
+ if(d_cellFeatures) KLTFreeFeatureList(d_cellFeatures);
+ if(d_cellImage) free(d_cellImage);
+ if(d_ownsContext && d_kltc) KLTFreeTrackingContext(d_kltc);
 #ifdef DEBUG
  fprintf(stderr, "[FeatureTrackerKLT::~FeatureTrackerKLT] Leaving.\n");
 #endif
@@ -40,6 +108,7 @@ int FeatureTrackerKLT::initialize(FeatureTrackerContext_t &ftc, KLT_TrackingCont
 //==============================================================================
 {
  d_frameNumber = 0;
+ d_pipeSlot = -1;
  d_kltc = kltc;
  
  // override some user specified parameters
@@ -49,8 +118,12 @@ int FeatureTrackerKLT::initialize(FeatureTrackerContext_t &ftc, KLT_TrackingCont
  d_numFrames = ftc.num_frames;
  d_autoSelect = ftc.auto_select_features;
  d_displayOn = ftc.display_tracked_features;
+ d_displayDecimation = (ftc.display_decimation > 0) ? ftc.display_decimation : 1;
  d_featureList = KLTCreateFeatureList(d_numFeatures);
- d_featureTable = KLTCreateFeatureTable(d_numFrames, d_numFeatures);
+ if( d_featureAdapter.attach(d_featureList) != 0 )
+  return -1;
+ if( d_history.initialize(d_numFeatures, d_numFrames, ftc.history_bytes) != 0 )
+  return -1;
  KLTSetVerbosity(0);
  
  return 0;
@@ -77,11 +150,34 @@ int FeatureTrackerKLT::processImage(unsigned char *buf, int w, int h, feature_li
   fprintf(stderr, "%s\n", "[FeatureTrackerKLT::processImage] ERROR. Must call initialize first.");
   return -1;
  }
- 
- if( d_frameNumber == d_numFrames) {
-  fprintf(stderr, "\n%s\n%s\n", 
-          "[FeatureTrackerKLT::processImage] WARNING Exceeded specified frame number limit ->",
-          "-> Feature table won't update further.");
+
+ // With pipelining, the helper copies this image in and builds its pyramid
+ // while the image of the last call is tracked, which is then processed
+ // in place of this one. No image flushes the one left in the pipeline.
+ if(d_pipelineOn) {
+  if( (buf == NULL) && (d_pipeSlot < 0) ) return 0;
+  if( allocatePyramids(w, h) != 0 ) return -1;
+  int slot = d_pipeSlot;
+  if(buf != NULL) {
+   d_buildImage = buf;
+   d_buildSlot = (slot == 0) ? 1 : 0;
+   d_buildPyramid = 3 - d_current - d_previous;
+   if( d_stage.start(pyramidJob, this) != 0 ) return -1;
+  }
+  int ret = 0;
+  if( (slot >= 0) && (d_frameNumber > 0) ) ret = trackParallel();
+  d_stage.wait();
+  if(buf != NULL) {
+   d_previous = d_current;
+   d_current = d_buildPyramid;
+  }
+  d_pipeSlot = (buf != NULL) ? d_buildSlot : -1;
+  if(ret != 0) return -1;
+  if(slot < 0) return 0;
+  buf = d_pipeImage[slot];
+ } else if(buf == NULL) {
+  fprintf(stderr, "[FeatureTrackerKLT::processImage] ERROR. No image.\n");
+  return -1;
  }
  
  // first frame - select features
@@ -89,7 +185,9 @@ int FeatureTrackerKLT::processImage(unsigned char *buf, int w, int h, feature_li
   
   // automatic or manual feature selection
   if(d_autoSelect) {
+   pthread_mutex_lock(&s_kltLock);
    KLTSelectGoodFeatures(d_kltc, buf, w, h, d_featureList);
+   pthread_mutex_unlock(&s_kltLock);
   } else {  
   
    // initialize display
@@ -113,7 +211,7 @@ int FeatureTrackerKLT::processImage(unsigned char *buf, int w, int h, feature_li
       fprintf(stdout, "Selected feature %3d at (%6.2f, %6.2f)\n", nFeatSelected, x, y); 
       d_featureList->feature[nFeatSelected]->x = x;
       d_featureList->feature[nFeatSelected]->y = y;
-      d_featureList->feature[nFeatSelected]->val = KLT_TRACKED;
+      d_featureList->feature[nFeatSelected]->val = e_new;
       ++nFeatSelected;
       boxColor(d_screen, (short)x-2, (short)y-2, (short)x+2, 
                (short)y+2, 0xff0000ff);
@@ -129,40 +227,49 @@ int FeatureTrackerKLT::processImage(unsigned char *buf, int w, int h, feature_li
     }
    }
   }
-  KLTStoreFeatureList(d_featureList, d_featureTable, d_frameNumber);
+  if( d_pool && !d_pipelineOn && (buildPyramid(buf, w, h) != 0) ) return -1;
+ } else if(d_pipelineOn) {
+  // tracked above
+ } else if(d_pool) {
+  // track features in this frame, in parallel
+  if( buildPyramid(buf, w, h) != 0 ) return -1;
+  if( trackParallel() != 0 ) return -1;
  } else {
   // track features in this frame
+  pthread_mutex_lock(&s_kltLock);
   KLTTrackFeatures(d_kltc, buf, buf, w, h, d_featureList);
-  if( d_frameNumber < d_numFrames )
-   KLTStoreFeatureList(d_featureList, d_featureTable, d_frameNumber);
+  pthread_mutex_unlock(&s_kltLock);
  }
  
- // prepare screen display 
- if(d_displayOn) {
+ // prepare screen display (decimated)
+ bool display = d_displayOn && (d_frameNumber % d_displayDecimation == 0);
+ if(display) {
   if(d_screen == NULL) if( d_display.init(w, h, "FeatureTrackerKLT") != 0) return -1;
   if( d_display.updateScreenBuffer((char *)buf, w, h, 1, NULL) != 0) return -1;
   d_screen = d_display.getScreenPointer();
  }
 
- // copy features into list, update display
- for(int i = 0; i < d_numFeatures; ++i) {
-  if (d_featureList->feature[i]->val == KLT_TRACKED) {
-   features.features[i].val = 0;
-   features.features[i].x = d_featureList->feature[i]->x;
-   features.features[i].y = d_featureList->feature[i]->y;
-   if(d_displayOn) 
-    boxColor(d_screen, (short)(features.features[i].x)-2, (short)(features.features[i].y)-2, 
-             (short)(features.features[i].x)+2, (short)(features.features[i].y)+2, 0xff0000ff);
-  } else {
-   features.features[i].val = -1;
-   features.features[i].x = 0;
-   features.features[i].y = 0;
-  }
+ // copy features into list
+ int nTracked = d_featureAdapter.copyFromKLT(features);
+ if(nTracked < 0) return -1;
+ if(d_reidOn) {
+  int nRestored = reidentify(buf, w, h, features);
+  if(nRestored < 0) return -1;
+  nTracked += nRestored;
+ }
+ if( d_replenishOn && (d_frameNumber > 0) ) {
+  int nNew = replenish(buf, w, h, features);
+  if(nNew < 0) return -1;
+  nTracked += nNew;
  }
+ if( d_reidOn && (d_reid.endFrame(features) != 0) ) return -1;
+ if( d_history.record(features, d_frameNumber) != 0 ) return -1;
+ if( d_log.isOpen() && (d_log.append(features, d_frameNumber) != 0) ) return -1;
  
  // update display
- if(d_displayOn) {
-  snprintf(d_message, 80, "Features tracked: %d/%d\0", KLTCountRemainingFeatures(d_featureList), d_numFeatures);
+ if(display) {
+  d_display.drawFeatures(features);
+  snprintf(d_message, 80, "Features tracked: %d/%d\0", nTracked, d_numFeatures);
   stringColor(d_screen, 2, h-10, d_message, 0xfd1b04FF);
   d_display.refresh();
  }
@@ -179,15 +286,637 @@ int FeatureTrackerKLT::processImage(unsigned char *buf, int w, int h, feature_li
 }
 
 
+//==============================================================================
+int FeatureTrackerKLT::openTrackLog(const char *fileName, int indexInterval)
+//==============================================================================
+{
+ if(d_numFeatures <= 0) {
+  fprintf(stderr, "[FeatureTrackerKLT::openTrackLog] ERROR. Call initialize() first.\n");
+  return -1;
+ }
+ return d_log.open(fileName, d_numFeatures, indexInterval);
+}
+
+
+//==============================================================================
+int FeatureTrackerKLT::setTaskPool(TaskPool *pool)
+//==============================================================================
+{
+ if(d_featureList == NULL) {
+  fprintf(stderr, "[FeatureTrackerKLT::setTaskPool] ERROR. Call initialize() first.\n");
+  return -1;
+ }
+ if( (pool == NULL) && d_pipelineOn ) {
+  fprintf(stderr, "[FeatureTrackerKLT::setTaskPool] ERROR. Turn pipelining off first.\n");
+  return -1;
+ }
+ if(d_frameNumber != 0) {
+  fprintf(stderr, "[FeatureTrackerKLT::setTaskPool] ERROR. Tracking has already started.\n");
+  return -1;
+ }
+ if( pool && (d_kltc->affineConsistencyCheck >= 0) ) {
+  fprintf(stderr, "[FeatureTrackerKLT::setTaskPool] ERROR. Affine consistency check not supported.\n");
+  return -1;
+ }
+
+ if(d_active) free(d_active);
+ if(d_windows) free(d_windows);
+ d_active = NULL;
+ d_windows = NULL;
+ d_pool = pool;
+ if(d_pool == NULL)
+  return 0;
+
+ // window dimensions are corrected the same way as KLTTrackFeatures does
+ if(d_kltc->window_width % 2 != 1) d_kltc->window_width += 1;
+ if(d_kltc->window_height % 2 != 1) d_kltc->window_height += 1;
+ if(d_kltc->window_width < 3) d_kltc->window_width = 3;
+ if(d_kltc->window_height < 3) d_kltc->window_height = 3;
+
+ // scratch memory used when there is no frame arena
+ int nPartitions = d_pool->getNumThreads() + 1;
+ int windowSize = d_kltc->window_width * d_kltc->window_height;
+ d_active = (KLT_Feature *)malloc(d_numFeatures * sizeof(KLT_Feature));
+ d_windows = (float *)malloc(3 * nPartitions * windowSize * sizeof(float));
+ if( (d_active == NULL) || (d_windows == NULL) ) {
+  fprintf(stderr, "[FeatureTrackerKLT::setTaskPool] ERROR allocating memory.\n");
+  d_pool = NULL;
+  return -1;
+ }
+ return 0;
+}
+
+
+//==============================================================================
+int FeatureTrackerKLT::setPipelining(bool on)
+//==============================================================================
+{
+ if(d_featureList == NULL) {
+  fprintf(stderr, "[FeatureTrackerKLT::setPipelining] ERROR. Call initialize() first.\n");
+  return -1;
+ }
+ if( (d_frameNumber != 0) || (d_pipeSlot >= 0) ) {
+  fprintf(stderr, "[FeatureTrackerKLT::setPipelining] ERROR. Tracking has already started.\n");
+  return -1;
+ }
+ if(!on) {
+  d_stage.shutdown();
+  d_pipelineOn = false;
+  return 0;
+ }
+ if(d_pool == NULL) {
+  fprintf(stderr, "[FeatureTrackerKLT::setPipelining] ERROR. Call setTaskPool() first.\n");
+  return -1;
+ }
+ if( !d_stage.isRunning() && (d_stage.initialize() != 0) )
+  return -1;
+ d_pipelineOn = true;
+ return 0;
+}
+
+
+//==============================================================================
+int FeatureTrackerKLT::setReplenishment(const ReplenishContext_t *rc)
+//==============================================================================
+{
+ if(rc == NULL) {
+  d_replenishOn = false;
+  return 0;
+ }
+ if(d_featureList == NULL) {
+  fprintf(stderr, "[FeatureTrackerKLT::setReplenishment] ERROR. Call initialize() first.\n");
+  return -1;
+ }
+ if(rc->max_per_cell < 1) {
+  fprintf(stderr, "[FeatureTrackerKLT::setReplenishment] ERROR. Invalid replenishment parameters.\n");
+  return -1;
+ }
+ if(d_cellFeatures) KLTFreeFeatureList(d_cellFeatures);
+ d_cellFeatures = KLTCreateFeatureList(rc->max_per_cell);
+ d_replenishContext = *rc;
+ d_replenishOn = true;
+ 
+ // the grid is set up with the image size on the next frame, unless known
+ if( d_replenisher.isInitialized() )
+  return d_replenisher.initialize(d_replenishContext, d_numFeatures, 
+                                  d_replenisher.getWidth(), d_replenisher.getHeight());
+ return 0;
+}
+
+
+//==============================================================================
+int FeatureTrackerKLT::replenish(unsigned char *buf, int w, int h, feature_list_t &features)
+//==============================================================================
+{
+ if( !d_replenisher.isInitialized() 
+     && (d_replenisher.initialize(d_replenishContext, d_numFeatures, w, h) != 0) )
+  return -1;
+
+ int numFree = d_replenisher.beginFrame(features, -1, d_reidOn ? d_reid.getPending() : NULL);
+ if(numFree <= 0) return numFree;
+
+ // KLT selects no features within its border, so each cell is searched 
+ // together with a margin of that width
+ int bx = d_kltc->borderx, by = d_kltc->bordery;
+ int cs = d_replenisher.getCellSize();
+ int size = (cs + 2 * bx) * (cs + 2 * by);
+ if(size > d_cellImageSize) {
+  unsigned char *cellImage = (unsigned char *)realloc(d_cellImage, size);
+  if(cellImage == NULL) {
+   fprintf(stderr, "[FeatureTrackerKLT::replenish] ERROR in memory allocation.\n");
+   return -1;
+  }
+  d_cellImage = cellImage;
+  d_cellImageSize = size;
+ }
+
+ // selecting in sequential mode would replace the pyramid of this frame,
+ // which the next frame is tracked from
+ KLT_BOOL sequential = d_kltc->sequentialMode;
+ d_kltc->sequentialMode = false;
+
+ int numAdded = 0;
+ int x, y, cw, ch;
+ while( d_replenisher.nextCell(x, y, cw, ch) ) {
+  int x0 = (x > bx) ? x - bx : 0;
+  int y0 = (y > by) ? y - by : 0;
+  int x1 = (x + cw + bx < w) ? x + cw + bx : w;
+  int y1 = (y + ch + by < h) ? y + ch + by : h;
+  int rw = x1 - x0, rh = y1 - y0;
+  for(int j = 0; j < rh; ++j)
+   memcpy(d_cellImage + j * rw, buf + (y0 + j) * w + x0, rw);
+  pthread_mutex_lock(&s_kltLock);
+  KLTSelectGoodFeatures(d_kltc, d_cellImage, rw, rh, d_cellFeatures);
+  pthread_mutex_unlock(&s_kltLock);
+
+  for(int i = 0; i < d_cellFeatures->nFeatures; ++i) {
+   KLT_Feature c = d_cellFeatures->feature[i];
+   if(c->val <= 0) continue;
+   float fx = c->x + x0, fy = c->y + y0;
+   if( (fx < x) || (fy < y) || (fx >= x + cw) || (fy >= y + ch) ) continue;
+   int slot = d_replenisher.addFeature(fx, fy);
+   if(slot < 0) continue;
+   d_featureList->feature[slot]->x = fx;
+   d_featureList->feature[slot]->y = fy;
+   d_featureList->feature[slot]->val = e_new;
+   features.features[slot].x = fx;
+   features.features[slot].y = fy;
+   features.features[slot].val = e_new;
+   ++numAdded;
+  }
+ }
+ d_kltc->sequentialMode = sequential;
+#ifdef DEBUG
+ fprintf(stderr, "[FeatureTrackerKLT::replenish] Added %d features.\n", numAdded);
+#endif
+ return numAdded;
+}
+
+
+//==============================================================================
+int FeatureTrackerKLT::setReidentification(const ReidContext_t *rc)
+//==============================================================================
+{
+ if(rc == NULL) {
+  d_reidOn = false;
+  return 0;
+ }
+ if(d_featureList == NULL) {
+  fprintf(stderr, "[FeatureTrackerKLT::setReidentification] ERROR. Call initialize() first.\n");
+  return -1;
+ }
+ d_reidContext = *rc;
+ d_reidOn = true;
+
+ // set up with the image size on the next frame, unless known
+ if( d_reid.isInitialized() )
+  return d_reid.initialize(d_reidContext, d_numFeatures, d_reid.getWidth(), d_reid.getHeight());
+ return 0;
+}
+
+
+//==============================================================================
+int FeatureTrackerKLT::reidentify(unsigned char *buf, int w, int h, feature_list_t &features)
+//==============================================================================
+{
+ if( !d_reid.isInitialized() 
+     && (d_reid.initialize(d_reidContext, d_numFeatures, w, h) != 0) )
+  return -1;
+
+ // restored features are tracked on from where they were found
+ int numRestored = d_reid.reidentify(buf, features);
+ for(int i = 0; i < numRestored; ++i) {
+  int slot = d_reid.getRestoredSlot(i);
+  d_featureList->feature[slot]->x = features.features[slot].x;
+  d_featureList->feature[slot]->y = features.features[slot].y;
+  d_featureList->feature[slot]->val = KLT_TRACKED;
+ }
+ return numRestored;
+}
+
+
+//==============================================================================
+int FeatureTrackerKLT::allocatePyramids(int w, int h)
+//==============================================================================
+{
+ if( d_tmpImage && ((d_tmpImage->ncols != w) || (d_tmpImage->nrows != h)) ) {
+  fprintf(stderr, "[FeatureTrackerKLT::allocatePyramids] ERROR. Image size changed.\n");
+  return -1;
+ }
+
+ // the third pyramid and the images are only needed for pipelining
+ int nLevels = d_kltc->nPyramidLevels;
+ int subsampling = d_kltc->subsampling;
+ if(d_tmpImage == NULL) {
+  d_tmpImage = _KLTCreateFloatImage(w, h);
+  d_floatImage = _KLTCreateFloatImage(w, h);
+ }
+ for(int i = 0; i < (d_pipelineOn ? 3 : 2); ++i) {
+  if(d_pyramid[i]) continue;
+  d_pyramid[i] = _KLTCreatePyramid(w, h, subsampling, nLevels);
+  d_gradx[i] = _KLTCreatePyramid(w, h, subsampling, nLevels);
+  d_grady[i] = _KLTCreatePyramid(w, h, subsampling, nLevels);
+ }
+ if( d_pipelineOn && (d_pipeImage[0] == NULL) ) {
+  d_pipeImage[0] = (unsigned char *)malloc(2 * w * h);
+  if(d_pipeImage[0] == NULL) {
+   fprintf(stderr, "[FeatureTrackerKLT::allocatePyramids] ERROR allocating memory.\n");
+   return -1;
+  }
+  d_pipeImage[1] = d_pipeImage[0] + w * h;
+ }
+ return 0;
+}
+
+
+//==============================================================================
+int FeatureTrackerKLT::buildPyramid(unsigned char *buf, int w, int h)
+//==============================================================================
+{
+ if( allocatePyramids(w, h) != 0 ) return -1;
+ int next = d_previous;
+ computePyramid(buf, next);
+ d_previous = d_current;
+ d_current = next;
+ return 0;
+}
+
+
+//==============================================================================
+void FeatureTrackerKLT::computePyramid(const unsigned char *buf, int index)
+//==============================================================================
+{
+ // smooth, subsample and differentiate as KLTTrackFeatures does. The KLT
+ // convolution routines cache kernels in globals, so this is not parallel,
+ // and takes turns with every other KLT tracker.
+ int w = d_tmpImage->ncols, h = d_tmpImage->nrows;
+ float smoothSigma = d_kltc->smooth_sigma_fact
+                     * ((d_kltc->window_width > d_kltc->window_height) ? 
+                        d_kltc->window_width : d_kltc->window_height);
+ pthread_mutex_lock(&s_kltLock);
+ _KLTToFloatImage((KLT_PixelType *)buf, w, h, d_tmpImage);
+ _KLTComputeSmoothedImage(d_tmpImage, smoothSigma, d_floatImage);
+ _KLTComputePyramid(d_floatImage, d_pyramid[index], d_kltc->pyramid_sigma_fact);
+ for(int i = 0; i < d_kltc->nPyramidLevels; ++i)
+  _KLTComputeGradients(d_pyramid[index]->img[i], d_kltc->grad_sigma,
+                       d_gradx[index]->img[i], d_grady[index]->img[i]);
+ pthread_mutex_unlock(&s_kltLock);
+}
+
+
+//==============================================================================
+void FeatureTrackerKLT::pyramidJob(void *arg)
+//==============================================================================
+{
+ // runs on the helper thread, alone in the KLT convolution routines
+ FeatureTrackerKLT *t = (FeatureTrackerKLT *)arg;
+ unsigned char *img = t->d_pipeImage[t->d_buildSlot];
+ memcpy(img, t->d_buildImage, t->d_tmpImage->ncols * t->d_tmpImage->nrows);
+ t->computePyramid(img, t->d_buildPyramid);
+}
+
+
+//==============================================================================
+int FeatureTrackerKLT::trackParallel()
+//==============================================================================
+{
+ int nPartitions = d_pool->getNumThreads() + 1;
+ int windowSize = d_kltc->window_width * d_kltc->window_height;
+
+ klt_partitions_t p;
+ p.tc = d_kltc;
+ p.features = d_active;
+ p.windows = d_windows;
+ if(d_arena) {
+  p.features = (KLT_Feature *)d_arena->allocate(d_numFeatures * sizeof(KLT_Feature));
+  p.windows = (float *)d_arena->allocate(3 * nPartitions * windowSize * sizeof(float), 64);
+  if( (p.features == NULL) || (p.windows == NULL) ) {
+   fprintf(stderr, "[FeatureTrackerKLT::trackParallel] ERROR. No scratch memory.\n");
+   return -1;
+  }
+ }
+
+ // lost features are not tracked, so leave them out of the partitions
+ int nActive = 0;
+ for(int i = 0; i < d_numFeatures; ++i)
+  if(d_featureList->feature[i]->val >= 0)
+   p.features[nActive++] = d_featureList->feature[i];
+ if(nActive == 0) return 0;
+
+ p.grain = (nActive + nPartitions - 1) / nPartitions;
+ p.pyramid1 = d_pyramid[d_previous];
+ p.gradx1 = d_gradx[d_previous];
+ p.grady1 = d_grady[d_previous];
+ p.pyramid2 = d_pyramid[d_current];
+ p.gradx2 = d_gradx[d_current];
+ p.grady2 = d_grady[d_current];
+ return d_pool->parallelFor(0, nActive, p.grain, trackPartition, &p);
+}
+
+
+//==============================================================================
+void FeatureTrackerKLT::freePyramids()
+//==============================================================================
+{
+ if(d_tmpImage) _KLTFreeFloatImage(d_tmpImage);
+ if(d_floatImage) _KLTFreeFloatImage(d_floatImage);
+ d_tmpImage = NULL;
+ d_floatImage = NULL;
+ for(int i = 0; i < 3; ++i) {
+  if(d_pyramid[i]) _KLTFreePyramid(d_pyramid[i]);
+  if(d_gradx[i]) _KLTFreePyramid(d_gradx[i]);
+  if(d_grady[i]) _KLTFreePyramid(d_grady[i]);
+  d_pyramid[i] = NULL;
+  d_gradx[i] = NULL;
+  d_grady[i] = NULL;
+ }
+ if(d_pipeImage[0]) free(d_pipeImage[0]);
+ d_pipeImage[0] = d_pipeImage[1] = NULL;
+}
+
+
 //==============================================================================
 int FeatureTrackerKLT::writeFeatureTable(const char *fileBaseName)
 //==============================================================================
 { 
  char name[80];
+ int nFrames = d_history.getNumFrames();
+ if(nFrames == 0) {
+  fprintf(stderr, "[FeatureTrackerKLT::writeFeatureTable] ERROR. No frames tracked yet.\n");
+  return -1;
+ }
+
+ // build a KLT table from the history only for the duration of the write
+ KLT_FeatureTable table = KLTCreateFeatureTable(nFrames, d_numFeatures);
+ int frame = d_history.getFirstFrameNumber();
+ for(int j = 0; j < nFrames; ++j, ++frame) {
+  const feature_t *f;
+  while( (f = d_history.getFrame(frame)) == NULL ) ++frame;
+  for(int i = 0; i < d_numFeatures; ++i) {
+   table->feature[i][j]->x = f[i].x;
+   table->feature[i][j]->y = f[i].y;
+   table->feature[i][j]->val = (f[i].val >= 0) ? f[i].val : KLT_NOT_FOUND;
+  }
+ }
+
  snprintf(name, 80, "%s.txt\0", fileBaseName);
- KLTWriteFeatureTable(d_featureTable, name, "%5.1f");
+ KLTWriteFeatureTable(table, name, "%5.1f");
  snprintf(name, 80, "%s.ft\0", fileBaseName);
- KLTWriteFeatureTable(d_featureTable, name, NULL);
+ KLTWriteFeatureTable(table, name, NULL);
+ KLTFreeFeatureTable(table);
  return 0;
 }
 
+
+//==============================================================================
+// trackPartition - track a range of features coarse to fine, as 
+// KLTTrackFeatures does for one feature
+//==============================================================================
+void trackPartition(int begin, int end, void *arg)
+{
+ klt_partitions_t *p = (klt_partitions_t *)arg;
+ KLT_TrackingContext tc = p->tc;
+ int windowSize = tc->window_width * tc->window_height;
+ float *imgdiff = p->windows + 3 * (begin / p->grain) * windowSize;
+ float *gradx = imgdiff + windowSize;
+ float *grady = gradx + windowSize;
+ float subsampling = (float)tc->subsampling;
+ int ncols = p->pyramid2->ncols[0];
+ int nrows = p->pyramid2->nrows[0];
+
+ for(int i = begin; i < end; ++i) {
+  KLT_Feature f = p->features[i];
+  float xloc = f->x;
+  float yloc = f->y;
+  int val = KLT_TRACKED;
+
+  // transform location to coarsest resolution
+  for(int r = tc->nPyramidLevels - 1; r >= 0; --r) {
+   xloc /= subsampling;
+   yloc /= subsampling;
+  }
+  float xlocout = xloc;
+  float ylocout = yloc;
+
+  // beginning with coarsest resolution, track and move to finer levels
+  for(int r = tc->nPyramidLevels - 1; r >= 0; --r) {
+   xloc *= subsampling;
+   yloc *= subsampling;
+   xlocout *= subsampling;
+   ylocout *= subsampling;
+   val = trackFeature(xloc, yloc, &xlocout, &ylocout,
+                      p->pyramid1->img[r], p->gradx1->img[r], p->grady1->img[r],
+                      p->pyramid2->img[r], p->gradx2->img[r], p->grady2->img[r],
+                      tc, imgdiff, gradx, grady);
+   if( (val == KLT_SMALL_DET) || (val == KLT_OOB) ) break;
+  }
+
+  // record feature
+  if( (val != KLT_OOB) && 
+      ((xlocout < tc->borderx) || (xlocout > ncols - 1 - tc->borderx) ||
+       (ylocout < tc->bordery) || (ylocout > nrows - 1 - tc->bordery)) )
+   val = KLT_OOB;
+  if(val == KLT_TRACKED) {
+   f->x = xlocout;
+   f->y = ylocout;
+  } else {
+   f->x = -1.0;
+   f->y = -1.0;
+  }
+  f->val = val;
+ }
+}
+
+
+//==============================================================================
+// trackFeature - track one feature at one pyramid level (_trackFeature in KLT)
+//==============================================================================
+int trackFeature(float x1, float y1, float *x2, float *y2,
+                 _KLT_FloatImage img1, _KLT_FloatImage gradx1, _KLT_FloatImage grady1,
+                 _KLT_FloatImage img2, _KLT_FloatImage gradx2, _KLT_FloatImage grady2,
+                 KLT_TrackingContext tc, float *imgdiff, float *gradx, float *grady)
+{
+ int width = tc->window_width;
+ int height = tc->window_height;
+ int n = width * height;
+ int hw = width/2;
+ int hh = height/2;
+ int nc = img1->ncols;
+ int nr = img1->nrows;
+ float onePlusEps = 1.001f;   // to prevent rounding errors
+ float gxx, gxy, gyy, ex, ey, dx = 0, dy = 0;
+ int iteration = 0;
+ int status = KLT_TRACKED;
+
+ do {
+  // if out of bounds, exit loop
+  if(  x1-hw < 0.0f || nc-( x1+hw) < onePlusEps ||
+      *x2-hw < 0.0f || nc-(*x2+hw) < onePlusEps ||
+       y1-hh < 0.0f || nr-( y1+hh) < onePlusEps ||
+      *y2-hh < 0.0f || nr-(*y2+hh) < onePlusEps ) {
+   status = KLT_OOB;
+   break;
+  }
+
+  // gradient and difference windows
+  intensityDifference(img1, img2, x1, y1, *x2, *y2, width, height, 
+                      tc->lighting_insensitive, imgdiff);
+  gradientSum(gradx1, grady1, gradx2, grady2, img1, img2, x1, y1, *x2, *y2, 
+              width, height, tc->lighting_insensitive, gradx, grady);
+
+  // 2x2 gradient matrix and 2x1 error vector
+  gxx = 0; gxy = 0; gyy = 0;
+  ex = 0; ey = 0;
+  for(int i = 0; i < n; ++i) {
+   gxx += gradx[i] * gradx[i];
+   gxy += gradx[i] * grady[i];
+   gyy += grady[i] * grady[i];
+   ex += imgdiff[i] * gradx[i];
+   ey += imgdiff[i] * grady[i];
+  }
+  ex *= tc->step_factor;
+  ey *= tc->step_factor;
+
+  // solve for new displacement
+  float det = gxx*gyy - gxy*gxy;
+  if(det < tc->min_determinant) {
+   status = KLT_SMALL_DET;
+   break;
+  }
+  dx = (gyy*ex - gxy*ey)/det;
+  dy = (gxx*ey - gxy*ex)/det;
+  *x2 += dx;
+  *y2 += dy;
+  iteration++;
+ } while( (fabs(dx) >= tc->min_displacement || fabs(dy) >= tc->min_displacement) 
+          && (iteration < tc->max_iterations) );
+
+ // check whether window is out of bounds
+ if( *x2-hw < 0.0f || nc-(*x2+hw) < onePlusEps || 
+     *y2-hh < 0.0f || nr-(*y2+hh) < onePlusEps )
+  status = KLT_OOB;
+
+ // check whether residue is too large
+ if(status == KLT_TRACKED) {
+  intensityDifference(img1, img2, x1, y1, *x2, *y2, width, height, 
+                      tc->lighting_insensitive, imgdiff);
+  float sum = 0;
+  for(int i = 0; i < n; ++i) sum += (float)fabs(imgdiff[i]);
+  if(sum/n > tc->max_residue) status = KLT_LARGE_RESIDUE;
+ }
+
+ if( (status == KLT_TRACKED) && (iteration >= tc->max_iterations) )
+  status = KLT_MAX_ITERATIONS;
+ return status;
+}
+
+
+//==============================================================================
+// interpolate - bilinear interpolation of image intensity
+//==============================================================================
+float interpolate(float x, float y, _KLT_FloatImage img)
+{
+ int xt = (int)x;  // coordinates of top-left corner
+ int yt = (int)y;
+ float ax = x - xt;
+ float ay = y - yt;
+ float *ptr = img->data + (img->ncols*yt) + xt;
+ return ( (1-ax) * (1-ay) * *ptr +
+          ax   * (1-ay) * *(ptr+1) +
+          (1-ax) *   ay   * *(ptr+(img->ncols)) +
+          ax   *   ay   * *(ptr+(img->ncols)+1) );
+}
+
+
+//==============================================================================
+// intensityDifference - difference between windows around a feature in
+// the two images
+//==============================================================================
+void intensityDifference(_KLT_FloatImage img1, _KLT_FloatImage img2,
+                         float x1, float y1, float x2, float y2,
+                         int width, int height, bool lightingInsensitive,
+                         float *imgdiff)
+{
+ int hw = width/2, hh = height/2;
+ float g1, g2;
+ float alpha = 1, beta = 0;
+
+ // gain and offset between the windows
+ if(lightingInsensitive) {
+  float sum1 = 0, sum2 = 0, sum1Squared = 0, sum2Squared = 0;
+  for(int j = -hh; j <= hh; ++j)
+   for(int i = -hw; i <= hw; ++i) {
+    g1 = interpolate(x1+i, y1+j, img1);
+    g2 = interpolate(x2+i, y2+j, img2);
+    sum1 += g1;
+    sum2 += g2;
+    sum1Squared += g1*g1;
+    sum2Squared += g2*g2;
+   }
+  alpha = (float)sqrt( (sum1Squared/(width*height)) / (sum2Squared/(width*height)) );
+  beta = sum1/(width*height) - alpha * (sum2/(width*height));
+ }
+
+ for(int j = -hh; j <= hh; ++j)
+  for(int i = -hw; i <= hw; ++i) {
+   g1 = interpolate(x1+i, y1+j, img1);
+   g2 = interpolate(x2+i, y2+j, img2);
+   *imgdiff++ = lightingInsensitive ? (g1 - g2*alpha - beta) : (g1 - g2);
+  }
+}
+
+
+//==============================================================================
+// gradientSum - sum of gradient windows around a feature in the two images
+//==============================================================================
+void gradientSum(_KLT_FloatImage gradx1, _KLT_FloatImage grady1,
+                 _KLT_FloatImage gradx2, _KLT_FloatImage grady2,
+                 _KLT_FloatImage img1, _KLT_FloatImage img2,
+                 float x1, float y1, float x2, float y2,
+                 int width, int height, bool lightingInsensitive,
+                 float *gradx, float *grady)
+{
+ int hw = width/2, hh = height/2;
+ float g1, g2;
+ float alpha = 1;
+
+ if(lightingInsensitive) {
+  float sum1 = 0, sum2 = 0;
+  for(int j = -hh; j <= hh; ++j)
+   for(int i = -hw; i <= hw; ++i) {
+    sum1 += interpolate(x1+i, y1+j, img1);
+    sum2 += interpolate(x2+i, y2+j, img2);
+   }
+  alpha = (float)sqrt( (sum1/(width*height)) / (sum2/(width*height)) );
+ }
+
+ for(int j = -hh; j <= hh; ++j)
+  for(int i = -hw; i <= hw; ++i) {
+   g1 = interpolate(x1+i, y1+j, gradx1);
+   g2 = interpolate(x2+i, y2+j, gradx2);
+   *gradx++ = g1 + g2*alpha;
+   g1 = interpolate(x1+i, y1+j, grady1);
+   g2 = interpolate(x2+i, y2+j, grady2);
+   *grady++ = g1 + g2*alpha;
+  }
+}
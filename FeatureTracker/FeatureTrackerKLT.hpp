@@ -7,9 +7,19 @@
 #define INCLUDED_FEATURETRACKERKLT_HPP
 
 #include "klt/klt.h"
+#include "klt/pyramid.h"
 #include <stdio.h>
 #include <malloc.h>
 #include "TrackerUtils.hpp"
+#include "FeatureTracker.hpp"
+#include "TrackHistory.hpp"
+#include "TrackLog.hpp"
+#include "FeatureReplenisher.hpp"
+#include "FeatureReidentifier.hpp"
+#include "RTUtils/PipelineStage.hpp"
+
+class TaskPool;
+class FrameArena;
 
 
 //==============================================================================
@@ -24,11 +34,30 @@
 // Image display and event handling routines use the SDL library . See:
 // http://www.libsdl.org. 
 //
+// Features can be tracked in parallel on a TaskPool (see setTaskPool()).
+// The image pyramid and its gradients are then computed once per frame 
+// and shared read-only, and the features are split into one partition per 
+// thread, each tracked with the same translational algorithm as 
+// KLTTrackFeatures(). Each feature is tracked independently of the others, 
+// so the results do not depend on the number of threads. In this mode, the
+// pyramid of each frame can also be built on a helper thread while the 
+// features of the previous frame are tracked, at the cost of one frame of
+// latency (see setPipelining()).
+//
+// The KLT library caches its convolution kernels in globals, so building
+// pyramids and selecting features take turns across all the KLT trackers
+// of a process (for instance the streams of a MultiStreamTracker), while
+// tracking on the pool still runs in parallel.
+//
+// Features lost for a few frames, for instance behind an occlusion, can be
+// found again by their appearance and restored to their original slots
+// (see setReidentification()).
+//
 // <b>Example Program:</b>
 // \include FeatureTrackerKLT.t.cpp
 //==============================================================================
 
-class FeatureTrackerKLT
+class FeatureTrackerKLT : public FeatureTracker
 {
  public:
   FeatureTrackerKLT();
@@ -36,6 +65,9 @@ class FeatureTrackerKLT
    
   ~FeatureTrackerKLT();
    // Destructor frees any allocated resources
+
+  virtual tracker_backend_t getBackend() const {return e_trackerKLT;}
+   //  return  e_trackerKLT.
    
   int initialize(FeatureTrackerContext_t &ftc, KLT_TrackingContext kltc);
    // Initialize the tracker. Call this method before calling 
@@ -43,8 +75,13 @@ class FeatureTrackerKLT
    //  ftc     settings specific to this class.
    //  kltc    KLT algorithm specific settings.
    //  return  0 on success, -1 on error (error message redirected to stderr).
+
+  inline void setContextOwnership(bool own) {d_ownsContext = own;}
+   // Free the KLT context given to initialize() in the destructor, once the
+   // pipeline helper (see setPipelining()) has stopped using it.
+   //  own     true to free it, false to leave it to the caller (default).
    
-  int processImage(unsigned char *img, int w, int h, feature_list_t &list);
+  virtual int processImage(unsigned char *img, int w, int h, feature_list_t &list);
    // Track features in the image buffer. Upon calling this method the first time, 
    // features are selected either automatically (if 'auto_select_features' was 
    // turned on during initialization) or by the user. If 'display_tracked_features' 
@@ -60,32 +97,144 @@ class FeatureTrackerKLT
    //  w,h       Image dimensions in pixels.
    //  list      List of tracked features. This list contains updated (x,y) locations
    //            of features and an integer value indicating whether the feature was 
-   //            tracked successfully (0) or not (-1). 
+   //            tracked successfully (e_tracked), was newly detected into this slot
+   //            (e_new) or was lost (e_lost). 
    //  return    current frame number on success (first frame = 1), -1 on error (error  
    //            message redirected to stderr), -2 on user initiated quit.
   
   int writeFeatureTable(const char *fileBaseName);
-   // Write the history of all tracked features into a feature table in ascii (.txt) 
+   // Write the history of tracked features into a feature table in ascii (.txt) 
    // and binary format (.ft). (See KLT library documentation for details on 
-   // reading from feature table). The number of records in this feature table 
-   // will be less than or equal to the 'num_frames' parameter in the  
-   // FeatureTrackerContext_t passed to initialize(). 
+   // reading from feature table). The table holds the frames currently in
+   // the track history, i.e., at most the 'num_frames' most recent frames 
+   // (see FeatureTrackerContext_t).
    //  fileBaseName  Base name of the file.
    //  return    0 on success, -1 on error (error message redirected to stderr).
    
+  virtual const TrackHistory &getTrackHistory() const {return d_history;}
+   //  return  The history of tracked features over recent frames. Frame 
+   //          numbers start at 0 for the first image processed.
+
+  virtual int openTrackLog(const char *fileName, int indexInterval = 30);
+   // Start logging tracked features from every subsequent call to 
+   // processImage() into a binary track log (see TrackLogWriter). Call 
+   // after initialize(). The log can be read with TrackLogReader.
+   //  fileName       Name of the log file.
+   //  indexInterval  Number of frames between commits of the log header.
+   //  return    0 on success, -1 on error (error message redirected to stderr).
+
+  virtual int closeTrackLog() {return d_log.close();}
+   // Stop logging and close the track log. Also done by the destructor.
+   //  return    0 on success, -1 on error (error message redirected to stderr).
+
+  virtual int setTaskPool(TaskPool *pool);
+   // Track features in parallel using a pool of worker threads. The pool 
+   // is shared, not owned. Call after initialize() and before the first 
+   // call to processImage(). The affine consistency check of the KLT library
+   // is not available in this mode.
+   //  pool    The task pool, or NULL to track with KLTTrackFeatures() in 
+   //          the calling thread (default). Not allowed while pipelining
+   //          is on.
+   //  return  0 on success, -1 on error (error message redirected to stderr).
+
+  void setFrameArena(FrameArena *arena) {d_arena = arena;}
+   // In parallel mode, take the per-frame partition tables and tracking 
+   // windows from frame scratch memory instead of memory owned by this object. 
+   // The arena must be reset by the caller after processImage() returns.
+   //  arena  The arena, or NULL to use memory owned by this object (default).
+
+  virtual int setReplenishment(const ReplenishContext_t *rc);
+   // Replace lost features in every frame after the first by selecting new
+   // features with KLTSelectGoodFeatures() in the grid cells that have no 
+   // features left (see FeatureReplenisher). New features are reported as 
+   // e_new. Call after initialize().
+   //  rc      Replenishment parameters, or NULL to turn replenishment off
+   //          (default).
+   //  return  0 on success, -1 on error (error message redirected to stderr).
+
+  virtual int setPipelining(bool on);
+   // In parallel mode (see setTaskPool()), build the pyramid of each image
+   // on a helper thread (see PipelineStage) while the features of the image
+   // passed in the previous call are tracked. Each call to processImage() 
+   // then copies its image in, and returns the features of the image passed
+   // in the previous call, i.e. one frame late: the first call returns 0 and
+   // leaves the list as it is, and a call with a NULL image returns the 
+   // features of the last image passed. The display, replenishment and 
+   // re-identification use the image the features belong to. Feature 
+   // selection and replenishment wait for the helper, since the KLT 
+   // convolution routines are not reentrant. Two images and three pyramids 
+   // are held in buffers allocated on the first frame. Call after 
+   // setTaskPool() and before the first call to processImage().
+   //  on      true to pipeline, false to process each image within its 
+   //          call (default).
+   //  return  0 on success, -1 on error (error message redirected to stderr).
+
+  virtual bool isPipelined() const {return d_pipelineOn;}
+   //  return  true if features are returned one frame late (see
+   //          setPipelining()).
+
+  virtual int setReidentification(const ReidContext_t *rc);
+   // Search for lost features near where they were lost, in the frames
+   // that follow, and restore those found to their slots as e_tracked, so
+   // that they keep their identity (see FeatureReidentifier). With
+   // replenishment on, the slots of features still searched for are 
+   // filled last. Call after initialize().
+   //  rc      Re-identification parameters, or NULL to turn it off
+   //          (default).
+   //  return  0 on success, -1 on error (error message redirected to stderr).
+   
  protected:
  private:
   SDLWindow d_display;
   SDL_Surface *d_screen;
   char d_message[80];
   KLT_TrackingContext d_kltc;
+  bool d_ownsContext;
   KLT_FeatureList d_featureList;
-  KLT_FeatureTable d_featureTable;
+  KLTFeatureListAdapter d_featureAdapter;
+  TrackHistory d_history;
+  TrackLogWriter d_log;
   int d_numFeatures;
   int d_numFrames;
   int d_frameNumber;
   bool d_autoSelect;
   bool d_displayOn;
+  int d_displayDecimation;
+  int allocatePyramids(int w, int h);
+  int buildPyramid(unsigned char *buf, int w, int h);
+  void computePyramid(const unsigned char *buf, int index);
+  static void pyramidJob(void *arg);
+  int trackParallel();
+  void freePyramids();
+  TaskPool *d_pool;
+  FrameArena *d_arena;
+  _KLT_FloatImage d_tmpImage;
+  _KLT_FloatImage d_floatImage;
+  _KLT_Pyramid d_pyramid[3];  // current and previous image, and the next 
+  _KLT_Pyramid d_gradx[3];    // one if pipelining
+  _KLT_Pyramid d_grady[3];
+  int d_current;              // index of pyramid of current image
+  int d_previous;             // index of pyramid of previous image
+  KLT_Feature *d_active;      // features not lost, in partition order
+  float *d_windows;           // tracking windows, three per partition
+  int replenish(unsigned char *buf, int w, int h, feature_list_t &list);
+  FeatureReplenisher d_replenisher;
+  ReplenishContext_t d_replenishContext;
+  bool d_replenishOn;
+  KLT_FeatureList d_cellFeatures;  // features selected in one grid cell
+  unsigned char *d_cellImage;      // grid cell and its margin
+  int d_cellImageSize;
+  int reidentify(unsigned char *buf, int w, int h, feature_list_t &list);
+  FeatureReidentifier d_reid;
+  ReidContext_t d_reidContext;
+  bool d_reidOn;
+  PipelineStage d_stage;
+  bool d_pipelineOn;
+  unsigned char *d_pipeImage[2];     // images in the pipeline
+  int d_pipeSlot;                    // image waiting to be tracked, or -1
+  const unsigned char *d_buildImage; // caller's image, copied in by the helper
+  int d_buildSlot;                   // image slot the helper fills
+  int d_buildPyramid;                // pyramid the helper computes
 };
 
 
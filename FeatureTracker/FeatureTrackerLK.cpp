@@ -0,0 +1,981 @@
+//==============================================================================
+// FeatureTrackerLK.cpp - Feature detection and pyramidal Lucas-Kanade tracking
+//                        with SIMD inner loops
+//==============================================================================
+
+#include "FeatureTrackerLK.hpp"
+#include "RTUtils/TaskPool.hpp"
+#include <math.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+//#define DEBUG
+
+// Bilinear weights are fixed-point with W_BITS fractional bits. Resampled
+// intensities keep 5 fractional bits, so that intensities, their
+// differences and gradients all fit in 16 bits.
+#define W_BITS 14
+#define DESCALE(x, n) (((x) + (1 << ((n) - 1))) >> (n))
+
+typedef struct _lk_frame
+{
+ const LKTrackingContext_t *tc;
+ int numLevels;
+ int maxLevels;                  // levels held per feature in the templates
+ const unsigned char **level;
+ const int *levelWidth, *levelHeight;
+ const int (*roi)[4];            // valid part of each level: x0, y0, x1, y1
+ feature_t *features;
+ short *templates;
+ float *inverses;
+ bool track;                     // track features, else only sample new ones
+}lk_frame_t;
+
+static void trackRange(int begin, int end, void *arg);
+static bool trackFeature(const lk_frame_t &f, int i);
+static bool sampleTemplate(const lk_frame_t &f, int i);
+static void bilinearWeights(float x, float y, int *ix, int *iy, int iw[4]);
+static void mismatch(const unsigned char *src, int stride, const int iw[4],
+                     const short *I, const short *Ix, const short *Iy, int win,
+                     float *b1, float *b2, int *absSum);
+static void downsample(const unsigned char *src, int sw, unsigned char *dst, int dstride,
+                       int dw, int dh);
+
+
+//==============================================================================
+FeatureTrackerLK::FeatureTrackerLK()
+//==============================================================================
+{
+ d_screen = NULL;
+ d_message[0] = '\0';
+ d_numFeatures = 0;
+ d_numFrames = 0;
+ d_frameNumber = 0;
+ d_autoSelect = true;
+ d_displayOn = true;
+ d_displayDecimation = 1;
+ d_width = d_height = 0;
+ d_numLevels = d_pyramidLevels = 0;
+ for(int i = 0; i < LK_MAX_LEVELS; ++i) {
+  d_level[i] = NULL;
+  d_levelWidth[i] = d_levelHeight[i] = 0;
+ }
+ d_levelData = NULL;
+ d_roiOn = false;
+ d_roiFull = true;
+ d_templates = NULL;
+ d_inverses = NULL;
+ d_cellCorners = NULL;
+ d_pool = NULL;
+ d_replenishOn = false;
+ d_maxIter = 0;
+ d_budgetOn = false;
+ d_pipelineOn = false;
+ d_pipeData = NULL;
+ for(int i = 0; i < 2; ++i)
+  for(int j = 0; j < LK_MAX_LEVELS; ++j)
+   d_pipeLevel[i][j] = NULL;
+ d_pipeSlot = -1;
+ d_buildImage = NULL;
+ d_buildSlot = 0;
+}
+
+
+//==============================================================================
+FeatureTrackerLK::~FeatureTrackerLK()
+//==============================================================================
+{
+ d_stage.shutdown();
+ freeFeatureList(d_features);
+ if(d_levelData) free(d_levelData);
+ if(d_pipeData) free(d_pipeData);
+ if(d_templates) free(d_templates);
+ if(d_inverses) free(d_inverses);
+ if(d_cellCorners) free(d_cellCorners);
+#ifdef DEBUG
+ fprintf(stderr, "[FeatureTrackerLK::~FeatureTrackerLK] Leaving.\n");
+#endif
+}
+
+
+//==============================================================================
+int FeatureTrackerLK::initialize(FeatureTrackerContext_t &ftc, LKTrackingContext_t &lkt)
+//==============================================================================
+{
+ if( (lkt.window_size < 3) || (lkt.window_size > LK_MAX_WINDOW) || (lkt.window_size % 2 != 1) ) {
+  fprintf(stderr, "[FeatureTrackerLK::initialize] ERROR. Window size must be odd, 3 to %d.\n",
+          LK_MAX_WINDOW);
+  return -1;
+ }
+ if( (lkt.num_levels < 1) || (lkt.num_levels > LK_MAX_LEVELS) ) {
+  fprintf(stderr, "[FeatureTrackerLK::initialize] ERROR. Number of levels must be 1 to %d.\n",
+          LK_MAX_LEVELS);
+  return -1;
+ }
+ if( (ftc.num_features < 1) || (lkt.max_iter < 1) ) {
+  fprintf(stderr, "[FeatureTrackerLK::initialize] ERROR. Invalid parameters.\n");
+  return -1;
+ }
+
+ d_trackingContext = lkt;
+ d_frameNumber = 0;
+ d_pipeSlot = -1;
+ d_numFeatures = ftc.num_features;
+ d_numFrames = ftc.num_frames;
+ d_autoSelect = ftc.auto_select_features;
+ d_displayOn = ftc.display_tracked_features;
+ d_displayDecimation = (ftc.display_decimation > 0) ? ftc.display_decimation : 1;
+
+ freeFeatureList(d_features);
+ if(d_templates) free(d_templates);
+ if(d_inverses) free(d_inverses);
+ int n = lkt.window_size * lkt.window_size;
+ d_templates = (short *)malloc(d_numFeatures * lkt.num_levels * 3 * n * sizeof(short));
+ d_inverses = (float *)malloc(d_numFeatures * lkt.num_levels * 4 * sizeof(float));
+ if( (allocateFeatureList(d_features, d_numFeatures) < 0) || !d_templates || !d_inverses ) {
+  fprintf(stderr, "[FeatureTrackerLK::initialize] ERROR in memory allocation.\n");
+  return -1;
+ }
+
+ if( d_history.initialize(d_numFeatures, d_numFrames, ftc.history_bytes) != 0 )
+  return -1;
+
+ // full effort until a latency target is set
+ d_maxIter = lkt.max_iter;
+ d_budgetOn = false;
+ return d_budget.initialize(BudgetContext_t(), d_numFeatures, d_maxIter, lkt.num_levels);
+}
+
+
+//==============================================================================
+int FeatureTrackerLK::processImage(unsigned char *buf, int w, int h, feature_list_t &features)
+//==============================================================================
+{
+ if( features.num_features != d_numFeatures ) {
+  fprintf(stderr, "[FeatureTrackerLK::processImage] ERROR. Feature list size mismatch ->\n");
+  fprintf(stderr, "-> Specified feature list (arg 4) holds %d features, but we are tracking %d features.\n",
+  features.num_features, d_numFeatures);
+  return -1;
+ }
+
+ // check if initialize() was called
+ if( d_templates == NULL ) {
+  fprintf(stderr, "%s\n", "[FeatureTrackerLK::processImage] ERROR. Must call initialize first.");
+  return -1;
+ }
+
+ // with pipelining, no image flushes the one left in the pipeline
+ if(buf == NULL) {
+  if(!d_pipelineOn) {
+   fprintf(stderr, "[FeatureTrackerLK::processImage] ERROR. No image.\n");
+   return -1;
+  }
+  if(d_pipeSlot < 0) return 0;
+ }
+
+ if(d_budgetOn) d_budget.beginFrame();
+ if( (d_frameNumber == 0) && (d_pipeSlot < 0) ) {
+  if( allocateBuffers(w, h) != 0 ) return -1;
+ } else if( (w != d_width) || (h != d_height) ) {
+  fprintf(stderr, "[FeatureTrackerLK::processImage] ERROR. Image size changed.\n");
+  return -1;
+ }
+ applyOperatingPoint();
+
+ int ret;
+ if(!d_pipelineOn) {
+  setROI( d_roiOn && (d_frameNumber > 0) );
+  buildPyramid(buf);
+  ret = processFrame(buf, features);
+ } else {
+  if( (d_pipeData == NULL) && (allocatePipeline() != 0) ) return -1;
+
+  // the helper copies this image in and builds its pyramid, while the 
+  // image of the last call is processed
+  int slot = d_pipeSlot;
+  if(buf != NULL) {
+   d_buildImage = buf;
+   d_buildSlot = (slot == 0) ? 1 : 0;
+   if( d_stage.start(pyramidJob, this) != 0 ) return -1;
+  }
+  ret = 0;
+  if(slot >= 0) {
+   setROI(false);
+   for(int i = 0; i < d_pyramidLevels; ++i)
+    d_level[i] = d_pipeLevel[slot][i];
+   ret = processFrame(d_pipeLevel[slot][0], features);
+  }
+  d_stage.wait();
+  d_pipeSlot = (buf != NULL) ? d_buildSlot : -1;
+  if(slot < 0) return 0;
+ }
+ if(ret < 0) return ret;
+
+ if(d_budgetOn) d_budget.endFrame();
+ return ret;
+}
+
+
+//==============================================================================
+int FeatureTrackerLK::processFrame(unsigned char *buf, feature_list_t &features)
+//==============================================================================
+{
+ SDL_Event event;
+ float x = 0;
+ float y = 0;
+ int w = d_width;
+ int h = d_height;
+
+ // first frame - select features
+ if(d_frameNumber == 0) {
+  int numSelected = 0;
+  if(d_autoSelect) { // automatic initialization
+   for(int i = 0; i < d_numFeatures; ++i)
+    d_features.features[i].val = e_lost;
+   numSelected = d_detector.detect(buf, d_features);
+   if(numSelected < 0) return -1;
+  } else {  // manual initialization
+   // initialize display
+   if( d_display.init(w, h, "FeatureTrackerLK") != 0) return -1;
+   d_screen = d_display.getScreenPointer();
+
+   // img->SDL surface
+   snprintf(d_message, 80, "ATTENTION: Please select %d feature points", d_numFeatures);
+   if( d_display.updateScreenBuffer((char *)buf, w, h, 1, d_message) != 0) return -1;
+   d_display.refresh();
+
+   // let user select features
+   while( (numSelected < d_numFeatures) && SDL_WaitEvent(&event)  ) {
+    switch(event.type) {
+     case SDL_MOUSEBUTTONDOWN:
+      x = event.button.x;
+      y = event.button.y;
+      fprintf(stdout, "Selected feature %3d at (%6.2f, %6.2f)\n", numSelected, x, y);
+      d_features.features[numSelected].x = x;
+      d_features.features[numSelected].y = y;
+      d_features.features[numSelected].val = e_new;
+      ++numSelected;
+      boxColor(d_screen, (short)x-2, (short)y-2, (short)x+2, (short)y+2, 0xff0000ff);
+      d_display.refresh();
+     break;
+     case SDL_QUIT:
+      fprintf(stdout, "\n[FeatureTrackerLK::processImage] I was asked to quit!\n");
+      d_displayOn = false;
+      return -2;
+     break;
+     default:
+     break;
+    }
+   }
+  }
+  for(int i = numSelected; i < d_numFeatures; ++i) {
+   // the detector fills slots in order
+   d_features.features[i].x = 0;
+   d_features.features[i].y = 0;
+   d_features.features[i].val = e_lost;
+  }
+ } else if( trackFeatures() != 0 ) {
+  return -1;
+ }
+ if( d_replenishOn && (d_frameNumber > 0) && (replenish(d_features) != 0) ) return -1;
+
+ // templates for the next frame, for features that were not tracked
+ lk_frame_t f;
+ f.tc = &d_trackingContext;
+ f.numLevels = d_numLevels;
+ f.maxLevels = d_trackingContext.num_levels;
+ f.level = d_level;
+ f.levelWidth = d_levelWidth;
+ f.levelHeight = d_levelHeight;
+ f.roi = d_roi;
+ f.features = d_features.features;
+ f.templates = d_templates;
+ f.inverses = d_inverses;
+ f.track = false;
+ trackRange(0, d_numFeatures, &f);
+
+ // prepare screen display (decimated)
+ bool display = d_displayOn && (d_frameNumber % d_displayDecimation == 0);
+ if(display) {
+  if(d_screen == NULL) if( d_display.init(w, h, "FeatureTrackerLK") != 0) return -1;
+  if( d_display.updateScreenBuffer((char *)buf, w, h, 1, NULL) != 0) return -1;
+  d_screen = d_display.getScreenPointer();
+ }
+
+ // copy features to external list
+ int numTracked = 0;
+ for(int i = 0; i < d_numFeatures; ++i) {
+  features.features[i] = d_features.features[i];
+  if(features.features[i].val >= 0) ++numTracked;
+ }
+ if( d_history.record(features, d_frameNumber) != 0 ) return -1;
+ if( d_log.isOpen() && (d_log.append(features, d_frameNumber) != 0) ) return -1;
+ if(display) {
+  d_display.drawFeatures(features);
+  snprintf(d_message, 80, "Features tracked: %d/%d", numTracked, d_numFeatures);
+  stringColor(d_screen, 2, h-10, d_message, 0xfd1b04FF);
+  d_display.refresh();
+ }
+
+ // handle user quit
+ while( SDL_PollEvent(&event)  ) {
+  if(event.type == SDL_QUIT) {
+   fprintf(stdout, "\n[FeatureTrackerLK::processImage] I was asked to quit!\n");
+   return -2;
+  }
+ }
+
+ ++d_frameNumber;
+ return d_frameNumber;
+}
+
+
+//==============================================================================
+int FeatureTrackerLK::openTrackLog(const char *fileName, int indexInterval)
+//==============================================================================
+{
+ if(d_numFeatures <= 0) {
+  fprintf(stderr, "[FeatureTrackerLK::openTrackLog] ERROR. Call initialize() first.\n");
+  return -1;
+ }
+ return d_log.open(fileName, d_numFeatures, indexInterval);
+}
+
+
+//==============================================================================
+int FeatureTrackerLK::setReplenishment(const ReplenishContext_t *rc)
+//==============================================================================
+{
+ if(rc == NULL) {
+  d_replenishOn = false;
+  return 0;
+ }
+ if(d_numFeatures <= 0) {
+  fprintf(stderr, "[FeatureTrackerLK::setReplenishment] ERROR. Call initialize() first.\n");
+  return -1;
+ }
+ if(rc->max_per_cell < 1) {
+  fprintf(stderr, "[FeatureTrackerLK::setReplenishment] ERROR. Invalid replenishment parameters.\n");
+  return -1;
+ }
+ feature_t *corners = (feature_t *)realloc(d_cellCorners, rc->max_per_cell * sizeof(feature_t));
+ if(corners == NULL) {
+  fprintf(stderr, "[FeatureTrackerLK::setReplenishment] ERROR in memory allocation.\n");
+  return -1;
+ }
+ d_cellCorners = corners;
+ d_replenishContext = *rc;
+ d_replenishOn = true;
+
+ // the grid is set up with the image size on the next frame, unless known
+ if( d_replenisher.isInitialized() )
+  return d_replenisher.initialize(d_replenishContext, d_numFeatures,
+                                  d_replenisher.getWidth(), d_replenisher.getHeight());
+ return 0;
+}
+
+
+//==============================================================================
+int FeatureTrackerLK::setLatencyTarget(const BudgetContext_t *bc)
+//==============================================================================
+{
+ if(d_numFeatures <= 0) {
+  fprintf(stderr, "[FeatureTrackerLK::setLatencyTarget] ERROR. Call initialize() first.\n");
+  return -1;
+ }
+ d_budgetOn = false;
+ if(bc == NULL)
+  return d_budget.initialize(BudgetContext_t(), d_numFeatures, d_maxIter, 
+                             d_trackingContext.num_levels);
+ if( d_budget.initialize(*bc, d_numFeatures, d_maxIter, d_trackingContext.num_levels) != 0 )
+  return -1;
+ d_budgetOn = true;
+ return 0;
+}
+
+
+//==============================================================================
+int FeatureTrackerLK::setPipelining(bool on)
+//==============================================================================
+{
+ if(d_numFeatures <= 0) {
+  fprintf(stderr, "[FeatureTrackerLK::setPipelining] ERROR. Call initialize() first.\n");
+  return -1;
+ }
+ if( (d_frameNumber != 0) || (d_pipeSlot >= 0) ) {
+  fprintf(stderr, "[FeatureTrackerLK::setPipelining] ERROR. Tracking has already started.\n");
+  return -1;
+ }
+ if(!on) {
+  d_stage.shutdown();
+  d_pipelineOn = false;
+  return 0;
+ }
+ if( !d_stage.isRunning() && (d_stage.initialize() != 0) )
+  return -1;
+ d_pipelineOn = true;
+ return 0;
+}
+
+
+//==============================================================================
+int FeatureTrackerLK::allocateBuffers(int w, int h)
+//==============================================================================
+{
+ if( (w == d_width) && (h == d_height) ) return 0;
+
+ // stop at the level on which a window with its border no longer fits
+ int win = d_trackingContext.window_size;
+ int size = 0;
+ d_numLevels = 1;
+ d_levelWidth[0] = w;
+ d_levelHeight[0] = h;
+ while( (d_numLevels < d_trackingContext.num_levels)
+        && (d_levelWidth[d_numLevels - 1] / 2 >= win + 3)
+        && (d_levelHeight[d_numLevels - 1] / 2 >= win + 3) ) {
+  d_levelWidth[d_numLevels] = d_levelWidth[d_numLevels - 1] / 2;
+  d_levelHeight[d_numLevels] = d_levelHeight[d_numLevels - 1] / 2;
+  size += d_levelWidth[d_numLevels] * d_levelHeight[d_numLevels];
+  ++d_numLevels;
+ }
+ d_pyramidLevels = d_numLevels;
+
+ if(d_levelData) free(d_levelData);
+ if(d_pipeData) free(d_pipeData);
+ d_pipeData = NULL;
+ d_levelData = (unsigned char *)malloc(size ? size : 1);
+ if( !d_levelData ) {
+  fprintf(stderr, "[FeatureTrackerLK::allocateBuffers] ERROR in memory allocation.\n");
+  d_width = d_height = 0;
+  return -1;
+ }
+ unsigned char *p = d_levelData;
+ for(int i = 1; i < d_numLevels; ++i) {
+  d_level[i] = p;
+  p += d_levelWidth[i] * d_levelHeight[i];
+ }
+ d_width = w;
+ d_height = h;
+
+ // about one cell per feature; features must be trackable, i.e. their 
+ // window with its border fits in the image
+ CornerDetectorContext_t dc;
+ dc.cell_size = (int)sqrtf((float)w * h / d_numFeatures);
+ if(dc.cell_size < 8) dc.cell_size = 8;
+ dc.max_per_cell = 2;
+ dc.quality = d_trackingContext.quality;
+ dc.min_eigenvalue = d_trackingContext.min_eigenvalue;
+ dc.min_dist = d_trackingContext.min_dist;
+ dc.border = win / 2 + 2;
+ return d_detector.initialize(dc, w, h);
+}
+
+
+//==============================================================================
+int FeatureTrackerLK::allocatePipeline()
+//==============================================================================
+{
+ // all levels, since the number in use may change while an image waits
+ int size = 0;
+ for(int i = 0; i < d_pyramidLevels; ++i)
+  size += d_levelWidth[i] * d_levelHeight[i];
+ d_pipeData = (unsigned char *)malloc(2 * size);
+ if( !d_pipeData ) {
+  fprintf(stderr, "[FeatureTrackerLK::allocatePipeline] ERROR in memory allocation.\n");
+  return -1;
+ }
+ unsigned char *p = d_pipeData;
+ for(int s = 0; s < 2; ++s) {
+  for(int i = 0; i < d_pyramidLevels; ++i) {
+   d_pipeLevel[s][i] = p;
+   p += d_levelWidth[i] * d_levelHeight[i];
+  }
+ }
+ return 0;
+}
+
+
+//==============================================================================
+void FeatureTrackerLK::applyOperatingPoint()
+//==============================================================================
+{
+ // Fewer levels are tracked from the top down; templates of the levels
+ // above are not sampled, and are skipped when the levels come back.
+ const budget_point_t &p = d_budget.getOperatingPoint();
+ d_trackingContext.max_iter = p.max_iter;
+ d_numLevels = (p.num_levels < d_pyramidLevels) ? p.num_levels : d_pyramidLevels;
+
+ // features in the slots out of use are dropped
+ for(int i = p.num_features; i < d_numFeatures; ++i) {
+  feature_t &f = d_features.features[i];
+  if(f.val < 0) continue;
+  f.x = 0;
+  f.y = 0;
+  f.val = e_lost;
+ }
+}
+
+
+//==============================================================================
+void FeatureTrackerLK::setROI(bool restrict)
+//==============================================================================
+{
+ d_roiFull = true;
+
+ // bounding box of the live features
+ float x0 = (float)d_width, y0 = (float)d_height, x1 = -1, y1 = -1;
+ if(restrict) {
+  for(int i = 0; i < d_numFeatures; ++i) {
+   const feature_t &p = d_features.features[i];
+   if(p.val < 0) continue;
+   if(p.x < x0) x0 = p.x;
+   if(p.x > x1) x1 = p.x;
+   if(p.y < y0) y0 = p.y;
+   if(p.y > y1) y1 = p.y;
+  }
+ }
+
+ // Expand the box on every level by the search radius, i.e. how far a 
+ // feature can move over all levels, plus the window and its border. 
+ // Coarse to fine, since each level must also hold the pixels that the
+ // window of the next coarser level is averaged from.
+ if(x1 >= 0) {
+  int r = d_trackingContext.window_size / 2;
+  float radius = (float)(r * ((1 << d_numLevels) - 1));
+  d_roiFull = false;
+  for(int l = d_numLevels - 1; l >= 0; --l) {
+   float s = 1.0f / (1 << l);
+   float m = radius * s + r + 2;
+   int *roi = d_roi[l];
+   roi[0] = (int)floorf(x0 * s - m);
+   roi[1] = (int)floorf(y0 * s - m);
+   roi[2] = (int)ceilf(x1 * s + m) + 1;
+   roi[3] = (int)ceilf(y1 * s + m) + 1;
+   if(l < d_numLevels - 1) {
+    const int *coarse = d_roi[l + 1];
+    if(2 * coarse[0] < roi[0]) roi[0] = 2 * coarse[0];
+    if(2 * coarse[1] < roi[1]) roi[1] = 2 * coarse[1];
+    if(2 * coarse[2] > roi[2]) roi[2] = 2 * coarse[2];
+    if(2 * coarse[3] > roi[3]) roi[3] = 2 * coarse[3];
+   }
+   // features near the edge; the window would be most of the image anyway
+   if( (roi[0] < 0) || (roi[1] < 0) || (roi[2] > d_levelWidth[l]) || (roi[3] > d_levelHeight[l]) ) {
+    d_roiFull = true;
+    break;
+   }
+  }
+ }
+
+ if(d_roiFull) {
+  for(int l = 0; l < d_numLevels; ++l) {
+   d_roi[l][0] = 0;
+   d_roi[l][1] = 0;
+   d_roi[l][2] = d_levelWidth[l];
+   d_roi[l][3] = d_levelHeight[l];
+  }
+ }
+}
+
+
+//==============================================================================
+void FeatureTrackerLK::buildPyramid(unsigned char *buf)
+//==============================================================================
+{
+ d_level[0] = buf;
+ for(int i = 1; i < d_numLevels; ++i) {
+  const int *roi = d_roi[i];
+  int sw = d_levelWidth[i - 1], dw = d_levelWidth[i];
+  downsample(d_level[i - 1] + 2 * (roi[1] * sw + roi[0]), sw,
+             (unsigned char *)d_level[i] + roi[1] * dw + roi[0], dw,
+             roi[2] - roi[0], roi[3] - roi[1]);
+ }
+}
+
+
+//==============================================================================
+void FeatureTrackerLK::pyramidJob(void *arg)
+//==============================================================================
+{
+ // runs on the helper thread, which only reads the level dimensions
+ FeatureTrackerLK *t = (FeatureTrackerLK *)arg;
+ unsigned char **level = t->d_pipeLevel[t->d_buildSlot];
+ memcpy(level[0], t->d_buildImage, t->d_width * t->d_height);
+ for(int i = 1; i < t->d_pyramidLevels; ++i)
+  downsample(level[i - 1], t->d_levelWidth[i - 1], level[i], t->d_levelWidth[i],
+             t->d_levelWidth[i], t->d_levelHeight[i]);
+}
+
+
+//==============================================================================
+bool FeatureTrackerLK::insideROI(float x, float y) const
+//==============================================================================
+{
+ if(d_roiFull) return true;
+ int b = d_trackingContext.window_size / 2 + 2;
+ for(int l = 0; l < d_numLevels; ++l) {
+  float s = 1.0f / (1 << l);
+  const int *roi = d_roi[l];
+  if( (x * s < roi[0] + b) || (y * s < roi[1] + b) || (x * s >= roi[2] - b) 
+      || (y * s >= roi[3] - b) )
+   return false;
+ }
+ return true;
+}
+
+
+//==============================================================================
+int FeatureTrackerLK::trackFeatures()
+//==============================================================================
+{
+ lk_frame_t f;
+ f.tc = &d_trackingContext;
+ f.numLevels = d_numLevels;
+ f.maxLevels = d_trackingContext.num_levels;
+ f.level = d_level;
+ f.levelWidth = d_levelWidth;
+ f.levelHeight = d_levelHeight;
+ f.roi = d_roi;
+ f.features = d_features.features;
+ f.templates = d_templates;
+ f.inverses = d_inverses;
+ f.track = true;
+ if(d_pool == NULL) {
+  trackRange(0, d_numFeatures, &f);
+  return 0;
+ }
+ int nPartitions = d_pool->getNumThreads() + 1;
+ int grain = (d_numFeatures + nPartitions - 1) / nPartitions;
+ return d_pool->parallelFor(0, d_numFeatures, grain, trackRange, &f);
+}
+
+
+//==============================================================================
+int FeatureTrackerLK::replenish(feature_list_t &features)
+//==============================================================================
+{
+ if( !d_replenisher.isInitialized()
+     && (d_replenisher.initialize(d_replenishContext, d_numFeatures, d_width, d_height) != 0) )
+  return -1;
+
+ int numFree = d_replenisher.beginFrame(features, d_budget.getOperatingPoint().num_features);
+ if(numFree <= 0) return numFree;
+
+ // with a region of interest, only cells in it, where the pyramid is built
+ int x, y, cw, ch;
+ while( d_replenisher.nextCell(x, y, cw, ch) ) {
+  if( !d_roiFull && ((x + cw <= d_roi[0][0]) || (y + ch <= d_roi[0][1]) 
+                     || (x >= d_roi[0][2]) || (y >= d_roi[0][3])) )
+   continue;
+  int n = d_detector.detectInRect(d_level[0], x, y, cw, ch, d_replenisher.getMaxPerCell(),
+                                  d_cellCorners);
+  for(int i = 0; i < n; ++i) {
+   if( !insideROI(d_cellCorners[i].x, d_cellCorners[i].y) ) continue;
+   int slot = d_replenisher.addFeature(d_cellCorners[i].x, d_cellCorners[i].y);
+   if(slot >= 0) features.features[slot] = d_cellCorners[i];
+  }
+ }
+ return 0;
+}
+
+
+//==============================================================================
+// trackRange - track features [begin, end) and sample their templates anew
+//==============================================================================
+void trackRange(int begin, int end, void *arg)
+{
+ const lk_frame_t &f = *(const lk_frame_t *)arg;
+ for(int i = begin; i < end; ++i) {
+  feature_t &p = f.features[i];
+  if(f.track) {
+   if(p.val < 0) continue;
+   p.val = trackFeature(f, i) ? e_tracked : e_lost;
+  } else if(p.val != e_new) {
+   continue;
+  }
+  if( (p.val >= 0) && !sampleTemplate(f, i) ) p.val = e_lost;
+  if(p.val < 0) {
+   p.x = 0;
+   p.y = 0;
+  }
+ }
+}
+
+
+//==============================================================================
+// trackFeature - move feature i from the position of its template to its
+// position in the current pyramid, coarse to fine
+//==============================================================================
+bool trackFeature(const lk_frame_t &f, int i)
+{
+ const LKTrackingContext_t &tc = *f.tc;
+ int win = tc.window_size, r = win / 2, n = win * win;
+ float eps2 = (float)(tc.epsilon * tc.epsilon);
+ feature_t &p = f.features[i];
+ int top = f.numLevels - 1;
+ float scale = 1.0f / (1 << top);
+ float x = (p.x + 0.5f) * scale - 0.5f;
+ float y = (p.y + 0.5f) * scale - 0.5f;
+ int absSum = 0;
+
+ for(int l = top; l >= 0; --l) {
+  if(l < top) {
+   x = 2 * x + 0.5f;
+   y = 2 * y + 0.5f;
+  }
+  const float *inv = f.inverses + (i * f.maxLevels + l) * 4;
+  if(inv[3] == 0) continue;  // too little texture on this level
+  const short *I = f.templates + (i * f.maxLevels + l) * 3 * n;
+  int wl = f.levelWidth[l];
+  const int *roi = f.roi[l];
+  for(int iter = 0; iter < tc.max_iter; ++iter) {
+   int ix, iy, iw[4];
+   bilinearWeights(x - r, y - r, &ix, &iy, iw);
+   if( (ix < roi[0]) || (iy < roi[1]) || (ix + win >= roi[2]) || (iy + win >= roi[3]) )
+    return false;
+   float b1, b2;
+   mismatch(f.level[l] + iy * wl + ix, wl, iw, I, I + n, I + 2 * n, win, &b1, &b2, &absSum);
+   // intensities carry 5 fractional bits and gradients are over 2 pixels,
+   // so the scaled b and G give twice the step
+   float dx = -2 * (inv[0] * b1 + inv[1] * b2);
+   float dy = -2 * (inv[1] * b1 + inv[2] * b2);
+   x += dx;
+   y += dy;
+   if(dx * dx + dy * dy < eps2) break;
+  }
+ }
+ if(f.inverses[i * f.maxLevels * 4 + 3] == 0) return false;
+ if(absSum > tc.max_residual * 32 * n) return false;
+ if( (x < 0) || (y < 0) || (x > f.levelWidth[0] - 1) || (y > f.levelHeight[0] - 1) )
+  return false;
+ p.x = x;
+ p.y = y;
+ return true;
+}
+
+
+//==============================================================================
+// sampleTemplate - resample the window around feature i on every level, with
+// its gradients and the inverse of its gradient matrix
+//==============================================================================
+bool sampleTemplate(const lk_frame_t &f, int i)
+{
+ const LKTrackingContext_t &tc = *f.tc;
+ int win = tc.window_size, r = win / 2, n = win * win;
+ int pw = win + 2;
+ short patch[(LK_MAX_WINDOW + 2) * (LK_MAX_WINDOW + 2)];
+ const feature_t &p = f.features[i];
+
+ for(int l = 0; l < f.maxLevels; ++l) {
+  float *inv = f.inverses + (i * f.maxLevels + l) * 4;
+  inv[0] = inv[1] = inv[2] = inv[3] = 0;
+  if(l >= f.numLevels) continue;
+
+  // the window and a 1 pixel border for the gradients
+  float scale = 1.0f / (1 << l);
+  int ix, iy, iw[4];
+  bilinearWeights((p.x + 0.5f) * scale - 0.5f - r - 1, (p.y + 0.5f) * scale - 0.5f - r - 1,
+                  &ix, &iy, iw);
+  int wl = f.levelWidth[l];
+  const int *roi = f.roi[l];
+  if( (ix < roi[0]) || (iy < roi[1]) || (ix + pw >= roi[2]) || (iy + pw >= roi[3]) ) continue;
+  const unsigned char *src = f.level[l] + iy * wl + ix;
+  for(int y = 0; y < pw; ++y, src += wl) {
+   for(int x = 0; x < pw; ++x) {
+    int v = src[x] * iw[0] + src[x + 1] * iw[1] + src[x + wl] * iw[2] + src[x + wl + 1] * iw[3];
+    patch[y * pw + x] = (short)DESCALE(v, W_BITS - 5);
+   }
+  }
+
+  short *I = f.templates + (i * f.maxLevels + l) * 3 * n;
+  short *Ix = I + n, *Iy = I + 2 * n;
+  double a11 = 0, a12 = 0, a22 = 0;
+  for(int y = 0; y < win; ++y) {
+   for(int x = 0; x < win; ++x) {
+    const short *c = patch + (y + 1) * pw + x + 1;
+    int gx = c[1] - c[-1];
+    int gy = c[pw] - c[-pw];
+    I[y * win + x] = c[0];
+    Ix[y * win + x] = (short)gx;
+    Iy[y * win + x] = (short)gy;
+    a11 += gx * gx;
+    a12 += gx * gy;
+    a22 += gy * gy;
+   }
+  }
+
+  // smallest eigenvalue per pixel; gradients are 64 times grey levels/pixel
+  double t = (a11 + a22) * 0.5;
+  double d = sqrt((a11 - a22) * (a11 - a22) * 0.25 + a12 * a12);
+  if( (t - d) / (4096.0 * n) < tc.min_eigenvalue ) continue;
+  double det = a11 * a22 - a12 * a12;
+  inv[0] = (float)(a22 / det);
+  inv[1] = (float)(-a12 / det);
+  inv[2] = (float)(a11 / det);
+  inv[3] = 1;
+ }
+ return f.inverses[i * f.maxLevels * 4 + 3] != 0;
+}
+
+
+//==============================================================================
+// bilinearWeights - integer position and fixed-point weights of (x, y)
+//==============================================================================
+void bilinearWeights(float x, float y, int *ix, int *iy, int iw[4])
+{
+ float fx = floorf(x), fy = floorf(y);
+ float a = x - fx, b = y - fy;
+ *ix = (int)fx;
+ *iy = (int)fy;
+ iw[0] = (int)((1 - a) * (1 - b) * (1 << W_BITS) + 0.5f);
+ iw[1] = (int)(a * (1 - b) * (1 << W_BITS) + 0.5f);
+ iw[2] = (int)((1 - a) * b * (1 << W_BITS) + 0.5f);
+ iw[3] = (1 << W_BITS) - iw[0] - iw[1] - iw[2];
+}
+
+
+//==============================================================================
+// mismatch - resample a window of the current image at the bilinear weights
+// 'iw' and accumulate b = sum (J - I) * grad(I) and sum |J - I|
+//==============================================================================
+void mismatch(const unsigned char *src, int stride, const int iw[4],
+              const short *I, const short *Ix, const short *Iy, int win,
+              float *b1, float *b2, int *absSum)
+{
+ float s1 = 0, s2 = 0;
+ int sa = 0;
+#ifdef __AVX2__
+ __m256i qw0 = _mm256_set1_epi32(iw[0] + (iw[1] << 16));
+ __m256i qw1 = _mm256_set1_epi32(iw[2] + (iw[3] << 16));
+ __m256i qdelta = _mm256_set1_epi32(1 << (W_BITS - 5 - 1));
+ __m256i ones = _mm256_set1_epi16(1);
+ __m256 qb1 = _mm256_setzero_ps(), qb2 = _mm256_setzero_ps();
+ __m256i qa = _mm256_setzero_si256();
+#endif
+#ifdef __SSE2__
+ __m128i z = _mm_setzero_si128();
+ __m128i pw0 = _mm_set1_epi32(iw[0] + (iw[1] << 16));
+ __m128i pw1 = _mm_set1_epi32(iw[2] + (iw[3] << 16));
+ __m128i pdelta = _mm_set1_epi32(1 << (W_BITS - 5 - 1));
+ __m128i pones = _mm_set1_epi16(1);
+ __m128 pb1 = _mm_setzero_ps(), pb2 = _mm_setzero_ps();
+ __m128i pa = _mm_setzero_si128();
+#endif
+
+ for(int y = 0; y < win; ++y, src += stride, I += win, Ix += win, Iy += win) {
+  int x = 0;
+#ifdef __AVX2__
+  // 16 pixels; unpack and pack both work within 128 bit lanes, so the
+  // pixels come out in order
+  for(; x <= win - 16; x += 16) {
+   __m256i v00 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(src + x)));
+   __m256i v01 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(src + x + 1)));
+   __m256i v10 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(src + x + stride)));
+   __m256i v11 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(src + x + stride + 1)));
+   __m256i t0 = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(v00, v01), qw0),
+                                 _mm256_madd_epi16(_mm256_unpacklo_epi16(v10, v11), qw1));
+   __m256i t1 = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(v00, v01), qw0),
+                                 _mm256_madd_epi16(_mm256_unpackhi_epi16(v10, v11), qw1));
+   t0 = _mm256_srai_epi32(_mm256_add_epi32(t0, qdelta), W_BITS - 5);
+   t1 = _mm256_srai_epi32(_mm256_add_epi32(t1, qdelta), W_BITS - 5);
+   __m256i diff = _mm256_sub_epi16(_mm256_packs_epi32(t0, t1),
+                                   _mm256_loadu_si256((const __m256i *)(I + x)));
+   qb1 = _mm256_add_ps(qb1, _mm256_cvtepi32_ps(_mm256_madd_epi16(diff,
+                       _mm256_loadu_si256((const __m256i *)(Ix + x)))));
+   qb2 = _mm256_add_ps(qb2, _mm256_cvtepi32_ps(_mm256_madd_epi16(diff,
+                       _mm256_loadu_si256((const __m256i *)(Iy + x)))));
+   qa = _mm256_add_epi32(qa, _mm256_madd_epi16(_mm256_abs_epi16(diff), ones));
+  }
+#endif
+#ifdef __SSE2__
+  for(; x <= win - 8; x += 8) {
+   __m128i v00 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(src + x)), z);
+   __m128i v01 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(src + x + 1)), z);
+   __m128i v10 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(src + x + stride)), z);
+   __m128i v11 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(src + x + stride + 1)), z);
+   __m128i t0 = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(v00, v01), pw0),
+                              _mm_madd_epi16(_mm_unpacklo_epi16(v10, v11), pw1));
+   __m128i t1 = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(v00, v01), pw0),
+                              _mm_madd_epi16(_mm_unpackhi_epi16(v10, v11), pw1));
+   t0 = _mm_srai_epi32(_mm_add_epi32(t0, pdelta), W_BITS - 5);
+   t1 = _mm_srai_epi32(_mm_add_epi32(t1, pdelta), W_BITS - 5);
+   __m128i diff = _mm_sub_epi16(_mm_packs_epi32(t0, t1), _mm_loadu_si128((const __m128i *)(I + x)));
+   pb1 = _mm_add_ps(pb1, _mm_cvtepi32_ps(_mm_madd_epi16(diff, _mm_loadu_si128((const __m128i *)(Ix + x)))));
+   pb2 = _mm_add_ps(pb2, _mm_cvtepi32_ps(_mm_madd_epi16(diff, _mm_loadu_si128((const __m128i *)(Iy + x)))));
+   __m128i absDiff = _mm_max_epi16(diff, _mm_sub_epi16(z, diff));
+   pa = _mm_add_epi32(pa, _mm_madd_epi16(absDiff, pones));
+  }
+#endif
+  for(; x < win; ++x) {
+   int v = src[x] * iw[0] + src[x + 1] * iw[1] + src[x + stride] * iw[2] + src[x + stride + 1] * iw[3];
+   int diff = DESCALE(v, W_BITS - 5) - I[x];
+   s1 += (float)(diff * Ix[x]);
+   s2 += (float)(diff * Iy[x]);
+   sa += (diff < 0) ? -diff : diff;
+  }
+ }
+
+#ifdef __AVX2__
+ {
+  float f1[8], f2[8];
+  int a[8];
+  _mm256_storeu_ps(f1, qb1);
+  _mm256_storeu_ps(f2, qb2);
+  _mm256_storeu_si256((__m256i *)a, qa);
+  for(int k = 0; k < 8; ++k) {
+   s1 += f1[k];
+   s2 += f2[k];
+   sa += a[k];
+  }
+ }
+#endif
+#ifdef __SSE2__
+ {
+  float f1[4], f2[4];
+  int a[4];
+  _mm_storeu_ps(f1, pb1);
+  _mm_storeu_ps(f2, pb2);
+  _mm_storeu_si128((__m128i *)a, pa);
+  for(int k = 0; k < 4; ++k) {
+   s1 += f1[k];
+   s2 += f2[k];
+   sa += a[k];
+  }
+ }
+#endif
+ *b1 = s1;
+ *b2 = s2;
+ *absSum = sa;
+}
+
+
+//==============================================================================
+// downsample - next pyramid level by 2x2 averaging, over a dw x dh window
+//==============================================================================
+void downsample(const unsigned char *src, int sw, unsigned char *dst, int dstride,
+                int dw, int dh)
+{
+ for(int y = 0; y < dh; ++y, dst += dstride) {
+  const unsigned char *r0 = src + 2 * y * sw;
+  const unsigned char *r1 = r0 + sw;
+  int x = 0;
+#ifdef __SSE2__
+  __m128i mask = _mm_set1_epi16(0x00ff);
+  __m128i two = _mm_set1_epi16(2);
+  for(; x <= dw - 8; x += 8) {
+   __m128i a = _mm_loadu_si128((const __m128i *)(r0 + 2 * x));
+   __m128i b = _mm_loadu_si128((const __m128i *)(r1 + 2 * x));
+   __m128i s = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a, mask), _mm_srli_epi16(a, 8)),
+                             _mm_add_epi16(_mm_and_si128(b, mask), _mm_srli_epi16(b, 8)));
+   s = _mm_srli_epi16(_mm_add_epi16(s, two), 2);
+   _mm_storel_epi64((__m128i *)(dst + x), _mm_packus_epi16(s, s));
+  }
+#endif
+  for(; x < dw; ++x)
+   dst[x] = (r0[2 * x] + r0[2 * x + 1] + r1[2 * x] + r1[2 * x + 1] + 2) >> 2;
+ }
+}
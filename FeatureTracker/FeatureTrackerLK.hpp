@@ -0,0 +1,285 @@
+//==============================================================================
+// FeatureTrackerLK.hpp - Feature detection and pyramidal Lucas-Kanade tracking
+//                        with SIMD inner loops
+//==============================================================================
+
+#ifndef INCLUDED_FEATURETRACKERLK_HPP
+#define INCLUDED_FEATURETRACKERLK_HPP
+
+#include <stdio.h>
+#include <malloc.h>
+#include "TrackerUtils.hpp"
+#include "FeatureTracker.hpp"
+#include "TrackHistory.hpp"
+#include "TrackLog.hpp"
+#include "FeatureReplenisher.hpp"
+#include "CornerDetector.hpp"
+#include "FeatureBudgetController.hpp"
+#include "RTUtils/PipelineStage.hpp"
+
+class TaskPool;
+
+#define LK_MAX_LEVELS  8   // maximum number of pyramid levels
+#define LK_MAX_WINDOW 31   // maximum tracking window size
+
+
+//==============================================================================
+/*! \struct _LKTrackingContext
+    \brief Parameters specific to the native Lucas-Kanade tracker (for use
+    with FeatureTrackerLK class)
+
+    Good default values for parameters are given in parenthesis. */
+//==============================================================================
+typedef struct _LKTrackingContext
+{
+ _LKTrackingContext() : window_size(15), num_levels(3), max_iter(20), epsilon(0.03),
+                        min_eigenvalue(4), max_residual(20), quality(0.01),
+                        min_dist(10) {};
+ int window_size;       /*!< Width and height of the tracking window in pixels.
+                             Odd, at most LK_MAX_WINDOW (15). */
+ int num_levels;        /*!< Number of pyramid levels, including the full
+                             resolution image. Fewer levels are used if the
+                             image is too small (3). */
+ int max_iter;          /*!< Maximum number of iterations per level (20). */
+ double epsilon;        /*!< Iterations stop once the feature moves by less
+                             than this many pixels (0.03). */
+ float min_eigenvalue;  /*!< Smallest eigenvalue of the gradient matrix of the
+                             window, per pixel, in (grey levels/pixel)^2.
+                             Features with less texture are lost (4). */
+ float max_residual;    /*!< Mean absolute difference in grey levels between
+                             the windows around the original and the moved
+                             feature. Features with a larger difference are
+                             lost (20). */
+ double quality;        /*!< Features are detected where the smallest
+                             eigenvalue is at least this fraction of the
+                             strongest in the image (0.01). */
+ int min_dist;          /*!< Minimum distance between detected features (10). */
+}LKTrackingContext_t;
+
+
+//==============================================================================
+// class FeatureTrackerLK
+//------------------------------------------------------------------------------
+// \brief
+// Automatic image feature detection and tracking using a native
+// implementation of the pyramidal Lucas-Kanade algorithm.
+//
+// Unlike FeatureTrackerKLT and FeatureTrackerOCV, this class needs neither
+// the KLT nor the OpenCV library to track, and does not copy the image into
+// a library specific image type: the finest pyramid level is the caller's
+// buffer itself. Coarser levels are built by 2x2 averaging. The previous
+// image is not kept either. Instead, after each frame the window around
+// every feature is sampled from the pyramid into a template of 16 bit
+// fixed-point intensities and gradients, together with the inverse of its
+// gradient matrix. The next frame is tracked against these templates.
+//
+// In the tracking iterations, the window in the new image is resampled with
+// fixed-point bilinear weights and compared against the template 8 pixels
+// at a time with SSE2, or 16 at a time with AVX2 if the library is built
+// with -mavx2. A plain C++ version is used on other processors.
+//
+// Features are selected with a CornerDetector, on a grid sized so that 
+// there are about as many cells as features.
+//
+// If the features cover a small part of the image, the pyramid can be built
+// and the features tracked in a region of interest around them only (see
+// setROIMode()).
+//
+// To hold a frame rate, the number of features, iterations and pyramid 
+// levels can be cut back while frames take too long, and restored when
+// they are fast again (see setLatencyTarget()).
+//
+// Features can be tracked in parallel on a TaskPool (see setTaskPool()).
+// Each feature is tracked independently of the others, so the results do
+// not depend on the number of threads.
+//
+// On more than one processor, the pyramid of each frame can be built on a
+// helper thread while the features of the previous frame are tracked, at
+// the cost of one frame of latency (see setPipelining()).
+//
+// Image display and event handling routines use the SDL library. See:
+// http://www.libsdl.org .
+//
+// <b>Example Program:</b>
+// \include FeatureTrackerLK.t.cpp
+//==============================================================================
+
+class FeatureTrackerLK : public FeatureTracker
+{
+ public:
+  FeatureTrackerLK();
+   // Default constructor.
+
+  ~FeatureTrackerLK();
+   // Destructor frees any allocated resources.
+
+  virtual tracker_backend_t getBackend() const {return e_trackerLK;}
+   //  return  e_trackerLK.
+
+  int initialize(FeatureTrackerContext_t &ftc, LKTrackingContext_t &lkt);
+   // Initialize the tracker. Call this method before calling
+   // any other methods of this class.
+   //  ftc     settings specific to this class.
+   //  lkt     tracker algorithm specific settings.
+   //  return  0 on success, -1 on error (error message redirected to stderr).
+
+  virtual int processImage(unsigned char *img, int w, int h, feature_list_t &list);
+   // Track features in the image buffer. Upon calling this method the first time,
+   // features are selected either automatically (if 'auto_select_features' was
+   // turned on during initialization) or by the user. If 'display_tracked_features'
+   // was turned on during initialization, the image display window will be
+   // updated with the current image in the buffer and the location of
+   // tracked features are marked. The buffer is only read during the call.
+   // <hr>
+   // NOTE: Calling this function initiates SDL event handling, including for SIGINT
+   // (CNTRL+C). Hence, to catch events outside of this method, use SDL functions
+   // such as SDL_PollEvent().
+   // <hr>
+   //  img       Pointer to image buffer. NOTE: image must be 8 bit grayscale, and
+   //            of the same size in every call.
+   //  w,h       Image dimensions in pixels.
+   //  list      List of tracked features. This list contains updated (x,y) locations
+   //            of features and an integer value indicating whether the feature was
+   //            tracked successfully (e_tracked), was newly detected into this slot
+   //            (e_new) or was lost (e_lost).
+   //  return    current frame number on success (first frame = 1), -1 on error (error
+   //            message redirected to stderr), -2 on user initiated quit.
+
+  virtual const TrackHistory &getTrackHistory() const {return d_history;}
+   //  return  The history of tracked features over recent frames. Frame
+   //          numbers start at 0 for the first image processed.
+
+  virtual int openTrackLog(const char *fileName, int indexInterval = 30);
+   // Start logging tracked features from every subsequent call to
+   // processImage() into a binary track log (see TrackLogWriter). Call
+   // after initialize(). The log can be read with TrackLogReader.
+   //  fileName       Name of the log file.
+   //  indexInterval  Number of frames between commits of the log header.
+   //  return    0 on success, -1 on error (error message redirected to stderr).
+
+  virtual int closeTrackLog() {return d_log.close();}
+   // Stop logging and close the track log. Also done by the destructor.
+   //  return    0 on success, -1 on error (error message redirected to stderr).
+
+  virtual int setTaskPool(TaskPool *pool) {d_pool = pool; d_detector.setTaskPool(pool); return 0;}
+   // Track and detect features in parallel using a pool of worker threads. 
+   // The pool is shared, not owned.
+   //  pool    The task pool, or NULL to track in the calling thread (default).
+   //  return  0.
+
+  void setROIMode(bool on) {d_roiOn = on;}
+   // Build the coarser pyramid levels and track only in a window around the
+   // features of the previous frame: their bounding box expanded, on every
+   // level, by the distance a feature can move over all levels plus the 
+   // tracking window. Features that move further are lost. The whole image is
+   // used on the first frame, when no features are left, and when the window
+   // would reach past an edge of the image. Replenishment only adds features
+   // inside the window. Saves time in proportion to the area when the 
+   // features cover a small part of the image.
+   //  on      true to restrict tracking to the window, false to use the 
+   //          whole image (default).
+
+  virtual int setReplenishment(const ReplenishContext_t *rc);
+   // Replace lost features in every frame after the first by detecting new
+   // features in the grid cells that have no features left (see
+   // FeatureReplenisher). New features are reported as e_new. Call after
+   // initialize().
+   //  rc      Replenishment parameters, or NULL to turn replenishment off
+   //          (default).
+   //  return  0 on success, -1 on error (error message redirected to stderr).
+
+  virtual int setLatencyTarget(const BudgetContext_t *bc);
+   // Time every call to processImage(), and adjust the effort spent on the
+   // next frames to stay within a target (see FeatureBudgetController): the
+   // maximum number of iterations, the number of pyramid levels (fewer are
+   // used if the image is too small) and the number of feature slots in use.
+   // Features in slots taken out of use are reported lost, and only
+   // replenishment (see setReplenishment()) fills the slots again when they
+   // come back into use. Call after initialize(). Starts from full effort.
+   //  bc      Control parameters, or NULL to track with the settings given 
+   //          to initialize() (default).
+   //  return  0 on success, -1 on error (error message redirected to stderr).
+
+  const budget_point_t &getOperatingPoint() const {return d_budget.getOperatingPoint();}
+   //  return  The effort used for the next frame, and the time of recent
+   //          frames if a latency target is set.
+
+  virtual int setPipelining(bool on);
+   // Build the pyramid of each image on a helper thread (see PipelineStage)
+   // while the features of the image passed in the previous call are 
+   // tracked. Each call to processImage() then copies its image in, and 
+   // returns the features of the image passed in the previous call, i.e. 
+   // one frame late: the first call returns 0 and leaves the list as it is,
+   // and a call with a NULL image returns the features of the last image 
+   // passed. The display shows the image the features belong to. The two 
+   // images in the pipeline and their pyramids are held in buffers allocated
+   // on the first frame. All pyramid levels are built on the whole image, so
+   // the region of interest mode (see setROIMode()) is not used. Call after
+   // initialize() and before the first call to processImage().
+   //  on      true to pipeline, false to process each image within its 
+   //          call (default).
+   //  return  0 on success, -1 on error (error message redirected to stderr).
+
+  virtual bool isPipelined() const {return d_pipelineOn;}
+   //  return  true if features are returned one frame late (see
+   //          setPipelining()).
+
+ protected:
+ private:
+  FeatureTrackerLK(const FeatureTrackerLK &);
+  FeatureTrackerLK &operator=(const FeatureTrackerLK &);
+  int allocateBuffers(int w, int h);
+  void applyOperatingPoint();
+  void setROI(bool restrict);
+  void buildPyramid(unsigned char *buf);
+  static void pyramidJob(void *arg);
+  int allocatePipeline();
+  int processFrame(unsigned char *buf, feature_list_t &list);
+  bool insideROI(float x, float y) const;
+  int trackFeatures();
+  int replenish(feature_list_t &list);
+  SDLWindow d_display;
+  SDL_Surface *d_screen;
+  char d_message[80];
+  LKTrackingContext_t d_trackingContext;
+  int d_numFeatures;
+  int d_numFrames;
+  int d_frameNumber;
+  bool d_autoSelect;
+  bool d_displayOn;
+  int d_displayDecimation;
+  int d_width, d_height;
+  int d_numLevels;                              // levels in use
+  int d_pyramidLevels;                          // levels allocated
+  const unsigned char *d_level[LK_MAX_LEVELS];  // finest level is the caller's buffer
+  unsigned char *d_levelData;                   // levels 1 and up
+  int d_levelWidth[LK_MAX_LEVELS], d_levelHeight[LK_MAX_LEVELS];
+  bool d_roiOn;
+  bool d_roiFull;                               // the window is the whole image
+  int d_roi[LK_MAX_LEVELS][4];                  // window on each level: x0, y0, x1, y1
+  feature_list_t d_features;
+  short *d_templates;    // per feature and level: intensity, x and y gradient windows
+  float *d_inverses;     // per feature and level: inverse gradient matrix, or 0s
+  CornerDetector d_detector;
+  feature_t *d_cellCorners;  // corners detected in one replenishment cell
+  TaskPool *d_pool;
+  FeatureReplenisher d_replenisher;
+  ReplenishContext_t d_replenishContext;
+  bool d_replenishOn;
+  FeatureBudgetController d_budget;
+  bool d_budgetOn;
+  int d_maxIter;                                // as given to initialize()
+  TrackHistory d_history;
+  TrackLogWriter d_log;
+  PipelineStage d_stage;
+  bool d_pipelineOn;
+  unsigned char *d_pipeData;                    // two images with their coarser levels
+  unsigned char *d_pipeLevel[2][LK_MAX_LEVELS];
+  int d_pipeSlot;                               // image waiting to be tracked, or -1
+  const unsigned char *d_buildImage;            // caller's image, copied in by the helper
+  int d_buildSlot;                              // slot the helper fills
+};
+
+
+
+#endif // INCLUDED_FEATURETRACKERLK_HPP
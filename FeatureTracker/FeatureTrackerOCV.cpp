@@ -4,9 +4,12 @@
 //==============================================================================
 
 #include "FeatureTrackerOCV.hpp"
+#include "RTUtils/FrameArena.hpp"
 
 //#define DEBUG
 
+static void cellImage(IplImage *img, int x, int y, int w, int h, IplImage *cell);
+
 
 //==============================================================================
 FeatureTrackerOCV::FeatureTrackerOCV()
@@ -20,9 +23,28 @@ FeatureTrackerOCV::FeatureTrackerOCV()
  d_trackStatus = 0;
  d_swapArray = 0;
  d_image = d_prevImage = d_pyramid = d_prevPyramid = d_swapImg = 0;
+ d_zeroCopy = false;
+ d_roiOn = false;
+ d_roi = d_pyramidROI = cvRect(0, 0, 0, 0);
+ d_maxLevels = d_pyramidLevels = OCV_PYR_LEVELS;
+ d_predictOn = false;
+ d_velocities = 0;
+ d_hasVelocity = 0;
+ d_homographyOn = false;
+ d_maxDeviation = 0;
+ d_predictions = 0;
+ for(int i = 0; i < 9; ++i) d_homography[i] = (i % 4 == 0) ? 1 : 0;
+ d_eigImage = d_tempImage = 0;
+ d_arena = 0;
+ d_replenishOn = false;
+ d_cellCorners = 0;
+ d_reidOn = false;
+ d_budgetOn = false;
+ d_maxIter = 0;
  d_frameNumber = 0;
  d_autoSelect = true;
  d_displayOn = true;
+ d_displayDecimation = 1;
  d_trackerFlags = 0;
  d_numDetectedFeatures = 0;
  d_trackedFeaturesIndices = 0;
@@ -34,15 +56,21 @@ FeatureTrackerOCV::FeatureTrackerOCV()
 FeatureTrackerOCV::~FeatureTrackerOCV()
 //==============================================================================
 {
- if(d_image) cvReleaseImage(&d_image);
- if(d_prevImage) cvReleaseImage(&d_prevImage);
+ if(d_image && !isFrameHeader(d_image)) cvReleaseImage(&d_image);
+ if(d_prevImage && !isFrameHeader(d_prevImage)) cvReleaseImage(&d_prevImage);
  if(d_pyramid) cvReleaseImage(&d_pyramid);
  if(d_prevPyramid) cvReleaseImage(&d_prevPyramid);
+ if(d_eigImage) cvReleaseImage(&d_eigImage);
+ if(d_tempImage) cvReleaseImage(&d_tempImage);
  if(d_featureList[1]) cvFree((void**)(&d_featureList[1]));
  if(d_featureList[0]) cvFree((void**)(&d_featureList[0]));
  if(d_trackStatus) cvFree((void**)(&d_trackStatus));
  if(d_trackedFeaturesIndices) free(d_trackedFeaturesIndices);
  if(d_trackingErrors) free(d_trackingErrors);
+ if(d_cellCorners) free(d_cellCorners);
+ if(d_velocities) free(d_velocities);
+ if(d_hasVelocity) free(d_hasVelocity);
+ if(d_predictions) free(d_predictions);
 #ifdef DEBUG
  fprintf(stderr, "[FeatureTrackerOCV::~FeatureTrackerOCV] Leaving.\n");
 #endif
@@ -59,6 +87,7 @@ int FeatureTrackerOCV::initialize(FeatureTrackerContext_t &ftc, OCVTrackingConte
  d_numFrames = ftc.num_frames;
  d_autoSelect = ftc.auto_select_features;
  d_displayOn = ftc.display_tracked_features;
+ d_displayDecimation = (ftc.display_decimation > 0) ? ftc.display_decimation : 1;
  d_featureList[0] = (CvPoint2D32f*)cvAlloc(d_numFeatures * sizeof(d_featureList[0][0]));
  if(d_featureList[0] == NULL) {
   fprintf(stderr, "[FeatureTrackerOCV::initialize] ERROR in memory allocation.\n");
@@ -84,10 +113,24 @@ int FeatureTrackerOCV::initialize(FeatureTrackerContext_t &ftc, OCVTrackingConte
   fprintf(stderr, "[FeatureTrackerOCV::initialize] ERROR in memory allocation.\n");
   return -1;
  }
+ d_velocities = (CvPoint2D32f *)malloc(d_numFeatures * sizeof(CvPoint2D32f));
+ d_hasVelocity = (char *)calloc(d_numFeatures, 1);
+ d_predictions = (CvPoint2D32f *)malloc(d_numFeatures * sizeof(CvPoint2D32f));
+ if( (d_velocities == NULL) || (d_hasVelocity == NULL) || (d_predictions == NULL) ) {
+  fprintf(stderr, "[FeatureTrackerOCV::initialize] ERROR in memory allocation.\n");
+  return -1;
+ }
+  
+ if( d_history.initialize(d_numFeatures, d_numFrames, ftc.history_bytes) != 0 )
+  return -1;
   
  d_trackerFlags = 0;
  d_numDetectedFeatures = 0;
- return 0;
+
+ // full effort until a latency target is set
+ d_maxIter = ocvt.max_iter;
+ d_budgetOn = false;
+ return d_budget.initialize(BudgetContext_t(), d_numFeatures, d_maxIter, d_maxLevels + 1);
 }
 
 
@@ -112,29 +155,41 @@ int FeatureTrackerOCV::processImage(unsigned char *buf, int w, int h, feature_li
   return -1;
  }
  
+ // effort for this frame
+ if(d_budgetOn) d_budget.beginFrame();
+ const budget_point_t &point = d_budget.getOperatingPoint();
+ d_trackingContext.max_iter = point.max_iter;
+
  // allocate buffers if not already
- if( !d_image) {
-  d_image = cvCreateImage(cvSize(w,h), 8, 1);
-  d_image->origin = 0;
-  d_prevImage = cvCreateImage(cvSize(w,h), 8, 1);
+ if( !d_pyramid) {
+  if( !d_zeroCopy ) {
+   d_image = cvCreateImage(cvSize(w,h), 8, 1);
+   d_image->origin = 0;
+   d_prevImage = cvCreateImage(cvSize(w,h), 8, 1);
+  }
   d_pyramid = cvCreateImage(cvSize(w,h), 8, 1);
   d_prevPyramid = cvCreateImage(cvSize(w,h), 8, 1);
   d_trackerFlags = 0;
  }
 
- memcpy(d_image->imageData, buf, w * h);
+ if(d_zeroCopy) {
+  // wrap the buffer in whichever header does not hold the previous frame
+  d_image = (d_prevImage == &d_frameHeader[0]) ? &d_frameHeader[1] : &d_frameHeader[0];
+  cvInitImageHeader(d_image, cvSize(w,h), 8, 1);
+  cvSetData(d_image, buf, w);
+ } else {
+  memcpy(d_image->imageData, buf, w * h);
+ }
  
  // first frame - select features
  if(d_frameNumber == 0) {
   if(d_autoSelect) { // automatic initialization
-   IplImage* eig = cvCreateImage( cvSize(w,h), 32, 1 );
-   IplImage* temp = cvCreateImage( cvSize(w,h), 32, 1 );
+   IplImage *eig, *temp;
+   if( getDetectorWorkspace(w, h, &eig, &temp) != 0 ) return -1;
    d_numDetectedFeatures = d_numFeatures;
    cvGoodFeaturesToTrack( d_image, eig, temp, d_featureList[1], &d_numDetectedFeatures,
                           d_trackingContext.quality, d_trackingContext.min_dist, 0, 
                           d_trackingContext.block_size, 0, 0.04 );
-   cvReleaseImage( &eig );
-   cvReleaseImage( &temp );
   } else {  // manual initialization
    // initialize display
    if( d_display.init(w, h, "FeatureTrackerOCV") != 0) return -1;
@@ -176,57 +231,104 @@ int FeatureTrackerOCV::processImage(unsigned char *buf, int w, int h, feature_li
   for(int i = 0; i < d_numDetectedFeatures; ++i) {
    d_trackedFeaturesIndices[i] = i;
    d_trackingErrors[i] = 0;
+   d_hasVelocity[i] = 0;
   }
+  d_roi = cvRect(0, 0, w, h);
+  d_pyramidROI = cvRect(0, 0, 0, 0);
  } else if(d_numDetectedFeatures){
-  cvCalcOpticalFlowPyrLK( d_prevImage, d_image, d_prevPyramid, d_pyramid,
+  // start from predicted positions, with as many levels as they need
+  int levels = d_maxLevels;
+  int flags = d_trackerFlags;
+  if(d_predictOn || d_homographyOn) {
+   levels = predictFeatures();
+   flags |= CV_LKFLOW_INITIAL_GUESSES;
+  }
+  if( d_budgetOn && (levels > point.num_levels - 1) ) levels = point.num_levels - 1;
+
+  // track in a window of the images around the features, through headers
+  d_roi = d_roiOn ? trackingROI(w, h, levels) : cvRect(0, 0, w, h);
+  bool restricted = (d_roi.width < w) || (d_roi.height < h);
+  IplImage *prevImage = d_prevImage, *image = d_image;
+  if(restricted) {
+   cellImage(d_prevImage, d_roi.x, d_roi.y, d_roi.width, d_roi.height, &d_roiHeader[0]);
+   cellImage(d_image, d_roi.x, d_roi.y, d_roi.width, d_roi.height, &d_roiHeader[1]);
+   prevImage = &d_roiHeader[0];
+   image = &d_roiHeader[1];
+   shiftFeatures(-d_roi.x, -d_roi.y);
+  }
+
+  // the pyramid of the previous image is reused if built over the same 
+  // window, with at least as many levels
+  if( (d_roi.x != d_pyramidROI.x) || (d_roi.y != d_pyramidROI.y) 
+      || (d_roi.width != d_pyramidROI.width) || (d_roi.height != d_pyramidROI.height)
+      || (levels > d_pyramidLevels) )
+   flags &= ~CV_LKFLOW_PYR_A_READY;
+  cvCalcOpticalFlowPyrLK( prevImage, image, d_prevPyramid, d_pyramid,
                  d_featureList[0], d_featureList[1], d_numDetectedFeatures, 
                  cvSize(d_trackingContext.window_size, d_trackingContext.window_size), 
-                 3, d_trackStatus, d_trackingErrors,
+                 levels, d_trackStatus, d_trackingErrors,
                  cvTermCriteria(CV_TERMCRIT_ITER|CV_TERMCRIT_EPS, 
-                 d_trackingContext.max_iter, d_trackingContext.epsilon), d_trackerFlags );
+                 d_trackingContext.max_iter, d_trackingContext.epsilon), flags );
   d_trackerFlags |= CV_LKFLOW_PYR_A_READY;
+  d_pyramidROI = d_roi;
+  d_pyramidLevels = levels;
+
+  if(restricted) shiftFeatures(d_roi.x, d_roi.y);
+ } else {
+  d_roi = cvRect(0, 0, w, h);
+  d_pyramidROI = cvRect(0, 0, 0, 0);
  }
  
- // prepare screen display 
- if(d_displayOn) {
+ // prepare screen display (decimated)
+ bool display = d_displayOn && (d_frameNumber % d_displayDecimation == 0);
+ if(display) {
   if(d_screen == NULL) if( d_display.init(w, h, "FeatureTrackerOCV") != 0) return -1;
   if( d_display.updateScreenBuffer((char *)buf, w, h, 1, NULL) != 0) return -1;
   d_screen = d_display.getScreenPointer();
  }
 
- // copy features to external list, update internal feature list
- int i, j = 0, k = 0, l = 0;
+ // copy features to external list, update internal feature list. Slots
+ // are reused by replenish(), so the tracked indices are not ordered.
+ // Features in slots out of use are dropped.
+ int i, j, k = 0;
+ for(j = 0; j < d_numFeatures; ++j) {
+  features.features[j].x = 0;
+  features.features[j].y = 0;
+  features.features[j].val = e_lost;
+ }
  for(i = 0; i < d_numDetectedFeatures; ++i) {
-  if( (d_frameNumber == 0) || ((d_trackStatus[i] == 1) && (fabs(d_trackingErrors[i]) < d_trackingContext.max_error)) ) {
+  if( (d_trackedFeaturesIndices[i] < point.num_features) && ((d_frameNumber == 0) 
+      || ((d_trackStatus[i] == 1) && (fabs(d_trackingErrors[i]) < d_trackingContext.max_error))) ) {
 
    d_featureList[1][k] = d_featureList[1][i];
    d_trackedFeaturesIndices[k] = d_trackedFeaturesIndices[i];
+   if(d_frameNumber > 0) {
+    int slot = d_trackedFeaturesIndices[k];
+    d_velocities[slot].x = d_featureList[1][k].x - d_featureList[0][i].x;
+    d_velocities[slot].y = d_featureList[1][k].y - d_featureList[0][i].y;
+    d_hasVelocity[slot] = 1;
+   }
 
-   if(d_displayOn) 
-    boxColor(d_screen, (short)(d_featureList[1][k].x)-2, (short)(d_featureList[1][k].y)-2, 
-             (short)(d_featureList[1][k].x)+2, (short)(d_featureList[1][k].y)+2, 0xff0000ff);
-  
-   for(j = l; j < d_trackedFeaturesIndices[k]; ++j) {
-    features.features[j].x = 0;
-    features.features[j].y = 0;
-    features.features[j].val = -1;
+   feature_t &f = features.features[d_trackedFeaturesIndices[k]];
+   f.x = d_featureList[1][k].x;
+   f.y = d_featureList[1][k].y;
+   f.val = (d_frameNumber == 0) ? e_new : e_tracked;
+   if( d_homographyOn && (d_frameNumber > 0) ) {
+    float dx = f.x - d_predictions[i].x, dy = f.y - d_predictions[i].y;
+    if(dx * dx + dy * dy > d_maxDeviation * d_maxDeviation) f.val = e_suspect;
    }
   
-   l = d_trackedFeaturesIndices[k] + 1;
-   features.features[d_trackedFeaturesIndices[k]].x = d_featureList[1][k].x;
-   features.features[d_trackedFeaturesIndices[k]].y = d_featureList[1][k].y;
-   features.features[d_trackedFeaturesIndices[k]].val = 0;
-  
    ++k;
   }
  }
  d_numDetectedFeatures = k;
- for (j = l; j < d_numFeatures; ++j) {
-  features.features[j].x = 0;
-  features.features[j].y = 0;
-  features.features[j].val = -1;
- }
- if(d_displayOn) {
+ if( d_reidOn && (reidentify(buf, w, h, features) != 0) ) return -1;
+ if( d_replenishOn && (d_frameNumber > 0) && (replenish(buf, w, h, features) != 0) ) return -1;
+ if( d_reidOn && (d_reid.endFrame(features) != 0) ) return -1;
+ if( d_history.record(features, d_frameNumber) != 0 ) return -1;
+ if( d_log.isOpen() && (d_log.append(features, d_frameNumber) != 0) ) return -1;
+ if(display) {
+  d_display.drawFeatures(features);
   snprintf(d_message, 80, "Features tracked: %d/%d\0", d_numDetectedFeatures, d_numFeatures);
   stringColor(d_screen, 2, h-10, d_message, 0xfd1b04FF);
   d_display.refresh();
@@ -244,7 +346,385 @@ int FeatureTrackerOCV::processImage(unsigned char *buf, int w, int h, feature_li
   }
  }
 
+ if(d_budgetOn) d_budget.endFrame();
  ++d_frameNumber;
  return d_frameNumber;
 }
 
+
+//==============================================================================
+int FeatureTrackerOCV::setZeroCopy(bool on)
+//==============================================================================
+{
+ if( d_featureList[0] == NULL ) {
+  fprintf(stderr, "[FeatureTrackerOCV::setZeroCopy] ERROR. Must call initialize first.\n");
+  return -1;
+ }
+ if( d_frameNumber != 0 ) {
+  fprintf(stderr, "[FeatureTrackerOCV::setZeroCopy] ERROR. Tracking already started.\n");
+  return -1;
+ }
+ d_zeroCopy = on;
+ return 0;
+}
+
+
+//==============================================================================
+CvRect FeatureTrackerOCV::trackingROI(int w, int h, int levels)
+//==============================================================================
+{
+ // bounding box of the features of the previous frame, and of their
+ // predicted positions
+ float x0 = (float)w, y0 = (float)h, x1 = -1, y1 = -1;
+ for(int l = 0; l < ((d_predictOn || d_homographyOn) ? 2 : 1); ++l) {
+  for(int i = 0; i < d_numDetectedFeatures; ++i) {
+   const CvPoint2D32f &p = d_featureList[l][i];
+   if(p.x < x0) x0 = p.x;
+   if(p.x > x1) x1 = p.x;
+   if(p.y < y0) y0 = p.y;
+   if(p.y > y1) y1 = p.y;
+  }
+ }
+
+ // A feature moves by up to about one window on the coarsest level, and
+ // the window around it must fit: two windows there. The box is aligned
+ // to 32 pixels so that it stays put while features move a little, and
+ // the pyramid of the previous image can be reused.
+ int m = (2 * (d_trackingContext.window_size + 1)) << levels;
+ int rx0 = ((int)floorf(x0) - m) & ~31;
+ int ry0 = ((int)floorf(y0) - m) & ~31;
+ int rx1 = ((int)ceilf(x1) + m + 32) & ~31;
+ int ry1 = ((int)ceilf(y1) + m + 32) & ~31;
+ if( (rx0 < 0) || (ry0 < 0) || (rx1 > w) || (ry1 > h) ) // near an edge
+  return cvRect(0, 0, w, h);
+ return cvRect(rx0, ry0, rx1 - rx0, ry1 - ry0);
+}
+
+
+//==============================================================================
+int FeatureTrackerOCV::setMotionPrediction(bool on, int maxLevels)
+//==============================================================================
+{
+ if( (maxLevels < 0) || (maxLevels > OCV_MAX_LEVELS) ) {
+  fprintf(stderr, "[FeatureTrackerOCV::setMotionPrediction] ERROR. Levels must be 0 to %d.\n",
+          OCV_MAX_LEVELS);
+  return -1;
+ }
+ d_predictOn = on;
+ d_maxLevels = on ? maxLevels : OCV_PYR_LEVELS;
+ return 0;
+}
+
+
+//==============================================================================
+int FeatureTrackerOCV::setHomographyPrediction(bool on, float maxDeviation)
+//==============================================================================
+{
+ if(maxDeviation <= 0) {
+  fprintf(stderr, "[FeatureTrackerOCV::setHomographyPrediction] ERROR. Invalid deviation.\n");
+  return -1;
+ }
+ d_homographyOn = on;
+ d_maxDeviation = maxDeviation;
+ return 0;
+}
+
+
+//==============================================================================
+void FeatureTrackerOCV::setHomography(const double *h)
+//==============================================================================
+{
+ for(int i = 0; i < 9; ++i) d_homography[i] = h[i];
+}
+
+
+//==============================================================================
+void FeatureTrackerOCV::setHomography(const Matrix<3, 3> &Hpn)
+//==============================================================================
+{
+ for(int r = 0; r < 3; ++r)
+  for(int c = 0; c < 3; ++c)
+   d_homography[3 * r + c] = Hpn(r + 1, c + 1);
+}
+
+
+//==============================================================================
+int FeatureTrackerOCV::setLatencyTarget(const BudgetContext_t *bc)
+//==============================================================================
+{
+ if(d_featureList[0] == NULL) {
+  fprintf(stderr, "[FeatureTrackerOCV::setLatencyTarget] ERROR. Call initialize() first.\n");
+  return -1;
+ }
+ d_budgetOn = false;
+ if(bc == NULL)
+  return d_budget.initialize(BudgetContext_t(), d_numFeatures, d_maxIter, d_maxLevels + 1);
+ if( d_budget.initialize(*bc, d_numFeatures, d_maxIter, d_maxLevels + 1) != 0 )
+  return -1;
+ d_budgetOn = true;
+ return 0;
+}
+
+
+//==============================================================================
+int FeatureTrackerOCV::predictFeatures()
+//==============================================================================
+{
+ float maxStep = 0;
+ bool unknown = false;
+
+ // every feature through the homography of the last frame, kept for
+ // comparison with the tracked positions
+ if(d_homographyOn) {
+  const double *h = d_homography;
+  for(int i = 0; i < d_numDetectedFeatures; ++i) {
+   const CvPoint2D32f &p = d_featureList[0][i];
+   CvPoint2D32f &q = d_featureList[1][i];
+   double z = h[6] * p.x + h[7] * p.y + h[8];
+   if(fabs(z) < 1e-12) {
+    q = p;
+   } else {
+    q.x = (float)((h[0] * p.x + h[1] * p.y + h[2]) / z);
+    q.y = (float)((h[3] * p.x + h[4] * p.y + h[5]) / z);
+   }
+   d_predictions[i] = q;
+   float step = (q.x - p.x) * (q.x - p.x) + (q.y - p.y) * (q.y - p.y);
+   if(step > maxStep) maxStep = step;
+  }
+ }
+
+ // constant velocity from the last two frames
+ for(int i = 0; !d_homographyOn && (i < d_numDetectedFeatures); ++i) {
+  int slot = d_trackedFeaturesIndices[i];
+  d_featureList[1][i] = d_featureList[0][i];
+  if( !d_hasVelocity[slot] ) {
+   unknown = true;
+   continue;
+  }
+  const CvPoint2D32f &v = d_velocities[slot];
+  d_featureList[1][i].x += v.x;
+  d_featureList[1][i].y += v.y;
+  float step = v.x * v.x + v.y * v.y;
+  if(step > maxStep) maxStep = step;
+ }
+
+ // Features without a velocity may move anywhere. Otherwise the prediction
+ // is assumed to be off by up to half the step plus a couple of pixels, and
+ // each level above the image doubles the reach of the search window.
+ if(unknown) return d_maxLevels;
+ float reach = 0.5f * sqrtf(maxStep) + 2;
+ int levels = 0;
+ while( (levels < d_maxLevels) && ((d_trackingContext.window_size << levels) < reach) )
+  ++levels;
+ return levels;
+}
+
+
+//==============================================================================
+void FeatureTrackerOCV::shiftFeatures(int dx, int dy)
+//==============================================================================
+{
+ for(int i = 0; i < d_numDetectedFeatures; ++i) {
+  d_featureList[0][i].x += dx;
+  d_featureList[0][i].y += dy;
+  d_featureList[1][i].x += dx;
+  d_featureList[1][i].y += dy;
+ }
+}
+
+
+//==============================================================================
+int FeatureTrackerOCV::getDetectorWorkspace(int w, int h, IplImage **eig, IplImage **temp)
+//==============================================================================
+{
+ if(d_arena) {
+  int step = w * sizeof(float);
+  char *eigData = (char *)d_arena->allocate(step * h, 64);
+  char *tempData = (char *)d_arena->allocate(step * h, 64);
+  if( (eigData == NULL) || (tempData == NULL) ) {
+   fprintf(stderr, "[FeatureTrackerOCV::getDetectorWorkspace] ERROR. No scratch memory.\n");
+   return -1;
+  }
+  cvInitImageHeader(&d_eigHeader, cvSize(w,h), 32, 1);
+  cvSetData(&d_eigHeader, eigData, step);
+  cvInitImageHeader(&d_tempHeader, cvSize(w,h), 32, 1);
+  cvSetData(&d_tempHeader, tempData, step);
+  *eig = &d_eigHeader;
+  *temp = &d_tempHeader;
+  return 0;
+ }
+
+ if( !d_eigImage ) {
+  d_eigImage = cvCreateImage(cvSize(w,h), 32, 1);
+  d_tempImage = cvCreateImage(cvSize(w,h), 32, 1);
+ }
+ *eig = d_eigImage;
+ *temp = d_tempImage;
+ return 0;
+}
+
+
+//==============================================================================
+int FeatureTrackerOCV::setReplenishment(const ReplenishContext_t *rc)
+//==============================================================================
+{
+ if(rc == NULL) {
+  d_replenishOn = false;
+  return 0;
+ }
+ if(d_numFeatures <= 0) {
+  fprintf(stderr, "[FeatureTrackerOCV::setReplenishment] ERROR. Call initialize() first.\n");
+  return -1;
+ }
+ if(rc->max_per_cell < 1) {
+  fprintf(stderr, "[FeatureTrackerOCV::setReplenishment] ERROR. Invalid replenishment parameters.\n");
+  return -1;
+ }
+ feature_t *corners = (feature_t *)realloc(d_cellCorners, rc->max_per_cell * sizeof(feature_t));
+ if(corners == NULL) {
+  fprintf(stderr, "[FeatureTrackerOCV::setReplenishment] ERROR in memory allocation.\n");
+  return -1;
+ }
+ d_cellCorners = corners;
+ d_replenishContext = *rc;
+ d_replenishOn = true;
+
+ // the grid is set up with the image size on the next frame, unless known
+ if( d_replenisher.isInitialized() )
+  return d_replenisher.initialize(d_replenishContext, d_numFeatures, 
+                                  d_replenisher.getWidth(), d_replenisher.getHeight());
+ return 0;
+}
+
+
+//==============================================================================
+int FeatureTrackerOCV::replenish(unsigned char *buf, int w, int h, feature_list_t &features)
+//==============================================================================
+{
+ if( !d_replenisher.isInitialized() 
+     && (d_replenisher.initialize(d_replenishContext, d_numFeatures, w, h) != 0) )
+  return -1;
+
+ // unlike cvGoodFeaturesToTrack() and cvFindCornerSubPix(), which allocate
+ // scratch memory on every call, the corner detector allocates only here.
+ // Features need their window and its border inside the image.
+ if( !d_detector.isInitialized() ) {
+  CornerDetectorContext_t dc;
+  dc.quality = d_trackingContext.quality;
+  dc.min_dist = d_trackingContext.min_dist;
+  dc.border = d_trackingContext.window_size + 2;
+  if( d_detector.initialize(dc, w, h) != 0 ) return -1;
+ }
+
+ int numFree = d_replenisher.beginFrame(features, d_budget.getOperatingPoint().num_features,
+                                        d_reidOn ? d_reid.getPending() : NULL);
+ if(numFree <= 0) return numFree;
+
+#ifdef DEBUG
+ int first = d_numDetectedFeatures;
+#endif
+ int x, y, cw, ch;
+ while( d_replenisher.nextCell(x, y, cw, ch) ) {
+  // only cells that overlap the tracking window, if restricted
+  if( (x + cw <= d_roi.x) || (y + ch <= d_roi.y) || (x >= d_roi.x + d_roi.width) 
+      || (y >= d_roi.y + d_roi.height) )
+   continue;
+
+  int n = d_detector.detectInRect(buf, x, y, cw, ch, d_replenisher.getMaxPerCell(),
+                                  d_cellCorners);
+  for(int i = 0; i < n; ++i) {
+   int slot = d_replenisher.addFeature(d_cellCorners[i].x, d_cellCorners[i].y);
+   if(slot < 0) continue;
+   features.features[slot] = d_cellCorners[i];
+   d_featureList[1][d_numDetectedFeatures] = cvPoint2D32f(d_cellCorners[i].x, d_cellCorners[i].y);
+   d_trackedFeaturesIndices[d_numDetectedFeatures] = slot;
+   d_hasVelocity[slot] = 0;
+   ++d_numDetectedFeatures;
+  }
+ }
+#ifdef DEBUG
+ fprintf(stderr, "[FeatureTrackerOCV::replenish] Added %d features.\n", d_numDetectedFeatures - first);
+#endif
+ return 0;
+}
+
+
+//==============================================================================
+int FeatureTrackerOCV::setReidentification(const ReidContext_t *rc)
+//==============================================================================
+{
+ if(rc == NULL) {
+  d_reidOn = false;
+  return 0;
+ }
+ if(d_numFeatures <= 0) {
+  fprintf(stderr, "[FeatureTrackerOCV::setReidentification] ERROR. Call initialize() first.\n");
+  return -1;
+ }
+ d_reidContext = *rc;
+ d_reidOn = true;
+
+ // set up with the image size on the next frame, unless known
+ if( d_reid.isInitialized() )
+  return d_reid.initialize(d_reidContext, d_numFeatures, d_reid.getWidth(), d_reid.getHeight());
+ return 0;
+}
+
+
+//==============================================================================
+int FeatureTrackerOCV::reidentify(unsigned char *buf, int w, int h, feature_list_t &features)
+//==============================================================================
+{
+ if( !d_reid.isInitialized() 
+     && (d_reid.initialize(d_reidContext, d_numFeatures, w, h) != 0) )
+  return -1;
+
+ int first = d_numDetectedFeatures;
+ int numRestored = d_reid.reidentify(buf, features, d_budget.getOperatingPoint().num_features);
+ if(numRestored <= 0) return numRestored;
+
+ // restored features are tracked on from where they were found, refined
+ // to sub-pixel accuracy as new ones are
+ for(int i = 0; i < numRestored; ++i) {
+  int slot = d_reid.getRestoredSlot(i);
+  d_featureList[1][d_numDetectedFeatures] = cvPoint2D32f(features.features[slot].x, 
+                                                         features.features[slot].y);
+  d_trackedFeaturesIndices[d_numDetectedFeatures] = slot;
+  d_hasVelocity[slot] = 0;
+  ++d_numDetectedFeatures;
+ }
+ cvFindCornerSubPix( d_image, d_featureList[1] + first, numRestored, 
+                     cvSize(d_trackingContext.window_size, d_trackingContext.window_size), 
+                     cvSize(-1,-1),
+                     cvTermCriteria(CV_TERMCRIT_ITER|CV_TERMCRIT_EPS,
+                     d_trackingContext.max_iter, d_trackingContext.epsilon));
+ for(int i = first; i < d_numDetectedFeatures; ++i) {
+  feature_t &f = features.features[d_trackedFeaturesIndices[i]];
+  f.x = d_featureList[1][i].x;
+  f.y = d_featureList[1][i].y;
+ }
+ return 0;
+}
+
+
+//==============================================================================
+int FeatureTrackerOCV::openTrackLog(const char *fileName, int indexInterval)
+//==============================================================================
+{
+ if(d_numFeatures <= 0) {
+  fprintf(stderr, "[FeatureTrackerOCV::openTrackLog] ERROR. Call initialize() first.\n");
+  return -1;
+ }
+ return d_log.open(fileName, d_numFeatures, indexInterval);
+}
+
+
+//==============================================================================
+// cellImage - header for a rectangle of an image, sharing its data
+//==============================================================================
+void cellImage(IplImage *img, int x, int y, int w, int h, IplImage *cell)
+{
+ cvInitImageHeader(cell, cvSize(w,h), img->depth, img->nChannels);
+ cvSetData(cell, img->imageData + y * img->widthStep + x * img->nChannels * (img->depth / 8),
+           img->widthStep);
+}
@@ -7,9 +7,22 @@
 #define INCLUDED_FEATURETRACKEROCV_HPP
 
 #include "opencv/cv.h"
+#include "Matrix.hpp"
 #include <stdio.h>
 #include <malloc.h>
 #include "TrackerUtils.hpp"
+#include "FeatureTracker.hpp"
+#include "TrackHistory.hpp"
+#include "TrackLog.hpp"
+#include "FeatureReplenisher.hpp"
+#include "CornerDetector.hpp"
+#include "FeatureReidentifier.hpp"
+#include "FeatureBudgetController.hpp"
+
+class FrameArena;
+
+#define OCV_PYR_LEVELS 3   // default number of pyramid levels above the image
+#define OCV_MAX_LEVELS 6   // maximum number of pyramid levels above the image
 
 
 //==============================================================================
@@ -44,14 +57,38 @@ typedef struct _OCVTrackingContext
 // OpenCV must be installed in order to use this class. See:
 // http://www.intel.com/technology/computing/opencv/index.htm .
 //
+// If the features cover a small part of the image, the pyramids can be built
+// and the features tracked in a window around them only (see setROIMode()).
+//
+// Each feature can be tracked from a predicted position rather than from 
+// where it was in the previous frame: from its own recent velocity (see
+// setMotionPrediction()), or from the homography of the scene between the
+// last two frames, for a planar scene or a rotating camera (see 
+// setHomographyPrediction()). Fewer pyramid levels are then needed, and
+// features that move fast with the camera are not lost.
+//
+// Features lost for a few frames, for instance behind an occlusion, can be
+// found again by their appearance and restored to their original slots
+// (see setReidentification()).
+//
+// To hold a frame rate, the number of features, iterations and pyramid 
+// levels can be cut back while frames take too long, and restored when
+// they are fast again (see setLatencyTarget()).
+//
+// By default every image is copied into an image owned by the tracker. In
+// zero-copy mode (see setZeroCopy()) the caller's buffers are used in place,
+// which saves a full frame copy per frame when the caller already keeps the
+// previous frame, as with double-buffered capture.
+//
 // Image display and event handling routines use the SDL library. See:
 // http://www.libsdl.org . 
 //
 // <b>Example Program:</b>
 // \include FeatureTrackerOCV.t.cpp
+// \include HomographyPrediction.t.cpp
 //==============================================================================
 
-class FeatureTrackerOCV
+class FeatureTrackerOCV : public FeatureTracker
 {
  public:
   FeatureTrackerOCV();
@@ -59,6 +96,9 @@ class FeatureTrackerOCV
    
   ~FeatureTrackerOCV();
    // Destructor frees any allocated resources.
+
+  virtual tracker_backend_t getBackend() const {return e_trackerOCV;}
+   //  return  e_trackerOCV.
    
   int initialize(FeatureTrackerContext_t &ftc, OCVTrackingContext_t &ocvt);
    // Initialize the tracker. Call this method before calling 
@@ -67,7 +107,7 @@ class FeatureTrackerOCV
    //  ocvt    tracker algorithm specific settings. 
    //  return  0 on success, -1 on error (error message redirected to stderr).
    
-  int processImage(unsigned char *img, int w, int h, feature_list_t &list);
+  virtual int processImage(unsigned char *img, int w, int h, feature_list_t &list);
    // Track features in the image buffer. Upon calling this method the first time, 
    // features are selected either automatically (if 'auto_select_features' was 
    // turned on during initialization) or by the user. If 'display_tracked_features' 
@@ -83,10 +123,138 @@ class FeatureTrackerOCV
    //  w,h       Image dimensions in pixels.
    //  list      List of tracked features. This list contains updated (x,y) locations
    //            of features and an integer value indicating whether the feature was 
-   //            tracked successfully (0) or not (-1). 
+   //            tracked successfully (e_tracked), was newly detected into this slot
+   //            (e_new), was lost (e_lost), or was tracked far from the
+   //            position predicted by the homography (e_suspect, see
+   //            setHomographyPrediction()).
    //  return    current frame number on success (first frame = 1), -1 on error (error  
    //            message redirected to stderr), -2 on user initiated quit.
   
+  virtual const TrackHistory &getTrackHistory() const {return d_history;}
+   //  return  The history of tracked features over recent frames. Frame 
+   //          numbers start at 0 for the first image processed.
+
+  virtual int openTrackLog(const char *fileName, int indexInterval = 30);
+   // Start logging tracked features from every subsequent call to 
+   // processImage() into a binary track log (see TrackLogWriter). Call 
+   // after initialize(). The log can be read with TrackLogReader.
+   //  fileName       Name of the log file.
+   //  indexInterval  Number of frames between commits of the log header.
+   //  return    0 on success, -1 on error (error message redirected to stderr).
+
+  virtual int closeTrackLog() {return d_log.close();}
+   // Stop logging and close the track log. Also done by the destructor.
+   //  return    0 on success, -1 on error (error message redirected to stderr).
+
+  void setFrameArena(FrameArena *arena) {d_arena = arena;}
+   // Take the workspace of the corner detector (two float images the size
+   // of the input image) from frame scratch memory whenever features are
+   // detected, instead of keeping it allocated in this object. The arena
+   // must be reset by the caller after processImage() returns.
+   //  arena  The arena, or NULL to use memory owned by this object (default).
+
+  virtual int setReplenishment(const ReplenishContext_t *rc);
+   // Replace lost features in every frame after the first by detecting new
+   // corners in the grid cells that have no features left (see 
+   // FeatureReplenisher). New features are reported as e_new. Corners are
+   // detected by a CornerDetector with its default smallest eigenvalue, 
+   // which allocates no memory after the first replenishing frame, unlike 
+   // cvGoodFeaturesToTrack(). Call after initialize().
+   //  rc      Replenishment parameters, or NULL to turn replenishment off
+   //          (default).
+   //  return  0 on success, -1 on error (error message redirected to stderr).
+
+  virtual int setReidentification(const ReidContext_t *rc);
+   // Search for lost features near where they were lost, in the frames
+   // that follow, and restore those found to their slots as e_tracked, so
+   // that they keep their identity (see FeatureReidentifier). With
+   // replenishment on, the slots of features still searched for are 
+   // filled last. Call after initialize().
+   //  rc      Re-identification parameters, or NULL to turn it off
+   //          (default).
+   //  return  0 on success, -1 on error (error message redirected to stderr).
+
+  void setROIMode(bool on) {d_roiOn = on;}
+   // Build the pyramids and track only in a window around the features of
+   // the previous frame: their bounding box expanded by two tracking windows
+   // on the coarsest pyramid level, aligned to 32 pixels. Features that move
+   // further are lost. The whole image is used when the window would reach
+   // past an edge of the image. Replenishment only adds features in cells 
+   // that overlap the window. Saves time in proportion to the area when the
+   // features cover a small part of the image.
+   //  on      true to restrict tracking to the window, false to use the 
+   //          whole image (default).
+
+  int setMotionPrediction(bool on, int maxLevels = OCV_PYR_LEVELS);
+   // Start tracking each feature from where it would be if it kept the
+   // velocity it had between the last two frames (passed to 
+   // cvCalcOpticalFlowPyrLK() as initial guesses), and choose the number of
+   // pyramid levels in every frame from the largest predicted step. Smooth
+   // motion is then tracked with fewer levels. Features without a velocity
+   // yet, such as new ones, are predicted not to move, and the frame is
+   // tracked with all levels.
+   //  on         true to predict, false to start from the previous 
+   //             positions with OCV_PYR_LEVELS levels (default).
+   //  maxLevels  Largest number of levels above the image, 0 to
+   //             OCV_MAX_LEVELS.
+   //  return     0 on success, -1 on error (error message redirected to stderr).
+
+  int setHomographyPrediction(bool on, float maxDeviation = 3);
+   // For a planar scene, start tracking each feature from its position in
+   // the previous frame mapped through the homography given by 
+   // setHomography(), and flag tracked features that end up further than
+   // 'maxDeviation' from there as e_suspect. The number of pyramid levels
+   // is chosen from the largest predicted step, up to the maximum set with
+   // setMotionPrediction(). Takes precedence over velocity prediction.
+   //  on            true to predict with the homography, false not to 
+   //                (default).
+   //  maxDeviation  Distance in pixels beyond which a feature is flagged.
+   //  return        0 on success, -1 on error (error message redirected to stderr).
+
+  void setHomography(const double *h);
+   // Set the homography used by setHomographyPrediction(), until the next
+   // call: usually the projective homography Hpn estimated between the 
+   // last two frames (see ProjectiveHomography), which is assumed to hold
+   // for the next frame as well. The identity is used until it is first set.
+   //  h       The 3x3 matrix, row by row, that maps pixel coordinates 
+   //          [x y 1]' in one frame to those in the next, up to scale.
+
+  void setHomography(const Matrix<3, 3> &Hpn);
+   // Set the homography used by setHomographyPrediction() from the output
+   // of ProjectiveHomography::compute(), as above.
+   //  Hpn     The projective homography that maps pixel coordinates 
+   //          [x y 1]' in one frame to those in the next, up to scale.
+
+  virtual int setLatencyTarget(const BudgetContext_t *bc);
+   // Time every call to processImage(), and adjust the effort spent on the
+   // next frames to stay within a target (see FeatureBudgetController): the
+   // maximum number of iterations, the number of pyramid levels (at most 
+   // one more than the levels above the image set with setMotionPrediction(),
+   // which must be called first) and the number of feature slots in use. 
+   // Features in slots taken out of use are reported lost, and only
+   // replenishment (see setReplenishment()) fills the slots again when they
+   // come back into use. Call after initialize(). Starts from full effort.
+   //  bc      Control parameters, or NULL to track with the settings given
+   //          to initialize() (default).
+   //  return  0 on success, -1 on error (error message redirected to stderr).
+
+  const budget_point_t &getOperatingPoint() const {return d_budget.getOperatingPoint();}
+   //  return  The effort used for the next frame, and the time of recent
+   //          frames if a latency target is set. Pyramid levels include
+   //          the image.
+
+  int setZeroCopy(bool on);
+   // Wrap the caller's image buffers in image headers instead of copying
+   // them. The tracker then holds on to the previous frame by reference,
+   // so the buffer passed to processImage() must stay valid and unchanged
+   // until the next call to processImage() returns (or the tracker is
+   // destroyed). With double-buffered capture, the buffer being filled
+   // must be the one that was passed two frames back. Rows must be packed
+   // (no padding between rows). Call after initialize() and before the first
+   // call to processImage().
+   //  on      true to use caller buffers in place, false to copy (default).
+   //  return  0 on success, -1 on error (error message redirected to stderr).
+   
  protected:
  private:
   SDLWindow d_display;
@@ -100,12 +268,52 @@ class FeatureTrackerOCV
   int *d_trackedFeaturesIndices;
   float *d_trackingErrors;
   IplImage *d_image, *d_prevImage, *d_pyramid, *d_prevPyramid, *d_swapImg;
+  bool d_zeroCopy;
+  IplImage d_frameHeader[2];           // caller's buffers, in zero-copy mode
+  bool isFrameHeader(const IplImage *img) const 
+   {return (img == &d_frameHeader[0]) || (img == &d_frameHeader[1]);}
+  CvRect trackingROI(int w, int h, int levels);
+  int predictFeatures();
+  void shiftFeatures(int dx, int dy);
+  bool d_predictOn;
+  int d_maxLevels;
+  int d_pyramidLevels;                 // levels of the pyramid of d_image
+  CvPoint2D32f *d_velocities;          // per slot: step over the last frame
+  char *d_hasVelocity;                 // per slot: 1 if the step is known
+  bool d_homographyOn;
+  double d_homography[9];
+  float d_maxDeviation;
+  CvPoint2D32f *d_predictions;         // positions predicted by the homography
+  bool d_roiOn;
+  CvRect d_roi;                        // window tracked in the current frame
+  CvRect d_pyramidROI;                 // window of the pyramid of d_image, if built
+  IplImage d_roiHeader[2];             // the window in the previous and current image
+  int getDetectorWorkspace(int w, int h, IplImage **eig, IplImage **temp);
+  IplImage *d_eigImage, *d_tempImage;  // corner detector workspace
+  IplImage d_eigHeader, d_tempHeader;  // same, in frame scratch memory
+  FrameArena *d_arena;
+  int replenish(unsigned char *buf, int w, int h, feature_list_t &list);
+  FeatureReplenisher d_replenisher;
+  ReplenishContext_t d_replenishContext;
+  bool d_replenishOn;
+  CornerDetector d_detector;
+  feature_t *d_cellCorners;
+  int reidentify(unsigned char *buf, int w, int h, feature_list_t &list);
+  FeatureReidentifier d_reid;
+  ReidContext_t d_reidContext;
+  bool d_reidOn;
+  FeatureBudgetController d_budget;
+  bool d_budgetOn;
+  int d_maxIter;                       // as given to initialize()
   int d_frameNumber;
   bool d_autoSelect;
   bool d_displayOn;
+  int d_displayDecimation;
   OCVTrackingContext_t d_trackingContext;
   int d_trackerFlags;
   int d_numDetectedFeatures;
+  TrackHistory d_history;
+  TrackLogWriter d_log;
 };
 
 
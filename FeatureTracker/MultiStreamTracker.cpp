@@ -0,0 +1,215 @@
+//==============================================================================
+// MultiStreamTracker.cpp - Feature tracking for several cameras in one process
+//==============================================================================
+
+#include "MultiStreamTracker.hpp"
+#include "FeatureClientServer.hpp"
+#include "RTUtils/TaskPool.hpp"
+
+//#define DEBUG
+
+
+//==============================================================================
+MultiStreamTracker::MultiStreamTracker()
+//==============================================================================
+{
+ for(int i = 0; i < MST_MAX_STREAMS; ++i) {
+  d_streams[i].tracker = NULL;
+  d_streams[i].buf = NULL;
+  d_streams[i].width = d_streams[i].height = 0;
+  d_streams[i].result = 0;
+ }
+ d_numStreams = 0;
+ d_numActive = 0;
+ d_started = false;
+ d_pool = NULL;
+ d_server = NULL;
+}
+
+
+//==============================================================================
+MultiStreamTracker::~MultiStreamTracker()
+//==============================================================================
+{
+ for(int i = 0; i < d_numStreams; ++i) {
+  if(d_streams[i].tracker) delete d_streams[i].tracker;
+  freeFeatureList(d_streams[i].features);
+ }
+#ifdef DEBUG
+ fprintf(stderr, "[MultiStreamTracker::~MultiStreamTracker] Leaving.\n");
+#endif
+}
+
+
+//==============================================================================
+int MultiStreamTracker::addStream(FeatureTrackerContext_t &ftc, OCVTrackingContext_t &ocvt)
+//==============================================================================
+{
+ int id = newStream(ftc);
+ if(id < 0) return -1;
+
+ FeatureTrackerOCV *tracker = new FeatureTrackerOCV;
+ return addTracker(tracker, tracker->initialize(ftc, ocvt));
+}
+
+
+//==============================================================================
+int MultiStreamTracker::addStream(FeatureTrackerContext_t &ftc, KLT_TrackingContext kltc)
+//==============================================================================
+{
+ int id = newStream(ftc);
+ if(id < 0) return -1;
+
+ FeatureTrackerKLT *tracker = new FeatureTrackerKLT;
+ return addTracker(tracker, tracker->initialize(ftc, kltc));
+}
+
+
+//==============================================================================
+int MultiStreamTracker::addStream(FeatureTrackerContext_t &ftc, LKTrackingContext_t &lkt)
+//==============================================================================
+{
+ int id = newStream(ftc);
+ if(id < 0) return -1;
+
+ FeatureTrackerLK *tracker = new FeatureTrackerLK;
+ return addTracker(tracker, tracker->initialize(ftc, lkt));
+}
+
+
+//==============================================================================
+int MultiStreamTracker::addStream(FeatureTrackerContext_t &ftc, tracker_backend_t backend,
+                                  const TrackerSettings_t &ts)
+//==============================================================================
+{
+ int id = newStream(ftc);
+ if(id < 0) return -1;
+
+ FeatureTracker *tracker = FeatureTracker::create(backend, ftc, ts);
+ return addTracker(tracker, tracker ? 0 : -1);
+}
+
+
+//==============================================================================
+int MultiStreamTracker::setTaskPool(TaskPool *pool)
+//==============================================================================
+{
+ if(d_started) {
+  fprintf(stderr, "[MultiStreamTracker::setTaskPool] ERROR. Tracking already started.\n");
+  return -1;
+ }
+
+ for(int i = 0; i < d_numStreams; ++i) {
+  FeatureTracker *tracker = d_streams[i].tracker;
+  if( (tracker->getBackend() != e_trackerOCV) && (tracker->setTaskPool(pool) != 0) ) 
+   return -1;
+ }
+ d_pool = pool;
+ return 0;
+}
+
+
+//==============================================================================
+int MultiStreamTracker::processImages(unsigned char *const *bufs, const int *w, const int *h)
+//==============================================================================
+{
+ if(d_numStreams == 0) {
+  fprintf(stderr, "[MultiStreamTracker::processImages] ERROR. No streams added.\n");
+  return -1;
+ }
+ d_started = true;
+
+ d_numActive = 0;
+ for(int i = 0; i < d_numStreams; ++i) {
+  if(bufs[i] == NULL) continue;
+  d_streams[i].buf = bufs[i];
+  d_streams[i].width = w[i];
+  d_streams[i].height = h[i];
+  d_active[d_numActive++] = i;
+ }
+
+ if(d_pool) {
+  if( d_pool->parallelFor(0, d_numActive, 1, processStreams, this) != 0 ) return -1;
+ } else {
+  processStreams(0, d_numActive, this);
+ }
+
+ int ret = d_numActive;
+ for(int i = 0; i < d_numActive; ++i) {
+  if(d_streams[d_active[i]].result < 0) {
+   fprintf(stderr, "[MultiStreamTracker::processImages] ERROR in stream %d.\n", d_active[i]);
+   ret = -1;
+  }
+ }
+ return ret;
+}
+
+
+//==============================================================================
+int MultiStreamTracker::newStream(FeatureTrackerContext_t &ftc)
+//==============================================================================
+{
+ if(d_started) {
+  fprintf(stderr, "[MultiStreamTracker::addStream] ERROR. Tracking already started.\n");
+  return -1;
+ }
+ if(d_numStreams >= MST_MAX_STREAMS) {
+  fprintf(stderr, "[MultiStreamTracker::addStream] ERROR. At most %d streams.\n", 
+          MST_MAX_STREAMS);
+  return -1;
+ }
+ if( ftc.display_tracked_features || !ftc.auto_select_features ) {
+  fprintf(stderr, "[MultiStreamTracker::addStream] ERROR. Streams need display off "
+          "and automatic feature selection.\n");
+  return -1;
+ }
+
+ stream_t &s = d_streams[d_numStreams];
+ if( allocateFeatureList(s.features, ftc.num_features) < 0 ) return -1;
+ s.result = 0;
+ return d_numStreams;
+}
+
+
+//==============================================================================
+int MultiStreamTracker::addTracker(FeatureTracker *tracker, int ret)
+//==============================================================================
+{
+ stream_t &s = d_streams[d_numStreams];
+ if(ret != 0) {
+  delete tracker;
+  freeFeatureList(s.features);
+  s.features.features = NULL;
+  return -1;
+ }
+ s.tracker = tracker;
+ return d_numStreams++;
+}
+
+
+//==============================================================================
+void MultiStreamTracker::processStreams(int begin, int end, void *arg)
+//==============================================================================
+{
+ MultiStreamTracker *self = (MultiStreamTracker *)arg;
+ for(int i = begin; i < end; ++i) {
+  int id = self->d_active[i];
+  self->processStream(self->d_streams[id], id);
+ }
+}
+
+
+//==============================================================================
+void MultiStreamTracker::processStream(stream_t &s, int id)
+//==============================================================================
+{
+ s.result = s.tracker->processImage(s.buf, s.width, s.height, s.features);
+ if(s.result < 0) {
+  s.result = -1;
+  return;
+ }
+ s.features.frame_number = s.result;
+
+ if( d_server && (d_server->updateFeatures(s.features, s.result, id) != 0) )
+  s.result = -1;
+}
@@ -0,0 +1,135 @@
+//==============================================================================
+// MultiStreamTracker.hpp - Feature tracking for several cameras in one process
+//==============================================================================
+
+#ifndef INCLUDED_MULTISTREAMTRACKER_HPP
+#define INCLUDED_MULTISTREAMTRACKER_HPP
+
+#include "FeatureTrackerOCV.hpp"
+#include "FeatureTrackerKLT.hpp"
+#include "FeatureTrackerLK.hpp"
+
+class TaskPool;
+class FeatureServer;
+
+#define MST_MAX_STREAMS 16   // maximum number of streams
+
+
+//==============================================================================
+// class MultiStreamTracker
+//------------------------------------------------------------------------------
+// \brief
+// Tracks features in the images of several cameras with one tracker per
+// camera stream, sharing one pool of worker threads and one feature server.
+//
+// Each stream has its own tracker (FeatureTrackerOCV, FeatureTrackerKLT or
+// FeatureTrackerLK), with its own settings, image buffers and feature list.
+// processImages() takes the latest image of every stream that has one, and
+// runs the streams as tasks of a TaskPool. A stream is processed entirely
+// by one task, so its buffers stay in one cache. Trackers that track in
+// parallel (KLT and LK) also split their own features over the same pool
+// while other streams run. KLT streams take turns in the calls into the
+// KLT library, which is not reentrant (see FeatureTrackerKLT). The features
+// of stream i are published to the FeatureServer as stream id i as soon as
+// that stream is done.
+//
+// Streams run without a display: features must be selected automatically
+// and 'display_tracked_features' must be off.
+//
+// <b>Example Program:</b>
+// \include MultiStreamTracker.t.cpp
+//==============================================================================
+class MultiStreamTracker
+{
+ public:
+  MultiStreamTracker();
+   // Default constructor.
+
+  ~MultiStreamTracker();
+   // Destructor frees all trackers and feature lists.
+
+  int addStream(FeatureTrackerContext_t &ftc, OCVTrackingContext_t &ocvt);
+  int addStream(FeatureTrackerContext_t &ftc, KLT_TrackingContext kltc);
+  int addStream(FeatureTrackerContext_t &ftc, LKTrackingContext_t &lkt);
+   // Add a stream tracked by FeatureTrackerOCV, FeatureTrackerKLT or
+   // FeatureTrackerLK, initialized with the given settings. Every KLT stream
+   // needs its own KLT context, which must outlive this object. Call before
+   // the first call to processImages().
+   //  ftc     settings common to all trackers. Display must be off and
+   //          features selected automatically.
+   //  ocvt, kltc, lkt  tracker algorithm specific settings.
+   //  return  the stream id (0 for the first stream added and so on), -1 on
+   //          error (error message redirected to stderr).
+
+  int addStream(FeatureTrackerContext_t &ftc, tracker_backend_t backend,
+                const TrackerSettings_t &ts = TrackerSettings_t());
+   // Add a stream tracked by a tracker chosen at run time (see
+   // FeatureTracker::create()). Call before the first call to processImages().
+   //  ftc      As above.
+   //  backend  The tracker of the stream.
+   //  ts       Tracking parameters.
+   //  return   As above.
+
+  int setTaskPool(TaskPool *pool);
+   // Process streams in parallel using a pool of worker threads. The pool is
+   // shared, not owned. Call after adding streams and before the first call
+   // to processImages().
+   //  pool    The task pool, or NULL to process streams one after another in
+   //          the calling thread (default).
+   //  return  0 on success, -1 on error (error message redirected to stderr).
+
+  void setFeatureServer(FeatureServer *server) {d_server = server;}
+   // Publish the features of every stream through a feature server. The
+   // server is shared, not owned, and must be initialized with at least as
+   // many streams, and with as many features, as the streams added here.
+   //  server  The server, or NULL to not publish features (default).
+
+  int processImages(unsigned char *const *bufs, const int *w, const int *h);
+   // Track features in the latest image of every stream, and wait for all
+   // streams to finish. Streams without a new image are skipped.
+   //  bufs    One image buffer per stream (8 bit grayscale), NULL if the
+   //          stream has no new image. Each buffer is passed to the
+   //          processImage() method of the stream's tracker.
+   //  w,h     Image dimensions of each stream in pixels.
+   //  return  Number of streams processed, -1 if any stream failed (error
+   //          message redirected to stderr, see getFrameNumber()).
+
+  inline int getNumStreams() const {return d_numStreams;}
+   //  return  Number of streams added.
+
+  const feature_list_t &getFeatures(int stream) const {return d_streams[stream].features;}
+   //  stream  The stream id.
+   //  return  Features tracked in the last image of the stream.
+
+  inline int getFrameNumber(int stream) const {return d_streams[stream].result;}
+   //  stream  The stream id.
+   //  return  Value returned by the tracker for the last image of the
+   //          stream: frame number (first frame = 1), or -1 on error. 0 before
+   //          the first image.
+
+ protected:
+ private:
+  MultiStreamTracker(const MultiStreamTracker &);
+  MultiStreamTracker &operator=(const MultiStreamTracker &);
+  typedef struct _stream
+  {
+   FeatureTracker *tracker;
+   feature_list_t features;
+   unsigned char *buf;         // image being processed
+   int width, height;
+   int result;
+  }stream_t;
+  int newStream(FeatureTrackerContext_t &ftc);
+  int addTracker(FeatureTracker *tracker, int ret);
+  static void processStreams(int begin, int end, void *arg);
+  void processStream(stream_t &s, int id);
+  stream_t d_streams[MST_MAX_STREAMS];
+  int d_numStreams;
+  int d_active[MST_MAX_STREAMS];   // streams with a new image
+  int d_numActive;
+  bool d_started;
+  TaskPool *d_pool;
+  FeatureServer *d_server;
+};
+
+#endif // INCLUDED_MULTISTREAMTRACKER_HPP
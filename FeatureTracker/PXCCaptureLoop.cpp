@@ -5,6 +5,9 @@
 //==============================================================================
 
 #include "PXCCaptureLoop.hpp"
+#include "RTUtils/FrameHandoff.hpp"
+#include <stdlib.h>
+#include <string.h>
 
 //#define DEBUG
 
@@ -22,6 +25,10 @@ PXCCaptureLoop::PXCCaptureLoop()
  d_triggerChannel = -1;
  d_bpp = 0;
  d_priority = 0;
+ d_handoff = NULL;
+ d_fieldMode = e_fullFrame;
+ d_fieldBuf = NULL;
+ d_field = -1;
 #ifdef DEBUG 
  fprintf(stderr, "DEBUG [PXCCaptureLoop::PXCCaptureLoop] leaving\n");
 #endif
@@ -42,6 +49,7 @@ PXCCaptureLoop::~PXCCaptureLoop()
   PXC200_CloseLibrary(&d_pxcLib);
   FRAMELIB_CloseLibrary(&d_frameLib);
  }
+ if(d_fieldBuf) free(d_fieldBuf);
 #ifdef DEBUG 
  fprintf(stderr, "DEBUG [PXCCaptureLoop::~PXCCaptureLoop] leaving\n");
 #endif
@@ -152,13 +160,33 @@ int PXCCaptureLoop::getImageProperties(int &w, int &h, int &bpp)
   return(-1);
  }
  w = d_imgWidth;
- h = d_imgHeight;
+ h = (d_fieldMode == e_fullFrame) ? d_imgHeight : d_imgHeight / 2;
  bpp = d_bpp;
  
  return 0;
 }
 
 
+//==============================================================================
+int PXCCaptureLoop::setFieldMode(pxc_field_mode_t mode)
+//==============================================================================
+{
+ if( !d_isInit ) {
+  fprintf(stderr, "[PXCCaptureLoop::setFieldMode]: ERROR PXC not initialized yet\n");
+  return(-1);
+ }
+ if(mode != e_fullFrame) {
+  d_fieldBuf = (unsigned char *)realloc(d_fieldBuf, d_imgWidth * (d_imgHeight / 2) * d_bpp);
+  if(d_fieldBuf == NULL) {
+   fprintf(stderr, "[PXCCaptureLoop::setFieldMode]: ERROR allocating field buffer\n");
+   return(-1);
+  }
+ }
+ d_fieldMode = mode;
+ return 0;
+}
+
+
 //==============================================================================
 int PXCCaptureLoop::startCaptureLoop()
 //==============================================================================
@@ -186,7 +214,7 @@ int PXCCaptureLoop::startCaptureLoop()
 int PXCCaptureLoop::processImage(const unsigned char *fbr, int w, int h, int bpp)
 //==============================================================================
 { 
- w = w; h = h; bpp = bpp; fbr = fbr;
+ if( d_handoff && (d_handoff->put(fbr, w * h * bpp) < 0) ) return -1;
 #ifdef DEBUG 
  fprintf(stderr, "DEBUG [PXCCaptureLoop::processImage] success\n");
 #endif
@@ -201,16 +229,7 @@ void PXCCaptureLoop::enterThread(void *arg)
 #ifdef DEBUG 
  fprintf(stderr, "DEBUG [PXCCaptureLoop::enterThread] entering\n");
 #endif
- struct sched_param param;
- int policy;
-
- pthread_getschedparam(pthread_self(), &policy, &param);
- policy = SCHED_FIFO;
- param.sched_priority = ((PXCCaptureLoop *)arg)->d_priority;
- pthread_setschedparam(pthread_self(), policy, &param);
- pthread_getschedparam(pthread_self(), &policy, &param);
- fprintf(stdout, "[PXCCaptureLoop::enterThread]: Thread priority set to %d\n", 
-         param.sched_priority);
+ applyThreadPlacement(e_captureThread, ((PXCCaptureLoop *)arg)->d_priority);
 #ifdef DEBUG 
  fprintf(stderr, "DEBUG [PXCCaptureLoop::enterThread] success\n");
 #endif
@@ -231,9 +250,6 @@ int PXCCaptureLoop::executeInThread(void *arg)
  int trigChannel = classPtr->d_triggerChannel;
  int mask = 1 << trigChannel;
  int gh[2];
- int w = classPtr->d_imgWidth;
- int h = classPtr->d_imgHeight;
- int bpp = classPtr->d_bpp;
  unsigned char *fbAddr[2]; 
 
  fbAddr[0] = (unsigned char *)classPtr->d_frameLib.FrameBuffer(classPtr->d_frHandle[0]);
@@ -247,11 +263,11 @@ int PXCCaptureLoop::executeInThread(void *arg)
   
   for(;;) {
    nanosleep(&t, NULL);
-   if( classPtr->processImage(fbAddr[0], w, h, bpp) != 0 ) break;
+   if( classPtr->passImage(fbAddr[0]) != 0 ) break;
    gh[0] = classPtr->d_pxcLib.Grab(classPtr->d_fgHandle, d_frHandle[0], QUEUED);
    nanosleep(&t, NULL);
    classPtr->d_pxcLib.WaitFinished(classPtr->d_fgHandle, gh[1]);
-   if( classPtr->processImage(fbAddr[1], w, h, bpp) != 0 ) break;
+   if( classPtr->passImage(fbAddr[1]) != 0 ) break;
    gh[1] = classPtr->d_pxcLib.Grab(classPtr->d_fgHandle, d_frHandle[1], QUEUED);
    classPtr->d_pxcLib.WaitFinished(classPtr->d_fgHandle, gh[0]);
    pthread_testcancel();
@@ -264,7 +280,7 @@ int PXCCaptureLoop::executeInThread(void *arg)
    classPtr->d_pxcLib.WaitAnyEvent(classPtr->d_fgHandle, classPtr->d_fgHandle, mask, 1, QUEUED);
    gh[0] = classPtr->d_pxcLib.Grab(classPtr->d_fgHandle, d_frHandle[0], QUEUED);
    classPtr->d_pxcLib.WaitFinished(classPtr->d_fgHandle, gh[0]);
-   if( classPtr->processImage(fbAddr[0], w, h, bpp) != 0 )
+   if( classPtr->passImage(fbAddr[0]) != 0 )
     break;
    pthread_testcancel();
    nanosleep(&t, NULL);
@@ -279,6 +295,31 @@ int PXCCaptureLoop::executeInThread(void *arg)
 }
 
 
+//==============================================================================
+int PXCCaptureLoop::passImage(const unsigned char *fbr)
+//==============================================================================
+{
+ if(d_fieldMode == e_fullFrame) {
+  d_field = -1;
+  return processImage(fbr, d_imgWidth, d_imgHeight, d_bpp);
+ }
+
+ // split the frame into fields, even first
+ int rowBytes = d_imgWidth * d_bpp;
+ int fh = d_imgHeight / 2;
+ for(int f = 0; f < 2; ++f) {
+  if( ((d_fieldMode == e_evenField) && (f == 1)) || ((d_fieldMode == e_oddField) && (f == 0)) )
+   continue;
+  const unsigned char *src = fbr + f * rowBytes;
+  for(int y = 0; y < fh; ++y, src += 2 * rowBytes)
+   memcpy(d_fieldBuf + y * rowBytes, src, rowBytes);
+  d_field = f;
+  if( processImage(d_fieldBuf, d_imgWidth, fh, d_bpp) != 0 ) return -1;
+ }
+ return 0;
+}
+
+
 //==============================================================================
 void PXCCaptureLoop::exitThread(void *arg)
 //==============================================================================
@@ -9,8 +9,11 @@
 #include "pxc200/pxc.h"
 #include "pxc200/frame.h"
 #include "putils/Thread.hpp"
+#include "RTUtils/ThreadPlacement.hpp"
 #include <stdio.h>
 
+class FrameHandoff;
+
 
 //==============================================================================
 /*! \struct _PXCContext
@@ -24,10 +27,25 @@ typedef struct _PXCContext
  int pixel_format;     //!< see frame.h for image data types. Use PBITS_Y8 or PBITS_RGB24
  int video_format;     //!< see pxc.h for video detect types. Use NTSC_FORMAT
  int trigger_channel;  //!< -1 for no external triggering; else triggers on rising edge. 
- int thread_priority;  //!< Priority of image capturing thread.
+ int thread_priority;  /*!< Priority of image capturing thread (SCHED_FIFO). Used 
+                            only if no placement was set for e_captureThread
+                            (see ThreadPlacement.hpp in RTUtils). */
 }PXCContext_t;
 
 
+//==============================================================================
+/*! \enum _pxc_field_mode
+    \brief Images passed on by PXCCaptureLoop from interlaced frames */
+//==============================================================================
+typedef enum _pxc_field_mode
+{
+ e_fullFrame = 0,  //!< Whole frames, as captured.
+ e_evenField,      //!< The even field (frame rows 0, 2, 4...) of every frame.
+ e_oddField,       //!< The odd field (frame rows 1, 3, 5...) of every frame.
+ e_bothFields      //!< Both fields of every frame, even then odd.
+}pxc_field_mode_t;
+
+
 //==============================================================================
 // class PXCCaptureLoop
 //------------------------------------------------------------------------------
@@ -42,6 +60,18 @@ typedef struct _PXCContext
 // with the QNX 6.2.1 device driver for PXC200AF. More information on PXC series
 // framegrabbers are available here: http://www.imagenation.com/pxcfamily.html.
 //
+// With interlaced video, the two fields of a frame are captured 1/60 s 
+// apart, so moving edges are combed in full frames. In field mode (see 
+// setFieldMode()), each frame is split into its fields, which are passed on
+// as half-height images: one field per frame, for half the work per frame, 
+// or both, for twice the temporal rate. Either way there is no interlace
+// error. Coordinates measured in a field map back to the frame with 
+// fieldToFrame() (see TrackerUtils.hpp).
+//
+// Frames can be passed to a processing thread through a FrameHandoff (see
+// setFrameHandoff() and RTUtils), which decides explicitly which frames to
+// drop when processing falls behind and accounts for them.
+//
 // <b>Example Program:</b>
 // \include PXCCaptureLoop.t.cpp
 //==============================================================================
@@ -65,9 +95,35 @@ class PXCCaptureLoop : public Thread
    // everytime a new image is acquired.
    //  return  0 on success, -1 on error (error message redirected to stderr).
   
+  int setFieldMode(pxc_field_mode_t mode);
+   // Pass on fields instead of whole frames. Fields are separated by
+   // copying every other row of the frame, and passed to processImage() as
+   // images of half the height. In e_bothFields mode, processImage() is
+   // called twice per frame, once the whole frame is captured. The fields
+   // are thus 1/60 s apart, but arrive in pairs. Call after initialize() and
+   // before startCaptureLoop().
+   //  mode    What to pass on (default e_fullFrame).
+   //  return  0 on success, -1 on error (error message redirected to stderr).
+
+  inline pxc_field_mode_t getFieldMode() const {return d_fieldMode;}
+   //  return  What is passed on (see setFieldMode()).
+
+  inline int getField() const {return d_field;}
+   //  return  The field of the image being passed to processImage(): 0 for
+   //          even, 1 for odd, -1 for a whole frame. In e_bothFields mode,
+   //          an image put into a frame handoff (see setFrameHandoff()) is 
+   //          the even field if its number is even.
+
+  void setFrameHandoff(FrameHandoff *handoff) {d_handoff = handoff;}
+   // Put every captured frame into a frame handoff, from which a processing 
+   // thread takes frames with FrameHandoff::acquire(). Used by the default
+   // processImage(). The handoff is shared, not owned, and must be 
+   // initialized with images of w * h * bpp bytes (see getImageProperties()).
+   //  handoff  The handoff, or NULL for none (default).
+
   int getImageProperties(int &w, int &h, int &bpp);
    // Get properties of the images being captured by the camera
-   //  w, h    Width and height of the image.
+   //  w, h    Width and height of the image (of a field in field mode).
    //  bpp     Image bytes per pixel (1 = 8 bit grayscale, 3 = 24 bit RGB).
    //  return  0 on success, -1 on error (error message redirected to stderr).
    
@@ -79,6 +135,8 @@ class PXCCaptureLoop : public Thread
    // frames. A suggested implementation would do nothing more than memcpy() 
    // the framebuffer to a user specified buffer and return immediately. A 
    // separate thread/process can then process the contents of the copied buffer.
+   // The default implementation puts the frame into the frame handoff, if
+   // one was set (see setFrameHandoff()).
    //  fbr     Pointer to frame buffer containing current image update.
    //  w, h    Width and height of the image.
    //  bpp     Image bytes per pixel (1 = 8 bit grayscale, 3 = 24 bit RGB).
@@ -106,6 +164,11 @@ class PXCCaptureLoop : public Thread
   int d_priority;
   bool d_isInit;
   bool d_libOpenError;
+  FrameHandoff *d_handoff;
+  int passImage(const unsigned char *fbr);
+  pxc_field_mode_t d_fieldMode;
+  unsigned char *d_fieldBuf;
+  int d_field;
 };
 
 #endif // INCLUDED_PXCCAPTURELOOP_HPP
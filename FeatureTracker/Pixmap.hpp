@@ -81,8 +81,9 @@ class Pixmap
    
   int create(int w, int h);
    // Allocates a new data buffer for image data, or resizes a previously
-   // allocated buffer. The buffer values are not initialized, and 
-   // may be anything arbitrary.
+   // allocated buffer. The buffer is only reallocated if it must grow, so 
+   // repeated calls with the same (or smaller) size do not touch the heap.
+   // The buffer values are not initialized, and may be anything arbitrary.
    //  w       width (pixels).
    //  h       height (pixels).
    //  return  0 on success, -1 if failed.
@@ -158,6 +159,7 @@ class Pixmap
   T *d_imgData;
   int d_w;
   int d_h;
+  int d_capacity;  // pixels allocated in d_imgData (0 if external)
 
  private:
   Pixmap(Pixmap &p) {return;};
@@ -193,17 +195,26 @@ Pixmap<T>::Pixmap()
  d_w = 0;
  d_h = 0;
  d_imgData = NULL;
+ d_capacity = 0;
 }
 
 template <class T>
 Pixmap<T>::Pixmap(int w, int h)
 {
+ d_usingExternalBuffer = false;
+ d_w = 0;
+ d_h = 0;
+ d_imgData = NULL;
+ d_capacity = 0;
  create(w,h);
 }
 
 template <class T>
 Pixmap<T>::Pixmap(uint8_t *buffer, int w, int h)
 {
+ d_usingExternalBuffer = false;
+ d_imgData = NULL;
+ d_capacity = 0;
  attach(buffer,w,h);
 }
 
@@ -225,15 +236,23 @@ Pixmap<T>::~Pixmap()
 template <class T>
 int Pixmap<T>::create(int w, int h)
 {
- d_usingExternalBuffer = false;
  if (w <= 0 || h <= 0 ) {
   fprintf(stderr, "[Pixmap::create]: Invalid Params (%d, %d)\n", w, h);
   return -1;
  }
- d_imgData = (T *)realloc(d_imgData, sizeof(T) * w * h);
- if( d_imgData == NULL) {
-  fprintf(stderr, "[Pixmap::create]: Error allocating image buffer.\n");
-  return -1;
+ if(d_usingExternalBuffer) {
+  d_imgData = NULL;
+  d_capacity = 0;
+ }
+ d_usingExternalBuffer = false;
+ if(w * h > d_capacity) {
+  d_imgData = (T *)realloc(d_imgData, sizeof(T) * w * h);
+  if( d_imgData == NULL) {
+   fprintf(stderr, "[Pixmap::create]: Error allocating image buffer.\n");
+   d_capacity = 0;
+   return -1;
+  }
+  d_capacity = w * h;
  }
  d_w = w;
  d_h = h;
@@ -247,6 +266,9 @@ int Pixmap<T>::create(int w, int h)
 template <class T>
 int Pixmap<T>::attach(uint8_t *buffer, int w, int h)
 {
+ if(!d_usingExternalBuffer && d_imgData)
+  free(d_imgData);
+ d_capacity = 0;
  d_usingExternalBuffer = true;
  d_w = w;
  d_h = h;
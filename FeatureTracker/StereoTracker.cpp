@@ -0,0 +1,383 @@
+//==============================================================================
+// StereoTracker.cpp - Feature tracking in a rectified stereo pair, with
+//                     matching along epipolar lines
+//==============================================================================
+
+#include "StereoTracker.hpp"
+#include "RTUtils/TaskPool.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//#define DEBUG
+
+#define TMPL_STRIDE 32   // bytes per row of a template window, zero padded
+
+static void extractTemplate(const unsigned char *src, int stride, int win,
+                            unsigned char *tmpl, unsigned char *mask, int *sum, int *sumSq);
+static int sad(const unsigned char *tmpl, const unsigned char *mask, const unsigned char *src,
+               int stride, int win, bool simd);
+static double ncc(const unsigned char *tmpl, const unsigned char *mask,
+                  const unsigned char *src, int stride, int win, int sumL, int sumSqL,
+                  bool simd);
+
+
+//==============================================================================
+StereoTracker::StereoTracker()
+//==============================================================================
+{
+ d_tracker = NULL;
+ d_numFeatures = 0;
+ d_disparities = NULL;
+ d_previous = NULL;
+ d_left = d_right = NULL;
+ d_width = d_height = 0;
+ d_leftList = NULL;
+ d_rightList = NULL;
+ d_numSearches = 0;
+ d_pool = NULL;
+}
+
+
+//==============================================================================
+StereoTracker::~StereoTracker()
+//==============================================================================
+{
+ if(d_tracker) delete d_tracker;
+ if(d_disparities) free(d_disparities);
+ if(d_previous) free(d_previous);
+#ifdef DEBUG
+ fprintf(stderr, "[StereoTracker::~StereoTracker] Leaving.\n");
+#endif
+}
+
+
+//==============================================================================
+int StereoTracker::initialize(FeatureTrackerContext_t &ftc, StereoContext_t &sc,
+                              tracker_backend_t backend, const TrackerSettings_t &ts)
+//==============================================================================
+{
+ if( (sc.window_size < 3) || (sc.window_size > STEREO_MAX_WINDOW)
+     || (sc.window_size % 2 != 1) ) {
+  fprintf(stderr, "[StereoTracker::initialize] ERROR. Window size must be odd, 3 to %d.\n",
+          STEREO_MAX_WINDOW);
+  return -1;
+ }
+ if( (sc.min_disparity < 0) || (sc.max_disparity < sc.min_disparity)
+     || (sc.max_disparity > STEREO_MAX_DISPARITY) || (sc.search_radius < 1) ) {
+  fprintf(stderr, "[StereoTracker::initialize] ERROR. Invalid disparity range.\n");
+  return -1;
+ }
+ if(ftc.num_features < 1) {
+  fprintf(stderr, "[StereoTracker::initialize] ERROR. Invalid number of features.\n");
+  return -1;
+ }
+
+ if(d_tracker) delete d_tracker;
+ if(d_disparities) free(d_disparities);
+ if(d_previous) free(d_previous);
+ d_disparities = (float *)malloc(ftc.num_features * sizeof(float));
+ d_previous = (float *)malloc(ftc.num_features * sizeof(float));
+ d_tracker = FeatureTracker::create(backend, ftc, ts);
+ if( !d_disparities || !d_previous || !d_tracker ) {
+  fprintf(stderr, "[StereoTracker::initialize] ERROR creating the tracker.\n");
+  return -1;
+ }
+ for(int i = 0; i < ftc.num_features; ++i)
+  d_disparities[i] = d_previous[i] = -1;
+ d_numFeatures = ftc.num_features;
+ d_stereoContext = sc;
+ d_pool = NULL;
+ return 0;
+}
+
+
+//==============================================================================
+int StereoTracker::setTaskPool(TaskPool *pool)
+//==============================================================================
+{
+ if(!d_tracker) {
+  fprintf(stderr, "[StereoTracker::setTaskPool] ERROR. Not initialized.\n");
+  return -1;
+ }
+
+ // the OpenCV tracker tracks in the calling thread only
+ if( (d_tracker->getBackend() != e_trackerOCV) && (d_tracker->setTaskPool(pool) != 0) )
+  return -1;
+ d_pool = pool;
+ return 0;
+}
+
+
+//==============================================================================
+int StereoTracker::processImages(unsigned char *left, unsigned char *right, int w, int h,
+                                 feature_list_t &leftList, feature_list_t &rightList)
+//==============================================================================
+{
+ if(!d_tracker) {
+  fprintf(stderr, "[StereoTracker::processImages] ERROR. Not initialized.\n");
+  return -1;
+ }
+ if( !left || !right ) {
+  fprintf(stderr, "[StereoTracker::processImages] ERROR. Need both images.\n");
+  return -1;
+ }
+ if( (leftList.num_features > d_numFeatures)
+     || (rightList.num_features < leftList.num_features) ) {
+  fprintf(stderr, "[StereoTracker::processImages] ERROR. Feature lists too small.\n");
+  return -1;
+ }
+
+ // the features of a pipelined tracker belong to the previous left image
+ if( d_tracker->isPipelined() ) {
+  fprintf(stderr, "[StereoTracker::processImages] ERROR. Pipelined trackers are not supported.\n");
+  return -1;
+ }
+
+ int ret = d_tracker->processImage(left, w, h, leftList);
+ if(ret < 0) return ret;
+
+ float *t = d_previous;
+ d_previous = d_disparities;
+ d_disparities = t;
+ d_left = left;
+ d_right = right;
+ d_width = w;
+ d_height = h;
+ d_leftList = &leftList;
+ d_rightList = &rightList;
+ rightList.frame_number = leftList.frame_number;
+
+ // each feature is matched independently of the others
+ if(d_pool) {
+  if( d_pool->parallelFor(0, leftList.num_features, 8, matchFeatures, this) != 0 ) return -1;
+ } else {
+  matchFeatures(0, leftList.num_features, this);
+ }
+ for(int i = leftList.num_features; i < rightList.num_features; ++i)
+  rightList.features[i].val = e_lost;
+
+ d_numSearches = 0;
+ for(int i = 0; i < leftList.num_features; ++i)
+  if(rightList.features[i].val == e_new) ++d_numSearches;
+#ifdef DEBUG
+ fprintf(stderr, "[StereoTracker::processImages] Frame %d: %d full searches.\n", ret,
+         d_numSearches);
+#endif
+ return ret;
+}
+
+
+//==============================================================================
+void StereoTracker::matchFeatures(int begin, int end, void *arg)
+//==============================================================================
+{
+ StereoTracker *self = (StereoTracker *)arg;
+ for(int i = begin; i < end; ++i) {
+  const feature_t &f = self->d_leftList->features[i];
+  feature_t &r = self->d_rightList->features[i];
+  float d = self->d_previous[i];
+  int val = e_lost;
+  if(f.val >= 0) {
+   // a feature that stayed in its slot is first looked for near its
+   // disparity in the previous frame
+   if( (f.val != e_new) && (d >= 0) && self->matchFeature(f, d, true) )
+    val = e_tracked;
+   else if( self->matchFeature(f, d, false) )
+    val = e_new;
+  }
+  if(val == e_lost) {
+   r.x = r.y = 0;
+   self->d_disparities[i] = -1;
+  } else {
+   r.x = f.x - d;
+   r.y = f.y;
+   self->d_disparities[i] = d;
+  }
+  r.val = val;
+ }
+}
+
+
+//==============================================================================
+bool StereoTracker::matchFeature(const feature_t &f, float &disparity, bool narrow) const
+//==============================================================================
+{
+ const StereoContext_t &sc = d_stereoContext;
+ int win = sc.window_size;
+ int half = win / 2;
+ int xi = (int)(f.x + 0.5f);
+ int yi = (int)(f.y + 0.5f);
+ if( (xi < half) || (yi < half) || (xi + half >= d_width) || (yi + half >= d_height) )
+  return false;
+
+ // disparities that keep the window in the right image
+ int first = sc.min_disparity;
+ int last = (sc.max_disparity < xi - half) ? sc.max_disparity : xi - half;
+ if(narrow) {
+  int lo = (int)floor(disparity - sc.search_radius);
+  int hi = (int)ceil(disparity + sc.search_radius);
+  if(lo > first) first = lo;
+  if(hi < last) last = hi;
+ }
+ if(first > last) return false;
+
+ unsigned char tmpl[STEREO_MAX_WINDOW * TMPL_STRIDE];
+ unsigned char mask[TMPL_STRIDE];
+ int sumL, sumSqL;
+ extractTemplate(d_left + (yi - half) * d_width + xi - half, d_width, win, tmpl, mask,
+                 &sumL, &sumSqL);
+
+ // SIMD loads read whole 16 byte blocks of each row, which must not go
+ // past the end of the image
+ const unsigned char *top = d_right + (yi - half) * d_width + xi - half;
+ int blocks = (win > 16) ? 32 : 16;
+ long room = (long)d_width * d_height - ((long)(yi + half) * d_width + xi - half);
+
+ int costs[STEREO_MAX_DISPARITY + 1];
+ int best = first;
+ for(int d = first; d <= last; ++d) {
+  costs[d - first] = sad(tmpl, mask, top - d, d_width, win, room + d >= blocks);
+  if(costs[d - first] < costs[best - first]) best = d;
+ }
+
+ if(narrow) {
+  // the minimum must be inside the window, else the feature moved further
+  if( ((best == first) && (first > sc.min_disparity))
+      || ((best == last) && (last < sc.max_disparity) && (last < xi - half)) )
+   return false;
+ } else {
+  int second = -1;
+  for(int d = first; d <= last; ++d)
+   if( ((d < best - 1) || (d > best + 1)) && ((second < 0) || (costs[d - first] < second)) )
+    second = costs[d - first];
+  if( (second >= 0) && (second <= (1 + sc.uniqueness) * costs[best - first]) ) return false;
+ }
+
+ if( ncc(tmpl, mask, top - best, d_width, win, sumL, sumSqL, room + best >= blocks)
+     < sc.min_ncc )
+  return false;
+
+ // parabola through the costs around the minimum
+ float offset = 0;
+ if( (best > first) && (best < last) ) {
+  int c0 = costs[best - first - 1], c1 = costs[best - first], c2 = costs[best - first + 1];
+  int denom = c0 - 2 * c1 + c2;
+  if(denom > 0) offset = 0.5f * (c0 - c2) / denom;
+ }
+ disparity = best + offset;
+ return true;
+}
+
+
+//==============================================================================
+// extractTemplate - copy a window into rows of TMPL_STRIDE bytes, zero past
+// the window, with a mask of the window columns and the sums of the pixels
+// and their squares
+//==============================================================================
+void extractTemplate(const unsigned char *src, int stride, int win,
+                     unsigned char *tmpl, unsigned char *mask, int *sum, int *sumSq)
+{
+ memset(mask, 0, TMPL_STRIDE);
+ memset(mask, 0xff, win);
+ int s = 0, s2 = 0;
+ for(int y = 0; y < win; ++y, src += stride, tmpl += TMPL_STRIDE) {
+  memset(tmpl + win, 0, TMPL_STRIDE - win);
+  for(int x = 0; x < win; ++x) {
+   tmpl[x] = src[x];
+   s += src[x];
+   s2 += src[x] * src[x];
+  }
+ }
+ *sum = s;
+ *sumSq = s2;
+}
+
+
+//==============================================================================
+// sad - sum of absolute differences between a template and a window of
+// the image, 16 pixels at a time if 'simd' is set
+//==============================================================================
+int sad(const unsigned char *tmpl, const unsigned char *mask, const unsigned char *src,
+        int stride, int win, bool simd)
+{
+#ifdef __SSE2__
+ if(simd) {
+  __m128i m0 = _mm_loadu_si128((const __m128i *)mask);
+  __m128i acc = _mm_setzero_si128();
+  if(win <= 16) {
+   for(int y = 0; y < win; ++y, src += stride, tmpl += TMPL_STRIDE) {
+    __m128i r = _mm_and_si128(_mm_loadu_si128((const __m128i *)src), m0);
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(r, _mm_loadu_si128((const __m128i *)tmpl)));
+   }
+  } else {
+   __m128i m1 = _mm_loadu_si128((const __m128i *)(mask + 16));
+   for(int y = 0; y < win; ++y, src += stride, tmpl += TMPL_STRIDE) {
+    __m128i r0 = _mm_loadu_si128((const __m128i *)src);
+    __m128i r1 = _mm_and_si128(_mm_loadu_si128((const __m128i *)(src + 16)), m1);
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(r0, _mm_loadu_si128((const __m128i *)tmpl)));
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(r1, _mm_loadu_si128((const __m128i *)(tmpl + 16))));
+   }
+  }
+  return _mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+ }
+#endif
+ int s = 0;
+ for(int y = 0; y < win; ++y, src += stride, tmpl += TMPL_STRIDE)
+  for(int x = 0; x < win; ++x)
+   s += (src[x] > tmpl[x]) ? src[x] - tmpl[x] : tmpl[x] - src[x];
+ return s;
+}
+
+
+//==============================================================================
+// ncc - normalized cross correlation between a template and a window of
+// the image, 16 pixels at a time if 'simd' is set
+//==============================================================================
+double ncc(const unsigned char *tmpl, const unsigned char *mask, const unsigned char *src,
+           int stride, int win, int sumL, int sumSqL, bool simd)
+{
+ int sumR = 0, sumSqR = 0, sumLR = 0;
+ int y = 0;
+#ifdef __SSE2__
+ if(simd) {
+  __m128i z = _mm_setzero_si128();
+  __m128i ps = _mm_setzero_si128(), psq = _mm_setzero_si128(), pc = _mm_setzero_si128();
+  int blocks = (win > 16) ? 2 : 1;
+  for(; y < win; ++y, src += stride, tmpl += TMPL_STRIDE) {
+   for(int b = 0; b < blocks; ++b) {
+    __m128i r = _mm_and_si128(_mm_loadu_si128((const __m128i *)(src + 16 * b)),
+                              _mm_loadu_si128((const __m128i *)(mask + 16 * b)));
+    __m128i t = _mm_loadu_si128((const __m128i *)(tmpl + 16 * b));
+    __m128i rlo = _mm_unpacklo_epi8(r, z), rhi = _mm_unpackhi_epi8(r, z);
+    ps = _mm_add_epi64(ps, _mm_sad_epu8(r, z));
+    psq = _mm_add_epi32(psq, _mm_add_epi32(_mm_madd_epi16(rlo, rlo), _mm_madd_epi16(rhi, rhi)));
+    pc = _mm_add_epi32(pc, _mm_add_epi32(_mm_madd_epi16(rlo, _mm_unpacklo_epi8(t, z)),
+                                         _mm_madd_epi16(rhi, _mm_unpackhi_epi8(t, z))));
+   }
+  }
+  int a[4], c[4];
+  _mm_storeu_si128((__m128i *)a, psq);
+  _mm_storeu_si128((__m128i *)c, pc);
+  sumR = _mm_cvtsi128_si32(ps) + _mm_cvtsi128_si32(_mm_srli_si128(ps, 8));
+  sumSqR = a[0] + a[1] + a[2] + a[3];
+  sumLR = c[0] + c[1] + c[2] + c[3];
+ }
+#endif
+ for(; y < win; ++y, src += stride, tmpl += TMPL_STRIDE) {
+  for(int x = 0; x < win; ++x) {
+   sumR += src[x];
+   sumSqR += src[x] * src[x];
+   sumLR += src[x] * tmpl[x];
+  }
+ }
+
+ double n = win * win;
+ double varL = n * sumSqL - (double)sumL * sumL;
+ double varR = n * sumSqR - (double)sumR * sumR;
+ if( (varL <= 0) || (varR <= 0) ) return 0;
+ return (n * sumLR - (double)sumL * sumR) / sqrt(varL * varR);
+}
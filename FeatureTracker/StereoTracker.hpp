@@ -0,0 +1,160 @@
+//==============================================================================
+// StereoTracker.hpp - Feature tracking in a rectified stereo pair, with
+//                     matching along epipolar lines
+//==============================================================================
+
+#ifndef INCLUDED_STEREOTRACKER_HPP
+#define INCLUDED_STEREOTRACKER_HPP
+
+#include <stdio.h>
+#include "FeatureTracker.hpp"
+
+class TaskPool;
+
+#define STEREO_MAX_WINDOW     31   // maximum matching window size
+#define STEREO_MAX_DISPARITY 255   // maximum disparity searched
+
+
+//==============================================================================
+/*! \struct _StereoContext
+    \brief Parameters for matching features between the images of a stereo
+    pair (for use with StereoTracker class)
+
+    Good default values for parameters are given in parenthesis. */
+//==============================================================================
+typedef struct _StereoContext
+{
+ _StereoContext() : window_size(11), min_disparity(0), max_disparity(64),
+                    search_radius(2), min_ncc(0.8), uniqueness(0.1) {};
+ int window_size;       /*!< Width and height of the matching window in
+                             pixels. Odd, at most STEREO_MAX_WINDOW (11). */
+ int min_disparity;     /*!< Smallest disparity searched, in pixels (0). */
+ int max_disparity;     /*!< Largest disparity searched, in pixels, at most
+                             STEREO_MAX_DISPARITY (64). */
+ int search_radius;     /*!< A feature matched in the previous frame is
+                             searched for only this many pixels either side of
+                             its previous disparity. It is searched for over
+                             the whole range if it is not found there (2). */
+ double min_ncc;        /*!< Normalized cross correlation between the windows
+                             of a match. Matches with less are rejected (0.8). */
+ double uniqueness;     /*!< In a search over the whole range, the second best
+                             match (not next to the best) must cost at least
+                             this fraction more than the best. Otherwise the
+                             match is ambiguous and rejected (0.1). */
+}StereoContext_t;
+
+
+//==============================================================================
+// class StereoTracker
+//------------------------------------------------------------------------------
+// \brief
+// Tracks features over time in the two images of a rectified stereo pair,
+// e.g. from two PXC200 channels, and reports the disparity of every feature.
+//
+// Features are detected and tracked in the left image by a FeatureTracker
+// of any backend. In the right image they are not tracked on their own:
+// the images must be rectified, so that a scene point appears in the same
+// row of both images, and a feature at (x, y) in the left image is found at
+// (x - d, y) in the right one, d being its disparity. Each feature is
+// therefore matched along its row only, which costs far less than a second
+// 2-D tracker and cannot drift off the epipolar line.
+//
+// The window around a feature in the left image is compared with the
+// windows at every disparity in the right image by their sum of absolute
+// differences, computed 16 pixels at a time with SSE2 (a plain C++ version
+// is used on other processors). The best match is accepted if it is
+// unambiguous and its normalized cross correlation is high enough, which
+// rejects matches in occluded and textureless areas, and refined to
+// subpixel disparity by fitting a parabola through the costs around it.
+//
+// Features are tracked in the right image through their disparity: a
+// feature matched in the previous frame is first searched for only near
+// its previous disparity, and over the whole range if not found there.
+//
+// The slot of a feature in the feature lists is its id, in both images and
+// in the disparities.
+//
+// <b>Example Program:</b>
+// \include StereoTracker.t.cpp
+//==============================================================================
+class StereoTracker
+{
+ public:
+  StereoTracker();
+   // Default constructor.
+
+  ~StereoTracker();
+   // Destructor frees any allocated resources.
+
+  int initialize(FeatureTrackerContext_t &ftc, StereoContext_t &sc,
+                 tracker_backend_t backend = e_trackerLK,
+                 const TrackerSettings_t &ts = TrackerSettings_t());
+   // Initialize the tracker. Call this method before calling any other
+   // methods of this class.
+   //  ftc      settings of the tracker of the left image (see
+   //           FeatureTracker::create()). The display, if on, shows the
+   //           left image.
+   //  sc       matching settings.
+   //  backend  The tracker of the left image.
+   //  ts       Tracking parameters of the left image.
+   //  return   0 on success, -1 on error (error message redirected to stderr).
+
+  int processImages(unsigned char *left, unsigned char *right, int w, int h,
+                    feature_list_t &leftList, feature_list_t &rightList);
+   // Track features in the left image and match them in the right image.
+   //  left,right  Image buffers, 8 bit grayscale, rectified, of the same
+   //              size in every call. Only read during the call.
+   //  w,h         Image dimensions in pixels.
+   //  leftList    Features tracked in the left image, as returned by the
+   //              tracker (see FeatureTracker::processImage()).
+   //  rightList   The same features in the right image: e_tracked if
+   //              matched near the disparity of the previous frame, e_new
+   //              if matched by a search over the whole range, e_lost if
+   //              lost in the left image or not matched. Must hold as many
+   //              features as leftList.
+   //  return      current frame number on success (first frame = 1), -1 on
+   //              error (error message redirected to stderr), -2 on user
+   //              initiated quit.
+
+  const float *getDisparities() const {return d_disparities;}
+   //  return  The disparity in pixels of every feature slot in the last
+   //          frame, -1 where the feature was not matched.
+
+  FeatureTracker &getTracker() {return *d_tracker;}
+   //  return  The tracker of the left image, to set its other options
+   //          (replenishment, track log...). processImages() fails if it
+   //          is pipelined (see FeatureTracker::setPipelining()), since its
+   //          features must belong to the right image passed with them.
+
+  int setTaskPool(TaskPool *pool);
+   // Match features, and track them where the tracker can, in parallel
+   // using a pool of worker threads. The pool is shared, not owned. Call
+   // after initialize().
+   //  pool    The task pool, or NULL to work in the calling thread (default).
+   //  return  0 on success, -1 on error (error message redirected to stderr).
+
+  inline int getNumSearches() const {return d_numSearches;}
+   //  return  Number of features searched for over the whole disparity
+   //          range in the last frame.
+
+ protected:
+ private:
+  StereoTracker(const StereoTracker &);
+  StereoTracker &operator=(const StereoTracker &);
+  static void matchFeatures(int begin, int end, void *arg);
+  bool matchFeature(const feature_t &f, float &disparity, bool narrow) const;
+  FeatureTracker *d_tracker;
+  StereoContext_t d_stereoContext;
+  int d_numFeatures;
+  float *d_disparities;
+  float *d_previous;             // disparities of the previous frame
+  const unsigned char *d_left, *d_right;
+  int d_width, d_height;
+  const feature_list_t *d_leftList;
+  feature_list_t *d_rightList;
+  int d_numSearches;
+  TaskPool *d_pool;
+};
+
+
+#endif // INCLUDED_STEREOTRACKER_HPP
@@ -0,0 +1,219 @@
+//==============================================================================
+// TrackHistory.cpp - Bounded history of tracked features
+//==============================================================================
+
+#include "TrackHistory.hpp"
+#include <stdlib.h>
+#include <string.h>
+
+//#define DEBUG
+
+//==============================================================================
+TrackHistory::TrackHistory()
+//==============================================================================
+{
+ d_records = NULL;
+ d_frameNumbers = NULL;
+ d_numFeatures = 0;
+ d_capacity = 0;
+ d_first = 0;
+ d_count = 0;
+}
+
+
+//==============================================================================
+TrackHistory::~TrackHistory()
+//==============================================================================
+{
+ if(d_records) free(d_records);
+ if(d_frameNumbers) free(d_frameNumbers);
+}
+
+
+//==============================================================================
+int TrackHistory::initialize(int numFeatures, int maxFrames, int maxBytes)
+//==============================================================================
+{
+ clear();
+ d_capacity = 0;
+
+ if(numFeatures <= 0 || maxFrames <= 0) {
+  fprintf(stderr, "[TrackHistory::initialize] ERROR. Invalid params (%d, %d).\n",
+          numFeatures, maxFrames);
+  return -1;
+ }
+
+ int frameBytes = numFeatures * sizeof(feature_t) + sizeof(int);
+ int nFrames = maxFrames;
+ if( (maxBytes > 0) && (nFrames > maxBytes / frameBytes) )
+  nFrames = maxBytes / frameBytes;
+ if(nFrames < 1) {
+  fprintf(stderr, "[TrackHistory::initialize] ERROR. %d bytes can't hold a single frame.\n",
+          maxBytes);
+  return -1;
+ }
+
+ // the old buffers stay owned (and are freed by the destructor) if a
+ // reallocation fails
+ feature_t *records = (feature_t *)realloc(d_records, nFrames * numFeatures * sizeof(feature_t));
+ if(records == NULL) {
+  fprintf(stderr, "[TrackHistory::initialize] ERROR allocating memory.\n");
+  return -1;
+ }
+ d_records = records;
+ int *frameNumbers = (int *)realloc(d_frameNumbers, nFrames * sizeof(int));
+ if(frameNumbers == NULL) {
+  fprintf(stderr, "[TrackHistory::initialize] ERROR allocating memory.\n");
+  return -1;
+ }
+ d_frameNumbers = frameNumbers;
+ d_numFeatures = numFeatures;
+ d_capacity = nFrames;
+
+#ifdef DEBUG
+ fprintf(stderr, "[TrackHistory::initialize] Holding %d frames of %d features.\n",
+         d_capacity, d_numFeatures);
+#endif
+ return 0;
+}
+
+
+//==============================================================================
+void TrackHistory::clear()
+//==============================================================================
+{
+ d_first = 0;
+ d_count = 0;
+}
+
+
+//==============================================================================
+int TrackHistory::record(const feature_list_t &f, int frameNumber)
+//==============================================================================
+{
+ if(d_capacity == 0) {
+  fprintf(stderr, "[TrackHistory::record] ERROR. Must call initialize first.\n");
+  return -1;
+ }
+ if(f.num_features != d_numFeatures) {
+  fprintf(stderr, "[TrackHistory::record] ERROR. Expecting %d features, got %d.\n",
+          d_numFeatures, f.num_features);
+  return -1;
+ }
+ if( d_count && (frameNumber <= getLastFrameNumber()) ) {
+  fprintf(stderr, "[TrackHistory::record] ERROR. Frame %d is older than frame %d.\n",
+          frameNumber, getLastFrameNumber());
+  return -1;
+ }
+
+ int slot;
+ if(d_count < d_capacity) {
+  slot = (d_first + d_count) % d_capacity;
+  ++d_count;
+ } else {
+  slot = d_first; // overwrite oldest
+  d_first = (d_first + 1) % d_capacity;
+ }
+ memcpy(d_records + slot * d_numFeatures, f.features, d_numFeatures * sizeof(feature_t));
+ d_frameNumbers[slot] = frameNumber;
+ return 0;
+}
+
+
+//==============================================================================
+int TrackHistory::getFirstFrameNumber() const
+//==============================================================================
+{
+ if(d_count == 0) return -1;
+ return d_frameNumbers[d_first];
+}
+
+
+//==============================================================================
+int TrackHistory::getLastFrameNumber() const
+//==============================================================================
+{
+ if(d_count == 0) return -1;
+ return d_frameNumbers[(d_first + d_count - 1) % d_capacity];
+}
+
+
+//==============================================================================
+int TrackHistory::findSlot(int frameNumber) const
+//==============================================================================
+{
+ if( (d_count == 0) || (frameNumber < getFirstFrameNumber())
+     || (frameNumber > getLastFrameNumber()) )
+  return -1;
+
+ // frame numbers are usually consecutive, so try the direct offset first
+ int i = frameNumber - getFirstFrameNumber();
+ if(i < d_count) {
+  int slot = (d_first + i) % d_capacity;
+  if(d_frameNumbers[slot] == frameNumber) return slot;
+ }
+
+ // frames were skipped; binary search over the ordered ring
+ int lo = 0, hi = d_count - 1;
+ while(lo <= hi) {
+  int mid = (lo + hi) / 2;
+  int slot = (d_first + mid) % d_capacity;
+  if(d_frameNumbers[slot] == frameNumber) return slot;
+  if(d_frameNumbers[slot] < frameNumber)
+   lo = mid + 1;
+  else
+   hi = mid - 1;
+ }
+ return -1;
+}
+
+
+//==============================================================================
+const feature_t *TrackHistory::getFrame(int frameNumber) const
+//==============================================================================
+{
+ int slot = findSlot(frameNumber);
+ if(slot < 0) return NULL;
+ return d_records + slot * d_numFeatures;
+}
+
+
+//==============================================================================
+int TrackHistory::getFrame(int frameNumber, feature_list_t &f) const
+//==============================================================================
+{
+ if(f.num_features != d_numFeatures) {
+  fprintf(stderr, "[TrackHistory::getFrame] ERROR. Expecting %d features, got %d.\n",
+          d_numFeatures, f.num_features);
+  return -1;
+ }
+ const feature_t *src = getFrame(frameNumber);
+ if(src == NULL) return -1;
+ memcpy(f.features, src, d_numFeatures * sizeof(feature_t));
+ f.frame_number = frameNumber;
+ return 0;
+}
+
+
+//==============================================================================
+int TrackHistory::getTrack(int featureId, int firstFrame, int lastFrame,
+                           feature_t *track, int *frameNumbers, int maxLength) const
+//==============================================================================
+{
+ if(featureId < 0 || featureId >= d_numFeatures || track == NULL) {
+  fprintf(stderr, "[TrackHistory::getTrack] ERROR. Invalid params.\n");
+  return -1;
+ }
+
+ int n = 0;
+ for(int i = 0; (i < d_count) && (n < maxLength); ++i) {
+  int slot = (d_first + i) % d_capacity;
+  int fr = d_frameNumbers[slot];
+  if(fr < firstFrame) continue;
+  if(fr > lastFrame) break;
+  track[n] = d_records[slot * d_numFeatures + featureId];
+  if(frameNumbers) frameNumbers[n] = fr;
+  ++n;
+ }
+ return n;
+}
@@ -0,0 +1,103 @@
+//==============================================================================
+// TrackHistory.hpp - Bounded history of tracked features
+//==============================================================================
+
+#ifndef INCLUDED_TRACKHISTORY_HPP
+#define INCLUDED_TRACKHISTORY_HPP
+
+#include "TrackerUtils.hpp"
+
+
+//==============================================================================
+// class TrackHistory
+//------------------------------------------------------------------------------
+// \brief
+// A fixed-size ring buffer holding the feature lists of the most recent frames.
+//
+// Memory for the history is allocated once in initialize(). When the buffer
+// is full, recording a new frame overwrites the oldest one, so memory use
+// stays flat however long the tracker runs. Frames are referred to by the
+// frame number passed to record(), which must increase from one call to the
+// next. Both FeatureTrackerKLT and FeatureTrackerOCV record into an object
+// of this class.
+//==============================================================================
+class TrackHistory
+{
+ public:
+  TrackHistory();
+   // Default constructor.
+
+  ~TrackHistory();
+   // Destructor frees the history buffer.
+
+  int initialize(int numFeatures, int maxFrames, int maxBytes = 0);
+   // Allocate the history buffer. Any previously recorded history is lost.
+   //  numFeatures  Number of features per frame.
+   //  maxFrames    Maximum number of frames to hold.
+   //  maxBytes     If > 0, an upper bound on the memory used by the history.
+   //               The number of frames held is reduced to fit.
+   //  return       0 on success, -1 on error (error message redirected to stderr).
+
+  void clear();
+   // Discard all recorded frames. Does not free memory.
+
+  int record(const feature_list_t &f, int frameNumber);
+   // Append a feature list to the history, overwriting the oldest frame
+   // if the history is full.
+   //  f            The feature list.
+   //  frameNumber  Frame number for this list. Must be greater than the
+   //               previously recorded frame number.
+   //  return       0 on success, -1 on error (error message redirected to stderr).
+
+  inline int getCapacity() const {return d_capacity;}
+   //  return  Maximum number of frames held.
+
+  inline int getNumFrames() const {return d_count;}
+   //  return  Number of frames currently held.
+
+  inline int getNumFeatures() const {return d_numFeatures;}
+   //  return  Number of features per frame.
+
+  int getFirstFrameNumber() const;
+   //  return  Frame number of the oldest frame held, -1 if history is empty.
+
+  int getLastFrameNumber() const;
+   //  return  Frame number of the latest frame held, -1 if history is empty.
+
+  const feature_t *getFrame(int frameNumber) const;
+   //  frameNumber  Frame number of interest.
+   //  return       Pointer to the features recorded for the frame, NULL
+   //               if the frame is not held. The pointer is valid until the
+   //               frame is overwritten.
+
+  int getFrame(int frameNumber, feature_list_t &f) const;
+   // Copy features recorded for a frame.
+   //  frameNumber  Frame number of interest.
+   //  f            Destination list. Must hold getNumFeatures() features.
+   //  return       0 on success, -1 if the frame is not held or on error.
+
+  int getTrack(int featureId, int firstFrame, int lastFrame, feature_t *track,
+               int *frameNumbers, int maxLength) const;
+   // Read the history of one feature over a range of frames. Frames in
+   // the range that are no longer (or not yet) held are skipped.
+   //  featureId     Index of the feature in the feature list.
+   //  firstFrame    First frame number of the range.
+   //  lastFrame     Last frame number of the range (inclusive).
+   //  track         Output buffer for the feature in each frame.
+   //  frameNumbers  Output buffer for the frame number of each entry in
+   //                'track'. Set to NULL if not required.
+   //  maxLength     Size of the output buffers.
+   //  return        Number of entries written, -1 on error.
+
+ protected:
+ private:
+  int findSlot(int frameNumber) const;
+  feature_t *d_records;
+  int *d_frameNumbers;
+  int d_numFeatures;
+  int d_capacity;
+  int d_first;  // slot of oldest frame
+  int d_count;
+};
+
+#endif // INCLUDED_TRACKHISTORY_HPP
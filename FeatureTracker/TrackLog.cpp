@@ -0,0 +1,371 @@
+//==============================================================================
+// TrackLog.cpp - Append-only binary log of tracked features
+//==============================================================================
+
+#include "TrackLog.hpp"
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//#define DEBUG
+
+#define TRACKLOG_MAGIC      "CVTRKLOG"
+#define TRACKLOG_BYTEORDER  0x01020304
+#define TRACKLOG_VERSION    1
+
+static uint32_t checksum(const track_log_record_t *r, const feature_t *f, int n);
+
+
+//==============================================================================
+TrackLogWriter::TrackLogWriter()
+//==============================================================================
+{
+ d_file = NULL;
+ memset(&d_header, 0, sizeof(d_header));
+ d_numRecords = 0;
+ d_lastFrame = -1;
+ d_sync = false;
+}
+
+
+//==============================================================================
+TrackLogWriter::~TrackLogWriter()
+//==============================================================================
+{
+ close();
+}
+
+
+//==============================================================================
+int TrackLogWriter::open(const char *fileName, int numFeatures, int indexInterval, bool sync)
+//==============================================================================
+{
+ close();
+
+ if(numFeatures <= 0) {
+  fprintf(stderr, "[TrackLogWriter::open] ERROR. Invalid number of features %d.\n", numFeatures);
+  return -1;
+ }
+ if( (d_file = fopen(fileName, "w+b")) == NULL ) {
+  fprintf(stderr, "[TrackLogWriter::open] ERROR. Could not open %s.\n", fileName);
+  return -1;
+ }
+
+ memset(&d_header, 0, sizeof(d_header));
+ memcpy(d_header.magic, TRACKLOG_MAGIC, 8);
+ d_header.byte_order = TRACKLOG_BYTEORDER;
+ d_header.version = TRACKLOG_VERSION;
+ d_header.num_features = numFeatures;
+ d_header.record_size = sizeof(track_log_record_t) + numFeatures * sizeof(feature_t);
+ d_header.index_interval = (indexInterval > 0) ? indexInterval : 1;
+ d_header.num_committed = 0;
+ d_numRecords = 0;
+ d_lastFrame = -1;
+ d_sync = sync;
+
+ if( fwrite(&d_header, sizeof(d_header), 1, d_file) != 1 ) {
+  fprintf(stderr, "[TrackLogWriter::open] ERROR writing header to %s.\n", fileName);
+  fclose(d_file);
+  d_file = NULL;
+  return -1;
+ }
+ return commit();
+}
+
+
+//==============================================================================
+int TrackLogWriter::append(const feature_list_t &f, int frameNumber)
+//==============================================================================
+{
+ if(d_file == NULL) {
+  fprintf(stderr, "[TrackLogWriter::append] ERROR. Log not open.\n");
+  return -1;
+ }
+ if(f.num_features != d_header.num_features) {
+  fprintf(stderr, "[TrackLogWriter::append] ERROR. Expecting %d features, got %d.\n",
+          d_header.num_features, f.num_features);
+  return -1;
+ }
+ if(frameNumber <= d_lastFrame) {
+  fprintf(stderr, "[TrackLogWriter::append] ERROR. Frame %d is older than frame %d.\n",
+          frameNumber, d_lastFrame);
+  return -1;
+ }
+
+ track_log_record_t rec;
+ rec.frame_number = frameNumber;
+ rec.num_tracked = 0;
+ rec.reserved = 0;
+ for(int i = 0; i < f.num_features; ++i)
+  if(f.features[i].val >= 0) ++rec.num_tracked;
+ rec.checksum = checksum(&rec, f.features, f.num_features);
+
+ if( (fwrite(&rec, sizeof(rec), 1, d_file) != 1)
+     || (fwrite(f.features, sizeof(feature_t), f.num_features, d_file) != (size_t)f.num_features) ) {
+  fprintf(stderr, "[TrackLogWriter::append] ERROR writing frame %d.\n", frameNumber);
+  return -1;
+ }
+ ++d_numRecords;
+ d_lastFrame = frameNumber;
+
+ if( (d_numRecords - d_header.num_committed) >= d_header.index_interval )
+  return commit();
+ return 0;
+}
+
+
+//==============================================================================
+int TrackLogWriter::commit()
+//==============================================================================
+{
+ if(d_file == NULL) return 0;
+
+ if( fflush(d_file) != 0 ) {
+  fprintf(stderr, "[TrackLogWriter::commit] ERROR flushing log.\n");
+  return -1;
+ }
+
+ // the header is rewritten in place; the stream position stays at the end
+ d_header.num_committed = d_numRecords;
+ if( pwrite(fileno(d_file), &d_header, sizeof(d_header), 0) != (ssize_t)sizeof(d_header) ) {
+  fprintf(stderr, "[TrackLogWriter::commit] ERROR updating header.\n");
+  return -1;
+ }
+ if(d_sync) fsync(fileno(d_file));
+ return 0;
+}
+
+
+//==============================================================================
+int TrackLogWriter::close()
+//==============================================================================
+{
+ if(d_file == NULL) return 0;
+ int ret = commit();
+ fclose(d_file);
+ d_file = NULL;
+ return ret;
+}
+
+
+//==============================================================================
+TrackLogReader::TrackLogReader()
+//==============================================================================
+{
+ d_map = NULL;
+ d_mapSize = 0;
+ d_header = NULL;
+ d_numRecords = 0;
+}
+
+
+//==============================================================================
+TrackLogReader::~TrackLogReader()
+//==============================================================================
+{
+ close();
+}
+
+
+//==============================================================================
+int TrackLogReader::open(const char *fileName)
+//==============================================================================
+{
+ close();
+
+ int fd = ::open(fileName, O_RDONLY);
+ if(fd < 0) {
+  fprintf(stderr, "[TrackLogReader::open] ERROR. Could not open %s.\n", fileName);
+  return -1;
+ }
+ struct stat st;
+ if( (fstat(fd, &st) != 0) || (st.st_size < (off_t)sizeof(track_log_header_t)) ) {
+  fprintf(stderr, "[TrackLogReader::open] ERROR. %s is not a track log.\n", fileName);
+  ::close(fd);
+  return -1;
+ }
+ d_mapSize = st.st_size;
+ d_map = mmap(NULL, d_mapSize, PROT_READ, MAP_SHARED, fd, 0);
+ ::close(fd);
+ if(d_map == MAP_FAILED) {
+  fprintf(stderr, "[TrackLogReader::open] ERROR mapping %s.\n", fileName);
+  d_map = NULL;
+  return -1;
+ }
+
+ // validate header
+ d_header = (const track_log_header_t *)d_map;
+ if( memcmp(d_header->magic, TRACKLOG_MAGIC, 8) || (d_header->byte_order != TRACKLOG_BYTEORDER)
+     || (d_header->version != TRACKLOG_VERSION) || (d_header->num_features <= 0)
+     || (d_header->record_size != (int)(sizeof(track_log_record_t)
+                                 + d_header->num_features * sizeof(feature_t))) ) {
+  fprintf(stderr, "[TrackLogReader::open] ERROR. %s is not a track log, or was written on another architecture.\n",
+          fileName);
+  close();
+  return -1;
+ }
+
+ // records up to the committed count are complete; beyond that, accept
+ // records until the first one that is torn or out of order
+ int nAvailable = (d_mapSize - sizeof(track_log_header_t)) / d_header->record_size;
+ if( (d_header->num_committed < 0) || (d_header->num_committed > nAvailable) ) {
+  fprintf(stderr, "[TrackLogReader::open] ERROR. %s claims %d committed records, but holds %d.\n",
+          fileName, d_header->num_committed, nAvailable);
+  close();
+  return -1;
+ }
+ d_numRecords = d_header->num_committed;
+ while(d_numRecords < nAvailable) {
+  const track_log_record_t *r = recordAt(d_numRecords);
+  if( r->checksum != checksum(r, (const feature_t *)(r + 1), d_header->num_features) ) break;
+  if( d_numRecords && (r->frame_number <= recordAt(d_numRecords - 1)->frame_number) ) break;
+  ++d_numRecords;
+ }
+
+#ifdef DEBUG
+ fprintf(stderr, "[TrackLogReader::open] %d records (%d committed, %d in file).\n",
+         d_numRecords, d_header->num_committed, nAvailable);
+#endif
+ return 0;
+}
+
+
+//==============================================================================
+void TrackLogReader::close()
+//==============================================================================
+{
+ if(d_map) munmap(d_map, d_mapSize);
+ d_map = NULL;
+ d_mapSize = 0;
+ d_header = NULL;
+ d_numRecords = 0;
+}
+
+
+//==============================================================================
+const track_log_record_t *TrackLogReader::recordAt(int index) const
+//==============================================================================
+{
+ return (const track_log_record_t *)((const char *)d_map + sizeof(track_log_header_t)
+                                     + (size_t)index * d_header->record_size);
+}
+
+
+//==============================================================================
+int TrackLogReader::getFirstFrameNumber() const
+//==============================================================================
+{
+ if(d_numRecords == 0) return -1;
+ return recordAt(0)->frame_number;
+}
+
+
+//==============================================================================
+int TrackLogReader::getLastFrameNumber() const
+//==============================================================================
+{
+ if(d_numRecords == 0) return -1;
+ return recordAt(d_numRecords - 1)->frame_number;
+}
+
+
+//==============================================================================
+const feature_t *TrackLogReader::getRecord(int index, int *frameNumber) const
+//==============================================================================
+{
+ if(index < 0 || index >= d_numRecords) return NULL;
+ const track_log_record_t *r = recordAt(index);
+ if(frameNumber) *frameNumber = r->frame_number;
+ return (const feature_t *)(r + 1);
+}
+
+
+//==============================================================================
+int TrackLogReader::findRecord(int frameNumber) const
+//==============================================================================
+{
+ if( (d_numRecords == 0) || (frameNumber < getFirstFrameNumber())
+     || (frameNumber > getLastFrameNumber()) )
+  return -1;
+
+ // direct offset if no frames were skipped
+ int i = frameNumber - getFirstFrameNumber();
+ if( (i < d_numRecords) && (recordAt(i)->frame_number == frameNumber) )
+  return i;
+
+ int lo = 0, hi = d_numRecords - 1;
+ while(lo <= hi) {
+  int mid = (lo + hi) / 2;
+  int fr = recordAt(mid)->frame_number;
+  if(fr == frameNumber) return mid;
+  if(fr < frameNumber)
+   lo = mid + 1;
+  else
+   hi = mid - 1;
+ }
+ return -1;
+}
+
+
+//==============================================================================
+const feature_t *TrackLogReader::getFrame(int frameNumber) const
+//==============================================================================
+{
+ return getRecord(findRecord(frameNumber));
+}
+
+
+//==============================================================================
+int TrackLogReader::getFrame(int frameNumber, feature_list_t &f) const
+//==============================================================================
+{
+ if(f.num_features != getNumFeatures()) {
+  fprintf(stderr, "[TrackLogReader::getFrame] ERROR. Expecting %d features, got %d.\n",
+          getNumFeatures(), f.num_features);
+  return -1;
+ }
+ const feature_t *src = getFrame(frameNumber);
+ if(src == NULL) return -1;
+ memcpy(f.features, src, f.num_features * sizeof(feature_t));
+ f.frame_number = frameNumber;
+ return 0;
+}
+
+
+//==============================================================================
+// checksum - Fletcher-32 over the record header, except the checksum itself,
+// and feature data
+//==============================================================================
+uint32_t checksum(const track_log_record_t *r, const feature_t *f, int n)
+{
+ uint32_t s1 = 0xffff, s2 = 0xffff;
+ const size_t after = offsetof(track_log_record_t, checksum) + sizeof(r->checksum);
+ const uint16_t *p[3];
+ size_t len[3];
+ p[0] = (const uint16_t *)r;   len[0] = offsetof(track_log_record_t, checksum) / 2;
+ p[1] = (const uint16_t *)((const char *)r + after);
+ len[1] = (sizeof(track_log_record_t) - after) / 2;
+ p[2] = (const uint16_t *)f;   len[2] = n * sizeof(feature_t) / 2;
+
+ for(int k = 0; k < 3; ++k) {
+  const uint16_t *d = p[k];
+  size_t words = len[k];
+  while(words) {
+   size_t block = (words > 359) ? 359 : words;
+   words -= block;
+   do {
+    s1 += *d++;
+    s2 += s1;
+   } while(--block);
+   s1 = (s1 & 0xffff) + (s1 >> 16);
+   s2 = (s2 & 0xffff) + (s2 >> 16);
+  }
+ }
+ s1 = (s1 & 0xffff) + (s1 >> 16);
+ s2 = (s2 & 0xffff) + (s2 >> 16);
+ return (s2 << 16) | s1;
+}
@@ -0,0 +1,179 @@
+//==============================================================================
+// TrackLog.hpp - Append-only binary log of tracked features
+//==============================================================================
+
+#ifndef INCLUDED_TRACKLOG_HPP
+#define INCLUDED_TRACKLOG_HPP
+
+#include "TrackerUtils.hpp"
+#include <stdio.h>
+#include <inttypes.h>
+
+//==============================================================================
+/*! \struct _track_log_header
+    \brief Header at the start of a track log file.
+
+    A track log file consists of this header followed by fixed size frame
+    records. Each record is a track_log_record_t followed by 'num_features'
+    feature_t structures. Because every record has the same size, record i
+    starts at byte sizeof(track_log_header_t) + i * record_size. All values
+    are stored in the byte order of the machine that wrote the log. */
+//==============================================================================
+typedef struct _track_log_header
+{
+ char magic[8];             //!< "CVTRKLOG"
+ int32_t byte_order;        //!< 0x01020304 in the writer's byte order.
+ int32_t version;           //!< Format version (1).
+ int32_t num_features;      //!< Number of features in each record.
+ int32_t record_size;       //!< Size of each record in bytes.
+ int32_t index_interval;    //!< Records between updates of 'num_committed'.
+ int32_t num_committed;     /*!< Number of records known to be completely
+                                 written. Updated periodically by the writer.
+                                 Records beyond this count are validated by
+                                 their checksum. */
+}track_log_header_t;
+
+
+//==============================================================================
+/*! \struct _track_log_record
+    \brief Per-frame record header in a track log. */
+//==============================================================================
+typedef struct _track_log_record
+{
+ int32_t frame_number;      //!< Frame number of the feature list.
+ int32_t num_tracked;       //!< Number of features with val >= 0.
+ uint32_t checksum;         //!< Checksum over the rest of the record.
+ int32_t reserved;
+}track_log_record_t;
+
+
+//==============================================================================
+// class TrackLogWriter
+//------------------------------------------------------------------------------
+// \brief
+// Writes feature lists to an append-only binary track log.
+//
+// append() only copies the feature list into a stdio buffer, so it is cheap
+// enough to call on every frame. Every 'index_interval' records the buffer is
+// flushed and the committed record count in the file header is updated. If
+// the writer dies, the log is still readable up to the last complete record.
+//
+// <b>Example Program:</b>
+// \include TrackLog.t.cpp
+//==============================================================================
+class TrackLogWriter
+{
+ public:
+  TrackLogWriter();
+   // Default constructor.
+
+  ~TrackLogWriter();
+   // Destructor closes the log.
+
+  int open(const char *fileName, int numFeatures, int indexInterval = 30, bool sync = false);
+   // Create a new log file, overwriting any existing file of the same name.
+   //  fileName       Name of the log file.
+   //  numFeatures    Number of features in each feature list.
+   //  indexInterval  Number of records between commits of the file header.
+   //  sync           If true, force data to disk (fsync) on every commit.
+   //  return         0 on success, -1 on error (error message redirected to stderr).
+
+  int append(const feature_list_t &f, int frameNumber);
+   // Append a feature list to the log.
+   //  f            The feature list.
+   //  frameNumber  Frame number of the list. Must be greater than the
+   //               previously logged frame number.
+   //  return       0 on success, -1 on error (error message redirected to stderr).
+
+  int commit();
+   // Flush buffered records and update the committed record count in the
+   // file header. Called automatically every 'indexInterval' records.
+   //  return  0 on success, -1 on error (error message redirected to stderr).
+
+  int close();
+   // Commit and close the log.
+   //  return  0 on success, -1 on error (error message redirected to stderr).
+
+  inline bool isOpen() const {return (d_file != NULL);}
+   //  return  true if a log is open.
+
+ protected:
+ private:
+  FILE *d_file;
+  track_log_header_t d_header;
+  int d_numRecords;
+  int d_lastFrame;
+  bool d_sync;
+};
+
+
+//==============================================================================
+// class TrackLogReader
+//------------------------------------------------------------------------------
+// \brief
+// Random access to a track log written by TrackLogWriter.
+//
+// The log file is memory mapped, and any frame record is located in
+// constant time from its record number. A log that is still being written,
+// or whose writer crashed, can be opened: records past the committed count
+// in the header are accepted only while their checksums are valid.
+//==============================================================================
+class TrackLogReader
+{
+ public:
+  TrackLogReader();
+   // Default constructor.
+
+  ~TrackLogReader();
+   // Destructor unmaps the log.
+
+  int open(const char *fileName);
+   // Map a log file.
+   //  fileName  Name of the log file.
+   //  return    0 on success, -1 on error (error message redirected to stderr).
+
+  void close();
+   // Unmap the log file.
+
+  inline int getNumFeatures() const {return (d_header ? d_header->num_features : 0);}
+   //  return  Number of features in each record.
+
+  inline int getNumRecords() const {return d_numRecords;}
+   //  return  Number of valid records in the log.
+
+  int getFirstFrameNumber() const;
+   //  return  Frame number of the first record, -1 if log is empty.
+
+  int getLastFrameNumber() const;
+   //  return  Frame number of the last record, -1 if log is empty.
+
+  const feature_t *getRecord(int index, int *frameNumber = NULL) const;
+   //  index        Record number (starts at 0).
+   //  frameNumber  If not NULL, set to the frame number of the record.
+   //  return       Pointer to the features in the record (valid until
+   //               close()), NULL if index is out of range.
+
+  const feature_t *getFrame(int frameNumber) const;
+   // Find the record for a frame. This takes constant time if no frames
+   // were skipped while writing the log, and a binary search otherwise.
+   //  frameNumber  Frame number of interest.
+   //  return       Pointer to the features for the frame (valid until
+   //               close()), NULL if the frame is not in the log.
+
+  int getFrame(int frameNumber, feature_list_t &f) const;
+   // Copy features for a frame.
+   //  frameNumber  Frame number of interest.
+   //  f            Destination list. Must hold getNumFeatures() features.
+   //  return       0 on success, -1 if the frame is not in the log or on error.
+
+ protected:
+ private:
+  const track_log_record_t *recordAt(int index) const;
+  int findRecord(int frameNumber) const;
+  void *d_map;
+  size_t d_mapSize;
+  const track_log_header_t *d_header;
+  int d_numRecords;
+};
+
+#endif // INCLUDED_TRACKLOG_HPP
@@ -5,6 +5,7 @@
 
 #include "TrackerUtils.hpp"
 #include <stdlib.h>
+#include <string.h>
 
 //==============================================================================
 int allocateFeatureList(feature_list_t &f, int num_features)
@@ -29,6 +30,17 @@ void freeFeatureList(feature_list_t &f)
 }
 
 
+//==============================================================================
+void fieldToFrame(feature_list_t &f, int field)
+//==============================================================================
+{
+ for(int i = 0; i < f.num_features; ++i) {
+  if(f.features[i].val < 0) continue;
+  f.features[i].y = 2 * f.features[i].y + field;
+ }
+}
+
+
 //==============================================================================
 int copyFeaturesToKLTFeatureList(feature_list_t &f, KLT_FeatureList kl)
 //==============================================================================
@@ -40,7 +52,7 @@ int copyFeaturesToKLTFeatureList(feature_list_t &f, KLT_FeatureList kl)
  for(int i = 0; i < kl->nFeatures; ++i) {
   kl->feature[i]->x = f.features[i].x;
   kl->feature[i]->y = f.features[i].y;
-  if( f.features[i].val == 0)
+  if( f.features[i].val >= 0)
    kl->feature[i]->val = KLT_TRACKED;
   else
    kl->feature[i]->val = KLT_NOT_FOUND;
@@ -49,6 +61,106 @@ int copyFeaturesToKLTFeatureList(feature_list_t &f, KLT_FeatureList kl)
 }
 
 
+//==============================================================================
+KLTFeatureListAdapter::KLTFeatureListAdapter()
+//==============================================================================
+{
+ d_kltList = NULL;
+ d_records = NULL;
+ d_numFeatures = 0;
+}
+
+
+//==============================================================================
+KLTFeatureListAdapter::~KLTFeatureListAdapter()
+//==============================================================================
+{
+}
+
+
+//==============================================================================
+int KLTFeatureListAdapter::attach(KLT_FeatureList kl)
+//==============================================================================
+{
+ d_kltList = NULL;
+ d_records = NULL;
+ d_numFeatures = 0;
+
+ if(kl == NULL) {
+  fprintf(stderr, "[KLTFeatureListAdapter::attach] ERROR. NULL feature list.\n");
+  return -1;
+ }
+ 
+ d_kltList = kl;
+ d_numFeatures = kl->nFeatures;
+ if(d_numFeatures == 0) return 0;
+ 
+ // use the record block directly only if every pointer agrees with it
+ KLT_Feature first = kl->feature[0];
+ for(int i = 1; i < d_numFeatures; ++i)
+  if(kl->feature[i] != first + i) return 0;
+ d_records = first;
+ return 0;
+}
+
+
+//==============================================================================
+int KLTFeatureListAdapter::copyToKLT(const feature_list_t &f)
+//==============================================================================
+{
+ if(d_kltList == NULL || f.num_features != d_numFeatures) {
+  fprintf(stderr, "[KLTFeatureListAdapter::copyToKLT] ERROR. List not attached or sizes don't match.\n");
+  return -1;
+ }
+ 
+ const feature_t *src = f.features;
+ if(d_records) {
+  KLT_Feature dst = d_records;
+  for(int i = 0; i < d_numFeatures; ++i, ++dst, ++src) {
+   dst->x = src->x;
+   dst->y = src->y;
+   dst->val = (src->val >= 0) ? KLT_TRACKED : KLT_NOT_FOUND;
+  }
+ } else {
+  for(int i = 0; i < d_numFeatures; ++i, ++src) {
+   KLT_Feature dst = d_kltList->feature[i];
+   dst->x = src->x;
+   dst->y = src->y;
+   dst->val = (src->val >= 0) ? KLT_TRACKED : KLT_NOT_FOUND;
+  }
+ }
+ return 0;
+}
+
+
+//==============================================================================
+int KLTFeatureListAdapter::copyFromKLT(feature_list_t &f)
+//==============================================================================
+{
+ if(d_kltList == NULL || f.num_features != d_numFeatures) {
+  fprintf(stderr, "[KLTFeatureListAdapter::copyFromKLT] ERROR. List not attached or sizes don't match.\n");
+  return -1;
+ }
+
+ int nTracked = 0;
+ feature_t *dst = f.features;
+ for(int i = 0; i < d_numFeatures; ++i, ++dst) {
+  const KLT_Feature src = getFeature(i);
+  if(src->val >= 0) { // KLT marks newly selected features with val > 0
+   dst->x = src->x;
+   dst->y = src->y;
+   dst->val = (src->val == KLT_TRACKED) ? e_tracked : e_new;
+   ++nTracked;
+  } else {
+   dst->x = 0;
+   dst->y = 0;
+   dst->val = e_lost;
+  }
+ }
+ return nTracked;
+}
+
+
 //==============================================================================
 CountFPS::CountFPS()
 //==============================================================================
@@ -128,6 +240,8 @@ SDLWindow::SDLWindow()
 {
  d_screen = NULL;
  d_message[0]='\0';
+ d_image = NULL;
+ d_imageBpp = 0;
 
  if( SDL_Init(SDL_INIT_VIDEO|SDL_INIT_EVENTTHREAD) < 0 ) 
   fprintf(stderr, "[SDLWindow::SDLWindow] ERROR SDL video init failed.\n");
@@ -149,6 +263,7 @@ SDLWindow::SDLWindow()
 SDLWindow::~SDLWindow()
 //==============================================================================
 {
+ if(d_image) SDL_FreeSurface(d_image);
  if(d_screen) SDL_FreeSurface(d_screen);
  if( SDL_WasInit(SDL_INIT_VIDEO) ) SDL_QuitSubSystem(SDL_INIT_VIDEO);
 }
@@ -189,24 +304,31 @@ int SDLWindow::updateScreenBuffer(char *buf, int w, int h, int bpp, const char *
  if(d_screen == NULL) if( init(w, h, NULL) != 0) return -1;
  if( w != d_screen->w || h != d_screen->h ) if( init(w, h, NULL) != 0) return -1;
 
- int rmask = 0, gmask = 0, bmask = 0;
- if( bpp == 3) { rmask = 0x0000FF; gmask = 0x00FF00; bmask = 0xFF0000; }
- if( bpp == 1) { rmask = 0x0000FF; gmask = 0x0000FF; bmask = 0x0000FF; }
-
- // img->SDL surface
- img = SDL_CreateRGBSurfaceFrom(buf, w, h, 8 * bpp, w * bpp, rmask, gmask, bmask, 0x00);
- if ( img == NULL ) {
-  fprintf(stderr, "[SDLWindow::show] ERROR: %s.\n", SDL_GetError());
-  return(-1);
+ // img->SDL surface. The surface wrapping the user buffer is kept between 
+ // calls and only recreated if the image format changes.
+ img = d_image;
+ if( (img == NULL) || (img->w != w) || (img->h != h) || (d_imageBpp != bpp) ) {
+  if(img) SDL_FreeSurface(img);
+  d_image = NULL;
+  int rmask = 0, gmask = 0, bmask = 0;
+  if( bpp == 3) { rmask = 0x0000FF; gmask = 0x00FF00; bmask = 0xFF0000; }
+  if( bpp == 1) { rmask = 0x0000FF; gmask = 0x0000FF; bmask = 0x0000FF; }
+  img = SDL_CreateRGBSurfaceFrom(buf, w, h, 8 * bpp, w * bpp, rmask, gmask, bmask, 0x00);
+  if ( img == NULL ) {
+   fprintf(stderr, "[SDLWindow::show] ERROR: %s.\n", SDL_GetError());
+   return(-1);
+  }
+  SDL_SetColors(img, d_8bppPalette, 0, 256);
+  d_image = img;
+  d_imageBpp = bpp;
  }
- SDL_SetColors(img, d_8bppPalette, 0, 256);
+ img->pixels = buf;
  
  // blit to video surface
  if ( SDL_BlitSurface(img, NULL, d_screen, NULL) < 0 ) {
   fprintf(stderr, "[SDLWindow::show] ERROR: %s.\n", SDL_GetError());
   return(-1);
  }
- if(img) SDL_FreeSurface(img);
 
  if(msg) stringColor(d_screen, 2, h-10, msg, 0xfd1b04FF);
 
@@ -225,6 +347,76 @@ void SDLWindow::refresh()
 }
 
 
+//==============================================================================
+int SDLWindow::drawFeatures(const feature_list_t &f, Uint32 color, int size)
+//==============================================================================
+{
+ if(d_screen == NULL) {
+  fprintf(stderr, "[SDLWindow::drawFeatures] ERROR. Screen not initialized.\n");
+  return -1;
+ }
+ if(f.features == NULL) return 0;
+
+ Uint32 pixel = SDL_MapRGB(d_screen->format, (color >> 24) & 0xff, (color >> 16) & 0xff, 
+                           (color >> 8) & 0xff);
+ int bpp = d_screen->format->BytesPerPixel;
+ Uint8 bytes[4];
+ memcpy(bytes, &pixel, 4);
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+ const Uint8 *rgb = bytes + 1;
+#else
+ const Uint8 *rgb = bytes;
+#endif
+
+ if( SDL_MUSTLOCK(d_screen) ) 
+  if( SDL_LockSurface(d_screen) < 0 ) {
+   fprintf(stderr, "[SDLWindow::drawFeatures] ERROR: %s.\n", SDL_GetError());
+   return -1;
+  }
+
+ int nDrawn = 0;
+ for(int i = 0; i < f.num_features; ++i) {
+  if(f.features[i].val < 0) continue;
+
+  // clip marker to screen
+  int x0 = (int)f.features[i].x - size, x1 = (int)f.features[i].x + size;
+  int y0 = (int)f.features[i].y - size, y1 = (int)f.features[i].y + size;
+  if(x0 < 0) x0 = 0;
+  if(y0 < 0) y0 = 0;
+  if(x1 >= d_screen->w) x1 = d_screen->w - 1;
+  if(y1 >= d_screen->h) y1 = d_screen->h - 1;
+  if(x0 > x1 || y0 > y1) continue;
+
+  for(int y = y0; y <= y1; ++y) {
+   Uint8 *row = (Uint8 *)d_screen->pixels + y * d_screen->pitch + x0 * bpp;
+   int n = x1 - x0 + 1;
+   switch(bpp) {
+    case 1:
+     memset(row, pixel, n);
+    break;
+    case 2:
+     for(int x = 0; x < n; ++x) ((Uint16 *)row)[x] = (Uint16)pixel;
+    break;
+    case 3:
+     for(int x = 0; x < n; ++x, row += 3) {
+      row[0] = rgb[0];
+      row[1] = rgb[1];
+      row[2] = rgb[2];
+     }
+    break;
+    default:
+     for(int x = 0; x < n; ++x) ((Uint32 *)row)[x] = pixel;
+    break;
+   }
+  }
+  ++nDrawn;
+ }
+
+ if( SDL_MUSTLOCK(d_screen) ) SDL_UnlockSurface(d_screen);
+ return nDrawn;
+}
+
+
 //==============================================================================
 void SDLWindow::printInfo()
 //==============================================================================
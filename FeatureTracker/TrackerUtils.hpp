@@ -16,15 +16,42 @@
 //==============================================================================
 typedef struct _FeatureTrackerContext
 {
+ _FeatureTrackerContext() : num_features(100), num_frames(100), auto_select_features(1),
+                            display_tracked_features(1), history_bytes(0),
+                            display_decimation(1) {};
  int num_features;             /*!< Max. number of features to track. */
- int num_frames;               /*!< Number of frames to track features over. */
+ int num_frames;               /*!< Number of most recent frames held in the 
+                                    track history. */
  int auto_select_features;     /*!< 1: if you want the tracker to select features
                                     automoatically, else 0. */
  int display_tracked_features; /*!< 1: if you want to display tracked features,
                                     else 0. */
+ int history_bytes;            /*!< If > 0, upper bound on memory (bytes) used 
+                                    by the track history. Fewer than 'num_frames'
+                                    frames are held if necessary (0). */
+ int display_decimation;       /*!< If 'display_tracked_features' is on, update 
+                                    the display only every Nth frame, so that 
+                                    tracking can run faster than the display 
+                                    (1). */
 }FeatureTrackerContext_t;
 
 
+//==============================================================================
+/*! \enum _feature_status
+    \brief Status of a feature in a feature list */
+//==============================================================================
+typedef enum _feature_status
+{
+ e_lost = -1,     //!< No feature in this slot (not tracked).
+ e_tracked = 0,   //!< Feature tracked from the previous frame.
+ e_new = 1,       //!< New feature, detected in this frame. Any feature 
+                  //!< previously held in the slot is gone.
+ e_suspect = 2    //!< Feature tracked from the previous frame, but far from 
+                  //!< where the motion of the scene predicted it. It may be
+                  //!< off the plane of the other features, or mistracked.
+}feature_status_t;
+
+
 //==============================================================================
 /*! \struct _feature 
     \brief A feature point */
@@ -33,7 +60,8 @@ typedef struct _feature
 {
  float x;  //!< x coordinate of feature in the image.
  float y;  //!< y coordinate of feature in the image.
- int val;  //!< FeatureTracker classes set this to 0 if feature is tracked, else -1.
+ int val;  //!< Status of the feature (see feature_status_t). Coordinates are 
+           //!< valid if val >= 0.
 }feature_t;
 
 
@@ -58,10 +86,74 @@ int allocateFeatureList(feature_list_t &f, int num_features);
 void freeFeatureList(feature_list_t &f);
  /*!< Free the memory allocated for storing features using allocateFeatureStruct(). */
 
+void fieldToFrame(feature_list_t &f, int field);
+ /*!< Convert the coordinates of features tracked in one field of an 
+      interlaced frame (a half-height image of every other row, see 
+      PXCCaptureLoop::setFieldMode()) to pixels of the full frame. Row y of
+      field 0 (even) is frame row 2y, row y of field 1 (odd) is frame row 
+      2y + 1. Lost features are left alone. */
+
 int copyFeaturesToKLTFeatureList(feature_list_t &f, KLT_FeatureList kl);
  /*!< Copy a feature list into feature list structure used in the KLT library.
+      For repeated copies between the same pair of lists, KLTFeatureListAdapter
+      is faster.
       \return  0 on success, -1 on error (error message redirected to stderr). */
 
+
+//==============================================================================
+// class KLTFeatureListAdapter
+//------------------------------------------------------------------------------
+// \brief
+// A persistent mapping between a KLT_FeatureList and a feature_list_t.
+//
+// The KLT library stores a feature list as an array of pointers to feature
+// records, so a field by field copy through kl->feature[i]->x costs a 
+// dependent load per feature. KLTCreateFeatureList() however allocates all 
+// feature records in a single contiguous block. This class verifies that 
+// layout once when attached to a list, and thereafter copies features in and 
+// out of the KLT list with a linear sweep over the record block. Lists 
+// that are not laid out contiguously are still handled through the pointer 
+// table.
+//==============================================================================
+class KLTFeatureListAdapter
+{
+ public:
+  KLTFeatureListAdapter();
+   // Default constructor.
+   
+  ~KLTFeatureListAdapter();
+   // Destructor. Does not free the attached KLT list.
+   
+  int attach(KLT_FeatureList kl);
+   // Attach to a KLT feature list. Call this again if the list is reallocated.
+   //  kl      The KLT feature list.
+   //  return  0 on success, -1 on error (error message redirected to stderr).
+   
+  int copyToKLT(const feature_list_t &f);
+   // Copy features into the attached KLT list. Features with val >= 0 are 
+   // marked KLT_TRACKED, all others KLT_NOT_FOUND.
+   //  f       Source feature list. Must hold as many features as the KLT list.
+   //  return  0 on success, -1 on error (error message redirected to stderr).
+   
+  int copyFromKLT(feature_list_t &f);
+   // Copy features out of the attached KLT list. Features tracked by KLT
+   // get val = e_tracked, features newly selected by KLT get val = e_new, 
+   // all others get val = e_lost and coordinates (0,0).
+   //  f       Destination feature list. Must hold as many features as the KLT list.
+   //  return  Number of tracked and new features on success, -1 on error 
+   //          (error message redirected to stderr).
+   
+  inline KLT_Feature getFeature(int i) 
+   { return (d_records ? (d_records + i) : d_kltList->feature[i]); }
+   //  return  Pointer to the KLT record for feature i. No bounds checking.
+   
+ protected:
+ private:
+  KLT_FeatureList d_kltList;
+  KLT_Feature d_records;  // first record of a contiguous block, else NULL.
+  int d_numFeatures;
+};
+
 //==============================================================================
 // class CountFPS
 //------------------------------------------------------------------------------
@@ -150,12 +242,24 @@ class SDLWindow
    //          to directly manipulate the screen buffer using an external 
    //          library such as SDL_gfx package.
 
+  int drawFeatures(const feature_list_t &f, Uint32 color = 0xff0000ff, int size = 2);
+   // Mark valid features (val >= 0) in the screen buffer with filled squares. 
+   // All markers are written directly into the locked screen surface in a 
+   // single pass, which is much cheaper than one SDL_gfx call per feature.
+   // Window doesn't show the markers until refresh() is called.
+   //  f       List of features.
+   //  color   Marker color as 0xRRGGBBAA (alpha is ignored).
+   //  size    Half width of the marker square in pixels.
+   //  return  Number of markers drawn, -1 on error (error message redirected to stderr).
+
  protected:
  private:
   void printInfo();
   CountFPS d_fps;
   char d_message[20];
   SDL_Surface *d_screen;
+  SDL_Surface *d_image;  // wraps the user image buffer
+  int d_imageBpp;
   SDL_Color d_8bppPalette[256];
 };
 
@@ -5,18 +5,21 @@
 //==============================================================================
 
 #include "FeatureClientServer.hpp"
+#include <stdlib.h>
 
 //==============================================================================
-// main: Connects to a feature server and delivers updates from server.
+// main: Connects to a feature server and delivers updates from server. An
+// optional argument selects the stream (FeatureClient.t <stream id>).
 //==============================================================================
 int main(int argc, char *argv[])
 {
  FeatureClient client;
  feature_list_t features;
  int nFeatures = 10;
+ int stream = (argc > 1) ? atoi(argv[1]) : 0;
  
  // initialize a client and connect to server
- if(client.initialize("127.0.0.1", 8000, 50, nFeatures) != 0) 
+ if(client.initialize("127.0.0.1", 8000, 50, nFeatures, stream) != 0) 
   return -1;
  
  // create feature list
@@ -5,9 +5,11 @@
 
 #include "FeatureTrackerKLT.hpp"
 #include "Pixmap.hpp"
+#include "RTUtils/TaskPool.hpp"
 #include <unistd.h>
+#include <string.h>
 
-int main()
+int main(int argc, char *argv[])
 { 
  KLT_TrackingContext kltContext;
  FeatureTrackerContext_t tracContext;
@@ -44,6 +46,15 @@ int main()
   return -1;
  }
 
+ // track in parallel if asked to (FeatureTrackerKLT.t -p)
+ TaskPool pool;
+ if( (argc > 1) && !strcmp(argv[1], "-p") ) {
+  if( (pool.initialize() != 0) || (tracker.setTaskPool(&pool) != 0) ) {
+   fprintf(stderr, "ERROR starting parallel tracking.\n");
+   return -1;
+  }
+ }
+
  // track features between frames
  for(int i = 0; i < 2; ++i) {
   if( tracker.processImage(img[i].getPointer(0), img[i].getWidth(), 
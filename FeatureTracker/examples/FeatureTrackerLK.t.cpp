@@ -0,0 +1,112 @@
+//==============================================================================
+// FeatureTrackerLK.t.cpp - Example program for FeatureTrackerLK class
+//==============================================================================
+
+#include "FeatureTrackerLK.hpp"
+#include "Pixmap.hpp"
+#include "RTUtils/TaskPool.hpp"
+#include <unistd.h>
+#include <string.h>
+
+int main(int argc, char *argv[])
+{
+ LKTrackingContext_t lkContext;
+ FeatureTrackerContext_t tracContext;
+ PixmapGray img[2];
+ feature_list_t features;
+
+ lkContext.window_size = 15;
+ lkContext.num_levels = 3;
+ lkContext.max_iter = 20;
+ lkContext.epsilon = 0.03;
+ lkContext.min_eigenvalue = 4;
+ lkContext.max_residual = 20;
+ lkContext.quality = 0.01;
+ lkContext.min_dist = 10;
+
+ tracContext.num_features = 4;
+ tracContext.num_frames = 2;
+ tracContext.auto_select_features = false;
+ tracContext.display_tracked_features = true;
+
+ // create feature list
+ if( allocateFeatureList(features, tracContext.num_features) < 0 )
+  return -1;
+
+ FeatureTrackerLK tracker;
+
+ img[0].loadPixmap("images/box0.pgm");
+ img[1].loadPixmap("images/box1.pgm");
+
+ // initialize system
+ if( tracker.initialize(tracContext, lkContext) != 0 ) {
+  fprintf(stderr, "ERROR initializing tracker.\n");
+  return -1;
+ }
+
+ // track in parallel (FeatureTrackerLK.t -p), and build the pyramid of
+ // the next frame on a helper thread (FeatureTrackerLK.t -l), if asked to
+ TaskPool pool;
+ bool pipelined = false;
+ for(int i = 1; i < argc; ++i) {
+  if( !strcmp(argv[i], "-p") ) {
+   if( pool.initialize() != 0 ) {
+    fprintf(stderr, "ERROR starting parallel tracking.\n");
+    return -1;
+   }
+   tracker.setTaskPool(&pool);
+  } else if( !strcmp(argv[i], "-l") ) {
+   if( tracker.setPipelining(true) != 0 ) {
+    fprintf(stderr, "ERROR starting pipelined tracking.\n");
+    return -1;
+   }
+   pipelined = true;
+  }
+ }
+
+ // hold frames to the NTSC frame time
+ BudgetContext_t budget;
+ budget.target_ms = 33;
+ budget.min_features = 2;
+ if( tracker.setLatencyTarget(&budget) != 0 ) {
+  fprintf(stderr, "ERROR setting latency target.\n");
+  return -1;
+ }
+
+ // track features between frames. Pipelined, the features of each frame
+ // come out of the next call, and a last call without an image flushes 
+ // the last frame.
+ for(int i = 0; i < (pipelined ? 3 : 2); ++i) {
+  int frame = tracker.processImage((i < 2) ? img[i].getPointer(0) : NULL, img[0].getWidth(),
+                                   img[0].getHeight(), features);
+  if(frame < 0) {
+   fprintf(stderr, "ERROR processing image.\n");
+   return -1;
+  }
+  if(frame == 0) continue;
+
+  // print features
+  fprintf(stdout, "== frame %2d ==\n", frame - 1);
+  for(int j = 0; j < tracContext.num_features; ++j) {
+   fprintf(stdout, "%2d (%3.1f, %3.1f)\n", features.features[j].val,
+           features.features[j].x, features.features[j].y);
+  }
+  const budget_point_t &point = tracker.getOperatingPoint();
+  fprintf(stdout, "%.1f ms, next frame: %d features, %d iterations, %d levels\n",
+          point.frame_ms, point.num_features, point.max_iter, point.num_levels);
+ }
+
+ // SDL events won't be caught outside processImage(), unless
+ // you do this...
+ SDL_Event event;
+ while( SDL_PollEvent(&event)  ) {
+  if(event.type == SDL_QUIT) {
+   fprintf(stdout, "\nI was asked to quit!\n");
+   return -2;
+  }
+ }
+
+ freeFeatureList(features);
+
+ return 0;
+}
@@ -42,6 +42,13 @@ int main()
   return -1;
  }
 
+ // both images stay loaded until the end, so the tracker can use
+ // them in place rather than copy them
+ if( tracker.setZeroCopy(true) != 0 ) {
+  fprintf(stderr, "ERROR setting zero-copy input.\n");
+  return -1;
+ }
+
  // track features between frames
  for(int i = 0; i < 2; ++i) {
   if( tracker.processImage(img[i].getPointer(0), img[i].getWidth(), 
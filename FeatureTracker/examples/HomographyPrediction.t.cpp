@@ -0,0 +1,258 @@
+//==============================================================================
+// HomographyPrediction.t.cpp - Example program for homography prediction
+//                              in FeatureTrackerOCV
+//
+// Tracks features in a synthetic sequence from a camera that rotates about
+// its center: it rolls about its optical axis and pans slowly, so that
+// every frame is a homography of the first one and the true position of
+// every feature is known. Halfway through, the roll reverses.
+//
+// After every frame, the homography Hpn between the last two frames is
+// estimated from some of the features tracked in both of them (see
+// ProjectiveHomography) and given to the tracker, which tracks the next
+// frame from the positions it predicts. The sequence is tracked for a few
+// maximum numbers of iterations, with and without the prediction: with it,
+// features start close to where they end up and fewer iterations are
+// needed to track them accurately. In the frame after the reversal the
+// prediction is wrong, and the features it misplaced are flagged e_suspect.
+//
+// Usage: HomographyPrediction.t
+//==============================================================================
+
+#include "FeatureTrackerOCV.hpp"
+#include "Homography.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define WIDTH 320
+#define HEIGHT 240
+#define FOCAL 400.0
+#define NUM_FRAMES 60
+#define REVERSAL 40             // last frame rolled forward
+#define ROLL 0.02               // roll per frame, radians
+#define PAN 0.004               // pan per frame, radians
+#define NUM_FEATURES 100
+#define NUM_FIT 8               // features used to estimate the homography
+#define TEXTURE_SIZE 1024       // texture point (512, 512) is image center
+
+static float s_texture[TEXTURE_SIZE][TEXTURE_SIZE];
+static unsigned char s_frames[NUM_FRAMES][WIDTH * HEIGHT];
+
+typedef struct _Result
+{
+ long tracked;                  // features tracked from the previous frame
+ long accurate;                 // of those, within a pixel of the truth
+ long lost;                     // features of the previous frame lost
+ long suspects;                 // features flagged, other than below
+ long suspectsAtReversal;       // features flagged in the frame after it
+}Result_t;
+
+// h maps image point [x y 1]' of the first frame to that of 'frame', or
+// back if 'inverse' is set: h = K Rz(roll) Ry(pan) inv(K)
+static void cameraHomography(int frame, bool inverse, double h[9])
+{
+ double roll = ROLL * ((frame <= REVERSAL) ? frame : (2 * REVERSAL - frame));
+ double pan = PAN * frame;
+ if(inverse) {
+  roll = -roll;
+  pan = -pan;
+ }
+ double cr = cos(roll), sr = sin(roll), cp = cos(pan), sp = sin(pan);
+ double rz[9] = { cr, -sr, 0,  sr, cr, 0,  0, 0, 1 };
+ double ry[9] = { cp, 0, sp,  0, 1, 0,  -sp, 0, cp };
+ double r[9], k[9] = { FOCAL, 0, WIDTH / 2,  0, FOCAL, HEIGHT / 2,  0, 0, 1 };
+ double ki[9] = { 1 / FOCAL, 0, -WIDTH / (2 * FOCAL),  0, 1 / FOCAL, -HEIGHT / (2 * FOCAL),  0, 0, 1 };
+ double kr[9];
+ const double *a = inverse ? ry : rz, *b = inverse ? rz : ry;
+ for(int i = 0; i < 3; ++i)
+  for(int j = 0; j < 3; ++j)
+   r[3 * i + j] = a[3 * i] * b[j] + a[3 * i + 1] * b[3 + j] + a[3 * i + 2] * b[6 + j];
+ for(int i = 0; i < 3; ++i)
+  for(int j = 0; j < 3; ++j)
+   kr[3 * i + j] = k[3 * i] * r[j] + k[3 * i + 1] * r[3 + j] + k[3 * i + 2] * r[6 + j];
+ for(int i = 0; i < 3; ++i)
+  for(int j = 0; j < 3; ++j)
+   h[3 * i + j] = kr[3 * i] * ki[j] + kr[3 * i + 1] * ki[3 + j] + kr[3 * i + 2] * ki[6 + j];
+}
+
+static void map(const double h[9], double x, double y, double &u, double &v)
+{
+ double z = h[6] * x + h[7] * y + h[8];
+ u = (h[0] * x + h[1] * y + h[2]) / z;
+ v = (h[3] * x + h[4] * y + h[5]) / z;
+}
+
+static void makeFrames()
+{
+ static unsigned char noise[TEXTURE_SIZE][TEXTURE_SIZE];
+ srand(1);
+ for(int y = 0; y < TEXTURE_SIZE; ++y)
+  for(int x = 0; x < TEXTURE_SIZE; ++x)
+   noise[y][x] = rand() % 256;
+ for(int y = 0; y < TEXTURE_SIZE; ++y) {
+  for(int x = 0; x < TEXTURE_SIZE; ++x) {
+   if( (x < 2) || (y < 2) || (x >= TEXTURE_SIZE - 2) || (y >= TEXTURE_SIZE - 2) ) {
+    s_texture[y][x] = 128;
+    continue;
+   }
+   float s = 0;
+   for(int j = -2; j <= 2; ++j)
+    for(int i = -2; i <= 2; ++i)
+     s += noise[y + j][x + i];
+   s = (s / 25 - 128) * 3 + 128;
+   s_texture[y][x] = (s < 0) ? 0 : ((s > 255) ? 255 : s);
+  }
+ }
+
+ for(int f = 0; f < NUM_FRAMES; ++f) {
+  double h[9];
+  cameraHomography(f, true, h);
+  for(int y = 0; y < HEIGHT; ++y) {
+   for(int x = 0; x < WIDTH; ++x) {
+    double sx, sy;
+    map(h, x, y, sx, sy);
+    sx += TEXTURE_SIZE / 2 - WIDTH / 2;
+    sy += TEXTURE_SIZE / 2 - HEIGHT / 2;
+    int x0 = (int)sx, y0 = (int)sy;
+    double fx = sx - x0, fy = sy - y0;
+    s_frames[f][y * WIDTH + x] = (unsigned char)
+     ((1 - fy) * ((1 - fx) * s_texture[y0][x0] + fx * s_texture[y0][x0 + 1])
+      + fy * ((1 - fx) * s_texture[y0 + 1][x0] + fx * s_texture[y0 + 1][x0 + 1]) + 0.5);
+   }
+  }
+ }
+}
+
+// Estimate the homography from the previous frame to the current one from
+// NUM_FIT of the features tracked in both. Returns -1 if too few are.
+static int estimateHomography(ProjectiveHomography &homography,
+                              const feature_list_t &previous,
+                              const feature_list_t &current, Matrix<3, 3> &Hpn)
+{
+ int pairs[NUM_FEATURES], numPairs = 0;
+ for(int j = 0; j < current.num_features; ++j) {
+  int val = current.features[j].val;
+  if( (previous.features[j].val >= 0) && ((val == e_tracked) || (val == e_suspect)) )
+   pairs[numPairs++] = j;
+ }
+ if(numPairs < NUM_FIT)
+  return -1;
+
+ Matrix<3, NUM_FIT> p1, p2;
+ Vector<NUM_FIT> sc;
+ Matrix<3, 3> dev;
+ for(int k = 0; k < NUM_FIT; ++k) {
+  int j = pairs[k * numPairs / NUM_FIT];
+  p1(1, k + 1) = previous.features[j].x;
+  p1(2, k + 1) = previous.features[j].y;
+  p1(3, k + 1) = 1;
+  p2(1, k + 1) = current.features[j].x;
+  p2(2, k + 1) = current.features[j].y;
+  p2(3, k + 1) = 1;
+ }
+ return (homography.compute(p2, p1, Hpn, sc, dev) == -1) ? -1 : 0;
+}
+
+static int track(int maxIter, bool predict, Result_t &result)
+{
+ OCVTrackingContext_t ocvContext;
+ ocvContext.min_dist = 10;
+ ocvContext.quality = 0.01;
+ ocvContext.block_size = 3;
+ ocvContext.max_iter = maxIter;
+ ocvContext.epsilon = 0.01;
+ ocvContext.window_size = 10;
+ ocvContext.max_error = 500;
+
+ FeatureTrackerContext_t tracContext;
+ tracContext.num_features = NUM_FEATURES;
+ tracContext.num_frames = 2;
+ tracContext.auto_select_features = true;
+ tracContext.display_tracked_features = false;
+
+ FeatureTrackerOCV tracker;
+ ReplenishContext_t replenishContext;
+ if( (tracker.initialize(tracContext, ocvContext) != 0)
+     || (tracker.setReplenishment(&replenishContext) != 0)
+     || (tracker.setHomographyPrediction(predict) != 0) ) {
+  fprintf(stderr, "ERROR initializing tracker.\n");
+  return -1;
+ }
+
+ feature_list_t current, previous;
+ if( (allocateFeatureList(current, tracContext.num_features) < 0)
+     || (allocateFeatureList(previous, tracContext.num_features) < 0) )
+  return -1;
+
+ ProjectiveHomography homography(NUM_FIT, e_ls);
+ Matrix<3, 3> Hpn;
+ double ref[2 * NUM_FEATURES]; // every feature in the first frame
+ Result_t r = {0, 0, 0, 0, 0};
+ for(int i = 0; i < NUM_FRAMES; ++i) {
+  if( tracker.processImage(s_frames[i], WIDTH, HEIGHT, current) < 0 ) {
+   fprintf(stderr, "ERROR in frame %d.\n", i);
+   return -1;
+  }
+
+  double h[9], hi[9];
+  cameraHomography(i, false, h);
+  cameraHomography(i, true, hi);
+  for(int j = 0; j < current.num_features; ++j) {
+   const feature_t &f = current.features[j];
+   if(f.val == e_new) {
+    map(hi, f.x, f.y, ref[2 * j], ref[2 * j + 1]);
+    continue;
+   }
+   if(i == 0) continue;
+   if(f.val == e_lost) {
+    if(previous.features[j].val >= 0) ++r.lost;
+    continue;
+   }
+   double x, y;
+   map(h, ref[2 * j], ref[2 * j + 1], x, y);
+   ++r.tracked;
+   if( (x - f.x) * (x - f.x) + (y - f.y) * (y - f.y) < 1 ) ++r.accurate;
+   if(f.val == e_suspect) {
+    if(i == REVERSAL + 1) ++r.suspectsAtReversal;
+    else ++r.suspects;
+   }
+  }
+
+  if( predict && (i > 0) && (estimateHomography(homography, previous, current, Hpn) == 0) )
+   tracker.setHomography(Hpn);
+  memcpy(previous.features, current.features, current.num_features * sizeof(feature_t));
+ }
+
+ freeFeatureList(current);
+ freeFeatureList(previous);
+ result = r;
+ return 0;
+}
+
+int main()
+{
+ const int maxIters[] = {1, 2, 3, 5, 10, 20};
+ const int numMaxIters = sizeof(maxIters) / sizeof(maxIters[0]);
+
+ makeFrames();
+ fprintf(stdout, "%d frames, roll %.3f rad/frame reversing after frame %d, pan %.3f rad/frame.\n",
+         NUM_FRAMES, ROLL, REVERSAL, PAN);
+ fprintf(stdout, "max_iter  prediction  accurate  lost  e_suspect/frame  e_suspect after reversal\n");
+
+ long flagged = 0;
+ for(int m = 0; m < numMaxIters; ++m) {
+  for(int p = 0; p < 2; ++p) {
+   Result_t r;
+   if( track(maxIters[m], p == 1, r) != 0 )
+    return -1;
+   fprintf(stdout, "%8d  %10s  %7.1f%%  %4ld  %15.2f  %24ld\n", maxIters[m], p ? "on" : "off",
+           r.tracked ? 100.0 * r.accurate / r.tracked : 0.0, r.lost,
+           r.suspects / (double)(NUM_FRAMES - 2), r.suspectsAtReversal);
+   if(p == 1) flagged += r.suspectsAtReversal;
+  }
+ }
+
+ // the wrong prediction after the reversal must have been noticed
+ return (flagged > 0) ? 0 : -1;
+}
@@ -0,0 +1,103 @@
+//==============================================================================
+// MultiStreamTracker.t.cpp - Example program for MultiStreamTracker class
+//
+// Tracks four streams, two with FeatureTrackerLK and one each with
+// FeatureTrackerOCV and FeatureTrackerKLT, on a shared task pool. The
+// features are served on port 8000. Stream i can be read with
+// 'FeatureClient.t i'.
+//==============================================================================
+
+#include "MultiStreamTracker.hpp"
+#include "FeatureClientServer.hpp"
+#include "Pixmap.hpp"
+#include "RTUtils/TaskPool.hpp"
+#include <unistd.h>
+
+#define NUM_STREAMS 4
+
+int main()
+{
+ FeatureTrackerContext_t tracContext;
+ LKTrackingContext_t lkContext;
+ OCVTrackingContext_t ocvContext;
+ KLT_TrackingContext kltContext;
+ FeatureServerContext_t serverContext;
+ PixmapGray img[2];
+
+ tracContext.num_features = 10;
+ tracContext.num_frames = 2;
+ tracContext.auto_select_features = true;
+ tracContext.display_tracked_features = false;
+
+ ocvContext.min_dist = 10;
+ ocvContext.quality = 0.01;
+ ocvContext.block_size = 3;
+ ocvContext.max_iter = 20;
+ ocvContext.epsilon = 0.03;
+ ocvContext.window_size = 10;
+ ocvContext.max_error = 200;
+
+ kltContext = KLTCreateTrackingContext();
+ kltContext->affineConsistencyCheck = -1;
+ kltContext->mindist = 10;
+
+ serverContext.port = 8000;
+ serverContext.thread_priority = 10;
+ serverContext.num_features = tracContext.num_features;
+ serverContext.num_streams = NUM_STREAMS;
+
+ img[0].loadPixmap("images/box0.pgm");
+ img[1].loadPixmap("images/box1.pgm");
+
+ // set up streams
+ MultiStreamTracker tracker;
+ if( (tracker.addStream(tracContext, lkContext) < 0) ||
+     (tracker.addStream(tracContext, lkContext) < 0) ||
+     (tracker.addStream(tracContext, ocvContext) < 0) ||
+     (tracker.addStream(tracContext, kltContext) < 0) ) {
+  fprintf(stderr, "ERROR adding streams.\n");
+  return -1;
+ }
+
+ TaskPool pool;
+ if( (pool.initialize() != 0) || (tracker.setTaskPool(&pool) != 0) ) {
+  fprintf(stderr, "ERROR starting task pool.\n");
+  return -1;
+ }
+
+ FeatureServer server;
+ if( server.initialize(serverContext) != 0 )
+  return -1;
+ tracker.setFeatureServer(&server);
+
+ // the same two images for every stream, in turn
+ unsigned char *bufs[NUM_STREAMS];
+ int w[NUM_STREAMS], h[NUM_STREAMS];
+ for(int i = 0; i < 2; ++i) {
+  for(int j = 0; j < NUM_STREAMS; ++j) {
+   bufs[j] = img[i].getPointer(0);
+   w[j] = img[i].getWidth();
+   h[j] = img[i].getHeight();
+  }
+  if( tracker.processImages(bufs, w, h) < 0 ) {
+   fprintf(stderr, "ERROR processing images.\n");
+   return -1;
+  }
+
+  // print features
+  for(int j = 0; j < NUM_STREAMS; ++j) {
+   const feature_list_t &f = tracker.getFeatures(j);
+   fprintf(stdout, "== stream %d, frame %2d ==\n", j, tracker.getFrameNumber(j));
+   for(int k = 0; k < f.num_features; ++k) {
+    fprintf(stdout, "%2d (%3.1f, %3.1f)\n", f.features[k].val,
+            f.features[k].x, f.features[k].y);
+   }
+  }
+ }
+
+ // give clients some time to read the features
+ sleep(10);
+
+ KLTFreeTrackingContext(kltContext);
+ return 0;
+}
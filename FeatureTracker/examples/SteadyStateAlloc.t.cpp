@@ -0,0 +1,336 @@
+//==============================================================================
+// SteadyStateAlloc.t.cpp : Checks that the capture->track->serve loop does
+//                          not allocate heap memory once it is warmed up.
+//==============================================================================
+
+#include "FeatureTrackerOCV.hpp"
+#include "FeatureTrackerLK.hpp"
+#include "FeatureClientServer.hpp"
+#include "RTUtils/FrameHandoff.hpp"
+#include <pthread.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <new>
+
+//==============================================================================
+// This program runs the same capture->track->serve loop as tracker01, on
+// synthetic images so that no framegrabber is needed:
+//  - a capture thread puts every frame into a FrameHandoff, as
+//    PXCCaptureLoop does, and the tracking thread takes them from there;
+//  - the tracker displays the features (through the SDL dummy video driver
+//    unless SDL_VIDEODRIVER is set) and replenishes lost ones;
+//  - the features are served by a FeatureServer, and a FeatureClient asks
+//    for them after every frame, so the server thread replies every time.
+// Every heap allocation is counted by the hooks below, per thread. After a
+// warm-up period, the allocations made in each stage of the loop are
+// counted over a number of frames. The loop is run once with
+// FeatureTrackerOCV and once with FeatureTrackerLK.
+//
+// The program returns -1 if any stage allocates in the steady state, with
+// one exception: cvCalcOpticalFlowPyrLK() allocates scratch buffers on each
+// call, inside OpenCV. Tracking with FeatureTrackerOCV is therefore first
+// run with detection idle (replenishment off), and the most allocations
+// it makes in one frame are taken as that scratch. Replenishment detects
+// with CornerDetector, not OpenCV, so with replenishment on, any frame in
+// which tracking allocates more fails the test.
+//==============================================================================
+using namespace std;
+
+//------------------------------------------------------------------------------
+// Allocation counting hooks. With glibc, the malloc family is interposed
+// (operator new calls malloc); elsewhere only operator new is counted.
+// Allocations are counted for the whole process and for each thread.
+//------------------------------------------------------------------------------
+static volatile long s_numAllocs = 0;
+static __thread long s_threadAllocs = 0;
+
+#ifdef __GLIBC__
+extern "C" {
+ void *__libc_malloc(size_t size);
+ void *__libc_calloc(size_t n, size_t size);
+ void *__libc_realloc(void *ptr, size_t size);
+
+ void *malloc(size_t size)
+ {
+  __sync_fetch_and_add(&s_numAllocs, 1);
+  ++s_threadAllocs;
+  return __libc_malloc(size);
+ }
+
+ void *calloc(size_t n, size_t size)
+ {
+  __sync_fetch_and_add(&s_numAllocs, 1);
+  ++s_threadAllocs;
+  return __libc_calloc(n, size);
+ }
+
+ void *realloc(void *ptr, size_t size)
+ {
+  __sync_fetch_and_add(&s_numAllocs, 1);
+  ++s_threadAllocs;
+  return __libc_realloc(ptr, size);
+ }
+}
+#else
+void *operator new(size_t size) throw(std::bad_alloc)
+{
+ __sync_fetch_and_add(&s_numAllocs, 1);
+ ++s_threadAllocs;
+ void *p = malloc(size ? size : 1);
+ if(p == NULL) throw std::bad_alloc();
+ return p;
+}
+
+void *operator new[](size_t size) throw(std::bad_alloc)
+{
+ return operator new(size);
+}
+
+void operator delete(void *p) throw() { free(p); }
+void operator delete[](void *p) throw() { free(p); }
+#endif
+
+static inline long getThreadAllocs() { return s_threadAllocs; }
+
+// Allocations of the capture and server threads while a loop is measured
+static volatile bool s_measuring = false;
+static volatile long s_captureAllocs = 0;
+static volatile long s_serverAllocs = 0;
+
+
+//------------------------------------------------------------------------------
+// Synthetic capture: a window moving in circles over a random texture
+//------------------------------------------------------------------------------
+#define IMG_W     320
+#define IMG_H     240
+#define MARGIN    32
+
+static unsigned char s_texture[(IMG_W + 2 * MARGIN) * (IMG_H + 2 * MARGIN)];
+static volatile bool s_done = false;
+
+static void makeTexture()
+{
+ int tw = IMG_W + 2 * MARGIN;
+ int th = IMG_H + 2 * MARGIN;
+ srand(1);
+ for(int y = 0; y < th; y += 8)
+  for(int x = 0; x < tw; x += 8) {
+   unsigned char v = rand() % 256;
+   for(int j = y; j < y + 8 && j < th; ++j)
+    memset(s_texture + j * tw + x, v, (x + 8 <= tw) ? 8 : tw - x);
+  }
+}
+
+static void captureFrame(long frame, unsigned char *buf)
+{
+ int tw = IMG_W + 2 * MARGIN;
+ int ox = MARGIN + (int)(MARGIN/2 * cos(0.05 * frame));
+ int oy = MARGIN + (int)(MARGIN/2 * sin(0.05 * frame));
+ for(int y = 0; y < IMG_H; ++y)
+  memcpy(buf + y * IMG_W, s_texture + (y + oy) * tw + ox, IMG_W);
+}
+
+// The capture thread: a frame every millisecond into the handoff, as the
+// PXCCaptureLoop capture thread does (see PXCCaptureLoop::processImage())
+void *capture(void *arg)
+{
+ FrameHandoff *handoff = (FrameHandoff *)arg;
+ static unsigned char frame[IMG_W * IMG_H];
+ for(long i = 0; !s_done; ++i) {
+  long n0 = getThreadAllocs();
+  captureFrame(i, frame);
+  if( handoff->put(frame, IMG_W * IMG_H) < 0 ) break;
+  if(s_measuring) __sync_fetch_and_add(&s_captureAllocs, getThreadAllocs() - n0);
+  usleep(1000);
+ }
+ return NULL;
+}
+
+
+//------------------------------------------------------------------------------
+// A FeatureServer that counts the allocations of its replies
+//------------------------------------------------------------------------------
+class CountingServer : public FeatureServer
+{
+ protected:
+  virtual const char *receiveAndReply(const char *inMsgBuf, int inMsgLen, int *outMsgLen)
+  {
+   long n0 = getThreadAllocs();
+   const char *reply = FeatureServer::receiveAndReply(inMsgBuf, inMsgLen, outMsgLen);
+   if(s_measuring) __sync_fetch_and_add(&s_serverAllocs, getThreadAllocs() - n0);
+   return reply;
+  }
+};
+
+
+//------------------------------------------------------------------------------
+// The capture->track->serve loop, over 'numFrames' frames. Counts the
+// allocations of each stage into n[0..2], the most allocations made by
+// the tracker in one frame into 'maxTrack', those beyond 'allowed' in any
+// frame into 'excess', and the features replenished into 'numNew'.
+//------------------------------------------------------------------------------
+#define WARMUP_FRAMES    30
+#define BASELINE_FRAMES  50
+#define TEST_FRAMES     300
+
+template<class Tracker>
+static int runLoop(Tracker &tracker, FrameHandoff &handoff, FeatureClient &client,
+                   FeatureServer &server, feature_list_t &features, feature_list_t &received,
+                   int numFrames, long allowed, long n[3], long &maxTrack, long &excess,
+                   long &numNew)
+{
+ n[0] = n[1] = n[2] = 0;
+ maxTrack = excess = numNew = 0;
+ long capture0 = s_captureAllocs, server0 = s_serverAllocs;
+ s_measuring = true;
+ for(int frame = 0; frame < numFrames; ++frame) {
+  // capture
+  long n0 = getThreadAllocs();
+  handoff_frame_t f;
+  if( handoff.acquire(f, 1000) != 0 ) {
+   fprintf(stderr, "ERROR: No frame from the capture thread.\n");
+   return -1;
+  }
+  long n1 = getThreadAllocs();
+
+  // track
+  if( tracker.processImage(f.buf, IMG_W, IMG_H, features) < 0 )
+   return -1;
+  long n2 = getThreadAllocs();
+  handoff.release();
+  long n3 = getThreadAllocs();
+
+  // serve, and request the features as a client would
+  if( server.updateFeatures(features, (int)f.number) != 0 )
+   return -1;
+  if( client.receiveFeatureList(received) != 0 )
+   return -1;
+  long n4 = getThreadAllocs();
+
+  n[0] += (n1 - n0) + (n3 - n2);
+  n[1] += n2 - n1;
+  n[2] += n4 - n3;
+  if(n2 - n1 > maxTrack) maxTrack = n2 - n1;
+  if(n2 - n1 > allowed) excess += n2 - n1 - allowed;
+  for(int i = 0; i < features.num_features; ++i)
+   if(features.features[i].val == e_new) ++numNew;
+ }
+ s_measuring = false;
+ n[0] += s_captureAllocs - capture0;
+ n[2] += s_serverAllocs - server0;
+ return 0;
+}
+
+
+int main()
+{
+ FeatureTrackerContext_t ftc;
+ OCVTrackingContext_t ocvtc;
+ LKTrackingContext_t lktc;
+ ReplenishContext_t rc;
+ FeatureServerContext_t fsc;
+ HandoffContext_t hc;
+ FrameHandoff handoff;
+ CountingServer server;
+ FeatureClient client;
+ feature_list_t features, received;
+
+ ftc.num_features = 100;
+ ftc.num_frames = 100;
+ ftc.auto_select_features = true;
+ ftc.display_tracked_features = true;
+
+ ocvtc.min_dist = 10;
+ ocvtc.quality = 0.01;
+ ocvtc.block_size = 3;
+ ocvtc.max_iter = 20;
+ ocvtc.epsilon = 0.03;
+ ocvtc.window_size = 10;
+ ocvtc.max_error = 200;
+
+ fsc.port = 8000;
+ fsc.thread_priority = 10;
+ fsc.num_features = ftc.num_features;
+
+ hc.frame_bytes = IMG_W * IMG_H;
+
+ // no window needed to exercise the display
+ setenv("SDL_VIDEODRIVER", "dummy", 0);
+
+ makeTexture();
+ if( (allocateFeatureList(features, ftc.num_features) < 0)
+     || (allocateFeatureList(received, ftc.num_features) < 0) )
+  return -1;
+ if( handoff.initialize(hc) != 0 ) return -1;
+ if( server.initialize(fsc) != 0 ) return -1;
+ if( client.initialize("127.0.0.1", fsc.port, 50, ftc.num_features) != 0 ) return -1;
+
+ pthread_t thread;
+ if( pthread_create(&thread, NULL, capture, &handoff) != 0 )
+  return -1;
+
+ long ocv[3], lk[3], base[3], warm[3];
+ long ocvMax, ocvExcess, ocvNew, lkMax, lkExcess, lkNew, baseMax, unused;
+ int ret = 0;
+
+ // one tracker at a time, as each owns the display while it lives
+ {
+  FeatureTrackerOCV ocvTracker;
+  if( (ocvTracker.initialize(ftc, ocvtc) != 0)
+      || (ocvTracker.openTrackLog("steadyStateAlloc.t.dat") != 0)
+      || (runLoop(ocvTracker, handoff, client, server, features, received, WARMUP_FRAMES,
+                  0, warm, unused, unused, unused) != 0)
+      || (runLoop(ocvTracker, handoff, client, server, features, received, BASELINE_FRAMES,
+                  0, base, baseMax, unused, unused) != 0)
+      || (ocvTracker.setReplenishment(&rc) != 0)
+      || (runLoop(ocvTracker, handoff, client, server, features, received, WARMUP_FRAMES,
+                  0, warm, unused, unused, unused) != 0)
+      || (runLoop(ocvTracker, handoff, client, server, features, received, TEST_FRAMES,
+                  baseMax, ocv, ocvMax, ocvExcess, ocvNew) != 0) )
+   ret = -1;
+  ocvTracker.closeTrackLog();
+ }
+ if(ret == 0) {
+  FeatureTrackerLK lkTracker;
+  if( (lkTracker.initialize(ftc, lktc) != 0)
+      || (lkTracker.setReplenishment(&rc) != 0)
+      || (runLoop(lkTracker, handoff, client, server, features, received, WARMUP_FRAMES,
+                  0, warm, unused, unused, unused) != 0)
+      || (runLoop(lkTracker, handoff, client, server, features, received, TEST_FRAMES,
+                  0, lk, lkMax, lkExcess, lkNew) != 0) )
+   ret = -1;
+ }
+
+ s_done = true;
+ pthread_join(thread, NULL);
+ freeFeatureList(features);
+ freeFeatureList(received);
+ if(ret != 0) {
+  fprintf(stderr, "ERROR running the loop.\n");
+  return -1;
+ }
+
+ fprintf(stdout, "Heap allocations over %d frames after %d warm-up frames:\n",
+         TEST_FRAMES, WARMUP_FRAMES);
+ fprintf(stdout, "             OCV     LK\n");
+ fprintf(stdout, " capture: %6ld %6ld\n", ocv[0], lk[0]);
+ fprintf(stdout, " track:   %6ld %6ld\n", ocv[1], lk[1]);
+ fprintf(stdout, " serve:   %6ld %6ld\n", ocv[2], lk[2]);
+ fprintf(stdout, "OCV tracking with detection idle: at most %ld per frame "
+         "(cvCalcOpticalFlowPyrLK scratch), %ld beyond that with replenishment.\n",
+         baseMax, ocvExcess);
+ fprintf(stdout, "Features replenished: %ld OCV, %ld LK.\n", ocvNew, lkNew);
+
+ if(ocv[0] || ocv[2] || ocvExcess || lk[0] || lk[1] || lk[2] || base[0] || base[2]) {
+  fprintf(stderr, "FAILED: steady state loop allocates.\n");
+  return -1;
+ }
+ if( (ocvNew == 0) || (lkNew == 0) ) {
+  fprintf(stderr, "FAILED: no features were replenished.\n");
+  return -1;
+ }
+ fprintf(stdout, "PASSED\n");
+ return 0;
+}
@@ -0,0 +1,170 @@
+//==============================================================================
+// StereoTracker.t.cpp - Example program for StereoTracker class
+//
+// Tracks features in a synthetic rectified stereo sequence: a random
+// texture on a slanted plane, which the camera pair pans across while the
+// plane moves nearer and further. The disparity of every feature is known,
+// and is compared with the disparity found.
+//
+// Usage: StereoTracker.t [-t ocv|klt|lk] [-n frames] [-p]
+//  -t  Tracker of the left image (lk).
+//  -n  Number of frames (100).
+//  -p  Match on a TaskPool.
+//==============================================================================
+
+#include "StereoTracker.hpp"
+#include "RTUtils/TaskPool.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#define WIDTH 640
+#define HEIGHT 480
+#define SCENE_WIDTH 880
+#define SCENE_HEIGHT 600
+#define SLANT 0.02
+
+static float s_scene[SCENE_HEIGHT][SCENE_WIDTH];
+
+// left image point (x, y) is scene point (x + ox, y + oy)
+static void pan(int frame, double &ox, double &oy)
+{
+ ox = 70 + 60 * sin(0.03 * frame);
+ oy = 50 + 40 * sin(0.05 * frame + 1);
+}
+
+// true disparity at column x of the left image
+static double disparity(int frame, double x)
+{
+ return 20 + 10 * sin(0.04 * frame) + SLANT * x;
+}
+
+static void makeScene()
+{
+ static unsigned char noise[SCENE_HEIGHT][SCENE_WIDTH];
+ srand(1);
+ for(int y = 0; y < SCENE_HEIGHT; ++y)
+  for(int x = 0; x < SCENE_WIDTH; ++x)
+   noise[y][x] = rand() % 256;
+ for(int y = 0; y < SCENE_HEIGHT; ++y) {
+  for(int x = 0; x < SCENE_WIDTH; ++x) {
+   if( (x < 2) || (y < 2) || (x >= SCENE_WIDTH - 2) || (y >= SCENE_HEIGHT - 2) ) {
+    s_scene[y][x] = 128;
+    continue;
+   }
+   float s = 0;
+   for(int j = -2; j <= 2; ++j)
+    for(int i = -2; i <= 2; ++i)
+     s += noise[y + j][x + i];
+   s = (s / 25 - 128) * 3 + 128;
+   s_scene[y][x] = (s < 0) ? 0 : ((s > 255) ? 255 : s);
+  }
+ }
+}
+
+// right image point xr shows left image point x, where xr = x - disparity(x)
+static void render(int frame, unsigned char *left, unsigned char *right)
+{
+ double ox, oy;
+ pan(frame, ox, oy);
+ double d0 = disparity(frame, 0);
+ for(int y = 0; y < HEIGHT; ++y) {
+  for(int x = 0; x < WIDTH; ++x) {
+   for(int v = 0; v < 2; ++v) {
+    double sx = (v == 0) ? x : (x + d0) / (1 - SLANT);
+    sx += ox;
+    double sy = y + oy;
+    int x0 = (int)sx, y0 = (int)sy;
+    double fx = sx - x0, fy = sy - y0;
+    unsigned char *img = (v == 0) ? left : right;
+    img[y * WIDTH + x] = (unsigned char)
+     ((1 - fy) * ((1 - fx) * s_scene[y0][x0] + fx * s_scene[y0][x0 + 1])
+      + fy * ((1 - fx) * s_scene[y0 + 1][x0] + fx * s_scene[y0 + 1][x0 + 1]) + 0.5);
+   }
+  }
+ }
+}
+
+int main(int argc, char *argv[])
+{
+ const char *backend = "lk";
+ int numFrames = 100;
+ bool parallel = false;
+ for(int i = 1; i < argc; ++i) {
+  if( !strcmp(argv[i], "-t") && (i + 1 < argc) ) backend = argv[++i];
+  else if( !strcmp(argv[i], "-n") && (i + 1 < argc) ) numFrames = atoi(argv[++i]);
+  else if( !strcmp(argv[i], "-p") ) parallel = true;
+  else {
+   fprintf(stderr, "Usage: %s [-t ocv|klt|lk] [-n frames] [-p]\n", argv[0]);
+   return -1;
+  }
+ }
+
+ FeatureTrackerContext_t tracContext;
+ tracContext.num_features = 100;
+ tracContext.num_frames = 2;
+ tracContext.auto_select_features = true;
+ tracContext.display_tracked_features = false;
+ StereoContext_t stereoContext;
+
+ int b = 0;
+ while( (b < e_numTrackerBackends)
+        && strcmp(backend, FeatureTracker::getBackendName((tracker_backend_t)b)) ) ++b;
+ StereoTracker tracker;
+ if( (b == e_numTrackerBackends)
+     || (tracker.initialize(tracContext, stereoContext, (tracker_backend_t)b) != 0) ) {
+  fprintf(stderr, "ERROR initializing the '%s' tracker.\n", backend);
+  return -1;
+ }
+ ReplenishContext_t replenishContext;
+ if( tracker.getTracker().setReplenishment(&replenishContext) != 0 )
+  return -1;
+
+ TaskPool pool;
+ if( parallel && ((pool.initialize() != 0) || (tracker.setTaskPool(&pool) != 0)) )
+  return -1;
+
+ feature_list_t leftList, rightList;
+ if( (allocateFeatureList(leftList, tracContext.num_features) < 0)
+     || (allocateFeatureList(rightList, tracContext.num_features) < 0) )
+  return -1;
+
+ makeScene();
+ static unsigned char left[WIDTH * HEIGHT], right[WIDTH * HEIGHT];
+ long live = 0, matched = 0, searched = 0;
+ double sumError = 0, maxError = 0, seconds = 0;
+ for(int i = 0; i < numFrames; ++i) {
+  render(i, left, right);
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  if( tracker.processImages(left, right, WIDTH, HEIGHT, leftList, rightList) < 0 ) {
+   fprintf(stderr, "ERROR in frame %d.\n", i);
+   return -1;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  seconds += (t1.tv_sec - t0.tv_sec) + 1e-9 * (t1.tv_nsec - t0.tv_nsec);
+  searched += tracker.getNumSearches();
+
+  const float *d = tracker.getDisparities();
+  for(int j = 0; j < leftList.num_features; ++j) {
+   if(leftList.features[j].val < 0) continue;
+   ++live;
+   if(rightList.features[j].val < 0) continue;
+   ++matched;
+   double e = fabs(d[j] - disparity(i, leftList.features[j].x));
+   sumError += e;
+   if(e > maxError) maxError = e;
+  }
+ }
+
+ double meanError = matched ? sumError / matched : 0;
+ fprintf(stdout, "%d frames, %.1f frames/s: %.1f%% of %ld features matched, %.1f%% by a "
+         "full search.\n", numFrames, numFrames / seconds, live ? 100.0 * matched / live : 0.0,
+         live, matched ? 100.0 * searched / matched : 0.0);
+ fprintf(stdout, "Disparity error mean %.3f, max %.3f pixels.\n", meanError, maxError);
+
+ freeFeatureList(leftList);
+ freeFeatureList(rightList);
+ return ( (matched > live / 2) && (meanError < 0.5) ) ? 0 : -1;
+}
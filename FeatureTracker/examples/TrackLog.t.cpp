@@ -0,0 +1,60 @@
+//==============================================================================
+// TrackLog.t.cpp : Example program for TrackLogWriter and TrackLogReader.
+//==============================================================================
+
+#include "TrackLog.hpp"
+#include <math.h>
+
+//==============================================================================
+// This example writes a track log of synthetic features moving in circles,
+// then maps the log and reads back a few frames and the track of one
+// feature. In a tracking application, the log would instead be written by
+// FeatureTrackerKLT::openTrackLog() or FeatureTrackerOCV::openTrackLog().
+//==============================================================================
+using namespace std;
+
+int main()
+{
+ int numFeatures = 50;
+ int numFrames = 1000;
+ feature_list_t features;
+ if( allocateFeatureList(features, numFeatures) < 0 ) return -1;
+
+ // write the log
+ TrackLogWriter writer;
+ if( writer.open("trackLog.t.dat", numFeatures) != 0 ) return -1;
+ for(int frame = 0; frame < numFrames; ++frame) {
+  for(int i = 0; i < numFeatures; ++i) {
+   features.features[i].x = 320 + 100 * cos(0.01 * frame + i);
+   features.features[i].y = 240 + 100 * sin(0.01 * frame + i);
+   features.features[i].val = ((frame + i) % 97 == 0) ? -1 : 0;
+  }
+  if( writer.append(features, frame) != 0 ) return -1;
+ }
+ writer.close();
+
+ // map the log and read it back
+ TrackLogReader reader;
+ if( reader.open("trackLog.t.dat") != 0 ) return -1;
+ fprintf(stdout, "Log holds %d records of %d features, frames %d to %d\n",
+         reader.getNumRecords(), reader.getNumFeatures(),
+         reader.getFirstFrameNumber(), reader.getLastFrameNumber());
+
+ // random access to a frame
+ if( reader.getFrame(500, features) != 0 ) {
+  fprintf(stderr, "OOPS\n");
+  return -1;
+ }
+ fprintf(stdout, "Frame %d, feature 0: (%f, %f) %d\n", features.frame_number,
+         features.features[0].x, features.features[0].y, features.features[0].val);
+
+ // track of feature 3 over frames 90 to 99
+ for(int frame = 90; frame < 100; ++frame) {
+  const feature_t *f = reader.getFrame(frame);
+  fprintf(stdout, "Frame %d, feature 3: (%f, %f) %d\n", frame, f[3].x, f[3].y, f[3].val);
+ }
+
+ reader.close();
+ freeFeatureList(features);
+ return 0;
+}
@@ -5,15 +5,10 @@
 // user selected features from frame to frame.
 //==============================================================================
 
-//#define USE_KLT
-
 #include "ffmpeg/avcodec.h"
 #include "ffmpeg/avformat.h"
-#ifdef USE_KLT
- #include "FeatureTrackerKLT.hpp"
-#else
- #include "FeatureTrackerOCV.hpp"
-#endif
+#include "FeatureTracker.hpp"
+#include "FeatureTrackerKLT.hpp"
 #include <malloc.h>
 
 #define TRACKED_FEATURES_TABLE_NAME      "./test0"
@@ -29,41 +24,18 @@ bool GetNextFrame(AVFormatContext *pFormatCtx, AVCodecContext *pCodecCtx,
 int main(int argc, char *argv[])
 {
  if(argc < 2) {
-  fprintf(stderr, "Usage: %s <video_file>\n", argv[0]);
+  fprintf(stderr, "Usage: %s <video_file> [ocv|klt|lk]\n", argv[0]);
   return -1;
  }
  
  AVFormatContext *avFormatContext;
  FeatureTrackerContext_t tracContext;
-#ifdef USE_KLT
- FeatureTrackerKLT tracker;
- KLT_TrackingContext tcxt;
- tcxt = KLTCreateTrackingContext();
- tcxt->lighting_insensitive = true;
- tcxt->writeInternalImages = false;
- tcxt->affineConsistencyCheck = -1;
- tcxt->window_width = 7;
- tcxt->window_height = 7;
- tcxt->max_iterations = 10;
- tcxt->mindist = 10;
- tcxt->smoothBeforeSelecting = true;
-
-// tcxt->min_displacement = 0.1;
-// tcxt->pyramid_sigma_fact = 0.9;
-// tcxt->smooth_sigma_fact = 0.1;
-// tcxt->grad_sigma = 1.5;
-// KLTUpdateTCBorder(tcxt);
-#else
- FeatureTrackerOCV tracker;
- OCVTrackingContext_t tcxt;
- tcxt.min_dist = 10;
- tcxt.quality = 0.01;
- tcxt.block_size = 9;
+ TrackerSettings_t tcxt;
+ tcxt.window_size = 21;
  tcxt.max_iter = 20;
  tcxt.epsilon = 0.01;
- tcxt.window_size = 10; 
- tcxt.max_error = 300;
-#endif
+ tcxt.min_dist = 10;
+ tcxt.quality = 0.01;
 
  feature_list_t features;
  int frameNumber = 0;
@@ -77,8 +49,9 @@ int main(int argc, char *argv[])
  if( allocateFeatureList(features, tracContext.num_features) < 0 )
   return -1;
 
- // initialize tracker
- if( tracker.initialize(tracContext, tcxt) != 0 ) {
+ // create the tracker named on the command line
+ FeatureTracker *tracker = FeatureTracker::create((argc > 2) ? argv[2] : "ocv", tracContext, tcxt);
+ if(tracker == NULL) {
   fprintf(stderr, "[%s] ERROR initializing tracker.\n", argv[0]);
   return -1;
  }
@@ -195,7 +168,7 @@ int main(int argc, char *argv[])
                avCodecContext->pix_fmt, imgW, imgH);
 
   // process image for features
-  if( (frameNumber = tracker.processImage(vFrameGrey->data[0], imgW, imgH, features)) < 0 ) {
+  if( (frameNumber = tracker->processImage(vFrameGrey->data[0], imgW, imgH, features)) < 0 ) {
    if( frameNumber != -2) fprintf(stderr, "[%s] ERROR processing image.\n", argv[0]);
    return frameNumber;
   }
@@ -205,14 +178,13 @@ int main(int argc, char *argv[])
   // break;
  }
  
-#ifdef USE_KLT
  // Write the feature table, and an image with tracked features
- if( tracker.writeFeatureTable(TRACKED_FEATURES_TABLE_NAME) != 0 ) {
+ if( (tracker->getBackend() == e_trackerKLT)
+     && (((FeatureTrackerKLT *)tracker)->writeFeatureTable(TRACKED_FEATURES_TABLE_NAME) != 0) ) {
   fprintf(stderr, "[%s] ERROR writing feature tables.\n", argv[0]);
   return -1;
  }
- KLTFreeTrackingContext(tcxt);
-#endif
+ delete tracker;
 
  // cleanup
  free(buffer);
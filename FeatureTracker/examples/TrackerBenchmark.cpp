@@ -0,0 +1,308 @@
+//==============================================================================
+// TrackerBenchmark.cpp - Compares the feature trackers on one image sequence
+//==============================================================================
+
+#include "FeatureTracker.hpp"
+#include "Pixmap.hpp"
+#include "RTUtils/TaskPool.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+//==============================================================================
+// Runs every tracker, or the one named with -t, through FeatureTracker over
+// the same sequence of images, and reports for each:
+//  - frames/s:   images processed per second spent in processImage().
+//  - us/feature: that time per live feature reported.
+//  - survival:   fraction of the features live in one frame that are still
+//                tracked in the next, over all frames.
+//  - drift:      mean and largest distance in pixels of tracked features
+//                from their true positions, i.e. where the scene point under
+//                the feature when it was detected has moved to.
+//
+// By default, the sequence is synthetic, so that true positions are known:
+// a random texture seen by a camera that pans and rolls smoothly. A
+// recorded sequence can be given as a list of PGM images instead; drift is
+// then not reported.
+//
+// Usage: TrackerBenchmark [-t ocv|klt|lk] [-n frames] [-f features] [-p]
+//                         [-l] [-r] [image.pgm ...]
+//  -t  Run only this tracker.
+//  -n  Number of synthetic frames (200).
+//  -f  Number of features (100).
+//  -p  Track in parallel on a TaskPool, where supported.
+//  -l  Pipeline pyramid construction, where supported.
+//  -r  Replenish lost features.
+//==============================================================================
+
+#define WIDTH 640
+#define HEIGHT 480
+#define SCENE_WIDTH 960
+#define SCENE_HEIGHT 720
+
+typedef struct _benchmark_result
+{
+ int frames;
+ double seconds;
+ long liveFeatures;     // over all frames
+ long survivors, candidates;
+ long drifted;          // tracked features compared with the truth
+ double sumDrift, maxDrift;
+}benchmark_result_t;
+
+static float s_scene[SCENE_HEIGHT][SCENE_WIDTH];
+
+// camera pose of a synthetic frame: image point x is scene point
+// R(angle) * (x - c) + c + (ox, oy), with c the image center
+static void pose(int frame, double &angle, double &ox, double &oy)
+{
+ angle = 0.08 * sin(0.031 * frame);
+ ox = 160 + 90 * sin(0.023 * frame);
+ oy = 120 + 70 * sin(0.037 * frame + 1);
+}
+
+static void imageToScene(int frame, double x, double y, double &sx, double &sy)
+{
+ double a, ox, oy;
+ pose(frame, a, ox, oy);
+ x -= WIDTH / 2;
+ y -= HEIGHT / 2;
+ sx = cos(a) * x - sin(a) * y + WIDTH / 2 + ox;
+ sy = sin(a) * x + cos(a) * y + HEIGHT / 2 + oy;
+}
+
+static void sceneToImage(int frame, double sx, double sy, double &x, double &y)
+{
+ double a, ox, oy;
+ pose(frame, a, ox, oy);
+ sx -= WIDTH / 2 + ox;
+ sy -= HEIGHT / 2 + oy;
+ x = cos(a) * sx + sin(a) * sy + WIDTH / 2;
+ y = -sin(a) * sx + cos(a) * sy + HEIGHT / 2;
+}
+
+// smoothed noise with the contrast stretched
+static void makeScene()
+{
+ static unsigned char noise[SCENE_HEIGHT][SCENE_WIDTH];
+ srand(1);
+ for(int y = 0; y < SCENE_HEIGHT; ++y)
+  for(int x = 0; x < SCENE_WIDTH; ++x)
+   noise[y][x] = rand() % 256;
+ for(int y = 0; y < SCENE_HEIGHT; ++y) {
+  for(int x = 0; x < SCENE_WIDTH; ++x) {
+   if( (x < 2) || (y < 2) || (x >= SCENE_WIDTH - 2) || (y >= SCENE_HEIGHT - 2) ) {
+    s_scene[y][x] = 128;
+    continue;
+   }
+   float s = 0;
+   for(int j = -2; j <= 2; ++j)
+    for(int i = -2; i <= 2; ++i)
+     s += noise[y + j][x + i];
+   s = (s / 25 - 128) * 3 + 128;
+   s_scene[y][x] = (s < 0) ? 0 : ((s > 255) ? 255 : s);
+  }
+ }
+}
+
+static void render(int frame, unsigned char *img)
+{
+ for(int y = 0; y < HEIGHT; ++y) {
+  for(int x = 0; x < WIDTH; ++x) {
+   double sx, sy;
+   imageToScene(frame, x, y, sx, sy);
+   int x0 = (int)sx, y0 = (int)sy;
+   double fx = sx - x0, fy = sy - y0;
+   img[y * WIDTH + x] = (unsigned char)
+    ((1 - fy) * ((1 - fx) * s_scene[y0][x0] + fx * s_scene[y0][x0 + 1])
+     + fy * ((1 - fx) * s_scene[y0 + 1][x0] + fx * s_scene[y0 + 1][x0 + 1]) + 0.5);
+  }
+ }
+}
+
+static double now()
+{
+ struct timespec t;
+ clock_gettime(CLOCK_MONOTONIC, &t);
+ return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+//==============================================================================
+// run - one tracker over the whole sequence
+//==============================================================================
+static int run(FeatureTracker &tracker, int numFrames, int numFeatures, PixmapGray *recorded,
+               benchmark_result_t &r)
+{
+ feature_list_t list;
+ if( allocateFeatureList(list, numFeatures) < 0 ) return -1;
+ static unsigned char img[WIDTH * HEIGHT];
+ int w = WIDTH, h = HEIGHT;
+
+ // per slot: the scene point of the feature when it was detected, and
+ // whether it was live in the frame before
+ double *origin = (double *)malloc(2 * numFeatures * sizeof(double));
+ char *live = (char *)calloc(numFeatures, 1);
+ if( !origin || !live ) return -1;
+ memset(&r, 0, sizeof(r));
+
+ // a pipelined tracker returns the features of each frame one call late,
+ // and of the last frame when called without an image
+ int processed = 0;
+ for(int i = 0; i <= numFrames; ++i) {
+  unsigned char *buf = NULL;
+  if(i < numFrames) {
+   if(recorded) {
+    buf = recorded[i].getPointer(0);
+    w = recorded[i].getWidth();
+    h = recorded[i].getHeight();
+   } else {
+    render(i, img);
+    buf = img;
+   }
+  } else if(processed == numFrames) {
+   break;
+  }
+
+  double t0 = now();
+  int frame = tracker.processImage(buf, w, h, list);
+  r.seconds += now() - t0;
+  if(frame < 0) {
+   free(origin);
+   free(live);
+   freeFeatureList(list);
+   return -1;
+  }
+  if(frame == 0) continue;
+  ++processed;
+
+  int k = frame - 1;
+  for(int j = 0; j < numFeatures; ++j) {
+   const feature_t &f = list.features[j];
+   if(f.val < 0) {
+    live[j] = 0;
+    continue;
+   }
+   ++r.liveFeatures;
+   if( live[j] ) {
+    ++r.candidates;
+    if(f.val == e_tracked) ++r.survivors;
+   }
+   if( (f.val == e_new) || (k == 0) ) {
+    imageToScene(k, f.x, f.y, origin[2 * j], origin[2 * j + 1]);
+   } else if( !recorded && (f.val == e_tracked) ) {
+    double x, y;
+    sceneToImage(k, origin[2 * j], origin[2 * j + 1], x, y);
+    double d = hypot(f.x - x, f.y - y);
+    r.sumDrift += d;
+    if(d > r.maxDrift) r.maxDrift = d;
+    ++r.drifted;
+   }
+   live[j] = 1;
+  }
+ }
+ r.frames = processed;
+ free(origin);
+ free(live);
+ freeFeatureList(list);
+ return 0;
+}
+
+//==============================================================================
+// main
+//==============================================================================
+int main(int argc, char *argv[])
+{
+ const char *only = NULL;
+ int numFrames = 200;
+ int numFeatures = 100;
+ bool parallel = false, pipelined = false, replenish = false;
+ int firstImage = argc;
+ for(int i = 1; i < argc; ++i) {
+  if( !strcmp(argv[i], "-t") && (i + 1 < argc) ) only = argv[++i];
+  else if( !strcmp(argv[i], "-n") && (i + 1 < argc) ) numFrames = atoi(argv[++i]);
+  else if( !strcmp(argv[i], "-f") && (i + 1 < argc) ) numFeatures = atoi(argv[++i]);
+  else if( !strcmp(argv[i], "-p") ) parallel = true;
+  else if( !strcmp(argv[i], "-l") ) pipelined = true;
+  else if( !strcmp(argv[i], "-r") ) replenish = true;
+  else if( argv[i][0] == '-' ) {
+   fprintf(stderr, "Usage: %s [-t ocv|klt|lk] [-n frames] [-f features] [-p] [-l] [-r] "
+           "[image.pgm ...]\n", argv[0]);
+   return -1;
+  } else {
+   firstImage = i;
+   break;
+  }
+ }
+ if( (numFrames < 2) || (numFeatures < 1) ) {
+  fprintf(stderr, "ERROR. Need at least 2 frames and 1 feature.\n");
+  return -1;
+ }
+
+ // a recorded sequence, loaded up front so that reading is not timed
+ PixmapGray *recorded = NULL;
+ if(firstImage < argc) {
+  numFrames = argc - firstImage;
+  recorded = new PixmapGray[numFrames];
+  for(int i = 0; i < numFrames; ++i) {
+   if( recorded[i].loadPixmap(argv[firstImage + i]) != 0 ) {
+    fprintf(stderr, "ERROR loading %s.\n", argv[firstImage + i]);
+    return -1;
+   }
+  }
+  fprintf(stdout, "%d recorded frames, %d features\n", numFrames, numFeatures);
+ } else {
+  makeScene();
+  fprintf(stdout, "%d synthetic %dx%d frames, %d features\n", numFrames, WIDTH, HEIGHT,
+          numFeatures);
+ }
+
+ TaskPool pool;
+ if( parallel && (pool.initialize() != 0) ) return -1;
+
+ FeatureTrackerContext_t ftc;
+ ftc.num_features = numFeatures;
+ ftc.num_frames = 2;
+ ftc.auto_select_features = true;
+ ftc.display_tracked_features = false;
+ TrackerSettings_t ts;
+ ReplenishContext_t rc;
+
+ fprintf(stdout, "tracker  frames/s  us/feature  survival  drift mean/max (px)\n");
+ for(int b = 0; b < e_numTrackerBackends; ++b) {
+  const char *name = FeatureTracker::getBackendName((tracker_backend_t)b);
+  if( only && strcmp(only, name) ) continue;
+  FeatureTracker *tracker = FeatureTracker::create((tracker_backend_t)b, ftc, ts);
+  if(tracker == NULL) {
+   fprintf(stdout, "%-7s  not available\n", name);
+   continue;
+  }
+  if( parallel && (tracker->setTaskPool(&pool) != 0) )
+   fprintf(stdout, "%-7s  (tracking in one thread)\n", name);
+  if( pipelined && (tracker->setPipelining(true) != 0) )
+   fprintf(stdout, "%-7s  (not pipelined)\n", name);
+  if( replenish && (tracker->setReplenishment(&rc) != 0) ) {
+   delete tracker;
+   return -1;
+  }
+
+  benchmark_result_t r;
+  if( run(*tracker, numFrames, numFeatures, recorded, r) != 0 ) {
+   fprintf(stdout, "%-7s  failed\n", name);
+   delete tracker;
+   continue;
+  }
+  delete tracker;
+
+  fprintf(stdout, "%-7s  %8.1f  %10.2f  %8.3f", name, r.frames / r.seconds,
+          r.liveFeatures ? 1e6 * r.seconds / r.liveFeatures : 0.0,
+          r.candidates ? (double)r.survivors / r.candidates : 0.0);
+  if(recorded || (r.drifted == 0))
+   fprintf(stdout, "  -\n");
+  else
+   fprintf(stdout, "  %.3f/%.3f\n", r.sumDrift / r.drifted, r.maxDrift);
+ }
+
+ if(recorded) delete [] recorded;
+ return 0;
+}
@@ -5,11 +5,16 @@
 //
 // This test program continuously acquires images and tracks user selected 
 // features in a sequential capture->track->display loop (no ext. triggering).
+// Each frame is split into its two fields, which are tracked as separate
+// half-height images at 60 Hz. Frames pass from the capture thread to the
+// tracker through a FrameHandoff, which keeps the latest pair of fields when
+// tracking falls behind.
 //==============================================================================
 
 #include "PXCCaptureLoop.hpp"
 #include "FeatureTrackerOCV.hpp"
 #include "FeatureClientServer.hpp"
+#include "RTUtils/FrameHandoff.hpp"
 
 
 //==============================================================================
@@ -22,16 +27,12 @@ class PXCTrackLoop : public PXCCaptureLoop
   int initSystem(PXCContext_t &cam_cxt, FeatureTrackerContext_t &ft_cxt,
                  OCVTrackingContext_t &ocvtc, FeatureServerContext_t &fs_cxt);
   int processCycle();
- protected:
-  virtual int processImage(const unsigned char *fbr, int w, int h, int bpp);
+  void printStats();
  private:
-  RWLock d_rwLock;
-  int d_srcImgNum;
-  unsigned char *d_copyBuf;
+  FrameHandoff d_handoff;
   FeatureTrackerOCV d_fTracker;
   FeatureServer d_fServer;
   bool d_sysIsInit;
-  bool d_fgIsInit;
   feature_list_t d_featureList;
 };
 
@@ -41,9 +42,6 @@ PXCTrackLoop::PXCTrackLoop()
 //==============================================================================
 {
  d_sysIsInit = false;
- d_fgIsInit = false;
- d_srcImgNum = 0;
- d_copyBuf = NULL;
 }
 
 
@@ -51,8 +49,6 @@ PXCTrackLoop::PXCTrackLoop()
 PXCTrackLoop::~PXCTrackLoop()
 //==============================================================================
 {
- if(d_copyBuf)
-  free(d_copyBuf);
  freeFeatureList(d_featureList);
 }
 
@@ -65,8 +61,6 @@ int PXCTrackLoop::initSystem(PXCContext_t &cam_cxt,
 //==============================================================================
 {
  d_sysIsInit = false;
- d_fgIsInit = false;
- d_srcImgNum = 0;
  
  if( allocateFeatureList(d_featureList, ft_cxt.num_features) < 0 )
   return -1;
@@ -75,18 +69,28 @@ int PXCTrackLoop::initSystem(PXCContext_t &cam_cxt,
  if( PXCCaptureLoop::initialize(cam_cxt) != 0)
   return -1;
  
- // create copy buffer
- if( (d_copyBuf = (unsigned char *)realloc(d_copyBuf, d_imgWidth * d_imgHeight * d_bpp + sizeof(int))) == NULL) {
-  fprintf(stderr, "[PXCTrackLoop::initSystem] ERROR creating buffer.\n");
+ // Track both fields of every frame. e_evenField tracks one field per frame
+ // instead, for half the work.
+ int w, h, bpp;
+ if( (PXCCaptureLoop::setFieldMode(e_bothFields) != 0) 
+     || (PXCCaptureLoop::getImageProperties(w, h, bpp) != 0) )
   return -1;
- }
+
+ // Field handoff to the tracker. Both fields of a frame arrive at once, so
+ // hold two. Use a longer queue to track every field through short bursts of
+ // slow fields, at the cost of latency.
+ HandoffContext_t hc;
+ hc.policy = e_boundedQueue;
+ hc.queue_length = 2;
+ hc.frame_bytes = w * h * bpp;
+ if( d_handoff.initialize(hc) != 0 )
+  return -1;
+ PXCCaptureLoop::setFrameHandoff(&d_handoff);
 
  // init tracker
  if( d_fTracker.initialize(ft_cxt, ocvtc) != 0 )
   return -1;
 
- d_fgIsInit = true; 
-
  // start capture thread
  if( PXCCaptureLoop::startCaptureLoop() != 0)
   return -1;
@@ -110,52 +114,42 @@ int PXCTrackLoop::processCycle()
   return(-1);
  }
 
- unsigned char *buf = d_copyBuf;
+ // wait for the next field; fields alternate even, odd
+ handoff_frame_t frame;
  int frPrNum = 0;
-  
- d_rwLock.readLock();
- int fSrcNum = *(int *)buf;
- buf += sizeof(int);
- if( ( frPrNum = d_fTracker.processImage(buf, d_imgWidth, d_imgHeight, d_featureList)) < 0 ) {
-  d_rwLock.unlock();
+ if( d_handoff.acquire(frame) != 0 )
+  return -1;
+ if( ( frPrNum = d_fTracker.processImage(frame.buf, d_imgWidth, d_imgHeight / 2, d_featureList)) < 0 ) {
+  d_handoff.release();
   return frPrNum;
  }
- d_rwLock.unlock();
+ d_handoff.release();
+
+ // serve features in frame coordinates
+ fieldToFrame(d_featureList, (int)(frame.number % 2));
  
- if( d_fServer.updateFeatures(d_featureList, fSrcNum) != 0)
+ if( d_fServer.updateFeatures(d_featureList, (int)frame.number) != 0)
   return -1;
-
  
  return frPrNum;
 }
 
 
 //==============================================================================
-int PXCTrackLoop::processImage(const unsigned char *fbr, int w, int h, int bpp)
+void PXCTrackLoop::printStats()
 //==============================================================================
 {
- if( !d_fgIsInit ) {
-  fprintf(stderr, "[PXCTrackLoop::processImage]: ERROR PXC not initialized yet\n");
-  return(-1);
- }
-
- unsigned char *buf = d_copyBuf;
-
- d_rwLock.writeLock();
- * (int *)buf = d_srcImgNum;
- buf += sizeof(int);
- memcpy(buf, fbr, w * h * bpp);
- d_rwLock.unlock();
- 
- ++d_srcImgNum;
-
- return 0;
+ handoff_stats_t s;
+ d_handoff.getStats(s);
+ fprintf(stdout, "Frames captured %ld, tracked %ld, dropped %ld, skipped %ld. "
+         "Age when tracked %.1f ms mean, %.1f ms max.\n", s.captured, s.delivered,
+         s.dropped, s.skipped, s.mean_age_ms, s.max_age_ms);
 }
 
 
 
 //==============================================================================
-int main()
+int main(int argc, char *argv[])
 //==============================================================================
 {
  PXCTrackLoop cv;
@@ -166,16 +160,13 @@ int main()
 
  //--------------------------------------------------------------------
  // Thread priority: this program > feature server > capture thread seems
- // to work best.
+ // to work best. The priorities below are used unless a thread placement 
+ // file (see RTUtils/examples/threadPlacement.cfg) is given as the first
+ // argument.
  //--------------------------------------------------------------------
- struct sched_param param;
- int policy;
- pthread_getschedparam(pthread_self(), &policy, &param);
- policy = SCHED_FIFO;
- param.sched_priority = 40;
- pthread_setschedparam(pthread_self(), policy, &param);
- pthread_getschedparam(pthread_self(), &policy, &param);
- fprintf(stdout, "[main]: Thread priority set to %d\n", param.sched_priority);
+ if( (argc > 1) && (loadThreadPlacement(argv[1]) != 0) )
+  return -1;
+ applyThreadPlacement(e_trackingThread, 40);
 
  // camera capture board settings
  cam_cxt.board_number = -1;
@@ -190,6 +181,7 @@ int main()
  ft_cxt.num_frames = 100;
  ft_cxt.auto_select_features = false;
  ft_cxt.display_tracked_features = true;
+ ft_cxt.display_decimation = 6;  // refresh display at 10 Hz (60 fields/s)
  
  // settings specific to tracking algorithm
  ocvtc.min_dist = 10;
@@ -211,13 +203,15 @@ int main()
 
  sleep(1);
  
- // capture->process->serve loop
+ // capture->process->serve loop, with frame accounting every 10 s
  int fr;
  while(1) {
-  usleep(1000);
   if( (fr = cv.processCycle()) < 0 )
    break;
+  if(fr % 600 == 0)
+   cv.printStats();
  }
+ cv.printStats();
  
  if(fr == -1) {
   fprintf(stderr, "ERROR occurred.\n");
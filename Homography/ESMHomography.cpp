@@ -0,0 +1,540 @@
+//==============================================================================
+// ESMHomography.cpp - Implementation of class ESMHomography
+//
+// Project       : Computer Vision Utilities (cvutils)
+// Compatibility : POSIX, GCC
+//==============================================================================
+
+#include "ESMHomography.hpp"
+#include "RTUtils/TaskPool.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+//#define DEBUG
+
+#define ESM_GRAIN 4      // template rows per chunk of work
+#define ESM_PARTIAL 46   // normal equations of a chunk: 36 + 8 + error + count
+
+typedef struct _esm_pass
+{
+ const float *img;       // image pyramid level
+ int w, h;
+ int tw, th;             // template on the level
+ const float *t, *tx, *ty;
+ float *warped;
+ char *valid;
+ const double *hom;      // from centered template coordinates to the level
+ double *partials;
+}esm_pass_t;
+
+static void warpRows(int begin, int end, void *arg);
+static void accumulateRows(int begin, int end, void *arg);
+static inline bool sample(const float *img, int w, int h, double x, double y, float &v);
+static void mul3(const double *a, const double *b, double *c);
+static void expm3(const double *a, double *e);
+static int solve8(double *a, double *b);
+
+
+//==============================================================================
+// ESMHomography::ESMHomography
+//==============================================================================
+ESMHomography::ESMHomography()
+{
+ d_numLevels = 0;
+ for(int l = 0; l < ESM_MAX_LEVELS; ++l) {
+  memset(&d_levels[l], 0, sizeof(esm_level_t));
+  d_pyramid[l] = NULL;
+  d_pyrWidth[l] = d_pyrHeight[l] = 0;
+ }
+ d_pyrSize = 0;
+ d_center[0] = d_center[1] = 0;
+ for(int i = 0; i < 9; ++i) d_estimate[i] = (i % 4 == 0) ? 1 : 0;
+ d_error = 0;
+ d_partials = NULL;
+ d_numChunks = 0;
+ d_pool = NULL;
+}
+
+
+//==============================================================================
+// ESMHomography::~ESMHomography
+//==============================================================================
+ESMHomography::~ESMHomography()
+{
+ freeTemplate();
+ if(d_pyramid[0]) free(d_pyramid[0]);
+}
+
+
+//==============================================================================
+// ESMHomography::initialize
+//==============================================================================
+int ESMHomography::initialize(const ESMContext_t &ec)
+{
+ if( (ec.num_levels < 1) || (ec.num_levels > ESM_MAX_LEVELS) || (ec.max_iter < 1)
+     || (ec.epsilon <= 0) || (ec.max_error <= 0) || (ec.min_size < 4) ) {
+  fprintf(stderr, "[ESMHomography::initialize] ERROR. Invalid parameters.\n");
+  return -1;
+ }
+ d_context = ec;
+ freeTemplate();
+ return 0;
+}
+
+
+//==============================================================================
+// ESMHomography::setTemplate
+//==============================================================================
+int ESMHomography::setTemplate(const unsigned char *img, int w, int h, int x, int y,
+                               int tw, int th)
+{
+ if( (tw < d_context.min_size) || (th < d_context.min_size) || (x < 0) || (y < 0)
+     || (x + tw > w) || (y + th > h) ) {
+  fprintf(stderr, "[ESMHomography::setTemplate] ERROR. Template must lie in the image "
+          "and be at least %d pixels wide and high.\n", d_context.min_size);
+  return -1;
+ }
+
+ // as many levels as keep the template at least 'min_size' pixels
+ int numLevels = 1;
+ while( (numLevels < d_context.num_levels) && ((tw >> numLevels) >= d_context.min_size)
+        && ((th >> numLevels) >= d_context.min_size) )
+  ++numLevels;
+
+ freeTemplate();
+ d_numLevels = numLevels;
+ if( buildPyramid(img, w, h) != 0 ) return -1;
+
+ d_numChunks = (th + ESM_GRAIN - 1) / ESM_GRAIN;
+ d_partials = (double *)malloc(d_numChunks * ESM_PARTIAL * sizeof(double));
+ if(d_partials == NULL) {
+  fprintf(stderr, "[ESMHomography::setTemplate] ERROR allocating memory.\n");
+  freeTemplate();
+  return -1;
+ }
+
+ // Template samples on level l are centered on the template, one level
+ // pixel apart. Pixel k of level l covers pixels k*2^l to (k+1)*2^l - 1 of
+ // the image.
+ d_center[0] = x + (tw - 1) / 2.0;
+ d_center[1] = y + (th - 1) / 2.0;
+ for(int l = 0; l < d_numLevels; ++l) {
+  esm_level_t &lv = d_levels[l];
+  lv.w = tw >> l;
+  lv.h = th >> l;
+  int n = lv.w * lv.h;
+  lv.t = (float *)malloc(4 * n * sizeof(float));
+  lv.valid = (char *)malloc(n);
+  if( (lv.t == NULL) || (lv.valid == NULL) ) {
+   fprintf(stderr, "[ESMHomography::setTemplate] ERROR allocating memory.\n");
+   freeTemplate();
+   return -1;
+  }
+  lv.tx = lv.t + n;
+  lv.ty = lv.t + 2 * n;
+  lv.warped = lv.t + 3 * n;
+
+  double s = ldexp(1.0, -l);
+  double cx = (d_center[0] - (1 / s - 1) / 2) * s;
+  double cy = (d_center[1] - (1 / s - 1) / 2) * s;
+  const float *ref = d_pyramid[l];
+  int rw = d_pyrWidth[l], rh = d_pyrHeight[l];
+  for(int j = 0; j < lv.h; ++j) {
+   for(int i = 0; i < lv.w; ++i) {
+    double px = cx + i - (lv.w - 1) / 2.0, py = cy + j - (lv.h - 1) / 2.0;
+    float v, l0, r0, u0, d0;
+    sample(ref, rw, rh, px, py, v);
+    sample(ref, rw, rh, px - 1, py, l0);
+    sample(ref, rw, rh, px + 1, py, r0);
+    sample(ref, rw, rh, px, py - 1, u0);
+    sample(ref, rw, rh, px, py + 1, d0);
+    lv.t[j * lv.w + i] = v;
+    lv.tx[j * lv.w + i] = 0.5f * (r0 - l0);
+    lv.ty[j * lv.w + i] = 0.5f * (d0 - u0);
+   }
+  }
+ }
+
+ // the template in the reference image is where it was taken
+ double c[9] = {1, 0, d_center[0], 0, 1, d_center[1], 0, 0, 1};
+ memcpy(d_estimate, c, sizeof(c));
+ d_error = 0;
+#ifdef DEBUG
+ fprintf(stderr, "[ESMHomography::setTemplate] %dx%d template, %d levels.\n", tw, th, d_numLevels);
+#endif
+ return 0;
+}
+
+
+//==============================================================================
+// ESMHomography::compute
+//==============================================================================
+int ESMHomography::compute(const unsigned char *img, int w, int h, Matrix<3,3> &Hpn)
+{
+ if(d_numLevels == 0) {
+  fprintf(stderr, "[ESMHomography::compute] ERROR. Call setTemplate() first.\n");
+  return -1;
+ }
+ if( buildPyramid(img, w, h) != 0 ) return -1;
+
+ // coarse to fine; on level l the estimate acts on template coordinates
+ // scaled by s = 2^-l, and gives level pixels
+ double hom[9], hl[9], tmp[9];
+ memcpy(hom, d_estimate, sizeof(hom));
+ int numIter = 0;
+ for(int l = d_numLevels - 1; l >= 0; --l) {
+  double s = ldexp(1.0, -l), t = -(1 - s) / 2;
+  double toLevel[9] = {s, 0, t, 0, s, t, 0, 0, 1};
+  double fromLevel[9] = {1 / s, 0, -t / s, 0, 1 / s, -t / s, 0, 0, 1};
+  double scaleUp[9] = {1 / s, 0, 0, 0, 1 / s, 0, 0, 0, 1};
+  double scaleDown[9] = {s, 0, 0, 0, s, 0, 0, 0, 1};
+  mul3(toLevel, hom, tmp);
+  mul3(tmp, scaleUp, hl);
+  for(int it = 0; it < d_context.max_iter; ++it) {
+   double step;
+   ++numIter;
+   int ret = iterate(l, hl, step);
+   if(ret == -1) fprintf(stderr, "[ESMHomography::compute] ERROR. Template lost from view.\n");
+   if(ret != 0) return -1;
+   if(step < d_context.epsilon) break;
+  }
+  mul3(fromLevel, hl, tmp);
+  mul3(tmp, scaleDown, hom);
+  if(fabs(hom[8]) > 1e-12)
+   for(int i = 0; i < 9; ++i) hom[i] /= hom[8];
+ }
+ if(d_error > d_context.max_error) {
+  fprintf(stderr, "[ESMHomography::compute] ERROR. Template not found (RMS error %.1f).\n", d_error);
+  return -1;
+ }
+ memcpy(d_estimate, hom, sizeof(hom));
+
+ // from the reference image instead of centered template coordinates
+ double center[9] = {1, 0, -d_center[0], 0, 1, -d_center[1], 0, 0, 1};
+ mul3(hom, center, tmp);
+ for(int r = 0; r < 3; ++r)
+  for(int c = 0; c < 3; ++c)
+   Hpn(r + 1, c + 1) = tmp[3 * r + c] / tmp[8];
+#ifdef DEBUG
+ fprintf(stderr, "[ESMHomography::compute] %d iterations, RMS error %.2f.\n", numIter, d_error);
+#endif
+ return numIter;
+}
+
+
+//==============================================================================
+// ESMHomography::setEstimate
+//==============================================================================
+void ESMHomography::setEstimate(const Matrix<3,3> &Hpn)
+{
+ double hpn[9], center[9] = {1, 0, d_center[0], 0, 1, d_center[1], 0, 0, 1};
+ for(int r = 0; r < 3; ++r)
+  for(int c = 0; c < 3; ++c)
+   hpn[3 * r + c] = Hpn(r + 1, c + 1);
+ mul3(hpn, center, d_estimate);
+}
+
+
+//==============================================================================
+// ESMHomography::iterate - one update of the estimate; -1 if the template
+// has left the image, -2 if the task pool failed
+//==============================================================================
+int ESMHomography::iterate(int level, double *hom, double &step)
+{
+ esm_level_t &lv = d_levels[level];
+ esm_pass_t pass;
+ pass.img = d_pyramid[level];
+ pass.w = d_pyrWidth[level];
+ pass.h = d_pyrHeight[level];
+ pass.tw = lv.w;
+ pass.th = lv.h;
+ pass.t = lv.t;
+ pass.tx = lv.tx;
+ pass.ty = lv.ty;
+ pass.warped = lv.warped;
+ pass.valid = lv.valid;
+ pass.hom = hom;
+ pass.partials = d_partials;
+
+ // every chunk of rows adds into its own partial sums, all of which are
+ // summed below (a pool without workers, or the serial path, runs the
+ // whole range as one chunk)
+ int numChunks = (lv.h + ESM_GRAIN - 1) / ESM_GRAIN;
+ memset(d_partials, 0, numChunks * ESM_PARTIAL * sizeof(double));
+
+ // warp the image into the template, then the normal equations, which
+ // need the gradient of the whole warped image
+ if(d_pool) {
+  if( (d_pool->parallelFor(0, lv.h, ESM_GRAIN, warpRows, &pass) != 0)
+      || (d_pool->parallelFor(0, lv.h, ESM_GRAIN, accumulateRows, &pass) != 0) ) {
+   fprintf(stderr, "[ESMHomography::iterate] ERROR running on the task pool.\n");
+   return -2;
+  }
+ } else {
+  warpRows(0, lv.h, &pass);
+  accumulateRows(0, lv.h, &pass);
+ }
+
+ // sum the chunks
+ double sum[ESM_PARTIAL];
+ memset(sum, 0, sizeof(sum));
+ for(int c = 0; c < numChunks; ++c)
+  for(int k = 0; k < ESM_PARTIAL; ++k)
+   sum[k] += d_partials[c * ESM_PARTIAL + k];
+ double count = sum[ESM_PARTIAL - 1];
+ if(count < 0.25 * lv.w * lv.h)
+  return -1;
+ d_error = sqrt(sum[ESM_PARTIAL - 2] / count);
+
+ // x = -inverse(J'J) J'r
+ double a[64], x[8];
+ for(int r = 0, k = 0; r < 8; ++r)
+  for(int c = r; c < 8; ++c, ++k)
+   a[8 * r + c] = a[8 * c + r] = sum[k];
+ for(int r = 0; r < 8; ++r)
+  x[r] = -sum[36 + r];
+ if( solve8(a, x) != 0 )
+  return -1;
+
+ // hom <- hom * exp(A(x)), with A(x) in sl(3)
+ double alg[9] = {x[4], x[2], x[0], x[3], -x[4] - x[5], x[1], x[6], x[7], x[5]};
+ double e[9], tmp[9];
+ expm3(alg, e);
+ mul3(hom, e, tmp);
+ memcpy(hom, tmp, sizeof(tmp));
+
+ // largest motion of a template corner
+ step = 0;
+ for(int k = 0; k < 4; ++k) {
+  double u = ((k & 1) ? 0.5 : -0.5) * (lv.w - 1), v = ((k & 2) ? 0.5 : -0.5) * (lv.h - 1);
+  double du = x[0] + x[2] * v + x[4] * u - x[5] * u - x[6] * u * u - x[7] * u * v;
+  double dv = x[1] + x[3] * u - x[4] * v - 2 * x[5] * v - x[6] * u * v - x[7] * v * v;
+  double d = sqrt(du * du + dv * dv);
+  if(d > step) step = d;
+ }
+ return 0;
+}
+
+
+//==============================================================================
+// ESMHomography::buildPyramid
+//==============================================================================
+int ESMHomography::buildPyramid(const unsigned char *img, int w, int h)
+{
+ if( (w >> (d_numLevels - 1)) < 2 || (h >> (d_numLevels - 1)) < 2 ) {
+  fprintf(stderr, "[ESMHomography::buildPyramid] ERROR. Image too small.\n");
+  return -1;
+ }
+ int size = 0;
+ for(int l = 0; l < d_numLevels; ++l)
+  size += (w >> l) * (h >> l);
+ if(size > d_pyrSize) {
+  float *p = (float *)realloc(d_pyramid[0], size * sizeof(float));
+  if(p == NULL) {
+   fprintf(stderr, "[ESMHomography::buildPyramid] ERROR allocating memory.\n");
+   return -1;
+  }
+  d_pyramid[0] = p;
+  d_pyrSize = size;
+ }
+
+ // each level the mean of 2x2 pixels of the one below
+ float *out = d_pyramid[0];
+ for(int i = 0; i < w * h; ++i)
+  out[i] = img[i];
+ d_pyrWidth[0] = w;
+ d_pyrHeight[0] = h;
+ for(int l = 1; l < d_numLevels; ++l) {
+  const float *in = d_pyramid[l - 1];
+  int iw = d_pyrWidth[l - 1];
+  int lw = w >> l, lh = h >> l;
+  d_pyramid[l] = d_pyramid[l - 1] + iw * d_pyrHeight[l - 1];
+  d_pyrWidth[l] = lw;
+  d_pyrHeight[l] = lh;
+  out = d_pyramid[l];
+  for(int j = 0; j < lh; ++j) {
+   const float *r0 = in + 2 * j * iw, *r1 = r0 + iw;
+   for(int i = 0; i < lw; ++i)
+    out[j * lw + i] = 0.25f * (r0[2 * i] + r0[2 * i + 1] + r1[2 * i] + r1[2 * i + 1]);
+  }
+ }
+ return 0;
+}
+
+
+//==============================================================================
+// ESMHomography::freeTemplate
+//==============================================================================
+void ESMHomography::freeTemplate()
+{
+ for(int l = 0; l < ESM_MAX_LEVELS; ++l) {
+  if(d_levels[l].t) free(d_levels[l].t);
+  if(d_levels[l].valid) free(d_levels[l].valid);
+  memset(&d_levels[l], 0, sizeof(esm_level_t));
+ }
+ if(d_partials) free(d_partials);
+ d_partials = NULL;
+ d_numChunks = 0;
+ d_numLevels = 0;
+}
+
+
+//==============================================================================
+// warpRows - warp the image into a range of template rows
+//==============================================================================
+void warpRows(int begin, int end, void *arg)
+{
+ esm_pass_t *p = (esm_pass_t *)arg;
+ const double *m = p->hom;
+ for(int j = begin; j < end; ++j) {
+  double v = j - (p->th - 1) / 2.0;
+  for(int i = 0; i < p->tw; ++i) {
+   double u = i - (p->tw - 1) / 2.0;
+   double z = m[6] * u + m[7] * v + m[8];
+   int k = j * p->tw + i;
+   p->valid[k] = 0;
+   if(fabs(z) < 1e-12) continue;
+   double x = (m[0] * u + m[1] * v + m[2]) / z;
+   double y = (m[3] * u + m[4] * v + m[5]) / z;
+   p->valid[k] = sample(p->img, p->w, p->h, x, y, p->warped[k]) ? 1 : 0;
+  }
+ }
+}
+
+
+//==============================================================================
+// accumulateRows - normal equations of the ESM step over a range of
+//                  template rows (border rows and columns are left out)
+//==============================================================================
+void accumulateRows(int begin, int end, void *arg)
+{
+ esm_pass_t *p = (esm_pass_t *)arg;
+ double *s = p->partials + (begin / ESM_GRAIN) * ESM_PARTIAL;
+ int tw = p->tw;
+ double j8[8];
+ for(int j = (begin > 1) ? begin : 1; (j < end) && (j < p->th - 1); ++j) {
+  double v = j - (p->th - 1) / 2.0;
+  for(int i = 1; i < tw - 1; ++i) {
+   int k = j * tw + i;
+   if( !p->valid[k] || !p->valid[k - 1] || !p->valid[k + 1] || !p->valid[k - tw]
+       || !p->valid[k + tw] )
+    continue;
+   double u = i - (tw - 1) / 2.0;
+
+   // mean of the gradients of the warped image and the template
+   double gx = 0.25 * (p->warped[k + 1] - p->warped[k - 1]) + 0.5 * p->tx[k];
+   double gy = 0.25 * (p->warped[k + tw] - p->warped[k - tw]) + 0.5 * p->ty[k];
+   double gp = gx * u + gy * v;
+   j8[0] = gx;
+   j8[1] = gy;
+   j8[2] = gx * v;
+   j8[3] = gy * u;
+   j8[4] = gx * u - gy * v;
+   j8[5] = -gx * u - 2 * gy * v;
+   j8[6] = -u * gp;
+   j8[7] = -v * gp;
+   double r = p->warped[k] - p->t[k];
+   for(int a = 0, n = 0; a < 8; ++a) {
+    for(int b = a; b < 8; ++b, ++n)
+     s[n] += j8[a] * j8[b];
+    s[36 + a] += j8[a] * r;
+   }
+   s[44] += r * r;
+   s[45] += 1;
+  }
+ }
+}
+
+
+//==============================================================================
+// sample - bilinear interpolation; false (and the nearest pixel) outside
+//          the image
+//==============================================================================
+bool sample(const float *img, int w, int h, double x, double y, float &v)
+{
+ bool inside = (x >= 0) && (y >= 0) && (x <= w - 1) && (y <= h - 1);
+ if(x < 0) x = 0; else if(x > w - 1) x = w - 1;
+ if(y < 0) y = 0; else if(y > h - 1) y = h - 1;
+ int x0 = (int)x, y0 = (int)y;
+ if(x0 > w - 2) x0 = w - 2;
+ if(y0 > h - 2) y0 = h - 2;
+ float fx = (float)(x - x0), fy = (float)(y - y0);
+ const float *r0 = img + y0 * w + x0, *r1 = r0 + w;
+ v = (1 - fy) * ((1 - fx) * r0[0] + fx * r0[1]) + fy * ((1 - fx) * r1[0] + fx * r1[1]);
+ return inside;
+}
+
+
+//==============================================================================
+// mul3 - product of 3x3 matrices stored row by row
+//==============================================================================
+void mul3(const double *a, const double *b, double *c)
+{
+ for(int r = 0; r < 3; ++r)
+  for(int k = 0; k < 3; ++k)
+   c[3 * r + k] = a[3 * r] * b[k] + a[3 * r + 1] * b[3 + k] + a[3 * r + 2] * b[6 + k];
+}
+
+
+//==============================================================================
+// expm3 - matrix exponential of a 3x3 matrix (scaling and squaring of a
+//         Taylor series)
+//==============================================================================
+void expm3(const double *a, double *e)
+{
+ double norm = 0;
+ for(int i = 0; i < 9; ++i) norm += fabs(a[i]);
+ int squarings = 0;
+ while( (norm > 0.5) && (squarings < 30) ) {
+  norm *= 0.5;
+  ++squarings;
+ }
+ double b[9], term[9], tmp[9];
+ double f = ldexp(1.0, -squarings);
+ for(int i = 0; i < 9; ++i) {
+  b[i] = a[i] * f;
+  e[i] = term[i] = (i % 4 == 0) ? 1 : 0;
+ }
+ for(int n = 1; n <= 8; ++n) {
+  mul3(term, b, tmp);
+  for(int i = 0; i < 9; ++i) {
+   term[i] = tmp[i] / n;
+   e[i] += term[i];
+  }
+ }
+ for(int s = 0; s < squarings; ++s) {
+  mul3(e, e, tmp);
+  memcpy(e, tmp, sizeof(tmp));
+ }
+}
+
+
+//==============================================================================
+// solve8 - solve a symmetric positive definite 8x8 system a x = b in place
+//          (Cholesky); -1 if a is not positive definite
+//==============================================================================
+int solve8(double *a, double *b)
+{
+ for(int j = 0; j < 8; ++j) {
+  double d = a[8 * j + j];
+  for(int k = 0; k < j; ++k) d -= a[8 * j + k] * a[8 * j + k];
+  if(d <= 1e-12) return -1;
+  d = sqrt(d);
+  a[8 * j + j] = d;
+  for(int i = j + 1; i < 8; ++i) {
+   double s = a[8 * i + j];
+   for(int k = 0; k < j; ++k) s -= a[8 * i + k] * a[8 * j + k];
+   a[8 * i + j] = s / d;
+  }
+ }
+ for(int i = 0; i < 8; ++i) {
+  for(int k = 0; k < i; ++k) b[i] -= a[8 * i + k] * b[k];
+  b[i] /= a[8 * i + i];
+ }
+ for(int i = 7; i >= 0; --i) {
+  for(int k = i + 1; k < 8; ++k) b[i] -= a[8 * k + i] * b[k];
+  b[i] /= a[8 * i + i];
+ }
+ return 0;
+}
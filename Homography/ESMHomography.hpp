@@ -0,0 +1,162 @@
+//==============================================================================
+// ESMHomography.hpp - Direct estimation of the homography of a planar
+//                     template from image intensities
+//
+// Project       : Computer Vision Utilities (cvutils)
+// Compatibility : POSIX, GCC
+//==============================================================================
+
+#ifndef INCLUDED_ESMHOMOGRAPHY_HPP
+#define INCLUDED_ESMHOMOGRAPHY_HPP
+
+#include "Matrix.hpp"
+#include <stdio.h>
+
+class TaskPool;
+
+#define ESM_MAX_LEVELS 6   // maximum number of pyramid levels, including the image
+
+
+//==============================================================================
+/*! \struct _ESMContext
+    \brief Parameters for ESMHomography
+
+    Good default values for parameters are given in parenthesis. */
+//==============================================================================
+typedef struct _ESMContext
+{
+ _ESMContext() : num_levels(3), max_iter(15), epsilon(0.05), max_error(30),
+                 min_size(16) {};
+ int num_levels;    /*!< Number of pyramid levels, including the full
+                         resolution image, 1 to ESM_MAX_LEVELS (3). */
+ int max_iter;      /*!< Maximum number of iterations per level (15). */
+ double epsilon;    /*!< Iterations on a level stop when no corner of the
+                         template moves by more than this many pixels of the
+                         level (0.05). */
+ double max_error;  /*!< Largest RMS intensity difference between the template
+                         and the warped image at which the estimate is
+                         accepted (30). */
+ int min_size;      /*!< Coarser levels are not used if the template would be
+                         smaller than this many pixels on either side (16). */
+}ESMContext_t;
+
+
+//==============================================================================
+// class ESMHomography
+//------------------------------------------------------------------------------
+// \brief
+// Estimates the projective homography of a planar target directly from
+// image intensities, by efficient second-order minimization (ESM).
+//
+// A rectangle of a reference image is taken as the template. In every
+// subsequent image, compute() finds the homography Hpn that warps the
+// template onto the image with the least sum of squared intensity
+// differences, such that p2 = sc * Hpn * p1 for a pixel p1 of the template
+// in the reference image and its image p2 (see ProjectiveHomography). Hpn
+// is thus found without tracking features and fitting a homography to
+// them, and can be used in place of ProjectiveHomography::compute() when
+// the target is planar.
+//
+// Each iteration warps the image into the template with the current
+// estimate, and updates the estimate by H <- H * exp(A(x)), where A(x) is
+// an element of the Lie algebra sl(3) with 8 parameters x. The Jacobian
+// uses the mean of the gradients of the template and of the warped image,
+// which gives second order convergence with first order derivatives
+// (Benhimane and Malis, IROS 2004). The template gradient is computed once;
+// per iteration only the warp, the image gradient and the 8x8 normal
+// equations are computed.
+//
+// The estimate is refined coarse to fine over an image pyramid, starting
+// from the estimate of the previous image, so motions of several pixels
+// between images converge. Warping and the normal equations are computed
+// in parallel over rows of the template on a TaskPool, if one is set.
+//
+// Reference: S. Benhimane and E. Malis, "Real-time image-based tracking of
+// planes using efficient second-order minimization," Proc. IEEE/RSJ IROS,
+// pp. 943-948, 2004.
+//
+// <b>Example Program:</b>
+// \include ESMHomography.t.cpp
+//==============================================================================
+class ESMHomography
+{
+ public:
+  ESMHomography();
+   // Default constructor.
+
+  ~ESMHomography();
+   // Destructor frees all memory.
+
+  int initialize(const ESMContext_t &ec);
+   // Set the parameters. Call before setTemplate().
+   //  ec      Estimation parameters.
+   //  return  0 on success, -1 on error (error message redirected to stderr).
+
+  int setTemplate(const unsigned char *img, int w, int h, int x, int y, int tw, int th);
+   // Take a rectangle of a reference image as the template, and reset the
+   // estimate to the identity.
+   //  img     Reference image, 8 bit grayscale, rows packed.
+   //  w,h     Image dimensions in pixels.
+   //  x,y     Top left corner of the template in the image.
+   //  tw,th   Template dimensions in pixels.
+   //  return  0 on success, -1 on error (error message redirected to stderr).
+
+  int compute(const unsigned char *img, int w, int h, Matrix<3,3> &Hpn);
+   // Estimate the homography of the template in an image, starting from
+   // the last estimate.
+   //  img     The image, 8 bit grayscale, rows packed.
+   //  w,h     Image dimensions in pixels. Need not be those of the
+   //          reference image.
+   //  Hpn     The projective homography from the reference image to this
+   //          image, normalized by the element at (3,3) (output). Not
+   //          changed on error.
+   //  return  Total number of iterations on success, -1 if the template
+   //          was not found or on error (error message redirected to stderr).
+
+  void setEstimate(const Matrix<3,3> &Hpn);
+   // Start the next call to compute() from this homography instead of the
+   // last estimate, e.g. one predicted from the motion of the camera.
+   //  Hpn     Homography from the reference image to the next image.
+
+  inline double getError() const {return d_error;}
+   //  return  RMS intensity difference between the template and the image,
+   //          at the last iteration of the last call to compute().
+
+  inline void setTaskPool(TaskPool *pool) {d_pool = pool;}
+   // Warp the image and build the normal equations in parallel on a pool
+   // of worker threads. The pool is shared, not owned.
+   //  pool  The task pool, or NULL to compute in the calling thread (default).
+
+ protected:
+  // ========== END OF INTERFACE ==========
+ private:
+  ESMHomography(const ESMHomography &);
+  ESMHomography &operator=(const ESMHomography &);
+  typedef struct _esm_level
+  {
+   int w, h;             // template size on this level
+   float *t;             // template intensities, row by row
+   float *tx, *ty;       // template gradients
+   float *warped;        // image warped into the template
+   char *valid;          // 1 if the warped pixel lies in the image
+  }esm_level_t;
+  int buildPyramid(const unsigned char *img, int w, int h);
+  int iterate(int level, double *h, double &step);
+  void freeTemplate();
+  ESMContext_t d_context;
+  int d_numLevels;                    // levels used for the template
+  esm_level_t d_levels[ESM_MAX_LEVELS];
+  float *d_pyramid[ESM_MAX_LEVELS];   // image pyramid
+  int d_pyrWidth[ESM_MAX_LEVELS];
+  int d_pyrHeight[ESM_MAX_LEVELS];
+  int d_pyrSize;                      // floats allocated for the pyramid
+  double d_center[2];                 // template center in the reference image
+  double d_estimate[9];               // from centered template coordinates
+                                      // to image pixels, row by row
+  double d_error;
+  double *d_partials;                 // per chunk of rows: normal equations
+  int d_numChunks;
+  TaskPool *d_pool;
+};
+
+#endif // INCLUDED_ESMHOMOGRAPHY_HPP
@@ -9,9 +9,19 @@
 
 #include "Homography.hpp"
 #include "HomographyUtilities.hpp"
+#include "RTUtils/TaskPool.hpp"
+#include "RTUtils/FrameArena.hpp"
 
 //#define DEBUG
 
+typedef struct _vp_equations
+{
+ const MatrixBase<> *p1;
+ const MatrixBase<> *p2;
+ const int *combos;
+ gsl_matrix *c;
+}vp_equations_t;
+
 static int scale(const MatrixBase<> &i1, const MatrixBase<> &i2, 
                  Vector<3> *x1, Vector<3> *x2,
                  Vector<3> &ic1, Vector<3> &ic2, double &f0);
@@ -21,6 +31,7 @@ static Matrix<3,3> crdcnv(const Matrix<3,3> &H, const Vector<3> &ic1,
 
 int getSubMatrix(const MatrixBase<> &s, int pr, int pc, MatrixBase<> &sm);
 static double norm(const Matrix<3,3> &m);
+static void vpEquations(int begin, int end, void *arg);
 
 
 //==============================================================================
@@ -33,11 +44,13 @@ ProjectiveHomography::ProjectiveHomography(int nFeatures, homography_method_t m)
  d_gslx1 = NULL;
  d_gslx2 = NULL;
  d_gslc = NULL;
- d_gslct = NULL;
  d_gslcaug = NULL;
  d_gslwork1 = NULL;
  d_gslwork2 = NULL;
- d_gslcombos = NULL;
+ d_combos = NULL;
+ d_multWork = NULL;
+ d_pool = NULL;
+ d_arena = NULL;
 
  d_computeMethod = m;
  d_nFeatures = nFeatures;
@@ -54,9 +67,18 @@ ProjectiveHomography::ProjectiveHomography(int nFeatures, homography_method_t m)
  } else if (d_computeMethod == e_vp) { 
   d_multWork = new double[3 * d_nFeatures];
   d_numcombos = nchoosek(nFeatures-3,3);
-  d_gslcombos = gsl_combination_alloc(nFeatures-3,3);
-  d_gslc = gsl_matrix_alloc(d_numcombos,7);
-  d_gslct = gsl_matrix_alloc(7, d_numcombos);
+  d_combos = new int[3 * d_numcombos];
+  gsl_combination *combos = gsl_combination_alloc(nFeatures-3,3);
+  gsl_combination_init_first(combos);
+  int eqn = 0;
+  do
+  {
+   d_combos[3 * eqn] = gsl_combination_get(combos,0) + 4;
+   d_combos[3 * eqn + 1] = gsl_combination_get(combos,1) + 4;
+   d_combos[3 * eqn + 2] = gsl_combination_get(combos,2) + 4;
+   eqn += 1;
+  }while(gsl_combination_next(combos) == GSL_SUCCESS);
+  gsl_combination_free(combos);
   d_gslcaug = gsl_matrix_alloc(7, 7);
   d_gslwork1 = gsl_eigen_symmv_alloc(7);
   d_gslwork2 = gsl_eigen_symmv_alloc(3);
@@ -83,10 +105,9 @@ ProjectiveHomography::~ProjectiveHomography()
   d_gslx2 = NULL;
   d_gslx1 = NULL;
  } else if(d_computeMethod == e_vp){
-  delete d_multWork;
-  gsl_combination_free(d_gslcombos);
-  gsl_matrix_free(d_gslc);
-  gsl_matrix_free(d_gslct);
+  delete [] d_multWork;
+  delete [] d_combos;
+  if(d_gslc) gsl_matrix_free(d_gslc);
   gsl_matrix_free(d_gslcaug);
   gsl_eigen_symmv_free(d_gslwork1);
   gsl_eigen_symmv_free(d_gslwork2);
@@ -342,92 +363,38 @@ int ProjectiveHomography::computeVP(MatrixBase<> &p2, MatrixBase<> &p1,
  multiply3n(inverse(vp_m), p2, p2);
  multiply3n(inverse(vp_mc), p1, p1);
 
- // generate n!/(6(n-3)!) linear equations based on epipolar constraints
- int i,j,k;
- gsl_combination_init_first(d_gslcombos);
- int eqn = 0;
- do
- {
-  i = gsl_combination_get(d_gslcombos,0) + 4;
-  j = gsl_combination_get(d_gslcombos,1) + 4;
-  k = gsl_combination_get(d_gslcombos,2) + 4;
-  
-  gsl_matrix_set(d_gslc, eqn, 0, 
-   p2.getElement(3,i)*p2.getElement(3,j)*p2.getElement(2,k)*p1.getElement(1,k) 
-   * (p1.getElement(1,j)*p1.getElement(2,i) - p1.getElement(1,i)*p1.getElement(2,j))
-   + p2.getElement(3,i)*p2.getElement(3,k)*p2.getElement(2,j)*p1.getElement(1,j) 
-   * (p1.getElement(1,i)*p1.getElement(2,k) - p1.getElement(1,k)*p1.getElement(2,i))
-   + p2.getElement(3,j)*p2.getElement(3,k)*p2.getElement(2,i)*p1.getElement(1,i) 
-   * (p1.getElement(1,k)*p1.getElement(2,j) - p1.getElement(1,j)*p1.getElement(2,k)));
-
-  gsl_matrix_set(d_gslc, eqn, 1, 
-   p2.getElement(3,i)*p2.getElement(3,j)*p2.getElement(1,k)*p1.getElement(2,k) 
-   * (p1.getElement(1,i)*p1.getElement(2,j) - p1.getElement(1,j)*p1.getElement(2,i))
-   + p2.getElement(3,i)*p2.getElement(3,k)*p2.getElement(1,j)*p1.getElement(2,j) 
-   * (p1.getElement(1,k)*p1.getElement(2,i) - p1.getElement(1,i)*p1.getElement(2,k))
-   + p2.getElement(3,j)*p2.getElement(3,k)*p2.getElement(1,i)*p1.getElement(2,i) 
-   * (p1.getElement(1,j)*p1.getElement(2,k) - p1.getElement(1,k)*p1.getElement(2,j)));
-
-  gsl_matrix_set(d_gslc, eqn, 2, 
-   p2.getElement(2,i)*p2.getElement(2,k)*p2.getElement(3,j)*p1.getElement(1,j) 
-   * (p1.getElement(1,i)*p1.getElement(3,k) - p1.getElement(1,k)*p1.getElement(3,i))
-   + p2.getElement(2,i)*p2.getElement(2,j)*p2.getElement(3,k)*p1.getElement(1,k) 
-   * (p1.getElement(1,j)*p1.getElement(3,i) - p1.getElement(1,i)*p1.getElement(3,j))
-   + p2.getElement(2,j)*p2.getElement(2,k)*p2.getElement(3,i)*p1.getElement(1,i) 
-   * (p1.getElement(1,k)*p1.getElement(3,j) - p1.getElement(1,j)*p1.getElement(3,k)));
-
-  gsl_matrix_set(d_gslc, eqn, 3, 
-   p2.getElement(1,i)*p2.getElement(1,k)*p2.getElement(3,j)*p1.getElement(2,j) 
-   * (p1.getElement(2,i)*p1.getElement(3,k) - p1.getElement(2,k)*p1.getElement(3,i))
-   + p2.getElement(1,i)*p2.getElement(1,j)*p2.getElement(3,k)*p1.getElement(2,k) 
-   * (p1.getElement(2,j)*p1.getElement(3,i) - p1.getElement(2,i)*p1.getElement(3,j))
-   + p2.getElement(1,j)*p2.getElement(1,k)*p2.getElement(3,i)*p1.getElement(2,i) 
-   * (p1.getElement(2,k)*p1.getElement(3,j) - p1.getElement(2,j)*p1.getElement(3,k)));
-
-  gsl_matrix_set(d_gslc, eqn, 4, 
-   p2.getElement(2,j)*p2.getElement(2,k)*p2.getElement(1,i)*p1.getElement(3,i) 
-   * (p1.getElement(1,j)*p1.getElement(3,k) - p1.getElement(1,k)*p1.getElement(3,j))
-   + p2.getElement(2,i)*p2.getElement(2,k)*p2.getElement(1,j)*p1.getElement(3,j) 
-   * (p1.getElement(1,k)*p1.getElement(3,i) - p1.getElement(1,i)*p1.getElement(3,k))
-   + p2.getElement(2,i)*p2.getElement(2,j)*p2.getElement(1,k)*p1.getElement(3,k) 
-   * (p1.getElement(1,i)*p1.getElement(3,j) - p1.getElement(1,j)*p1.getElement(3,i)));
-
-  gsl_matrix_set(d_gslc, eqn, 5, 
-   p2.getElement(1,j)*p2.getElement(1,k)*p2.getElement(2,i)*p1.getElement(3,i) 
-   * (p1.getElement(2,j)*p1.getElement(3,k) - p1.getElement(2,k)*p1.getElement(3,j))
-   + p2.getElement(1,i)*p2.getElement(1,k)*p2.getElement(2,j)*p1.getElement(3,j) 
-   * (p1.getElement(2,k)*p1.getElement(3,i) - p1.getElement(2,i)*p1.getElement(3,k))
-   + p2.getElement(1,i)*p2.getElement(1,j)*p2.getElement(2,k)*p1.getElement(3,k) 
-   * (p1.getElement(2,i)*p1.getElement(3,j) - p1.getElement(2,j)*p1.getElement(3,i)));
+ // equations go in frame scratch memory if available
+ gsl_matrix *c = d_gslc;
+ gsl_matrix_view cv;
+ if(d_arena) {
+  double *data = (double *)d_arena->allocate(d_numcombos * 7 * sizeof(double), 64);
+  if(data == NULL) return -1;
+  cv = gsl_matrix_view_array(data, d_numcombos, 7);
+  c = &cv.matrix;
+ } else if(c == NULL) {
+  c = d_gslc = gsl_matrix_alloc(d_numcombos, 7);
+ }
 
-  gsl_matrix_set(d_gslc, eqn, 6, 
-   p2.getElement(1,i)*p2.getElement(2,k)*p2.getElement(3,j) 
-   * (p1.getElement(1,k)*p1.getElement(2,j)*p1.getElement(3,i) 
-   - p1.getElement(1,j)*p1.getElement(2,i)*p1.getElement(3,k))
-   + p2.getElement(1,k)*p2.getElement(2,i)*p2.getElement(3,j) 
-   * (p1.getElement(1,j)*p1.getElement(2,k)*p1.getElement(3,i) 
-   - p1.getElement(1,i)*p1.getElement(2,j)*p1.getElement(3,k))
-   + p2.getElement(1,i)*p2.getElement(2,j)*p2.getElement(3,k) 
-   * (p1.getElement(1,k)*p1.getElement(2,i)*p1.getElement(3,j) 
-   - p1.getElement(1,j)*p1.getElement(2,k)*p1.getElement(3,i))
-   + p2.getElement(1,j)*p2.getElement(2,i)*p2.getElement(3,k) 
-   * (p1.getElement(1,i)*p1.getElement(2,k)*p1.getElement(3,j) 
-   - p1.getElement(1,k)*p1.getElement(2,j)*p1.getElement(3,i))
-   + p2.getElement(1,k)*p2.getElement(2,j)*p2.getElement(3,i) 
-   * (p1.getElement(1,j)*p1.getElement(2,i)*p1.getElement(3,k) 
-   - p1.getElement(1,i)*p1.getElement(2,k)*p1.getElement(3,j))
-   + p2.getElement(1,j)*p2.getElement(2,k)*p2.getElement(3,i) 
-   * (p1.getElement(1,i)*p1.getElement(2,j)*p1.getElement(3,k) 
-   - p1.getElement(1,k)*p1.getElement(2,i)*p1.getElement(3,j)));
-  eqn += 1;
- }while(gsl_combination_next(d_gslcombos) == GSL_SUCCESS);
+ // generate n!/(6(n-3)!) linear equations based on epipolar constraints
+ vp_equations_t eqns;
+ eqns.p1 = &p1;
+ eqns.p2 = &p2;
+ eqns.combos = d_combos;
+ eqns.c = c;
+ if(d_pool) {
+  if( d_pool->parallelFor(0, d_numcombos, 64, vpEquations, &eqns) != 0 ) {
+   fprintf(stderr, "[computeVP] : Could not generate equations.\n");
+   return -1;
+  }
+ } else {
+  vpEquations(0, d_numcombos, &eqns);
+ }
  
 
- // find eigen vector corres. to lowest eigen value for (d_gslc^T)d_gslc
+ // find eigen vector corres. to lowest eigen value for (c^T)c
  gsl_vector vp_eval1; Vector<7> eval1; GSLCompat_vector(&eval1, &vp_eval1);
  gsl_matrix vp_evec1; Matrix<7,7> evec1; GSLCompat_matrix(&evec1, &vp_evec1);
- gsl_matrix_transpose_memcpy(d_gslct, d_gslc);
- gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, d_gslct, d_gslc, 0.0, d_gslcaug);
+ gsl_blas_dgemm(CblasTrans, CblasNoTrans, 1.0, c, c, 0.0, d_gslcaug);
  gsl_eigen_symmv(d_gslcaug, &vp_eval1, &vp_evec1, d_gslwork1);
  gsl_eigen_symmv_sort(&vp_eval1, &vp_evec1, GSL_EIGEN_SORT_ABS_ASC);
 
@@ -437,8 +404,8 @@ int ProjectiveHomography::computeVP(MatrixBase<> &p2, MatrixBase<> &p1,
 
  if(fabs(eval1(6)) < 1e-5) 
  {
-  g(1,1) = -gsl_matrix_get(d_gslc, 0, 4)/gsl_matrix_get(d_gslc, 0, 2); //c5/c3
-  g(2,2) = -gsl_matrix_get(d_gslc, 0, 5)/gsl_matrix_get(d_gslc, 0, 3); //c6/c4
+  g(1,1) = -gsl_matrix_get(c, 0, 4)/gsl_matrix_get(c, 0, 2); //c5/c3
+  g(2,2) = -gsl_matrix_get(c, 0, 5)/gsl_matrix_get(c, 0, 3); //c6/c4
   g(3,3) = 1.0;
  }
  else
@@ -882,3 +849,89 @@ int ProjectiveHomography::multiply3n(const MatrixBase<> &lh, const MatrixBase<>
  return 0;
 }
 
+
+//==============================================================================
+// vpEquations - fill rows [begin, end) of the virtual parallax equations
+//==============================================================================
+void vpEquations(int begin, int end, void *arg)
+{
+ vp_equations_t *eqns = (vp_equations_t *)arg;
+ const MatrixBase<> &p1 = *eqns->p1;
+ const MatrixBase<> &p2 = *eqns->p2;
+ gsl_matrix *c = eqns->c;
+ int i,j,k;
+ for(int eqn = begin; eqn < end; ++eqn)
+ {
+  i = eqns->combos[3 * eqn];
+  j = eqns->combos[3 * eqn + 1];
+  k = eqns->combos[3 * eqn + 2];
+  
+  gsl_matrix_set(c, eqn, 0, 
+   p2.getElement(3,i)*p2.getElement(3,j)*p2.getElement(2,k)*p1.getElement(1,k) 
+   * (p1.getElement(1,j)*p1.getElement(2,i) - p1.getElement(1,i)*p1.getElement(2,j))
+   + p2.getElement(3,i)*p2.getElement(3,k)*p2.getElement(2,j)*p1.getElement(1,j) 
+   * (p1.getElement(1,i)*p1.getElement(2,k) - p1.getElement(1,k)*p1.getElement(2,i))
+   + p2.getElement(3,j)*p2.getElement(3,k)*p2.getElement(2,i)*p1.getElement(1,i) 
+   * (p1.getElement(1,k)*p1.getElement(2,j) - p1.getElement(1,j)*p1.getElement(2,k)));
+
+  gsl_matrix_set(c, eqn, 1, 
+   p2.getElement(3,i)*p2.getElement(3,j)*p2.getElement(1,k)*p1.getElement(2,k) 
+   * (p1.getElement(1,i)*p1.getElement(2,j) - p1.getElement(1,j)*p1.getElement(2,i))
+   + p2.getElement(3,i)*p2.getElement(3,k)*p2.getElement(1,j)*p1.getElement(2,j) 
+   * (p1.getElement(1,k)*p1.getElement(2,i) - p1.getElement(1,i)*p1.getElement(2,k))
+   + p2.getElement(3,j)*p2.getElement(3,k)*p2.getElement(1,i)*p1.getElement(2,i) 
+   * (p1.getElement(1,j)*p1.getElement(2,k) - p1.getElement(1,k)*p1.getElement(2,j)));
+
+  gsl_matrix_set(c, eqn, 2, 
+   p2.getElement(2,i)*p2.getElement(2,k)*p2.getElement(3,j)*p1.getElement(1,j) 
+   * (p1.getElement(1,i)*p1.getElement(3,k) - p1.getElement(1,k)*p1.getElement(3,i))
+   + p2.getElement(2,i)*p2.getElement(2,j)*p2.getElement(3,k)*p1.getElement(1,k) 
+   * (p1.getElement(1,j)*p1.getElement(3,i) - p1.getElement(1,i)*p1.getElement(3,j))
+   + p2.getElement(2,j)*p2.getElement(2,k)*p2.getElement(3,i)*p1.getElement(1,i) 
+   * (p1.getElement(1,k)*p1.getElement(3,j) - p1.getElement(1,j)*p1.getElement(3,k)));
+
+  gsl_matrix_set(c, eqn, 3, 
+   p2.getElement(1,i)*p2.getElement(1,k)*p2.getElement(3,j)*p1.getElement(2,j) 
+   * (p1.getElement(2,i)*p1.getElement(3,k) - p1.getElement(2,k)*p1.getElement(3,i))
+   + p2.getElement(1,i)*p2.getElement(1,j)*p2.getElement(3,k)*p1.getElement(2,k) 
+   * (p1.getElement(2,j)*p1.getElement(3,i) - p1.getElement(2,i)*p1.getElement(3,j))
+   + p2.getElement(1,j)*p2.getElement(1,k)*p2.getElement(3,i)*p1.getElement(2,i) 
+   * (p1.getElement(2,k)*p1.getElement(3,j) - p1.getElement(2,j)*p1.getElement(3,k)));
+
+  gsl_matrix_set(c, eqn, 4, 
+   p2.getElement(2,j)*p2.getElement(2,k)*p2.getElement(1,i)*p1.getElement(3,i) 
+   * (p1.getElement(1,j)*p1.getElement(3,k) - p1.getElement(1,k)*p1.getElement(3,j))
+   + p2.getElement(2,i)*p2.getElement(2,k)*p2.getElement(1,j)*p1.getElement(3,j) 
+   * (p1.getElement(1,k)*p1.getElement(3,i) - p1.getElement(1,i)*p1.getElement(3,k))
+   + p2.getElement(2,i)*p2.getElement(2,j)*p2.getElement(1,k)*p1.getElement(3,k) 
+   * (p1.getElement(1,i)*p1.getElement(3,j) - p1.getElement(1,j)*p1.getElement(3,i)));
+
+  gsl_matrix_set(c, eqn, 5, 
+   p2.getElement(1,j)*p2.getElement(1,k)*p2.getElement(2,i)*p1.getElement(3,i) 
+   * (p1.getElement(2,j)*p1.getElement(3,k) - p1.getElement(2,k)*p1.getElement(3,j))
+   + p2.getElement(1,i)*p2.getElement(1,k)*p2.getElement(2,j)*p1.getElement(3,j) 
+   * (p1.getElement(2,k)*p1.getElement(3,i) - p1.getElement(2,i)*p1.getElement(3,k))
+   + p2.getElement(1,i)*p2.getElement(1,j)*p2.getElement(2,k)*p1.getElement(3,k) 
+   * (p1.getElement(2,i)*p1.getElement(3,j) - p1.getElement(2,j)*p1.getElement(3,i)));
+
+  gsl_matrix_set(c, eqn, 6, 
+   p2.getElement(1,i)*p2.getElement(2,k)*p2.getElement(3,j) 
+   * (p1.getElement(1,k)*p1.getElement(2,j)*p1.getElement(3,i) 
+   - p1.getElement(1,j)*p1.getElement(2,i)*p1.getElement(3,k))
+   + p2.getElement(1,k)*p2.getElement(2,i)*p2.getElement(3,j) 
+   * (p1.getElement(1,j)*p1.getElement(2,k)*p1.getElement(3,i) 
+   - p1.getElement(1,i)*p1.getElement(2,j)*p1.getElement(3,k))
+   + p2.getElement(1,i)*p2.getElement(2,j)*p2.getElement(3,k) 
+   * (p1.getElement(1,k)*p1.getElement(2,i)*p1.getElement(3,j) 
+   - p1.getElement(1,j)*p1.getElement(2,k)*p1.getElement(3,i))
+   + p2.getElement(1,j)*p2.getElement(2,i)*p2.getElement(3,k) 
+   * (p1.getElement(1,i)*p1.getElement(2,k)*p1.getElement(3,j) 
+   - p1.getElement(1,k)*p1.getElement(2,j)*p1.getElement(3,i))
+   + p2.getElement(1,k)*p2.getElement(2,j)*p2.getElement(3,i) 
+   * (p1.getElement(1,j)*p1.getElement(2,i)*p1.getElement(3,k) 
+   - p1.getElement(1,i)*p1.getElement(2,k)*p1.getElement(3,j))
+   + p2.getElement(1,j)*p2.getElement(2,k)*p2.getElement(3,i) 
+   * (p1.getElement(1,i)*p1.getElement(2,j)*p1.getElement(3,k) 
+   - p1.getElement(1,k)*p1.getElement(2,i)*p1.getElement(3,j)));
+ }
+}
@@ -21,6 +21,9 @@
 #include <gsl/gsl_eigen.h>
 #include <math.h>
 
+class TaskPool;
+class FrameArena;
+
 
 //==============================================================================
 /*! \struct _motion_params 
@@ -192,6 +195,17 @@ class ProjectiveHomography
    //          when using the optimal algorithm (input).
    //  return  number of iterations if using the optimal algorithm, 
    //          1 if using the least squares method, and -1 on error.
+
+  inline void setTaskPool(TaskPool *pool) {d_pool = pool;}
+   // Use a pool of worker threads to generate the linear equations of the 
+   // virtual parallax method in parallel. The pool is shared, not owned.
+   //  pool  The task pool, or NULL to compute in the calling thread (default).
+
+  inline void setFrameArena(FrameArena *arena) {d_arena = arena;}
+   // Take the equation matrix of the virtual parallax method, which has 
+   // n!/(6(n-3)!) rows, from frame scratch memory on every call to compute() 
+   // instead of keeping it allocated in this object.
+   //  arena  The arena, or NULL to use memory owned by this object (default).
    
  protected:
   // ========== END OF INTERFACE ==========
@@ -212,11 +226,12 @@ class ProjectiveHomography
   Vector<3> *d_gslx2;
   int d_numcombos;
   gsl_matrix *d_gslc;
-  gsl_matrix *d_gslct;
   gsl_matrix *d_gslcaug;
   gsl_eigen_symmv_workspace *d_gslwork1;
   gsl_eigen_symmv_workspace *d_gslwork2;
-  gsl_combination *d_gslcombos;
+  int *d_combos;    // feature index triples, one per equation
+  TaskPool *d_pool;
+  FrameArena *d_arena;
 };
 
 #endif // #ifndef INCLUDED_HOMOGRAPHY_HPP
@@ -0,0 +1,112 @@
+//==============================================================================
+// ESMHomography.t.cpp - Example program for direct homography estimation
+// Project       : Computer Vision Utilities (cvutils)
+//==============================================================================
+
+#include "ESMHomography.hpp"
+#include "RTUtils/TaskPool.hpp"
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+using namespace std;
+
+#define WIDTH 320
+#define HEIGHT 240
+
+//==============================================================================
+// This example renders a random texture as seen by a camera that moves a
+// little further in every frame, and estimates the homography of a
+// rectangle of the first frame in each of the following frames. The
+// estimates are compared with the true homographies.
+//==============================================================================
+
+static float texture[HEIGHT][WIDTH];
+
+// render the texture warped by homography h (row by row)
+static void render(const double *h, unsigned char *img)
+{
+ // inverse by cofactors
+ double inv[9] = {h[4] * h[8] - h[5] * h[7], h[2] * h[7] - h[1] * h[8], h[1] * h[5] - h[2] * h[4],
+                  h[5] * h[6] - h[3] * h[8], h[0] * h[8] - h[2] * h[6], h[2] * h[3] - h[0] * h[5],
+                  h[3] * h[7] - h[4] * h[6], h[1] * h[6] - h[0] * h[7], h[0] * h[4] - h[1] * h[3]};
+ for(int y = 0; y < HEIGHT; ++y) {
+  for(int x = 0; x < WIDTH; ++x) {
+   double z = inv[6] * x + inv[7] * y + inv[8];
+   double u = (inv[0] * x + inv[1] * y + inv[2]) / z;
+   double v = (inv[3] * x + inv[4] * y + inv[5]) / z;
+   int u0 = (u < 0) ? 0 : ((u > WIDTH - 2) ? WIDTH - 2 : (int)u);
+   int v0 = (v < 0) ? 0 : ((v > HEIGHT - 2) ? HEIGHT - 2 : (int)v);
+   double fu = u - u0, fv = v - v0;
+   if(fu < 0) fu = 0; else if(fu > 1) fu = 1;
+   if(fv < 0) fv = 0; else if(fv > 1) fv = 1;
+   img[y * WIDTH + x] = (unsigned char)
+    ((1 - fv) * ((1 - fu) * texture[v0][u0] + fu * texture[v0][u0 + 1])
+     + fv * ((1 - fu) * texture[v0 + 1][u0] + fu * texture[v0 + 1][u0 + 1]));
+  }
+ }
+}
+
+//==============================================================================
+// main
+//==============================================================================
+int main(int argc, char *argv[])
+{
+ // smoothed noise, with the contrast stretched
+ srand(1);
+ static float noise[HEIGHT][WIDTH];
+ for(int y = 0; y < HEIGHT; ++y)
+  for(int x = 0; x < WIDTH; ++x)
+   noise[y][x] = rand() % 256;
+ for(int y = 2; y < HEIGHT - 2; ++y) {
+  for(int x = 2; x < WIDTH - 2; ++x) {
+   float s = 0;
+   for(int j = -2; j <= 2; ++j)
+    for(int i = -2; i <= 2; ++i)
+     s += noise[y + j][x + i];
+   s = (s / 25 - 128) * 3 + 128;
+   texture[y][x] = (s < 0) ? 0 : ((s > 255) ? 255 : s);
+  }
+ }
+
+ static unsigned char img[WIDTH * HEIGHT];
+ double identity[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+ render(identity, img);
+
+ ESMHomography esm;
+ ESMContext_t ec;
+ if( (esm.initialize(ec) != 0) || (esm.setTemplate(img, WIDTH, HEIGHT, 100, 70, 120, 100) != 0) )
+  return -1;
+
+ // estimate in parallel if asked to (ESMHomography.t -p)
+ TaskPool pool;
+ if( (argc > 1) && !strcmp(argv[1], "-p") ) {
+  if( pool.initialize() != 0 ) return -1;
+  esm.setTaskPool(&pool);
+ }
+
+ Matrix<3,3> Hpn;
+ for(int f = 1; f <= 10; ++f) {
+  double a = 0.02 * f;
+  double h[9] = {cos(a) * (1 + 0.01 * f), -sin(a), 3.0 * f,
+                 sin(a), cos(a), -2.0 * f,
+                 1e-5 * f, -1e-5 * f, 1};
+  render(h, img);
+  int numIter = esm.compute(img, WIDTH, HEIGHT, Hpn);
+  if(numIter < 0) {
+   cerr << "Homography estimation failed in frame " << f << "." << endl;
+   return -1;
+  }
+
+  double maxDiff = 0;
+  for(int r = 0; r < 3; ++r)
+   for(int c = 0; c < 2; ++c)
+    if(fabs(Hpn(r + 1, c + 1) - h[3 * r + c]) > maxDiff) maxDiff = fabs(Hpn(r + 1, c + 1) - h[3 * r + c]);
+  cout << "frame " << f << ": " << numIter << " iterations, RMS error " << esm.getError()
+       << ", translation (" << Hpn(1,3) << ", " << Hpn(2,3) << ") true (" << h[2] << ", "
+       << h[5] << "), largest error in other elements " << maxDiff << endl;
+ }
+ cout << "Homography of the last frame: " << endl << Hpn << endl;
+ return 0;
+}
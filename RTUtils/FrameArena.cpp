@@ -0,0 +1,124 @@
+//==============================================================================
+// FrameArena.cpp - A bump allocator for scratch memory that lives for the
+//                  duration of one frame.
+//==============================================================================
+
+#include "FrameArena.hpp"
+#include <stdlib.h>
+
+//#define DEBUG
+
+
+//==============================================================================
+FrameArena::FrameArena()
+//==============================================================================
+{
+ d_block = NULL;
+ d_capacity = 0;
+ d_used = 0;
+ d_highWater = 0;
+ d_spillBytes = 0;
+ d_spills = NULL;
+ d_numSpills = 0;
+}
+
+
+//==============================================================================
+FrameArena::~FrameArena()
+//==============================================================================
+{
+ reset();
+ if(d_block) free(d_block);
+}
+
+
+//==============================================================================
+int FrameArena::initialize(size_t capacity)
+//==============================================================================
+{
+ reset();
+ if(d_block) free(d_block);
+ d_capacity = 0;
+ if( (d_block = (char *)malloc(capacity + 1)) == NULL ) {
+  fprintf(stderr, "[FrameArena::initialize] ERROR allocating %lu bytes.\n",
+          (unsigned long)capacity);
+  return -1;
+ }
+ d_capacity = capacity;
+ d_highWater = 0;
+ d_numSpills = 0;
+ return 0;
+}
+
+
+//==============================================================================
+void *FrameArena::allocate(size_t size, size_t align)
+//==============================================================================
+{
+ if( (align == 0) || (align & (align - 1)) ) {
+  fprintf(stderr, "[FrameArena::allocate] ERROR. Alignment %lu is not a power of 2.\n",
+          (unsigned long)align);
+  return NULL;
+ }
+
+ // bump the offset if it fits in the block
+ if(d_block) {
+  size_t addr = (size_t)(d_block + d_used);
+  size_t pad = (align - (addr & (align - 1))) & (align - 1);
+  if(d_used + pad + size <= d_capacity) {
+   d_used += pad + size;
+   if(d_used + d_spillBytes > d_highWater) d_highWater = d_used + d_spillBytes;
+   return (void *)(addr + pad);
+  }
+ }
+
+ // otherwise take it from the heap until the next reset
+ spill_t *s = (spill_t *)malloc(sizeof(spill_t) + size + align);
+ if(s == NULL) {
+  fprintf(stderr, "[FrameArena::allocate] ERROR allocating %lu bytes.\n",
+          (unsigned long)size);
+  return NULL;
+ }
+ s->next = d_spills;
+ d_spills = s;
+ d_spillBytes += size + align;
+ ++d_numSpills;
+ if(d_used + d_spillBytes > d_highWater) d_highWater = d_used + d_spillBytes;
+#ifdef DEBUG
+ fprintf(stderr, "[FrameArena::allocate] %lu bytes did not fit, %lu/%lu used.\n",
+         (unsigned long)size, (unsigned long)d_used, (unsigned long)d_capacity);
+#endif
+ size_t addr = (size_t)(s + 1);
+ return (void *)((addr + align - 1) & ~(align - 1));
+}
+
+
+//==============================================================================
+void FrameArena::reset()
+//==============================================================================
+{
+ while(d_spills) {
+  spill_t *s = d_spills;
+  d_spills = s->next;
+  free(s);
+ }
+
+ // grow the block so that the next frame like this one fits, with some
+ // headroom because alignment padding depends on the block address
+ if(d_spillBytes) {
+  size_t capacity = d_highWater + d_highWater / 4;
+  if(d_block) free(d_block);
+  d_capacity = 0;
+  if( (d_block = (char *)malloc(capacity + 1)) == NULL ) {
+   fprintf(stderr, "[FrameArena::reset] ERROR allocating %lu bytes.\n",
+           (unsigned long)capacity);
+  } else {
+   d_capacity = capacity;
+  }
+#ifdef DEBUG
+  fprintf(stderr, "[FrameArena::reset] Grew block to %lu bytes.\n", (unsigned long)d_capacity);
+#endif
+ }
+ d_used = 0;
+ d_spillBytes = 0;
+}
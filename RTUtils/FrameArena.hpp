@@ -0,0 +1,90 @@
+//==============================================================================
+// FrameArena.hpp - A bump allocator for scratch memory that lives for the
+//                  duration of one frame.
+//==============================================================================
+
+#ifndef INCLUDED_FRAMEARENA_HPP
+#define INCLUDED_FRAMEARENA_HPP
+
+#include <stdio.h>
+#include <stddef.h>
+
+
+//==============================================================================
+// class FrameArena
+//------------------------------------------------------------------------------
+// \brief
+// Frame-scoped scratch memory.
+//
+// Memory is handed out from a single block by advancing an offset, and is
+// released all at once by reset(), which the processing loop calls at the
+// end of every frame. Nothing allocated from the arena may be used after the
+// next reset(). Consecutive allocations are adjacent in memory, and the same
+// addresses are reused every frame, so scratch buffers stay in cache.
+//
+// If a frame needs more memory than the block holds, the extra requests are
+// served from the heap and freed by the next reset(), which also grows the
+// block beyond the largest amount used in a frame so far. After a few frames
+// the arena therefore makes no heap allocations at all.
+//
+// An arena is not thread-safe. Use one arena per processing thread.
+//
+// <b>Example Program:</b>
+// \include FrameArena.t.cpp
+//==============================================================================
+class FrameArena
+{
+ public:
+  FrameArena();
+   // Default constructor. No memory is allocated until initialize() is called.
+
+  ~FrameArena();
+   // Destructor frees all memory.
+
+  int initialize(size_t capacity);
+   // Allocate the memory block.
+   //  capacity  Initial size of the block in bytes.
+   //  return    0 on success, -1 on error (error message redirected to stderr).
+
+  void *allocate(size_t size, size_t align = 16);
+   // Get scratch memory, valid until the next call to reset().
+   //  size    Number of bytes.
+   //  align   Alignment of the returned address (a power of 2).
+   //  return  Pointer to memory, or NULL on error (error message redirected
+   //          to stderr).
+
+  void reset();
+   // Release all memory allocated since the last reset. Grows the block if
+   // it was too small for this frame.
+
+  inline size_t getCapacity() const {return d_capacity;}
+   //  return  Size of the memory block in bytes.
+
+  inline size_t getUsed() const {return d_used + d_spillBytes;}
+   //  return  Bytes allocated since the last reset.
+
+  inline size_t getHighWater() const {return d_highWater;}
+   //  return  Largest number of bytes allocated in any frame so far.
+
+  inline long getNumSpills() const {return d_numSpills;}
+   //  return  Total number of requests that did not fit in the block and
+   //          were served from the heap.
+
+ protected:
+ private:
+  typedef struct _spill
+  {
+   struct _spill *next;
+  }spill_t;
+  FrameArena(const FrameArena &);
+  FrameArena &operator=(const FrameArena &);
+  char *d_block;
+  size_t d_capacity;
+  size_t d_used;
+  size_t d_highWater;
+  size_t d_spillBytes;
+  spill_t *d_spills;
+  long d_numSpills;
+};
+
+#endif // INCLUDED_FRAMEARENA_HPP
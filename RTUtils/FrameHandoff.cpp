@@ -0,0 +1,272 @@
+//==============================================================================
+// FrameHandoff.cpp - Passes captured frames from a capture thread to a
+//                    processing thread under an explicit drop policy.
+//==============================================================================
+
+#include "FrameHandoff.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+//#define DEBUG
+
+static float elapsedMs(const struct timespec &from, const struct timespec &to);
+
+
+//==============================================================================
+FrameHandoff::FrameHandoff()
+//==============================================================================
+{
+ pthread_mutex_init(&d_lock, NULL);
+ pthread_cond_init(&d_readyCond, NULL);
+ d_data = NULL;
+ d_numbers = NULL;
+ d_stamps = NULL;
+ d_free = NULL;
+ d_numFree = 0;
+ d_pending = NULL;
+ d_capacity = 0;
+ d_first = d_numPending = 0;
+ d_held = -1;
+ d_waiting = false;
+ d_underLoad = false;
+ d_sequence = 0;
+ resetStats();
+}
+
+
+//==============================================================================
+FrameHandoff::~FrameHandoff()
+//==============================================================================
+{
+ freeAll();
+ pthread_mutex_destroy(&d_lock);
+ pthread_cond_destroy(&d_readyCond);
+}
+
+
+//==============================================================================
+int FrameHandoff::initialize(const HandoffContext_t &hc)
+//==============================================================================
+{
+ if( (hc.frame_bytes == 0) || (hc.policy < e_latestOnly) || (hc.policy > e_skipUnderLoad)
+     || ((hc.policy == e_boundedQueue) && (hc.queue_length < 1))
+     || ((hc.policy == e_skipUnderLoad) && (hc.skip_interval < 1)) ) {
+  fprintf(stderr, "[FrameHandoff::initialize] ERROR. Invalid handoff parameters.\n");
+  return -1;
+ }
+
+ // waiting frames, plus one being filled and one held by the consumer
+ freeAll();
+ d_context = hc;
+ d_capacity = (hc.policy == e_boundedQueue) ? hc.queue_length : 1;
+ int n = d_capacity + 2;
+ d_data = (unsigned char *)malloc(n * hc.frame_bytes);
+ d_numbers = (long *)malloc(n * sizeof(long));
+ d_stamps = (struct timespec *)malloc(n * sizeof(struct timespec));
+ d_free = (int *)malloc(n * sizeof(int));
+ d_pending = (int *)malloc(d_capacity * sizeof(int));
+ if( !d_data || !d_numbers || !d_stamps || !d_free || !d_pending ) {
+  fprintf(stderr, "[FrameHandoff::initialize] ERROR allocating %d frames.\n", n);
+  freeAll();
+  return -1;
+ }
+ for(int i = 0; i < n; ++i)
+  d_free[i] = n - 1 - i;
+ d_numFree = n;
+ d_first = d_numPending = 0;
+ d_held = -1;
+ d_waiting = false;
+ d_underLoad = false;
+ d_sequence = 0;
+ resetStats();
+ return 0;
+}
+
+
+//==============================================================================
+int FrameHandoff::put(const unsigned char *buf, size_t bytes)
+//==============================================================================
+{
+ if( (d_data == NULL) || (bytes != d_context.frame_bytes) ) {
+  fprintf(stderr, "[FrameHandoff::put] ERROR. Not initialized, or wrong frame size.\n");
+  return -1;
+ }
+ struct timespec stamp;
+ clock_gettime(CLOCK_MONOTONIC, &stamp);
+
+ // decide whether to take the frame, and into which buffer
+ pthread_mutex_lock(&d_lock);
+ long number = d_sequence++;
+ ++d_stats.captured;
+ if(d_context.policy == e_skipUnderLoad) {
+  // behind if the last frame taken in is still waiting; caught up once
+  // the consumer waits for a frame
+  if(d_numPending > 0) d_underLoad = true;
+  else if(d_waiting) d_underLoad = false;
+  if( d_underLoad && (number % d_context.skip_interval != 0) ) {
+   ++d_stats.skipped;
+   pthread_mutex_unlock(&d_lock);
+   return 0;
+  }
+ } else {
+  d_underLoad = (d_numPending > 0);
+ }
+ if( (d_context.policy == e_boundedQueue) && (d_numPending == d_capacity) ) {
+  ++d_stats.dropped;
+  pthread_mutex_unlock(&d_lock);
+  return 0;
+ }
+ if(d_numFree == 0) {
+  pthread_mutex_unlock(&d_lock);
+  fprintf(stderr, "[FrameHandoff::put] ERROR. No free buffer (more than one producer?).\n");
+  return -1;
+ }
+ int slot = d_free[--d_numFree];
+ pthread_mutex_unlock(&d_lock);
+
+ memcpy(d_data + slot * d_context.frame_bytes, buf, bytes);
+ d_numbers[slot] = number;
+ d_stamps[slot] = stamp;
+
+ pthread_mutex_lock(&d_lock);
+ if( (d_context.policy != e_boundedQueue) && (d_numPending == 1) ) {
+  d_free[d_numFree++] = d_pending[d_first];
+  d_numPending = 0;
+  ++d_stats.dropped;
+ }
+ d_pending[(d_first + d_numPending) % d_capacity] = slot;
+ ++d_numPending;
+ pthread_cond_signal(&d_readyCond);
+ pthread_mutex_unlock(&d_lock);
+ return 1;
+}
+
+
+//==============================================================================
+int FrameHandoff::acquire(handoff_frame_t &frame, int timeoutMs)
+//==============================================================================
+{
+ if(d_data == NULL) {
+  fprintf(stderr, "[FrameHandoff::acquire] ERROR. Call initialize() first.\n");
+  return -1;
+ }
+
+ struct timespec deadline;
+ if(timeoutMs >= 0) {
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += timeoutMs / 1000;
+  deadline.tv_nsec += (timeoutMs % 1000) * 1000000L;
+  if(deadline.tv_nsec >= 1000000000L) {
+   deadline.tv_nsec -= 1000000000L;
+   ++deadline.tv_sec;
+  }
+ }
+
+ pthread_mutex_lock(&d_lock);
+ if(d_held >= 0) {
+  d_free[d_numFree++] = d_held;
+  d_held = -1;
+ }
+ d_waiting = true;
+ while(d_numPending == 0) {
+  if(timeoutMs < 0) {
+   pthread_cond_wait(&d_readyCond, &d_lock);
+  } else if( (pthread_cond_timedwait(&d_readyCond, &d_lock, &deadline) == ETIMEDOUT)
+             && (d_numPending == 0) ) {
+   d_waiting = false;
+   pthread_mutex_unlock(&d_lock);
+   return 1;
+  }
+ }
+ d_waiting = false;
+ d_held = d_pending[d_first];
+ d_first = (d_first + 1) % d_capacity;
+ --d_numPending;
+
+ struct timespec now;
+ clock_gettime(CLOCK_MONOTONIC, &now);
+ frame.buf = d_data + d_held * d_context.frame_bytes;
+ frame.number = d_numbers[d_held];
+ frame.stamp = d_stamps[d_held];
+ frame.age_ms = elapsedMs(frame.stamp, now);
+ ++d_stats.delivered;
+ d_sumAge += frame.age_ms;
+ if(frame.age_ms > d_stats.max_age_ms) d_stats.max_age_ms = frame.age_ms;
+ pthread_mutex_unlock(&d_lock);
+
+#ifdef DEBUG
+ fprintf(stderr, "[FrameHandoff::acquire] Frame %ld, %.2f ms old.\n", frame.number, frame.age_ms);
+#endif
+ return 0;
+}
+
+
+//==============================================================================
+void FrameHandoff::release()
+//==============================================================================
+{
+ pthread_mutex_lock(&d_lock);
+ if(d_held >= 0) {
+  d_free[d_numFree++] = d_held;
+  d_held = -1;
+ }
+ pthread_mutex_unlock(&d_lock);
+}
+
+
+//==============================================================================
+void FrameHandoff::getStats(handoff_stats_t &stats)
+//==============================================================================
+{
+ pthread_mutex_lock(&d_lock);
+ stats = d_stats;
+ stats.mean_age_ms = d_stats.delivered ? (float)(d_sumAge / d_stats.delivered) : 0;
+ stats.under_load = d_underLoad;
+ pthread_mutex_unlock(&d_lock);
+}
+
+
+//==============================================================================
+void FrameHandoff::resetStats()
+//==============================================================================
+{
+ pthread_mutex_lock(&d_lock);
+ d_stats.captured = 0;
+ d_stats.delivered = 0;
+ d_stats.dropped = 0;
+ d_stats.skipped = 0;
+ d_stats.mean_age_ms = 0;
+ d_stats.max_age_ms = 0;
+ d_stats.under_load = false;
+ d_sumAge = 0;
+ pthread_mutex_unlock(&d_lock);
+}
+
+
+//==============================================================================
+void FrameHandoff::freeAll()
+//==============================================================================
+{
+ if(d_data) free(d_data);
+ if(d_numbers) free(d_numbers);
+ if(d_stamps) free(d_stamps);
+ if(d_free) free(d_free);
+ if(d_pending) free(d_pending);
+ d_data = NULL;
+ d_numbers = NULL;
+ d_stamps = NULL;
+ d_free = NULL;
+ d_pending = NULL;
+ d_numFree = 0;
+ d_capacity = 0;
+}
+
+
+//==============================================================================
+// elapsedMs - milliseconds from one time to another
+//==============================================================================
+float elapsedMs(const struct timespec &from, const struct timespec &to)
+{
+ return (to.tv_sec - from.tv_sec) * 1000.0f + (to.tv_nsec - from.tv_nsec) * 1e-6f;
+}
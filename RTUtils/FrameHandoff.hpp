@@ -0,0 +1,172 @@
+//==============================================================================
+// FrameHandoff.hpp - Passes captured frames from a capture thread to a
+//                    processing thread under an explicit drop policy.
+//==============================================================================
+
+#ifndef INCLUDED_FRAMEHANDOFF_HPP
+#define INCLUDED_FRAMEHANDOFF_HPP
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <time.h>
+
+
+//==============================================================================
+/*! \enum _handoff_policy
+    \brief What FrameHandoff does with frames that arrive faster than they
+    are processed */
+//==============================================================================
+typedef enum _handoff_policy
+{
+ e_latestOnly = 0,     //!< Hold one frame. A new frame replaces one that has
+                       //!< not been taken yet. Lowest latency.
+ e_boundedQueue = 1,   //!< Hold up to 'queue_length' frames in order. Frames
+                       //!< that arrive while the queue is full are dropped.
+                       //!< Absorbs bursts of slow frames at the cost of latency.
+ e_skipUnderLoad = 2   //!< As e_latestOnly, but while the consumer cannot keep
+                       //!< up, only every 'skip_interval'th frame is taken, so
+                       //!< processed frames stay evenly spaced in time.
+}handoff_policy_t;
+
+
+//==============================================================================
+/*! \struct _HandoffContext
+    \brief Parameters for FrameHandoff
+
+    Good default values for parameters are given in parenthesis. */
+//==============================================================================
+typedef struct _HandoffContext
+{
+ _HandoffContext() : policy(e_latestOnly), frame_bytes(0), queue_length(3),
+                     skip_interval(2) {};
+ handoff_policy_t policy;  /*!< Drop policy (e_latestOnly). */
+ size_t frame_bytes;       /*!< Size of a frame in bytes. */
+ int queue_length;         /*!< Frames held by e_boundedQueue (3). */
+ int skip_interval;        /*!< e_skipUnderLoad takes one frame in this many
+                                while the consumer is behind (2). */
+}HandoffContext_t;
+
+
+//==============================================================================
+/*! \struct _handoff_frame
+    \brief A frame taken from a FrameHandoff */
+//==============================================================================
+typedef struct _handoff_frame
+{
+ unsigned char *buf;       /*!< Frame data, valid until released. */
+ long number;              /*!< Capture sequence number, from 0. Gaps are
+                                frames that were dropped or skipped. */
+ struct timespec stamp;    /*!< Capture time (CLOCK_MONOTONIC). */
+ float age_ms;             /*!< Time from capture until the frame was taken,
+                                in milliseconds. */
+}handoff_frame_t;
+
+
+//==============================================================================
+/*! \struct _handoff_stats
+    \brief Frame accounting of a FrameHandoff */
+//==============================================================================
+typedef struct _handoff_stats
+{
+ long captured;            /*!< Frames put in by the producer. */
+ long delivered;           /*!< Frames taken by the consumer. */
+ long dropped;             /*!< Frames replaced or refused before they were
+                                taken. */
+ long skipped;             /*!< Frames not taken in by e_skipUnderLoad. */
+ float mean_age_ms;        /*!< Mean age of delivered frames when taken. */
+ float max_age_ms;         /*!< Largest age of a delivered frame when taken. */
+ bool under_load;          /*!< The consumer is currently behind. */
+}handoff_stats_t;
+
+
+//==============================================================================
+// class FrameHandoff
+//------------------------------------------------------------------------------
+// \brief
+// Hands captured frames from one producer thread to one consumer thread.
+//
+// The producer (usually a capture loop, see PXCCaptureLoop) copies every
+// frame in with put(), which never blocks on the consumer. The consumer
+// waits for frames with acquire(), processes the frame in place, and gives
+// the buffer back with release(). No lock is held while a frame is copied
+// or processed, so neither side stalls the other.
+//
+// When frames arrive faster than they are processed, some must be lost. The
+// policy decides which (see handoff_policy_t), and every frame is accounted
+// for as delivered, dropped or skipped, along with the age of frames when
+// they are taken (see getStats()). The consumer can thus trade throughput
+// against latency on purpose, and see what the trade costs.
+//
+// All buffers are allocated in initialize(): one per frame that can be
+// waiting, one being filled and one held by the consumer.
+//
+// <b>Example Program:</b>
+// \include FrameHandoff.t.cpp
+//==============================================================================
+class FrameHandoff
+{
+ public:
+  FrameHandoff();
+   // Default constructor.
+
+  ~FrameHandoff();
+   // Destructor frees all buffers.
+
+  int initialize(const HandoffContext_t &hc);
+   // Allocate buffers and set the policy. Call before the producer and
+   // consumer start.
+   //  hc      Handoff parameters.
+   //  return  0 on success, -1 on error (error message redirected to stderr).
+
+  int put(const unsigned char *buf, size_t bytes);
+   // Offer a captured frame. Called by the producer thread only.
+   //  buf     Frame data.
+   //  bytes   Size of the frame; must be 'frame_bytes'.
+   //  return  1 if the frame was copied in, 0 if the policy skipped or
+   //          dropped it, -1 on error (error message redirected to stderr).
+
+  int acquire(handoff_frame_t &frame, int timeoutMs = -1);
+   // Take the next frame, waiting for one if none is ready. A frame still
+   // held from an earlier call is released first. Called by the consumer
+   // thread only.
+   //  frame      The frame (output).
+   //  timeoutMs  Longest time to wait in milliseconds, -1 to wait for ever.
+   //  return     0 on success, 1 if no frame arrived in time, -1 on error
+   //             (error message redirected to stderr).
+
+  void release();
+   // Give the buffer of the frame taken last back for capture.
+
+  void getStats(handoff_stats_t &stats);
+   // Frame accounting since initialize() or resetStats().
+   //  stats   The counts (output).
+
+  void resetStats();
+   // Restart the frame accounting.
+
+ protected:
+ private:
+  FrameHandoff(const FrameHandoff &);
+  FrameHandoff &operator=(const FrameHandoff &);
+  void freeAll();
+  HandoffContext_t d_context;
+  pthread_mutex_t d_lock;
+  pthread_cond_t d_readyCond;
+  unsigned char *d_data;     // all frame buffers
+  long *d_numbers;           // per buffer: capture sequence number
+  struct timespec *d_stamps; // per buffer: capture time
+  int *d_free;               // buffers not in use
+  int d_numFree;
+  int *d_pending;            // buffers waiting for the consumer (ring)
+  int d_capacity;
+  int d_first, d_numPending;
+  int d_held;                // buffer held by the consumer, or -1
+  bool d_waiting;            // the consumer is waiting in acquire()
+  bool d_underLoad;
+  long d_sequence;
+  handoff_stats_t d_stats;
+  double d_sumAge;
+};
+
+#endif // INCLUDED_FRAMEHANDOFF_HPP
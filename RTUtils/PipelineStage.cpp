@@ -0,0 +1,130 @@
+//==============================================================================
+// PipelineStage.cpp - A helper thread that runs one job at a time alongside
+//                     the thread that hands it over.
+//==============================================================================
+
+#include "PipelineStage.hpp"
+#include "ThreadPlacement.hpp"
+
+//#define DEBUG
+
+
+//==============================================================================
+PipelineStage::PipelineStage()
+//==============================================================================
+{
+ pthread_mutex_init(&d_lock, NULL);
+ pthread_cond_init(&d_startCond, NULL);
+ pthread_cond_init(&d_doneCond, NULL);
+ d_function = NULL;
+ d_arg = NULL;
+ d_busy = false;
+ d_quit = false;
+ d_isInit = false;
+}
+
+
+//==============================================================================
+PipelineStage::~PipelineStage()
+//==============================================================================
+{
+ shutdown();
+ pthread_mutex_destroy(&d_lock);
+ pthread_cond_destroy(&d_startCond);
+ pthread_cond_destroy(&d_doneCond);
+}
+
+
+//==============================================================================
+int PipelineStage::initialize()
+//==============================================================================
+{
+ shutdown();
+ d_busy = false;
+ d_quit = false;
+ if( pthread_create(&d_thread, NULL, stageThread, this) != 0 ) {
+  fprintf(stderr, "[PipelineStage::initialize] ERROR starting thread.\n");
+  return -1;
+ }
+ d_isInit = true;
+ return 0;
+}
+
+
+//==============================================================================
+void PipelineStage::shutdown()
+//==============================================================================
+{
+ if(!d_isInit) return;
+ wait();
+ pthread_mutex_lock(&d_lock);
+ d_quit = true;
+ pthread_cond_signal(&d_startCond);
+ pthread_mutex_unlock(&d_lock);
+ pthread_join(d_thread, NULL);
+ d_isInit = false;
+#ifdef DEBUG
+ fprintf(stderr, "[PipelineStage::shutdown] Thread stopped.\n");
+#endif
+}
+
+
+//==============================================================================
+int PipelineStage::start(void (*function)(void *arg), void *arg)
+//==============================================================================
+{
+ if(!d_isInit) {
+  function(arg);
+  return 0;
+ }
+
+ pthread_mutex_lock(&d_lock);
+ if(d_busy) {
+  pthread_mutex_unlock(&d_lock);
+  fprintf(stderr, "[PipelineStage::start] ERROR. A job is already in flight.\n");
+  return -1;
+ }
+ d_function = function;
+ d_arg = arg;
+ d_busy = true;
+ pthread_cond_signal(&d_startCond);
+ pthread_mutex_unlock(&d_lock);
+ return 0;
+}
+
+
+//==============================================================================
+void PipelineStage::wait()
+//==============================================================================
+{
+ if(!d_isInit) return;
+ pthread_mutex_lock(&d_lock);
+ while(d_busy)
+  pthread_cond_wait(&d_doneCond, &d_lock);
+ pthread_mutex_unlock(&d_lock);
+}
+
+
+//==============================================================================
+void *PipelineStage::stageThread(void *arg)
+//==============================================================================
+{
+ PipelineStage *stage = (PipelineStage *)arg;
+ applyThreadPlacement(e_workerThread);
+
+ pthread_mutex_lock(&stage->d_lock);
+ while(true) {
+  while( !stage->d_busy && !stage->d_quit )
+   pthread_cond_wait(&stage->d_startCond, &stage->d_lock);
+  if(!stage->d_busy) break;
+
+  // run the job unlocked
+  pthread_mutex_unlock(&stage->d_lock);
+  stage->d_function(stage->d_arg);
+  pthread_mutex_lock(&stage->d_lock);
+  stage->d_busy = false;
+  pthread_cond_signal(&stage->d_doneCond);
+ }
+ pthread_mutex_unlock(&stage->d_lock);
+ return NULL;
+}
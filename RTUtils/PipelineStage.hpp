@@ -0,0 +1,82 @@
+//==============================================================================
+// PipelineStage.hpp - A helper thread that runs one job at a time alongside
+//                     the thread that hands it over.
+//==============================================================================
+
+#ifndef INCLUDED_PIPELINESTAGE_HPP
+#define INCLUDED_PIPELINESTAGE_HPP
+
+#include <pthread.h>
+#include <stdio.h>
+
+
+//==============================================================================
+// class PipelineStage
+//------------------------------------------------------------------------------
+// \brief
+// A dedicated thread for one stage of a two stage pipeline.
+//
+// The owner hands a job to the stage with start(), does its own work for
+// the current item meanwhile, and joins the job with wait() before it uses
+// the results. At most one job is in flight. Unlike a task spawned into a
+// TaskPool, the job is never run by the thread that waits for it, so the
+// two stages overlap even while all workers of a pool are busy; the job
+// should be a sizeable piece of work, such as building the image pyramid of
+// the next frame while the features of the current frame are tracked.
+//
+// The thread applies the placement configured for e_workerThread (see
+// ThreadPlacement.hpp) when it starts. No memory is allocated after
+// initialize().
+//
+// <b>Example Program:</b>
+// \include PipelineStage.t.cpp
+//==============================================================================
+class PipelineStage
+{
+ public:
+  PipelineStage();
+   // Default constructor. No thread is started until initialize() is called.
+
+  ~PipelineStage();
+   // Destructor waits for a job in flight and stops the thread.
+
+  int initialize();
+   // Start the thread.
+   //  return  0 on success, -1 on error (error message redirected to stderr).
+
+  void shutdown();
+   // Wait for a job in flight, and stop and join the thread.
+
+  inline bool isRunning() const {return d_isInit;}
+   //  return  true if the thread has been started.
+
+  int start(void (*function)(void *arg), void *arg);
+   // Hand a job to the thread. If the thread has not been started, the job
+   // is run in the calling thread before start() returns.
+   //  function  The job function.
+   //  arg       Argument passed to the function. Must remain valid until
+   //            wait() returns.
+   //  return    0 on success, -1 if a job is already in flight (error
+   //            message redirected to stderr).
+
+  void wait();
+   // Wait for the job handed over last to complete. Returns at once if no
+   // job is in flight.
+
+ protected:
+ private:
+  PipelineStage(const PipelineStage &);
+  PipelineStage &operator=(const PipelineStage &);
+  static void *stageThread(void *arg);
+  pthread_t d_thread;
+  pthread_mutex_t d_lock;
+  pthread_cond_t d_startCond;
+  pthread_cond_t d_doneCond;
+  void (*d_function)(void *arg);
+  void *d_arg;
+  bool d_busy;        // a job has been handed over and has not completed
+  bool d_quit;
+  bool d_isInit;
+};
+
+#endif // INCLUDED_PIPELINESTAGE_HPP
@@ -0,0 +1,365 @@
+//==============================================================================
+// TaskPool.cpp - A work-stealing pool of worker threads with parallel-for
+//                and fork/join primitives.
+//==============================================================================
+
+#include "TaskPool.hpp"
+#include "ThreadPlacement.hpp"
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#ifdef NTO
+#include <sys/syspage.h>
+#endif
+
+//#define DEBUG
+
+typedef struct _parallel_for
+{
+ void (*body)(int begin, int end, void *arg);
+ void *arg;
+ volatile int next;
+ int last;
+ int grain;
+}parallel_for_t;
+
+static void runParallelFor(void *arg);
+
+
+//==============================================================================
+TaskGroup::TaskGroup(TaskPool &pool)
+ : d_pool(pool)
+//==============================================================================
+{
+ d_numPending = 0;
+}
+
+
+//==============================================================================
+TaskGroup::~TaskGroup()
+//==============================================================================
+{
+ wait();
+}
+
+
+//==============================================================================
+void TaskGroup::spawn(void (*function)(void *arg), void *arg)
+//==============================================================================
+{
+ task_t t;
+ t.function = function;
+ t.arg = arg;
+ t.group = this;
+ __sync_fetch_and_add(&d_numPending, 1);
+ if( !d_pool.push(t) ) d_pool.run(t);
+}
+
+
+//==============================================================================
+void TaskGroup::wait()
+//==============================================================================
+{
+ while( __sync_fetch_and_add(&d_numPending, 0) > 0 ) {
+  if( !d_pool.runOne() ) sched_yield();
+ }
+}
+
+
+//==============================================================================
+TaskPool::TaskPool()
+//==============================================================================
+{
+ d_numThreads = 0;
+ d_numQueues = 0;
+ d_queueSize = 0;
+ d_queues = NULL;
+ d_threads = NULL;
+ d_numQueued = 0;
+ d_numSleeping = 0;
+ d_nextQueue = 0;
+ d_numStarted = 0;
+ d_quit = false;
+ d_isInit = false;
+}
+
+
+//==============================================================================
+TaskPool::~TaskPool()
+//==============================================================================
+{
+ shutdown();
+}
+
+
+//==============================================================================
+int TaskPool::initialize(int numThreads, int queueSize)
+//==============================================================================
+{
+ shutdown();
+
+ if(numThreads <= 0) {
+#ifdef NTO
+  numThreads = _syspage_ptr->num_cpu - 1;
+#else
+  numThreads = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+#endif
+ }
+ if(numThreads < 0) numThreads = 0;
+ if(queueSize < 1) {
+  fprintf(stderr, "[TaskPool::initialize] ERROR. Invalid queue size %d.\n", queueSize);
+  return -1;
+ }
+
+ pthread_key_create(&d_workerKey, NULL);
+ pthread_mutex_init(&d_sleepLock, NULL);
+ pthread_cond_init(&d_wakeCond, NULL);
+ d_numQueued = 0;
+ d_numSleeping = 0;
+ d_nextQueue = 0;
+ d_numStarted = 0;
+ d_quit = false;
+ d_isInit = true;
+
+ // allocate worker queues
+ d_queueSize = queueSize;
+ d_queues = (worker_queue_t *)malloc(numThreads * sizeof(worker_queue_t) + 1);
+ d_threads = (pthread_t *)malloc(numThreads * sizeof(pthread_t) + 1);
+ if(d_queues == NULL || d_threads == NULL) {
+  fprintf(stderr, "[TaskPool::initialize] ERROR allocating memory.\n");
+  shutdown();
+  return -1;
+ }
+ for(d_numQueues = 0; d_numQueues < numThreads; ++d_numQueues) {
+  worker_queue_t &q = d_queues[d_numQueues];
+  q.head = 0;
+  q.count = 0;
+  if( (q.tasks = (task_t *)malloc(d_queueSize * sizeof(task_t))) == NULL ) {
+   fprintf(stderr, "[TaskPool::initialize] ERROR allocating memory.\n");
+   shutdown();
+   return -1;
+  }
+  pthread_mutex_init(&q.lock, NULL);
+ }
+
+ // start workers
+ d_numThreads = numThreads;
+ for(int i = 0; i < numThreads; ++i) {
+  if( pthread_create(&d_threads[i], NULL, workerThread, this) != 0 ) {
+   fprintf(stderr, "[TaskPool::initialize] ERROR starting worker thread %d.\n", i);
+   d_numThreads = i;
+   shutdown();
+   return -1;
+  }
+ }
+
+#ifdef DEBUG
+ fprintf(stderr, "[TaskPool::initialize] Started %d workers.\n", d_numThreads);
+#endif
+ return 0;
+}
+
+
+//==============================================================================
+void TaskPool::shutdown()
+//==============================================================================
+{
+ if(!d_isInit) return;
+
+ pthread_mutex_lock(&d_sleepLock);
+ d_quit = true;
+ pthread_cond_broadcast(&d_wakeCond);
+ pthread_mutex_unlock(&d_sleepLock);
+ for(int i = 0; i < d_numThreads; ++i)
+  pthread_join(d_threads[i], NULL);
+
+ d_numThreads = 0;
+ for(int i = 0; i < d_numQueues; ++i) {
+  pthread_mutex_destroy(&d_queues[i].lock);
+  free(d_queues[i].tasks);
+ }
+ d_numQueues = 0;
+ if(d_queues) free(d_queues);
+ if(d_threads) free(d_threads);
+ d_queues = NULL;
+ d_threads = NULL;
+ pthread_key_delete(d_workerKey);
+ pthread_mutex_destroy(&d_sleepLock);
+ pthread_cond_destroy(&d_wakeCond);
+ d_isInit = false;
+}
+
+
+//==============================================================================
+int TaskPool::getWorkerIndex() const
+//==============================================================================
+{
+ if(!d_isInit) return -1;
+ return (int)(long)pthread_getspecific(d_workerKey) - 1;
+}
+
+
+//==============================================================================
+bool TaskPool::push(const task_t &t)
+//==============================================================================
+{
+ if(d_numThreads == 0) return false;
+
+ // workers queue onto their own queue, other threads spread tasks out
+ int i = getWorkerIndex();
+ if(i < 0) i = (unsigned int)__sync_fetch_and_add(&d_nextQueue, 1) % d_numThreads;
+
+ worker_queue_t &q = d_queues[i];
+ pthread_mutex_lock(&q.lock);
+ if(q.count == d_queueSize) {
+  pthread_mutex_unlock(&q.lock);
+  return false;
+ }
+ q.tasks[(q.head + q.count) % d_queueSize] = t;
+ ++q.count;
+ pthread_mutex_unlock(&q.lock);
+
+ __sync_fetch_and_add(&d_numQueued, 1);
+ if( __sync_fetch_and_add(&d_numSleeping, 0) > 0 ) {
+  pthread_mutex_lock(&d_sleepLock);
+  pthread_cond_signal(&d_wakeCond);
+  pthread_mutex_unlock(&d_sleepLock);
+ }
+ return true;
+}
+
+
+//==============================================================================
+bool TaskPool::pop(task_t &t)
+//==============================================================================
+{
+ int i = getWorkerIndex();
+ if(i < 0) return false;
+
+ bool found = false;
+ worker_queue_t &q = d_queues[i];
+ pthread_mutex_lock(&q.lock);
+ if(q.count > 0) {
+  --q.count;
+  t = q.tasks[(q.head + q.count) % d_queueSize];
+  found = true;
+ }
+ pthread_mutex_unlock(&q.lock);
+ if(found) __sync_fetch_and_sub(&d_numQueued, 1);
+ return found;
+}
+
+
+//==============================================================================
+bool TaskPool::steal(int self, task_t &t)
+//==============================================================================
+{
+ for(int k = 1; k <= d_numThreads; ++k) {
+  worker_queue_t &q = d_queues[(self + k + d_numThreads) % d_numThreads];
+  bool found = false;
+  pthread_mutex_lock(&q.lock);
+  if(q.count > 0) {
+   t = q.tasks[q.head];
+   q.head = (q.head + 1) % d_queueSize;
+   --q.count;
+   found = true;
+  }
+  pthread_mutex_unlock(&q.lock);
+  if(found) {
+   __sync_fetch_and_sub(&d_numQueued, 1);
+   return true;
+  }
+ }
+ return false;
+}
+
+
+//==============================================================================
+bool TaskPool::runOne()
+//==============================================================================
+{
+ if(d_numThreads == 0) return false;
+ task_t t;
+ if( pop(t) || steal(getWorkerIndex(), t) ) {
+  run(t);
+  return true;
+ }
+ return false;
+}
+
+
+//==============================================================================
+void TaskPool::run(const task_t &t)
+//==============================================================================
+{
+ t.function(t.arg);
+ if(t.group) __sync_fetch_and_sub(&t.group->d_numPending, 1);
+}
+
+
+//==============================================================================
+void *TaskPool::workerThread(void *arg)
+//==============================================================================
+{
+ TaskPool *pool = (TaskPool *)arg;
+ int index = __sync_fetch_and_add(&pool->d_numStarted, 1);
+ pthread_setspecific(pool->d_workerKey, (void *)(long)(index + 1));
+ applyThreadPlacement(e_workerThread);
+
+ while(!pool->d_quit) {
+  if( pool->runOne() ) continue;
+
+  // nothing to do, sleep until tasks are queued
+  pthread_mutex_lock(&pool->d_sleepLock);
+  __sync_fetch_and_add(&pool->d_numSleeping, 1);
+  while( (__sync_fetch_and_add(&pool->d_numQueued, 0) == 0) && !pool->d_quit )
+   pthread_cond_wait(&pool->d_wakeCond, &pool->d_sleepLock);
+  __sync_fetch_and_sub(&pool->d_numSleeping, 1);
+  pthread_mutex_unlock(&pool->d_sleepLock);
+ }
+ return NULL;
+}
+
+
+//==============================================================================
+int TaskPool::parallelFor(int first, int last, int grain,
+                          void (*body)(int begin, int end, void *arg), void *arg)
+//==============================================================================
+{
+ if(grain < 1 || body == NULL) {
+  fprintf(stderr, "[TaskPool::parallelFor] ERROR. Invalid params.\n");
+  return -1;
+ }
+ if(first >= last) return 0;
+
+ parallel_for_t loop;
+ loop.body = body;
+ loop.arg = arg;
+ loop.next = first;
+ loop.last = last;
+ loop.grain = grain;
+
+ // one task per worker at most; each task claims chunks until none are left
+ int nChunks = (last - first + grain - 1) / grain;
+ int nTasks = (nChunks - 1 < d_numThreads) ? nChunks - 1 : d_numThreads;
+ TaskGroup group(*this);
+ for(int i = 0; i < nTasks; ++i)
+  group.spawn(runParallelFor, &loop);
+ runParallelFor(&loop);
+ group.wait();
+ return 0;
+}
+
+
+//==============================================================================
+// runParallelFor - run chunks of a parallel loop until all are claimed
+//==============================================================================
+void runParallelFor(void *arg)
+{
+ parallel_for_t *loop = (parallel_for_t *)arg;
+ int begin;
+ while( (begin = __sync_fetch_and_add(&loop->next, loop->grain)) < loop->last ) {
+  int end = (begin + loop->grain < loop->last) ? begin + loop->grain : loop->last;
+  loop->body(begin, end, loop->arg);
+ }
+}
@@ -0,0 +1,157 @@
+//==============================================================================
+// TaskPool.hpp - A work-stealing pool of worker threads with parallel-for
+//                and fork/join primitives.
+//==============================================================================
+
+#ifndef INCLUDED_TASKPOOL_HPP
+#define INCLUDED_TASKPOOL_HPP
+
+#include <pthread.h>
+#include <stdio.h>
+
+class TaskPool;
+class TaskGroup;
+
+
+//==============================================================================
+/*! \struct _task
+    \brief A unit of work queued in a TaskPool. */
+//==============================================================================
+typedef struct _task
+{
+ void (*function)(void *arg);  //!< Function to run.
+ void *arg;                    //!< Argument passed to the function.
+ TaskGroup *group;             //!< Group notified when the task completes.
+}task_t;
+
+
+//==============================================================================
+// class TaskGroup
+//------------------------------------------------------------------------------
+// \brief
+// A set of tasks forked into a TaskPool and joined with wait().
+//
+// Tasks spawned into a group may themselves create groups and spawn more
+// tasks. While waiting, the calling thread runs queued tasks, so nested
+// fork/join does not deadlock even if all workers are waiting.
+//==============================================================================
+class TaskGroup
+{
+ public:
+  TaskGroup(TaskPool &pool);
+   // Constructor.
+   //  pool  The pool in which tasks of this group are run.
+
+  ~TaskGroup();
+   // Destructor waits for all tasks of the group to complete.
+
+  void spawn(void (*function)(void *arg), void *arg);
+   // Queue a task. If the queue of the calling thread is full, the task
+   // is run immediately in the calling thread.
+   //  function  The task function.
+   //  arg       Argument to pass to the function. Must remain valid until
+   //            the task completes.
+
+  void wait();
+   // Wait for all tasks spawned in this group to complete, running queued
+   // tasks in the calling thread meanwhile.
+
+ protected:
+ private:
+  friend class TaskPool;
+  TaskPool &d_pool;
+  volatile int d_numPending;
+};
+
+
+//==============================================================================
+// class TaskPool
+//------------------------------------------------------------------------------
+// \brief
+// A pool of worker threads shared by the data-parallel parts of a vision
+// system.
+//
+// Each worker owns a bounded task queue. A worker runs tasks from the back
+// of its own queue (most recently spawned first, which keeps data in its
+// cache), and when its queue is empty it steals from the front of the
+// queues of other workers. Tasks spawned from a thread outside the pool are
+// distributed over the worker queues. Idle workers sleep until tasks are
+// queued. Queues are allocated once in initialize(), so spawning tasks does
+// not allocate memory.
+//
+// Worker threads apply the placement configured for e_workerThread (see
+// ThreadPlacement.hpp) when they start.
+//
+// <b>Example Program:</b>
+// \include TaskPool.t.cpp
+//==============================================================================
+class TaskPool
+{
+ public:
+  TaskPool();
+   // Default constructor. No threads are started until initialize() is called.
+
+  ~TaskPool();
+   // Destructor stops the worker threads. Tasks still queued are not run.
+
+  int initialize(int numThreads = 0, int queueSize = 256);
+   // Start the worker threads.
+   //  numThreads  Number of worker threads. If 0, one less than the number
+   //              of online CPUs, because the thread that submits work also
+   //              runs tasks while it waits.
+   //  queueSize   Capacity of the task queue of each worker.
+   //  return      0 on success, -1 on error (error message redirected to stderr).
+
+  void shutdown();
+   // Stop and join the worker threads.
+
+  inline int getNumThreads() const {return d_numThreads;}
+   //  return  Number of worker threads.
+
+  int parallelFor(int first, int last, int grain,
+                  void (*body)(int begin, int end, void *arg), void *arg);
+   // Run a loop body over the range [first, last) in parallel, and wait for
+   // it to complete. The range is cut into chunks of 'grain' iterations,
+   // which are claimed dynamically by the workers and the calling thread.
+   // If the pool has no worker threads, the whole range is run in the
+   // calling thread.
+   //  first, last  The range of iterations.
+   //  grain        Number of iterations per chunk (>= 1).
+   //  body         Function called for each chunk [begin, end).
+   //  arg          Argument passed to the body.
+   //  return       0 on success, -1 on error (error message redirected to stderr).
+
+ protected:
+ private:
+  friend class TaskGroup;
+  typedef struct _worker_queue
+  {
+   pthread_mutex_t lock;
+   task_t *tasks;
+   int head;   // index of oldest task
+   int count;
+  }worker_queue_t;
+  static void *workerThread(void *arg);
+  bool push(const task_t &t);
+  bool pop(task_t &t);
+  bool steal(int self, task_t &t);
+  bool runOne();
+  void run(const task_t &t);
+  int getWorkerIndex() const;
+  int d_numThreads;
+  int d_numQueues;
+  int d_queueSize;
+  worker_queue_t *d_queues;
+  pthread_t *d_threads;
+  pthread_key_t d_workerKey;
+  pthread_mutex_t d_sleepLock;
+  pthread_cond_t d_wakeCond;
+  volatile int d_numQueued;
+  volatile int d_numSleeping;
+  volatile int d_nextQueue;
+  volatile int d_numStarted;
+  volatile bool d_quit;
+  bool d_isInit;
+};
+
+#endif // INCLUDED_TASKPOOL_HPP
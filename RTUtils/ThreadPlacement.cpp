@@ -0,0 +1,304 @@
+//==============================================================================
+// ThreadPlacement.cpp - Scheduling policy, priority and CPU placement of the
+//                       real-time threads of a vision system.
+//==============================================================================
+
+#include "ThreadPlacement.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#ifdef NTO
+#include <sys/neutrino.h>
+#endif
+
+//#define DEBUG
+
+static const char *s_roleNames[e_numThreadRoles] = {"capture", "tracking", "server", "worker"};
+static thread_placement_t s_placement[e_numThreadRoles];
+static bool s_isSet[e_numThreadRoles] = {false, false, false, false};
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int parseCpuList(const char *str, unsigned long *mask);
+static void formatCpuList(unsigned long mask, char *str, int len);
+static const char *policyName(int policy);
+
+
+//==============================================================================
+const char *getThreadRoleName(thread_role_t role)
+//==============================================================================
+{
+ if(role < 0 || role >= e_numThreadRoles) return "unknown";
+ return s_roleNames[role];
+}
+
+
+//==============================================================================
+int setThreadPlacement(thread_role_t role, const thread_placement_t &p)
+//==============================================================================
+{
+ if(role < 0 || role >= e_numThreadRoles) {
+  fprintf(stderr, "[setThreadPlacement] ERROR. Invalid thread role %d.\n", role);
+  return -1;
+ }
+ if(p.policy != SCHED_FIFO && p.policy != SCHED_RR && p.policy != SCHED_OTHER) {
+  fprintf(stderr, "[setThreadPlacement] ERROR. Invalid policy %d for %s threads.\n",
+          p.policy, s_roleNames[role]);
+  return -1;
+ }
+ pthread_mutex_lock(&s_lock);
+ s_placement[role] = p;
+ s_isSet[role] = true;
+ pthread_mutex_unlock(&s_lock);
+ return 0;
+}
+
+
+//==============================================================================
+int getThreadPlacement(thread_role_t role, thread_placement_t &p)
+//==============================================================================
+{
+ if(role < 0 || role >= e_numThreadRoles) {
+  fprintf(stderr, "[getThreadPlacement] ERROR. Invalid thread role %d.\n", role);
+  return -1;
+ }
+ pthread_mutex_lock(&s_lock);
+ p = s_placement[role];
+ int isSet = s_isSet[role] ? 1 : 0;
+ pthread_mutex_unlock(&s_lock);
+ return isSet;
+}
+
+
+//==============================================================================
+int loadThreadPlacement(const char *fileName)
+//==============================================================================
+{
+ FILE *fp = fopen(fileName, "r");
+ if(fp == NULL) {
+  fprintf(stderr, "[loadThreadPlacement] ERROR. Could not open %s.\n", fileName);
+  return -1;
+ }
+
+ char line[256], role[32], policy[32], cpus[128];
+ int lineNumber = 0, ret = 0;
+ while( fgets(line, 256, fp) ) {
+  ++lineNumber;
+  char *c = strchr(line, '#');
+  if(c) *c = '\0';
+
+  thread_placement_t p;
+  int n = sscanf(line, "%31s %31s %d %127s %d", role, policy, &p.priority, cpus, &p.isolated);
+  if(n <= 0) continue; // blank line
+  if(n != 5) {
+   fprintf(stderr, "[loadThreadPlacement] ERROR. %s:%d: expecting 5 fields.\n",
+           fileName, lineNumber);
+   ret = -1;
+   continue;
+  }
+
+  int r;
+  for(r = 0; r < e_numThreadRoles; ++r)
+   if( !strcmp(role, s_roleNames[r]) ) break;
+  if(r == e_numThreadRoles) {
+   fprintf(stderr, "[loadThreadPlacement] ERROR. %s:%d: unknown role '%s'.\n",
+           fileName, lineNumber, role);
+   ret = -1;
+   continue;
+  }
+
+  if( !strcmp(policy, "fifo") ) p.policy = SCHED_FIFO;
+  else if( !strcmp(policy, "rr") ) p.policy = SCHED_RR;
+  else if( !strcmp(policy, "other") ) p.policy = SCHED_OTHER;
+  else {
+   fprintf(stderr, "[loadThreadPlacement] ERROR. %s:%d: unknown policy '%s'.\n",
+           fileName, lineNumber, policy);
+   ret = -1;
+   continue;
+  }
+
+  if( parseCpuList(cpus, &p.cpu_mask) != 0 ) {
+   fprintf(stderr, "[loadThreadPlacement] ERROR. %s:%d: invalid CPU list '%s'.\n",
+           fileName, lineNumber, cpus);
+   ret = -1;
+   continue;
+  }
+
+  if( setThreadPlacement((thread_role_t)r, p) != 0 ) ret = -1;
+ }
+ fclose(fp);
+ return ret;
+}
+
+
+//==============================================================================
+int applyThreadPlacement(thread_role_t role, int defaultPriority)
+//==============================================================================
+{
+ thread_placement_t p;
+ int isSet = getThreadPlacement(role, p);
+ if(isSet < 0) return -1;
+ if(!isSet && defaultPriority >= 0) {
+  p.policy = SCHED_FIFO;
+  p.priority = defaultPriority;
+ }
+ int ret = 0;
+
+ // scheduling policy and priority
+ struct sched_param param;
+ int policy;
+ pthread_getschedparam(pthread_self(), &policy, &param);
+ if( isSet || defaultPriority >= 0 ) {
+  param.sched_priority = p.priority;
+  int err = pthread_setschedparam(pthread_self(), p.policy, &param);
+  if(err != 0) {
+   fprintf(stderr, "[applyThreadPlacement] ERROR setting %s priority %d for %s thread: %s\n",
+           policyName(p.policy), p.priority, s_roleNames[role], strerror(err));
+   ret = -1;
+  }
+ }
+
+ // CPU affinity
+ bool affinitySet = false;
+ if(p.cpu_mask) {
+#if defined(NTO)
+  if( ThreadCtl(_NTO_TCTL_RUNMASK, (void *)p.cpu_mask) == -1 ) {
+   fprintf(stderr, "[applyThreadPlacement] ERROR setting CPU mask for %s thread.\n",
+           s_roleNames[role]);
+   ret = -1;
+  } else {
+   affinitySet = true;
+  }
+#elif defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for(unsigned int i = 0; i < 8 * sizeof(unsigned long); ++i)
+   if(p.cpu_mask & (1UL << i)) CPU_SET(i, &set);
+  int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if(err != 0) {
+   fprintf(stderr, "[applyThreadPlacement] ERROR setting CPU affinity for %s thread: %s\n",
+           s_roleNames[role], strerror(err));
+   ret = -1;
+  } else {
+   affinitySet = true;
+  }
+#else
+  fprintf(stderr, "[applyThreadPlacement] WARNING. CPU affinity not supported on this OS.\n");
+#endif
+ }
+
+ // isolation hints; the thread is reported isolated only if it is bound to
+ // its CPUs and nothing warned below applies to them
+ char cpuList[128];
+ bool isolated = p.isolated && affinitySet;
+ if(isolated) {
+  for(int r = 0; r < e_numThreadRoles; ++r) {
+   thread_placement_t q;
+   if( (r == role) || (getThreadPlacement((thread_role_t)r, q) != 1) ) continue;
+   if( (q.cpu_mask == 0) || (q.cpu_mask & p.cpu_mask) ) {
+    formatCpuList(q.cpu_mask ? (q.cpu_mask & p.cpu_mask) : p.cpu_mask, cpuList, 128);
+    fprintf(stderr, "[applyThreadPlacement] WARNING. CPUs %s reserved for %s threads may also run %s threads.\n",
+            cpuList, s_roleNames[role], s_roleNames[r]);
+    isolated = false;
+   }
+  }
+#ifdef __linux__
+  unsigned long isolatedMask = 0;
+  FILE *fp = fopen("/sys/devices/system/cpu/isolated", "r");
+  if(fp) {
+   char buf[128];
+   if( fgets(buf, 128, fp) && (buf[0] != '\n') ) parseCpuList(buf, &isolatedMask);
+   fclose(fp);
+  }
+  if( (p.cpu_mask & isolatedMask) != p.cpu_mask ) {
+   formatCpuList(p.cpu_mask & ~isolatedMask, cpuList, 128);
+   fprintf(stderr, "[applyThreadPlacement] WARNING. CPUs %s for %s threads are not isolated by the kernel (see isolcpus).\n",
+           cpuList, s_roleNames[role]);
+   isolated = false;
+  }
+#endif
+ }
+
+ // log effective placement
+ pthread_getschedparam(pthread_self(), &policy, &param);
+ unsigned long mask = affinitySet ? p.cpu_mask : 0;
+#if defined(__linux__)
+ cpu_set_t set;
+ CPU_ZERO(&set);
+ if( pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0 ) {
+  mask = 0;
+  for(unsigned int i = 0; i < 8 * sizeof(unsigned long); ++i)
+   if( CPU_ISSET(i, &set) ) mask |= (1UL << i);
+ }
+#endif
+ if(mask)
+  formatCpuList(mask, cpuList, 128);
+ else
+  snprintf(cpuList, 128, "any");
+ fprintf(stdout, "[applyThreadPlacement]: %s thread: policy %s, priority %d, CPUs %s%s\n",
+         s_roleNames[role], policyName(policy), param.sched_priority, cpuList,
+         isolated ? " (isolated)" : "");
+ return ret;
+}
+
+
+//==============================================================================
+// parseCpuList - "0,2-3" -> 0xd, "-" -> 0
+//==============================================================================
+int parseCpuList(const char *str, unsigned long *mask)
+{
+ int maxCpu = 8 * sizeof(unsigned long) - 1;
+ *mask = 0;
+ if( !strcmp(str, "-") ) return 0;
+
+ const char *c = str;
+ while(*c && !isspace(*c)) {
+  char *end;
+  long first = strtol(c, &end, 10);
+  if(end == c || first < 0 || first > maxCpu) return -1;
+  long last = first;
+  c = end;
+  if(*c == '-') {
+   ++c;
+   last = strtol(c, &end, 10);
+   if(end == c || last < first || last > maxCpu) return -1;
+   c = end;
+  }
+  for(long i = first; i <= last; ++i) *mask |= (1UL << i);
+  if(*c == ',') ++c;
+  else if(*c && !isspace(*c)) return -1;
+ }
+ return 0;
+}
+
+
+//==============================================================================
+// formatCpuList - 0xd -> "0,2-3"
+//==============================================================================
+void formatCpuList(unsigned long mask, char *str, int len)
+{
+ int nBits = 8 * sizeof(unsigned long);
+ int n = 0;
+ str[0] = '\0';
+ for(int i = 0; i < nBits && n < len; ++i) {
+  if( !(mask & (1UL << i)) ) continue;
+  int j = i;
+  while( (j + 1 < nBits) && (mask & (1UL << (j + 1))) ) ++j;
+  if(j == i)
+   n += snprintf(str + n, len - n, "%s%d", n ? "," : "", i);
+  else
+   n += snprintf(str + n, len - n, "%s%d-%d", n ? "," : "", i, j);
+  i = j;
+ }
+}
+
+
+//==============================================================================
+// policyName
+//==============================================================================
+const char *policyName(int policy)
+{
+ if(policy == SCHED_FIFO) return "FIFO";
+ if(policy == SCHED_RR) return "RR";
+ if(policy == SCHED_OTHER) return "OTHER";
+ return "unknown";
+}
@@ -0,0 +1,94 @@
+//==============================================================================
+// ThreadPlacement.hpp - Scheduling policy, priority and CPU placement of the
+//                       real-time threads of a vision system.
+//==============================================================================
+
+#ifndef INCLUDED_THREADPLACEMENT_HPP
+#define INCLUDED_THREADPLACEMENT_HPP
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+
+//==============================================================================
+/*! \enum _thread_role
+    \brief Roles of the threads in a capture->track->serve system. */
+//==============================================================================
+typedef enum _thread_role
+{
+ e_captureThread = 0,  //!< Image capture thread (PXCCaptureLoop).
+ e_trackingThread,     //!< Thread that runs the feature tracker (usually main()).
+ e_serverThread,       //!< Feature server thread (FeatureServer).
+ e_workerThread,       //!< Worker threads of a thread pool.
+ e_numThreadRoles
+}thread_role_t;
+
+
+//==============================================================================
+/*! \struct _thread_placement
+    \brief Where and how a thread should run.
+
+    The default values in parenthesis leave scheduling of a thread unchanged. */
+//==============================================================================
+typedef struct _thread_placement
+{
+ _thread_placement() : policy(SCHED_OTHER), priority(0), cpu_mask(0), isolated(0) {};
+ int policy;              /*!< SCHED_FIFO, SCHED_RR or SCHED_OTHER (SCHED_OTHER). */
+ int priority;            /*!< Scheduling priority (0). */
+ unsigned long cpu_mask;  /*!< Bit i set allows the thread to run on CPU i. 0
+                               leaves the CPU affinity unchanged (0). */
+ int isolated;            /*!< 1 if the CPUs in 'cpu_mask' are reserved for this
+                               role. No other role should be placed on them,
+                               and the OS should be told to keep other
+                               processes off them (isolcpus on Linux) (0). */
+}thread_placement_t;
+
+
+int setThreadPlacement(thread_role_t role, const thread_placement_t &p);
+ /*!< Set the placement of threads in a role. Threads already running are
+      not affected; placement is applied by applyThreadPlacement().
+      \param role  The thread role.
+      \param p     Placement for threads in the role.
+      \return      0 on success, -1 on error (error message redirected to stderr). */
+
+int getThreadPlacement(thread_role_t role, thread_placement_t &p);
+ /*!< \param role  The thread role.
+      \param p     Set to the placement of threads in the role.
+      \return      1 if a placement was set for the role, 0 if not (p is then
+                   set to defaults), -1 on error. */
+
+int loadThreadPlacement(const char *fileName);
+ /*!< Read placement of all roles from a text file. Each line holds the
+      placement of one role as
+      \code
+      # role     policy  priority  cpus   isolated
+      capture    fifo    50        1      1
+      tracking   fifo    40        2,3    1
+      server     rr      30        0      0
+      worker     other   0         4-7    0
+      \endcode
+      Roles are 'capture', 'tracking', 'server' and 'worker'. Policies are
+      'fifo', 'rr' and 'other'. CPUs are given as a comma separated list of
+      CPU numbers and ranges, or '-' to leave affinity unchanged. Text after
+      '#' is ignored. Roles not listed in the file are left unchanged.
+      \param fileName  Name of the configuration file.
+      \return          0 on success, -1 on error (error message redirected to stderr). */
+
+int applyThreadPlacement(thread_role_t role, int defaultPriority = -1);
+ /*!< Apply the placement of a role to the calling thread, and print the
+      effective policy, priority and CPU affinity of the thread to stdout.
+      Call this at the start of a thread (for instance in Thread::enterThread()).
+      Warnings are printed if a CPU reserved for an isolated role is shared
+      with another role, or (on Linux) is not isolated by the kernel.
+      \param role             The role of the calling thread.
+      \param defaultPriority  If >= 0 and no placement was set for the role,
+                              the thread is run with SCHED_FIFO at this
+                              priority, with CPU affinity unchanged.
+      \return                 0 on success, -1 on error (error message
+                              redirected to stderr). */
+
+const char *getThreadRoleName(thread_role_t role);
+ /*!< \return  The name of the role, as used in configuration files. */
+
+#endif // INCLUDED_THREADPLACEMENT_HPP
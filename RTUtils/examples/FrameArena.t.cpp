@@ -0,0 +1,48 @@
+//==============================================================================
+// FrameArena.t.cpp : Example program for FrameArena class.
+//==============================================================================
+
+#include "FrameArena.hpp"
+#include <string.h>
+
+//==============================================================================
+// This example simulates a processing loop in which the scratch memory
+// needed per frame grows for a while. The arena starts out too small, serves
+// the overflow from the heap, and grows until no frame spills any more.
+//==============================================================================
+using namespace std;
+
+int main()
+{
+ FrameArena arena;
+ if( arena.initialize(4096) != 0 )
+  return -1;
+
+ long spills = 0;
+ for(int frame = 0; frame < 20; ++frame) {
+  int nBuffers = (frame < 10) ? frame + 1 : 10;
+  for(int i = 0; i < nBuffers; ++i) {
+   size_t size = 1000 + 100 * i;
+   char *p = (char *)arena.allocate(size, 64);
+   if(p == NULL) return -1;
+   if( (size_t)p & 63 ) {
+    fprintf(stderr, "OOPS: Buffer %d not aligned.\n", i);
+    return -1;
+   }
+   memset(p, i, size);
+  }
+  fprintf(stdout, "frame %2d: used %6lu bytes of %6lu, spills so far %ld\n", frame,
+          (unsigned long)arena.getUsed(), (unsigned long)arena.getCapacity(),
+          arena.getNumSpills());
+  if(frame == 10) spills = arena.getNumSpills();
+  arena.reset();
+ }
+
+ // steady state
+ if( arena.getNumSpills() != spills ) {
+  fprintf(stderr, "OOPS: Arena still spills in steady state.\n");
+  return -1;
+ }
+ fprintf(stdout, "High water mark %lu bytes: OK\n", (unsigned long)arena.getHighWater());
+ return 0;
+}
@@ -0,0 +1,81 @@
+//==============================================================================
+// FrameHandoff.t.cpp : Example program for FrameHandoff class.
+//==============================================================================
+
+#include "FrameHandoff.hpp"
+#include <string.h>
+#include <unistd.h>
+
+//==============================================================================
+// This example simulates a camera delivering a frame every 5 ms to a
+// consumer that needs 8 ms per frame, with each handoff policy in turn.
+// Every frame must be accounted for, and frames must arrive in order.
+//==============================================================================
+using namespace std;
+
+#define FRAME_BYTES (320 * 240)
+#define NUM_FRAMES 200
+
+static volatile bool s_done;
+
+void *capture(void *arg)
+{
+ FrameHandoff *handoff = (FrameHandoff *)arg;
+ static unsigned char frame[FRAME_BYTES];
+ for(int i = 0; i < NUM_FRAMES; ++i) {
+  memset(frame, i & 0xff, FRAME_BYTES);
+  if( handoff->put(frame, FRAME_BYTES) < 0 ) break;
+  usleep(5000);
+ }
+ s_done = true;
+ return NULL;
+}
+
+int main()
+{
+ const char *names[] = {"latest only", "bounded queue", "skip under load"};
+ handoff_policy_t policies[] = {e_latestOnly, e_boundedQueue, e_skipUnderLoad};
+
+ for(int p = 0; p < 3; ++p) {
+  FrameHandoff handoff;
+  HandoffContext_t hc;
+  hc.policy = policies[p];
+  hc.frame_bytes = FRAME_BYTES;
+  hc.queue_length = 4;
+  hc.skip_interval = 2;
+  if( handoff.initialize(hc) != 0 )
+   return -1;
+
+  s_done = false;
+  pthread_t thread;
+  if( pthread_create(&thread, NULL, capture, &handoff) != 0 )
+   return -1;
+
+  // process until capture stops and no frame is left
+  long last = -1;
+  handoff_frame_t frame;
+  int ret;
+  while( ((ret = handoff.acquire(frame, 50)) == 0) || !s_done ) {
+   if(ret != 0) continue;
+   if( (frame.number <= last) || (frame.buf[0] != (frame.number & 0xff)) ) {
+    fprintf(stderr, "OOPS: Frame %ld out of order or corrupt.\n", frame.number);
+    return -1;
+   }
+   last = frame.number;
+   usleep(8000);
+   handoff.release();
+  }
+  pthread_join(thread, NULL);
+
+  handoff_stats_t s;
+  handoff.getStats(s);
+  fprintf(stdout, "%-16s captured %3ld delivered %3ld dropped %3ld skipped %3ld, "
+          "age %5.2f ms mean %5.2f ms max\n", names[p], s.captured, s.delivered,
+          s.dropped, s.skipped, s.mean_age_ms, s.max_age_ms);
+  if( s.captured != s.delivered + s.dropped + s.skipped ) {
+   fprintf(stderr, "OOPS: Frames not accounted for.\n");
+   return -1;
+  }
+ }
+ return 0;
+}
@@ -0,0 +1,98 @@
+//==============================================================================
+// PipelineStage.t.cpp : Example program for PipelineStage class.
+//==============================================================================
+
+#include "PipelineStage.hpp"
+#include <string.h>
+#include <time.h>
+
+//==============================================================================
+// This example runs a two stage pipeline over a sequence of items: the
+// first stage fills a buffer for the next item on the helper thread while
+// the main thread reduces the buffer of the current item, with two buffers
+// taking turns. The sums must equal those of running the stages one after
+// the other.
+//==============================================================================
+using namespace std;
+
+#define ITEM_SIZE (1 << 20)
+#define NUM_ITEMS 50
+
+typedef struct _item
+{
+ int number;
+ unsigned char *data;
+}item_t;
+
+static unsigned char buffers[2][ITEM_SIZE];
+
+// first stage
+void fill(void *arg)
+{
+ item_t *item = (item_t *)arg;
+ unsigned int s = item->number * 2654435761u;
+ for(int i = 0; i < ITEM_SIZE; ++i) {
+  s = s * 1103515245u + 12345u;
+  item->data[i] = (unsigned char)(s >> 16);
+ }
+}
+
+// second stage
+long reduce(const unsigned char *data)
+{
+ long sum = 0;
+ for(int i = 0; i < ITEM_SIZE; ++i)
+  sum += (data[i] * data[i]) % 13;
+ return sum;
+}
+
+double elapsed(const struct timespec &from)
+{
+ struct timespec to;
+ clock_gettime(CLOCK_MONOTONIC, &to);
+ return (to.tv_sec - from.tv_sec) + 1e-9 * (to.tv_nsec - from.tv_nsec);
+}
+
+int main()
+{
+ static long expected[NUM_ITEMS];
+ struct timespec t0;
+
+ // in sequence
+ clock_gettime(CLOCK_MONOTONIC, &t0);
+ item_t item;
+ item.data = buffers[0];
+ for(int i = 0; i < NUM_ITEMS; ++i) {
+  item.number = i;
+  fill(&item);
+  expected[i] = reduce(item.data);
+ }
+ double sequential = elapsed(t0);
+
+ // pipelined: item i+1 is filled while item i is reduced
+ PipelineStage stage;
+ if( stage.initialize() != 0 )
+  return -1;
+ clock_gettime(CLOCK_MONOTONIC, &t0);
+ item_t items[2];
+ items[0].number = 0;
+ items[0].data = buffers[0];
+ fill(&items[0]);
+ int errors = 0;
+ for(int i = 0; i < NUM_ITEMS; ++i) {
+  item_t &next = items[(i + 1) % 2];
+  if(i + 1 < NUM_ITEMS) {
+   next.number = i + 1;
+   next.data = buffers[(i + 1) % 2];
+   if( stage.start(fill, &next) != 0 ) return -1;
+  }
+  if( reduce(items[i % 2].data) != expected[i] ) ++errors;
+  stage.wait();
+ }
+ double pipelined = elapsed(t0);
+ stage.shutdown();
+
+ fprintf(stdout, "%d items: %.1f ms in sequence, %.1f ms pipelined, %d mismatches.\n",
+         NUM_ITEMS, 1e3 * sequential, 1e3 * pipelined, errors);
+ return (errors == 0) ? 0 : -1;
+}
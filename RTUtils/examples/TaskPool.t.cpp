@@ -0,0 +1,80 @@
+//==============================================================================
+// TaskPool.t.cpp : Example program for TaskPool and TaskGroup classes.
+//==============================================================================
+
+#include "TaskPool.hpp"
+#include <stdlib.h>
+#include <math.h>
+
+//==============================================================================
+// This example uses a parallel loop to compute square roots of an array,
+// and recursive fork/join to compute a Fibonacci number. Results are
+// compared against serial computation.
+//==============================================================================
+using namespace std;
+
+#define N 1000000
+
+static double s_in[N], s_out[N];
+
+void sqrtBody(int begin, int end, void *arg)
+{
+ arg = arg;
+ for(int i = begin; i < end; ++i)
+  s_out[i] = sqrt(s_in[i]);
+}
+
+typedef struct _fib
+{
+ TaskPool *pool;
+ int n;
+ long result;
+}fib_t;
+
+void fibTask(void *arg)
+{
+ fib_t *f = (fib_t *)arg;
+ if(f->n < 20) { // too small to be worth a task
+  long a = 0, b = 1;
+  for(int i = 0; i < f->n; ++i) { long c = a + b; a = b; b = c; }
+  f->result = a;
+  return;
+ }
+ fib_t f1 = {f->pool, f->n - 1, 0};
+ fib_t f2 = {f->pool, f->n - 2, 0};
+ TaskGroup group(*f->pool);
+ group.spawn(fibTask, &f1);
+ fibTask(&f2);
+ group.wait();
+ f->result = f1.result + f2.result;
+}
+
+int main()
+{
+ TaskPool pool;
+
+ // one worker thread less than the number of CPUs
+ if( pool.initialize() != 0 )
+  return -1;
+ fprintf(stdout, "Started %d worker threads\n", pool.getNumThreads());
+
+ // parallel loop
+ for(int i = 0; i < N; ++i) s_in[i] = i;
+ if( pool.parallelFor(0, N, 4096, sqrtBody, NULL) != 0 )
+  return -1;
+ for(int i = 0; i < N; ++i) {
+  if(s_out[i] != sqrt(s_in[i])) {
+   fprintf(stderr, "OOPS: parallelFor result wrong at %d\n", i);
+   return -1;
+  }
+ }
+ fprintf(stdout, "parallelFor: OK\n");
+
+ // fork/join
+ fib_t f = {&pool, 40, 0};
+ fibTask(&f);
+ fprintf(stdout, "fib(%d) = %ld (%s)\n", f.n, f.result, (f.result == 102334155) ? "OK" : "WRONG");
+
+ pool.shutdown();
+ return (f.result == 102334155) ? 0 : -1;
+}
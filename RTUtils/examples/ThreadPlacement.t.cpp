@@ -0,0 +1,42 @@
+//==============================================================================
+// ThreadPlacement.t.cpp : Example program for thread placement functions.
+//==============================================================================
+
+#include "ThreadPlacement.hpp"
+
+//==============================================================================
+// This example reads thread placement from a configuration file, places
+// the main thread as the tracking thread and starts a capture thread and
+// a server thread. Each thread prints its effective placement. Real-time
+// policies usually require root privileges.
+//==============================================================================
+using namespace std;
+
+void *threadFunction(void *arg)
+{
+ applyThreadPlacement(*(thread_role_t *)arg);
+ return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+ const char *fileName = (argc > 1) ? argv[1] : "threadPlacement.cfg";
+ if( loadThreadPlacement(fileName) != 0 )
+  return -1;
+
+ // placement can also be set directly
+ thread_placement_t p;
+ getThreadPlacement(e_serverThread, p);
+ p.priority = 25;
+ setThreadPlacement(e_serverThread, p);
+
+ applyThreadPlacement(e_trackingThread);
+
+ pthread_t thread[2];
+ thread_role_t role[2] = {e_captureThread, e_serverThread};
+ for(int i = 0; i < 2; ++i) {
+  pthread_create(&thread[i], NULL, threadFunction, &role[i]);
+  pthread_join(thread[i], NULL);
+ }
+ return 0;
+}